@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <chrono>
+#include "../src/data_parser.h"
+#include "../src/dataset.h"
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include <Eigen/Dense>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Throughput and accuracy of a small convolutional network (conv 5x5 with 8 channels, relu, 2x2 max-pool, linear,
+ * softmax) compared with the dense network of main.cpp (784 -> 392 -> 196 -> 10), both trained with the same SDG
+ * settings as main.cpp. Usage (from the project root):
+ *     BenchmarkConv [epochs] [training samples]
+ * Uses ./tests/MNIST_train.csv and ./tests/MNIST_test.csv if they exist, otherwise synthetic MNIST-shaped images:
+ * one prototype of random strokes per class which is shifted by up to four pixels per sample (plus noise), i.e. data
+ * where the translation invariance of the convolution matters.
+ */
+
+// synthetic images (28x28, values in [0, 1]) with a fixed seed
+void synthetic_images(int samples, unsigned seed, Eigen::MatrixXd& X, Eigen::RowVectorXi& classes) {
+    std::mt19937 prototypeRng(7);
+    std::uniform_int_distribution<int> coordinate(4, 23);
+    std::vector<Eigen::MatrixXd> prototypes(10, Eigen::MatrixXd::Zero(28, 28));
+    for (Eigen::MatrixXd& prototype: prototypes) {
+        // three strokes between random points
+        for (int stroke=0; stroke<3; stroke++) {
+            int y0 = coordinate(prototypeRng), x0 = coordinate(prototypeRng);
+            int y1 = coordinate(prototypeRng), x1 = coordinate(prototypeRng);
+            for (int t=0; t<=20; t++) {
+                prototype(y0 + (y1 - y0)*t/20, x0 + (x1 - x0)*t/20) = 1.0;
+            }
+        }
+    }
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> shift(-4, 4);
+    std::normal_distribution<double> noise(0.0, 0.3);
+    X.resize(784, samples);
+    classes.resize(samples);
+    for (int j=0; j<samples; j++) {
+        classes(j) = rng() % 10;
+        int dy = shift(rng), dx = shift(rng);
+        for (int y=0; y<28; y++) {
+            for (int x=0; x<28; x++) {
+                int py = std::min(27, std::max(0, y - dy)), px = std::min(27, std::max(0, x - dx));
+                X(y*28 + x, j) = std::min(1.0, std::max(0.0, prototypes[classes(j)](py, px) + noise(rng)));
+            }
+        }
+    }
+}
+
+SequentialNN conv_network() {
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<ConvLayer>(1, 28, 28, 8, 5),
+                                                std::make_shared<ActivationLayer>(8*24*24, "relu"),
+                                                std::make_shared<MaxPoolLayer>(8, 24, 24, 2),
+                                                std::make_shared<LinearLayer>(10, 8*12*12),
+                                                std::make_shared<ActivationLayer>(10, "softmax")};
+    SequentialNN snn(layers);
+    // the last layer is not initialized (see SequentialNN::Initialize)
+    std::static_pointer_cast<LinearTransformation>(snn.GetLayer(3).GetTransformation())->Initialize("Xavier");
+    return snn;
+}
+
+long parameters(SequentialNN& snn) {
+    long count = 0;
+    for (int i=0; i<snn.Length(); i++) {
+        for (int j=0; j<snn.GetLayer(i).NumParameters(); j++) {
+            count += snn.GetLayer(i).Parameter(j, 0).size;
+        }
+    }
+    return count;
+}
+
+void run(const std::string& name, SequentialNN snn, int epochs, const Eigen::MatrixXd& X, const Eigen::RowVectorXi& y,
+         const Eigen::MatrixXd& XTest, const Eigen::RowVectorXi& yTest) {
+    SDG sdg("cross_entropy", 50, 0.003);
+    sdg.SetSeed(1);
+    auto start = std::chrono::steady_clock::now();
+    sdg.Train(snn, X, y, epochs);
+    double trainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    double accuracy = snn.Accuracy(XTest, yTest, 100);
+    double testSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::left << std::setw(7) << name << std::right << std::setw(10) << parameters(snn)
+              << std::setw(14) << std::fixed << std::setprecision(0) << epochs*X.cols()/trainSeconds
+              << std::setw(14) << XTest.cols()/testSeconds << std::setw(11) << std::setprecision(4) << accuracy << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int epochs = (argc > 1) ? std::stoi(argv[1]) : 1;
+    int samples = (argc > 2) ? std::stoi(argv[2]) : 6000;
+    Eigen::MatrixXd X, XTest;
+    Eigen::RowVectorXi y, yTest;
+    std::string data;
+    if (std::filesystem::exists("./tests/MNIST_train.csv") && std::filesystem::exists("./tests/MNIST_test.csv")) {
+        DataParser dp;
+        Dataset train = dp.LoadDataset("./tests/MNIST_train.csv");
+        Dataset test = dp.LoadDataset("./tests/MNIST_test.csv");
+        samples = std::min<long>(samples, train.Samples().cols());
+        X = train.Samples().leftCols(samples);
+        y = dp.ClassIndices(train.Labels(), 9).head(samples);
+        XTest = test.Samples();
+        yTest = dp.ClassIndices(test.Labels(), 9);
+        data = "MNIST";
+    } else {
+        synthetic_images(samples, 1, X, y);
+        synthetic_images(samples/6, 2, XTest, yTest);
+        data = "synthetic images";
+    }
+
+    std::cout << "Dense vs. convolutional network on " << data << " (" << X.cols() << " training, " << XTest.cols()
+              << " test samples, " << epochs << " epoch(s)):\n"
+              << "model  parameters  train [1/s]  infer [1/s]  accuracy" << std::endl;
+    run("dense", SequentialNN({LinearLayer(392, 784), ActivationLayer(392, "relu"), LinearLayer(196, 392),
+                               ActivationLayer(196, "relu"), LinearLayer(10, 196), ActivationLayer(10, "softmax")}),
+        epochs, X, y, XTest, yTest);
+    run("conv", conv_network(), epochs, X, y, XTest, yTest);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "../src/data_parser.h"
+#include "../src/thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <Eigen/Dense>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+/**
+ * Compares the throughput (MB/s) of DataParser::LoadCSV (line by line, followed by the transposition of main.cpp)
+ * with the parallel loader DataParser::LoadSamplesLabels. Usage:
+ *     BenchmarkCSVLoader [path]
+ * where path is a csv-file with the label in the first column (e.g. ./tests/MNIST_train.csv). Without a path, a
+ * file with MNIST-like content (label and 784 pixels per line) is generated in the current directory and removed
+ * afterwards. Finally, the startup time with the binary sidecar (DataParser::LoadDataset) is measured for the first
+ * run (parse and write the sidecar) and for a repeated run (memory-map the sidecar).
+ */
+
+const int kGeneratedLines = 20000;
+
+void generate_csv(const std::string& path) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> label(0, 9);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    std::bernoulli_distribution background(0.8);
+    std::ofstream out(path);
+    for (int i=0; i<kGeneratedLines; i++) {
+        out << label(rng);
+        for (int j=0; j<784; j++) {
+            out << "," << (background(rng) ? 0 : pixel(rng));
+        }
+        out << "\n";
+    }
+}
+
+long file_size(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return in.tellg();
+}
+
+template<typename F>
+double time_s(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    bool generated = (argc < 2);
+    std::string path = generated ? "./benchmark_csv_loader.csv" : argv[1];
+    if (generated) {
+        generate_csv(path);
+    }
+    double megabytes = file_size(path)/1e6;
+    DataParser dp;
+
+    // current loader (as in main.cpp before: load row-major and transpose)
+    Eigen::MatrixXd samples_getline;
+    Eigen::RowVectorXd labels_getline;
+    double getline_s = time_s([&]() {
+        Eigen::MatrixXd X = dp.LoadCSV<Eigen::MatrixXd>(path);
+        samples_getline = X.rightCols(X.cols()-1).transpose();
+        labels_getline = X.col(0).transpose();
+    });
+
+    // parallel loader (best of three, the first run also pays for reading the file from disk)
+    Eigen::MatrixXd samples;
+    Eigen::RowVectorXd labels;
+    double parallel_s = 1e30;
+    for (int run=0; run<3; run++) {
+        parallel_s = std::min(parallel_s, time_s([&]() { dp.LoadSamplesLabels(path, samples, labels); }));
+    }
+
+    std::cout << "File: " << path << " (" << megabytes << " MB, " << samples.cols() << " samples)" << std::endl;
+    std::cout << "  getline/stod:           " << getline_s << " s, " << megabytes/getline_s << " MB/s" << std::endl;
+    std::cout << "  mmap/from_chars (" << ThreadPool::Global().NumThreads() << " threads): " << parallel_s << " s, "
+              << megabytes/parallel_s << " MB/s" << std::endl;
+    std::cout << "  speedup: " << getline_s/parallel_s << std::endl;
+    bool equal = (samples == samples_getline) && (labels == labels_getline);
+    std::cout << "  results coincide: " << equal << std::endl;
+
+    // binary sidecar
+    std::string sidecar = DataParser::SidecarPath(path);
+    bool existed = std::ifstream(sidecar).good();
+    if (!existed) {
+        double first_s = time_s([&]() { dp.LoadDataset(path); });
+        std::cout << "  LoadDataset (parse and write sidecar): " << first_s << " s" << std::endl;
+    }
+    double mapped_sum = 0;
+    double repeated_s = time_s([&]() {
+        Dataset dataset = dp.LoadDataset(path);
+        // NOTE: includes touching every page of the mapped samples
+        mapped_sum = dataset.Samples().sum();
+    });
+    std::cout << "  LoadDataset (mapped sidecar, incl. reading all samples): " << repeated_s << " s" << std::endl;
+    equal = equal && (mapped_sum == samples.sum());
+
+    if (generated) {
+        std::remove(path.c_str());
+    }
+    if (!existed) {
+        std::remove(sidecar.c_str());
+    }
+    return equal ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include "../src/data_parser.h"
+#include "../src/layer.h"
+#include "../src/loss_function.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include <algorithm>
+#include <chrono>
+#include <Eigen/Dense>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Compares the time-to-accuracy of the optimizers on tests/train.csv (first column are the labels).
+ * Each optimizer starts from the same initial weights and trains until all samples are classified correctly
+ * and the cross entropy (per sample) is below a threshold. Run from the project root directory.
+ */
+
+const double kTargetLoss = 0.05;
+const int kMaxSteps = 200000;
+const int kTrials = 5;
+
+struct Result {
+    int steps;
+    double ms;
+};
+
+// network used for the benchmark with the given initial weights
+SequentialNN create_network(const std::vector<Eigen::MatrixXd>& weights, int inputSize, int classes) {
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<LinearLayer>(8, inputSize),
+                                                std::make_shared<ActivationLayer>(8, "relu"),
+                                                std::make_shared<LinearLayer>(classes, 8),
+                                                std::make_shared<ActivationLayer>(classes, "softmax")};
+    SequentialNN snn(layers);
+    std::static_pointer_cast<LinearTransformation>(snn.GetLayer(0).GetTransformation())->SetWeights(weights[0]);
+    std::static_pointer_cast<LinearTransformation>(snn.GetLayer(2).GetTransformation())->SetWeights(weights[1]);
+    return snn;
+}
+
+bool all_correct(const Eigen::MatrixXd& output, const Eigen::MatrixXd& Y) {
+    Eigen::Index predicted, label;
+    for (int j=0; j<output.cols(); j++) {
+        output.col(j).maxCoeff(&predicted);
+        Y.col(j).maxCoeff(&label);
+        if (predicted != label) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Result time_to_accuracy(Optimizer& optimizer, SequentialNN& snn, const Eigen::MatrixXd& X, const Eigen::MatrixXd& Y) {
+    auto start = std::chrono::steady_clock::now();
+    int step = 0;
+    for (; step < kMaxSteps; step++) {
+        double loss = optimizer.Step(snn, X, Y);
+        // NOTE: loss and output are the ones of the forward pass of this step (before the update)
+        if (all_correct(snn.Output(), Y) && (loss/X.cols() < kTargetLoss)) {
+            break;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return {step, std::chrono::duration<double, std::milli>(end - start).count()};
+}
+
+int main() {
+    DataParser dp;
+    Eigen::MatrixXd data = dp.LoadCSV<Eigen::MatrixXd>("./tests/train.csv");
+    // samples as columns, labels one-hot-encoded
+    Eigen::MatrixXd X = data.rightCols(data.cols()-1).transpose();
+    Eigen::RowVectorXd labels = data.col(0).transpose();
+    int classes = (int)labels.maxCoeff() + 1;
+    Eigen::MatrixXd Y = dp.OneHotEncoder(labels, classes-1);
+    int batchSize = X.cols();
+
+    std::vector<std::string> names{"SDG", "Momentum", "RMSProp", "Adam", "AdamW"};
+    std::vector<std::vector<Result> > results(names.size());
+
+    for (int trial=0; trial<kTrials; trial++) {
+        // same (random) initial weights for all optimizers
+        Eigen::MatrixXd W0 = Eigen::MatrixXd::Random(8, X.rows())*std::sqrt(2.0/X.rows());
+        Eigen::MatrixXd W1 = Eigen::MatrixXd::Random(classes, 8)*std::sqrt(6.0/(8+classes));
+
+        for (int k=0; k<(int)names.size(); k++) {
+            std::unique_ptr<Optimizer> optimizer;
+            if (names[k] == "SDG") optimizer = std::make_unique<SDG>("cross_entropy", batchSize, 0.01);
+            else if (names[k] == "Momentum") optimizer = std::make_unique<Momentum>("cross_entropy", batchSize, 0.01);
+            else if (names[k] == "RMSProp") optimizer = std::make_unique<RMSProp>("cross_entropy", batchSize, 0.01);
+            else if (names[k] == "Adam") optimizer = std::make_unique<Adam>("cross_entropy", batchSize, 0.01);
+            else optimizer = std::make_unique<AdamW>("cross_entropy", batchSize, 0.01);
+
+            SequentialNN snn = create_network({W0, W1}, X.rows(), classes);
+            results[k].push_back(time_to_accuracy(*optimizer, snn, X, Y));
+        }
+    }
+
+    std::cout << "Time to accuracy on tests/train.csv (" << X.cols() << " samples, target: all correct and loss < "
+              << kTargetLoss << ", median of " << kTrials << " trials)" << std::endl;
+    for (int k=0; k<(int)names.size(); k++) {
+        // median of steps and time (separately)
+        std::vector<Result>& r = results[k];
+        Result median;
+        std::sort(r.begin(), r.end(), [](const Result& a, const Result& b) { return a.steps < b.steps; });
+        median.steps = r[r.size()/2].steps;
+        std::sort(r.begin(), r.end(), [](const Result& a, const Result& b) { return a.ms < b.ms; });
+        median.ms = r[r.size()/2].ms;
+        std::cout << "  " << names[k] << ": " << median.steps << " steps, " << median.ms << " ms"
+                  << (median.steps >= kMaxSteps ? " (target not reached)" : "") << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "../src/layer.h"
+#include <chrono>
+#include <Eigen/Dense>
+#include <iostream>
+#include <vector>
+
+/**
+ * Measures memory and backward pass time of relu layers with and without the bit mask used in training mode.
+ * The shapes are the ones of the relu layers in main.cpp (392 and 196 features with batches of 50 samples)
+ * and a larger batch size for comparison.
+ */
+
+// average time in microseconds of a function called repetitions times
+template<typename F>
+double time_us(F f, int repetitions) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r=0; r<repetitions; r++) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count()/repetitions;
+}
+
+void benchmark_relu(int features, int batchSize, int repetitions) {
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(features, batchSize);
+    Eigen::MatrixXd G = Eigen::MatrixXd::Random(batchSize, features);
+
+    // relu layer without mask (backward pass with the forward input)
+    ActivationLayer dense(features, "relu");
+    dense.Input(X);
+    dense.Forward();
+    dense.BackwardInput(G);
+    double dense_us = time_us([&]() { dense.Backward(); }, repetitions);
+
+    // elementwise backward pass with the full (double) forward input as reference
+    Eigen::MatrixXd reference(batchSize, features);
+    double reference_us = time_us([&]() {
+        reference = G.array()*(X.transpose().array() > 0.0).cast<double>();
+    }, repetitions);
+
+    // relu layer with mask
+    ActivationLayer masked(features, "relu");
+    masked.SetTraining(true);
+    masked.Input(X);
+    masked.Forward();
+    masked.BackwardInput(G);
+    double masked_us = time_us([&]() { masked.Backward(); }, repetitions);
+
+    if (!masked.BackwardOutput().isApprox(reference)) {
+        std::cout << "WARNING: masked backward output differs from reference" << std::endl;
+    }
+
+    // memory which has to be kept from the forward to the backward pass
+    size_t elements = (size_t)features*batchSize;
+    size_t preactivation_bytes = elements*sizeof(double);
+    size_t mask_bytes = masked.GetLayerCache().GetForwardMask().Bytes();
+    // bytes read/written by the backward pass: forward input/mask + backward input + backward output
+    size_t dense_traffic = 3*elements*sizeof(double);
+    size_t masked_traffic = mask_bytes + 2*elements*sizeof(double);
+
+    std::cout << "relu " << features << " x " << batchSize << ":\n"
+              << "  kept for backward pass: " << preactivation_bytes << " B (pre-activation) vs. "
+              << mask_bytes << " B (mask), saving " << preactivation_bytes - mask_bytes << " B per layer\n"
+              << "  backward traffic:       " << dense_traffic << " B vs. " << masked_traffic << " B ("
+              << 100.0*(dense_traffic - masked_traffic)/dense_traffic << "% less)\n"
+              << "  backward time:          " << dense_us << " us (Layer::Backward with derivative), "
+              << reference_us << " us (elementwise with pre-activation), "
+              << masked_us << " us (mask)" << std::endl;
+}
+
+int main() {
+    std::vector<int> features{392, 196};
+    std::vector<int> batchSizes{50, 1024};
+
+    for (int batchSize: batchSizes) {
+        for (int f: features) {
+            // the derivative path is quadratic in the number of features, so use fewer repetitions for large batches
+            benchmark_relu(f, batchSize, batchSize > 100 ? 5 : 50);
+        }
+    }
+
+    return 0;
+}
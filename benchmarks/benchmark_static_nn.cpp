@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <chrono>
+#include <Eigen/Dense>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include "../src/layer.h"
+#include "../src/sequential_nn.h"
+#include "../src/static_sequential_nn.h"
+#include <string>
+#include <vector>
+
+/**
+ * Latency of a single-sample forward pass of a tiny network (16 -> 32 -> 8 with relu and softmax) as
+ * StaticSequentialNN, as SequentialNN (layer by layer) and as compiled SequentialNN (see ExecutionPlan).
+ * Reports the best of several runs in nanoseconds per sample.
+ */
+
+using TinyNN = StaticSequentialNN<StaticLinear<32, 16>, StaticRelu<32>, StaticLinear<8, 32>, StaticSoftmax<8> >;
+
+// best time in nanoseconds per call of f over several runs of the given number of repetitions
+template<typename F>
+double best_ns(F f, int repetitions, int runs=7) {
+    double best = 1e300;
+    for (int run=0; run<runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int r=0; r<repetitions; r++) {
+            f(r);
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count()/repetitions);
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int repetitions = (argc > 1) ? std::stoi(argv[1]) : 200000;
+    // a few different inputs (so that the compiler cannot hoist the passes)
+    const int kInputs = 64;
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(16, kInputs);
+    std::vector<TinyNN::InputVector> inputs(kInputs);
+    for (int j=0; j<kInputs; j++) {
+        inputs[j] = X.col(j);
+    }
+
+    // same weights in all three networks (the replica shares them)
+    SequentialNN snn({LinearLayer(32, 16), ActivationLayer(32, "relu"), LinearLayer(8, 32),
+                      ActivationLayer(8, "softmax")});
+    SequentialNN compiled = snn.Replicate();
+    compiled.Compile(1, ExecutionPlan::Mode::kInference);
+    TinyNN tiny;
+    tiny.Load(snn);
+
+    double checksum[3] = {0, 0, 0};
+    double staticNs = best_ns([&](int r) {
+        tiny.Forward(inputs[r % kInputs]);
+        checksum[0] += tiny.Output()(0);
+    }, repetitions);
+    double dynamicNs = best_ns([&](int r) {
+        snn.Input(X.col(r % kInputs));
+        snn.Forward();
+        checksum[1] += snn.Output()(0, 0);
+    }, repetitions);
+    double compiledNs = best_ns([&](int r) {
+        compiled.Input(X.col(r % kInputs));
+        compiled.Forward();
+        checksum[2] += compiled.Output()(0, 0);
+    }, repetitions);
+
+    std::cout << "Forward pass of a 16-32-8 network (single sample, best of 7 runs of " << repetitions << "):\n"
+              << std::fixed << std::setprecision(1)
+              << "  StaticSequentialNN:        " << std::setw(8) << staticNs << " ns\n"
+              << "  SequentialNN:              " << std::setw(8) << dynamicNs << " ns\n"
+              << "  SequentialNN (compiled):   " << std::setw(8) << compiledNs << " ns\n"
+              << "  speedup static vs. dynamic: " << std::setprecision(2) << dynamicNs/staticNs << "x, vs. compiled: "
+              << compiledNs/staticNs << "x" << std::endl;
+    if ((std::abs(checksum[0] - checksum[1]) > 1e-6*std::abs(checksum[1]))
+        || (std::abs(checksum[2] - checksum[1]) > 1e-6*std::abs(checksum[1]))) {
+        std::cout << "WARNING: outputs of the networks differ" << std::endl;
+    }
+    return 0;
+}
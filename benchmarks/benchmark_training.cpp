@@ -0,0 +1,242 @@
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/profiler.h"
+#include "../src/sequential_nn.h"
+#include "../src/thread_pool.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <Eigen/Dense>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+/**
+ * End-to-end training throughput of the network of main.cpp (784 -> 392 -> 196 -> 10, relu/softmax) trained with SDG
+ * (cross entropy, class indices) on a synthetic MNIST-shaped data set with a fixed seed. Usage (from the project root):
+ *     BenchmarkTraining [--samples N] [--epochs E] [--batch B] [--out path] [--baseline path] [--threshold t]
+ *                       [--threads T] [--write-baseline path]
+ * Reports samples/s, the time per step split into data (waiting for the BatchLoader), forward, backward and update
+ * (measured in a second, profiled run, see Profiler) and the peak resident set size. The results are written as JSON
+ * (--out) and compared with the baseline (default: benchmarks/baseline_training.json): the exit code is 1 if the
+ * throughput is more than the threshold (default: 0.2, i.e. 20%) below the baseline, 2 for invalid arguments, a
+ * missing baseline or a baseline which was recorded with a different configuration (samples, epochs, batch size,
+ * threads). --threads sets the number of threads of the global ThreadPool (default: one per hardware thread), e.g.
+ * to match the baseline.
+ *
+ * NOTE: the baseline is only meaningful for the machine (and build type) it was recorded on. After a deliberate
+ * change of the performance or on a new machine, record a new one with --write-baseline.
+ */
+
+struct Options {
+    int samples = 6000;
+    int epochs = 1;
+    int batchSize = 50;
+    std::string out = "";
+    std::string baseline = "benchmarks/baseline_training.json";
+    std::string writeBaseline = "";
+    double threshold = 0.2;
+    // number of threads of the global ThreadPool (0: default)
+    int threads = 0;
+};
+
+struct Results {
+    double samplesPerSecond;
+    long steps;
+    // per step
+    double dataMs;
+    double forwardMs;
+    double backwardMs;
+    double updateMs;
+    double stepMs;
+    double peakRssMb;
+};
+
+// synthetic MNIST: one random prototype per class in [0, 1] plus noise (fixed seed)
+void synthetic_mnist(int samples, Eigen::MatrixXd& X, Eigen::RowVectorXi& classes) {
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.2);
+    Eigen::MatrixXd prototypes(784, 10);
+    for (long i=0; i<prototypes.size(); i++) {
+        prototypes(i) = (uniform(rng) < 0.2) ? uniform(rng) : 0.0;
+    }
+    X.resize(784, samples);
+    classes.resize(samples);
+    for (int j=0; j<samples; j++) {
+        classes(j) = rng() % 10;
+        for (int i=0; i<784; i++) {
+            X(i, j) = std::min(1.0, std::max(0.0, prototypes(i, classes(j)) + noise(rng)));
+        }
+    }
+}
+
+double peak_rss_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on Linux
+    return usage.ru_maxrss/1024.0;
+}
+
+Results run(const Options& options) {
+    Eigen::MatrixXd X;
+    Eigen::RowVectorXi classes;
+    synthetic_mnist(options.samples, X, classes);
+    SequentialNN snn({LinearLayer(392, 784), ActivationLayer(392, "relu"), LinearLayer(196, 392),
+                      ActivationLayer(196, "relu"), LinearLayer(10, 196), ActivationLayer(10, "softmax")});
+    SDG sdg("cross_entropy", options.batchSize, 0.003);
+    sdg.SetSeed(7);
+
+    // warm-up (caches, buffers of the layers)
+    for (int s=0; s<5; s++) {
+        sdg.Step(snn, X.leftCols(options.batchSize), classes.head(options.batchSize));
+    }
+
+    // throughput without profiling
+    auto start = std::chrono::steady_clock::now();
+    sdg.Train(snn, X, classes, options.epochs);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long steps = options.epochs*((options.samples + options.batchSize - 1)/options.batchSize);
+    double dataSeconds = sdg.DataWaitSeconds();
+
+    // breakdown of the steps with the profiler
+    sdg.SetProfiling(true);
+    sdg.Train(snn, X, classes, options.epochs);
+    double phases[Profiler::kPhases] = {0, 0, 0};
+    for (const Profiler::LayerStats& layer: sdg.Profile()->Report()) {
+        for (int p=0; p<Profiler::kPhases; p++) {
+            phases[p] += layer.phases[p].totalSeconds;
+        }
+    }
+
+    Results results;
+    results.samplesPerSecond = (double)options.epochs*options.samples/seconds;
+    results.steps = steps;
+    results.stepMs = seconds*1e3/steps;
+    results.dataMs = dataSeconds*1e3/steps;
+    results.forwardMs = phases[(int)Profiler::Phase::kForward]*1e3/steps;
+    results.backwardMs = phases[(int)Profiler::Phase::kBackward]*1e3/steps;
+    results.updateMs = phases[(int)Profiler::Phase::kUpdate]*1e3/steps;
+    results.peakRssMb = peak_rss_mb();
+    return results;
+}
+
+std::string to_json(const Options& options, const Results& r) {
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\n  \"benchmark\": \"training_mnist_784_392_196_10_sdg\",\n"
+         << "  \"samples\": " << options.samples << ",\n  \"epochs\": " << options.epochs
+         << ",\n  \"batch_size\": " << options.batchSize << ",\n  \"threads\": " << ThreadPool::Global().NumThreads()
+         << ",\n  \"steps\": " << r.steps << ",\n  \"samples_per_second\": " << r.samplesPerSecond
+         << ",\n  \"step_ms\": " << r.stepMs << ",\n  \"data_ms\": " << r.dataMs << ",\n  \"forward_ms\": " << r.forwardMs
+         << ",\n  \"backward_ms\": " << r.backwardMs << ",\n  \"update_ms\": " << r.updateMs
+         << ",\n  \"peak_rss_mb\": " << r.peakRssMb << "\n}\n";
+    return json.str();
+}
+
+// value of a number in a flat JSON object (NaN if not found)
+double json_number(const std::string& json, const std::string& key) {
+    size_t position = json.find("\"" + key + "\"");
+    if (position == std::string::npos) {
+        return std::nan("");
+    }
+    position = json.find(':', position);
+    return (position == std::string::npos) ? std::nan("") : std::strtod(json.c_str() + position + 1, nullptr);
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i=1; i<argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--samples") options.samples = std::atoi(value.c_str());
+        else if (arg == "--epochs") options.epochs = std::atoi(value.c_str());
+        else if (arg == "--batch") options.batchSize = std::atoi(value.c_str());
+        else if (arg == "--out") options.out = value;
+        else if (arg == "--baseline") options.baseline = value;
+        else if (arg == "--write-baseline") options.writeBaseline = value;
+        else if (arg == "--threshold") options.threshold = std::atof(value.c_str());
+        else if (arg == "--threads") options.threads = std::atoi(value.c_str());
+        else return false;
+    }
+    return (options.samples >= options.batchSize) && (options.batchSize > 0) && (options.epochs > 0)
+           && (options.threshold >= 0) && (options.threads >= 0);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--samples N] [--epochs E] [--batch B] [--out path] [--baseline path]"
+                  << " [--threshold t] [--threads T] [--write-baseline path]" << std::endl;
+        return 2;
+    }
+    if (options.threads > 0) {
+        ThreadPool::SetGlobalThreads(options.threads);
+    }
+    Results results = run(options);
+    std::string json = to_json(options, results);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Training " << options.samples << " samples x " << options.epochs << " epochs, batch size "
+              << options.batchSize << ", " << ThreadPool::Global().NumThreads() << " threads" << std::endl;
+    std::cout << "  throughput: " << results.samplesPerSecond << " samples/s (" << results.stepMs << " ms per step)" << std::endl;
+    std::cout << "  per step:   data " << results.dataMs << " ms, forward " << results.forwardMs << " ms, backward "
+              << results.backwardMs << " ms, update " << results.updateMs << " ms" << std::endl;
+    std::cout << "  peak RSS:   " << results.peakRssMb << " MB" << std::endl;
+
+    if (!options.out.empty()) {
+        std::ofstream(options.out) << json;
+    }
+    if (!options.writeBaseline.empty()) {
+        std::ofstream(options.writeBaseline) << json;
+        std::cout << "Baseline written to " << options.writeBaseline << std::endl;
+        return 0;
+    }
+
+    std::ifstream in(options.baseline);
+    if (!in) {
+        std::cerr << "Baseline " << options.baseline << " not found (record one with --write-baseline)." << std::endl;
+        return 2;
+    }
+    std::string baseline((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    // throughputs of different configurations are not comparable
+    bool mismatch = false;
+    for (const char* key: {"samples", "epochs", "batch_size", "threads"}) {
+        double recorded = json_number(baseline, key);
+        double current = json_number(json, key);
+        if (recorded != current) {
+            std::cerr << "Baseline " << options.baseline << " was recorded with " << key << " " << recorded
+                      << ", this run uses " << current << "." << std::endl;
+            mismatch = true;
+        }
+    }
+    if (mismatch) {
+        std::cerr << "Configurations differ, run with the configuration of the baseline (--samples, --epochs, --batch,"
+                  << " --threads) or record a new one with --write-baseline." << std::endl;
+        return 2;
+    }
+    double expected = json_number(baseline, "samples_per_second");
+    if (!(expected > 0)) {
+        std::cerr << "Baseline " << options.baseline << " has no throughput." << std::endl;
+        return 2;
+    }
+    double change = results.samplesPerSecond/expected - 1;
+    std::cout << "Baseline:     " << expected << " samples/s, change: " << std::showpos << 100*change << "%" << std::noshowpos;
+    for (const char* key: {"forward_ms", "backward_ms", "update_ms"}) {
+        std::cout << ", " << key << " " << json_number(baseline, key);
+    }
+    std::cout << std::endl;
+    if (change < -options.threshold) {
+        std::cout << "REGRESSION: throughput dropped by more than " << 100*options.threshold << "%" << std::endl;
+        return 1;
+    }
+    return 0;
+}
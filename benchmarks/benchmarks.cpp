@@ -0,0 +1,402 @@
+#include "../src/data_parser.h"
+#include "../src/layer.h"
+#include "../src/loss_function.h"
+#include "../src/sequential_nn.h"
+#include "../src/thread_pool.h"
+#include "../src/transformation.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <Eigen/Dense>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Microbenchmarks of the kernels and data paths, parameterized by shape, batch size and number of threads:
+ *     Benchmarks [--quick] [--filter name] [--out path]
+ * Each benchmark is run for kRepetitions repetitions of (at least) kMinRepetitionSeconds after a warm-up; the median,
+ * minimum and mean time per iteration are written as JSON to path (default: benchmarks.json) and printed as a table.
+ * With --quick, the grid is smaller and the repetitions shorter (e.g. for CI), --filter only runs the benchmarks
+ * whose name contains the given string (e.g. --filter activation).
+ *
+ * Threads: the batch is split into one slice per thread which are processed concurrently on the global ThreadPool
+ * (as the micro-batches of Optimizer::Step on the replicas), i.e. the thread count measures the data-parallel scaling
+ * of a kernel. Kernels with state per layer (Layer::Backward, LinearLayer::UpdateWeightsBias) and the serial data
+ * paths only run with one thread; DataParser::LoadSamplesLabels uses the global ThreadPool itself.
+ *
+ * Run from the project root directory (the csv-files are generated in the current directory and removed afterwards).
+ */
+
+const int kRepetitions = 5;
+double kMinRepetitionSeconds = 0.05;
+
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > params;
+    long iterations;
+    double medianNs;
+    double minNs;
+    double meanNs;
+    // per iteration (zero if not meaningful)
+    double flops;
+    double bytes;
+};
+
+std::vector<Result> results;
+std::string filter;
+
+bool selected(const std::string& name) {
+    return filter.empty() || (name.find(filter) != std::string::npos);
+}
+
+template<typename F>
+double time_s(long iterations, F& f) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i=0; i<iterations; i++) {
+        f();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// time f: warm-up, calibrate the iterations per repetition, then kRepetitions repetitions
+template<typename F>
+void run(const std::string& name, std::vector<std::pair<std::string, std::string> > params, double flops, double bytes, F f) {
+    if (!selected(name)) {
+        return;
+    }
+    f();
+    long iterations = 1;
+    double seconds = time_s(iterations, f);
+    while (seconds < kMinRepetitionSeconds) {
+        iterations = (seconds > 0) ? std::max(iterations + 1, (long)(iterations*1.2*kMinRepetitionSeconds/seconds)) : iterations*10;
+        seconds = time_s(iterations, f);
+    }
+    std::vector<double> ns;
+    for (int r=0; r<kRepetitions; r++) {
+        ns.push_back(time_s(iterations, f)*1e9/iterations);
+    }
+    std::sort(ns.begin(), ns.end());
+    double mean = 0;
+    for (double t: ns) {
+        mean += t/ns.size();
+    }
+    results.push_back({name, params, iterations, ns[ns.size()/2], ns[0], mean, flops, bytes});
+
+    const Result& r = results.back();
+    std::ostringstream line;
+    line << std::left << std::setw(28) << name;
+    for (auto& p: params) {
+        line << p.first << "=" << p.second << " ";
+    }
+    std::cout << std::left << std::setw(80) << line.str() << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << r.medianNs/1e3 << " us";
+    if (flops > 0) {
+        std::cout << std::setprecision(2) << std::setw(10) << flops/r.medianNs << " GFLOP/s";
+    }
+    if (bytes > 0) {
+        std::cout << std::setprecision(2) << std::setw(10) << bytes/r.medianNs << " GB/s";
+    }
+    std::cout << std::endl;
+}
+
+// run f(first, size, slot) for one slice of the batch per thread concurrently
+template<typename F>
+void split_batch(long batch, int threads, F f) {
+    long chunk = (batch + threads - 1)/threads;
+    ThreadPool::Global().ParallelFor(0, threads, 1, [&](long begin, long end) {
+        for (long t=begin; t<end; t++) {
+            long first = t*chunk;
+            long size = std::min(chunk, batch - first);
+            if (size > 0) {
+                f(first, size, t);
+            }
+        }
+    });
+}
+
+// slices of the columns of X (one per thread)
+std::vector<Eigen::MatrixXd> slices(const Eigen::MatrixXd& X, int threads) {
+    std::vector<Eigen::MatrixXd> parts(threads);
+    long chunk = (X.cols() + threads - 1)/threads;
+    for (int t=0; t<threads; t++) {
+        long first = std::min<long>(t*chunk, X.cols());
+        parts[t] = X.middleCols(first, std::min<long>(chunk, X.cols() - first));
+    }
+    return parts;
+}
+
+std::string str(long value) {
+    return std::to_string(value);
+}
+
+
+/*********************
+ * KERNEL BENCHMARKS *
+ *********************/
+
+void bench_linear_transform(int rows, int cols, int batch, int threads) {
+    LinearTransformation linear(rows, cols);
+    linear.Initialize("He");
+    std::vector<Eigen::MatrixXd> X = slices(Eigen::MatrixXd::Random(cols, batch), threads);
+    std::vector<Eigen::MatrixXd> Y(threads);
+    run("linear_transform", {{"rows", str(rows)}, {"cols", str(cols)}, {"batch", str(batch)}, {"threads", str(threads)}},
+        2.0*rows*cols*batch, 8.0*(rows*cols + (double)(rows + cols)*batch), [&]() {
+        split_batch(batch, threads, [&](long, long, long t) { Y[t] = linear.Transform(X[t]); });
+    });
+}
+
+void bench_activation(const std::string& activation, int size, int batch, int threads) {
+    ActivationTransformation transformation(size, activation);
+    Eigen::MatrixXd input = Eigen::MatrixXd::Random(size, batch);
+    std::vector<Eigen::MatrixXd> X = slices(input, threads);
+    std::vector<Eigen::MatrixXd> Y(threads);
+    std::vector<std::pair<std::string, std::string> > params{{"activation", activation}, {"size", str(size)},
+                                                             {"batch", str(batch)}, {"threads", str(threads)}};
+    run("activation_transform", params, 1.0*size*batch, 16.0*size*batch, [&]() {
+        split_batch(batch, threads, [&](long, long, long t) { Y[t] = transformation.Transform(X[t]); });
+    });
+
+    // batch backward pass (samples of the backward input are rows)
+    std::vector<Eigen::MatrixXd> output(threads), backwardInput(threads), backwardOutput(threads);
+    for (int t=0; t<threads; t++) {
+        output[t] = transformation.Transform(X[t]);
+        backwardInput[t] = Eigen::MatrixXd::Random(X[t].cols(), size);
+    }
+    run("activation_batch_backward", params, 1.0*size*batch, 32.0*size*batch, [&]() {
+        split_batch(batch, threads, [&](long, long, long t) {
+            transformation.BatchBackwardTransform(X[t], output[t], backwardInput[t], backwardOutput[t]);
+        });
+    });
+
+    // per sample with the Jacobian (serial: BackwardTransform writes the derivative of the transformation)
+    if (threads == 1) {
+        Eigen::RowVectorXd row = Eigen::RowVectorXd::Random(size);
+        Eigen::RowVectorXd result;
+        run("activation_backward_sample", {{"activation", activation}, {"size", str(size)}, {"batch", str(batch)}},
+            2.0*size*size*batch, 8.0*size*size*batch, [&]() {
+            for (int j=0; j<batch; j++) {
+                result = transformation.BackwardTransform(input.col(j), row);
+            }
+        });
+    }
+}
+
+// network of a LinearLayer followed by a relu layer after a forward and backward pass (in training mode)
+SequentialNN prepared_network(int rows, int cols, int batch) {
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<LinearLayer>(rows, cols),
+                                                std::make_shared<ActivationLayer>(rows, "relu")};
+    SequentialNN snn(layers);
+    snn.SetTraining(true);
+    snn(Eigen::MatrixXd::Random(cols, batch));
+    snn.BackwardInput(Eigen::MatrixXd::Random(batch, rows));
+    snn.Backward();
+    return snn;
+}
+
+void bench_layer(int rows, int cols, int batch) {
+    SequentialNN snn = prepared_network(rows, cols, batch);
+    std::vector<std::pair<std::string, std::string> > params{{"rows", str(rows)}, {"cols", str(cols)}, {"batch", str(batch)}};
+    run("linear_layer_backward", params, 2.0*rows*cols*batch, 8.0*(rows*cols + (double)(rows + cols)*batch), [&]() {
+        snn.GetLayer(0).Backward();
+    });
+    run("relu_layer_backward", {{"size", str(rows)}, {"batch", str(batch)}}, 1.0*rows*batch, 16.0*rows*batch, [&]() {
+        snn.GetLayer(1).Backward();
+    });
+    // Deltas of the batch and update (i.e. a step of plain gradient descent)
+    run("linear_update_weights_bias", params, 2.0*rows*cols*batch + 2.0*rows*cols,
+        8.0*(4.0*rows*cols + (double)(rows + cols)*batch), [&]() {
+        snn.GetLayer(0).UpdateWeightsBias(1e-9);
+    });
+    // forward pass of the pair layer by layer and compiled (fused, see ExecutionPlan)
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(cols, batch);
+    for (bool compiled: {false, true}) {
+        SequentialNN network = prepared_network(rows, cols, batch);
+        if (compiled) {
+            network.Compile(batch, ExecutionPlan::Mode::kInference);
+        }
+        network.Input(X);
+        std::vector<std::pair<std::string, std::string> > forwardParams(params);
+        forwardParams.push_back({"compiled", str(compiled)});
+        run("linear_relu_forward", forwardParams, 2.0*rows*cols*batch + 2.0*rows*batch,
+            8.0*(rows*cols + (double)(rows + cols)*batch), [&]() {
+            network.Forward();
+        });
+    }
+}
+
+void bench_loss(const std::string& name, int classes, int batch, int threads) {
+    std::vector<Eigen::MatrixXd> y = slices((Eigen::MatrixXd::Random(classes, batch).array() + 1.5).matrix(), threads);
+    std::vector<Eigen::MatrixXd> labels(threads), grads(threads);
+    std::vector<Eigen::RowVectorXi> indices(threads);
+    std::vector<LossFunction> losses(threads, LossFunction(name));
+    std::mt19937 rng(1);
+    for (int t=0; t<threads; t++) {
+        indices[t].resize(y[t].cols());
+        labels[t] = Eigen::MatrixXd::Zero(classes, y[t].cols());
+        for (long j=0; j<y[t].cols(); j++) {
+            indices[t](j) = rng() % classes;
+            labels[t](indices[t](j), j) = 1.0;
+        }
+    }
+    std::vector<std::pair<std::string, std::string> > params{{"loss", name}, {"classes", str(classes)},
+                                                             {"batch", str(batch)}, {"threads", str(threads)}};
+    run("loss_evaluate_one_hot", params, 3.0*classes*batch, 24.0*classes*batch, [&]() {
+        split_batch(batch, threads, [&](long, long, long t) { losses[t].Evaluate(y[t], labels[t], grads[t]); });
+    });
+    run("loss_evaluate_classes", params, 3.0*classes*batch, 16.0*classes*batch, [&]() {
+        split_batch(batch, threads, [&](long, long, long t) { losses[t].Evaluate(y[t], indices[t], grads[t]); });
+    });
+}
+
+
+/************************
+ * DATA PATH BENCHMARKS *
+ ************************/
+
+// csv-file with the label in the first column followed by features pixels (MNIST-like), returns its size in bytes
+long generate_csv(const std::string& path, int lines, int features) {
+    std::mt19937 rng(42);
+    std::ofstream out(path);
+    for (int i=0; i<lines; i++) {
+        out << rng() % 10;
+        for (int j=0; j<features; j++) {
+            out << "," << ((rng() % 5 == 0) ? rng() % 256 : 0);
+        }
+        out << "\n";
+    }
+    out.flush();
+    return out.tellp();
+}
+
+void bench_csv(int lines, const std::vector<int>& threadCounts) {
+    std::string path = "./benchmarks_generated.csv";
+    double bytes = generate_csv(path, lines, 784);
+    DataParser dp;
+    run("load_csv", {{"lines", str(lines)}, {"threads", "1"}}, 0, bytes, [&]() {
+        Eigen::MatrixXd data = dp.LoadCSV<Eigen::MatrixXd>(path);
+    });
+    for (int threads: threadCounts) {
+        ThreadPool::SetGlobalThreads(threads);
+        Eigen::MatrixXd samples;
+        Eigen::RowVectorXd labels;
+        run("load_samples_labels", {{"lines", str(lines)}, {"threads", str(threads)}}, 0, bytes, [&]() {
+            dp.LoadSamplesLabels(path, samples, labels);
+        });
+    }
+    std::remove(path.c_str());
+}
+
+void bench_one_hot(int classes, int samples) {
+    DataParser dp;
+    Eigen::RowVectorXd labels(samples);
+    for (int j=0; j<samples; j++) {
+        labels(j) = j % classes;
+    }
+    run("one_hot_encoder", {{"classes", str(classes)}, {"samples", str(samples)}}, 0, 8.0*(classes + 1)*samples, [&]() {
+        Eigen::MatrixXd Y = dp.OneHotEncoder(labels, classes - 1);
+    });
+}
+
+
+/**********
+ * OUTPUT *
+ **********/
+
+void write_json(const std::string& path, bool quick) {
+    std::ofstream out(path);
+    out << std::setprecision(9);
+    out << "{\n  \"suite\": \"SequentialNN microbenchmarks\",\n  \"quick\": " << (quick ? "true" : "false")
+        << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+        << ",\n  \"repetitions\": " << kRepetitions << ",\n  \"results\": [\n";
+    for (size_t i=0; i<results.size(); i++) {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"params\": {";
+        for (size_t p=0; p<r.params.size(); p++) {
+            out << (p > 0 ? ", " : "") << "\"" << r.params[p].first << "\": ";
+            // numbers without quotes
+            bool number = !r.params[p].second.empty() && (r.params[p].second.find_first_not_of("0123456789") == std::string::npos);
+            out << (number ? r.params[p].second : "\"" + r.params[p].second + "\"");
+        }
+        out << "}, \"iterations\": " << r.iterations << ", \"median_ns\": " << r.medianNs << ", \"min_ns\": " << r.minNs
+            << ", \"mean_ns\": " << r.meanNs << ", \"gflops\": " << ((r.flops > 0) ? r.flops/r.medianNs : 0.0)
+            << ", \"gbytes_per_second\": " << ((r.bytes > 0) ? r.bytes/r.medianNs : 0.0) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    std::string path = "benchmarks.json";
+    for (int i=1; i<argc; i++) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if ((std::strcmp(argv[i], "--filter") == 0) && (i + 1 < argc)) {
+            filter = argv[++i];
+        } else if ((std::strcmp(argv[i], "--out") == 0) && (i + 1 < argc)) {
+            path = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--filter name] [--out path]" << std::endl;
+            return 1;
+        }
+    }
+    if (quick) {
+        kMinRepetitionSeconds = 0.005;
+    }
+
+    // grid: (rows x cols) of the linear layers, batch sizes and thread counts
+    std::vector<std::pair<int, int> > shapes = quick ? std::vector<std::pair<int, int> >{{64, 64}, {128, 784}}
+                                                     : std::vector<std::pair<int, int> >{{64, 64}, {256, 256}, {128, 784}};
+    std::vector<int> batches = quick ? std::vector<int>{1, 64} : std::vector<int>{1, 32, 256};
+    std::vector<int> threadCounts{1};
+    int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (hardwareThreads > 1) {
+        threadCounts.push_back(hardwareThreads);
+    }
+    std::vector<std::string> activations{"relu", "sigmoid", "tanh", "softmax"};
+    int defaultThreads = ThreadPool::Global().NumThreads();
+
+    for (int threads: threadCounts) {
+        ThreadPool::SetGlobalThreads(threads);
+        for (auto& shape: shapes) {
+            for (int batch: batches) {
+                bench_linear_transform(shape.first, shape.second, batch, threads);
+                for (const std::string& activation: activations) {
+                    bench_activation(activation, shape.first, batch, threads);
+                }
+                if (threads == 1) {
+                    bench_layer(shape.first, shape.second, batch);
+                }
+            }
+        }
+        for (int classes: {10, 100}) {
+            for (int batch: batches) {
+                bench_loss("mse", classes, batch, threads);
+                bench_loss("cross_entropy", classes, batch, threads);
+            }
+        }
+    }
+    ThreadPool::SetGlobalThreads(1);
+    // (the file is only generated if one of the benchmarks is selected)
+    if (selected("load_csv") || selected("load_samples_labels")) {
+        bench_csv(quick ? 500 : 5000, threadCounts);
+    }
+    ThreadPool::SetGlobalThreads(1);
+    for (int classes: {10, 100}) {
+        bench_one_hot(classes, quick ? 10000 : 60000);
+    }
+    ThreadPool::SetGlobalThreads(defaultThreads);
+
+    write_json(path, quick);
+    std::cout << results.size() << " benchmarks written to " << path << std::endl;
+    return 0;
+}
@@ -1,10 +1,15 @@
+#include "src/checkpoint.h"
 #include "src/data_parser.h"
+#include "src/dataset.h"
 #include "src/layer.h"
 #include "src/loss_function.h"
 #include "src/sequential_nn.h"
 #include "src/optimizer.h"
+#include <cmath>
 #include <Eigen/Dense>
+#include <filesystem>
 #include <iostream>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -13,51 +18,39 @@
 
 */
 
-// split data samples and labels (for now each label is a single number; hence the labels form a row vector)
-std::pair<Eigen::MatrixXd, Eigen::RowVectorXd> split_samples_labels(const std::string file_path) {
-    DataParser dp;
-    Eigen::MatrixXd X = dp.LoadCSV<Eigen::MatrixXd>(file_path);
-
-    // get the actual training samples
-    // we work with column vectors as data 
-    // TODO: needs to be changed at some point because most data is provided as row vectors)
-    Eigen::MatrixXd samples = X(Eigen::placeholders::all, Eigen::seq(1, Eigen::indexing::last)).transpose(); 
-    // get labels
-    Eigen::RowVectorXd labels = X.col(0).transpose();
-
-    return {samples, labels};
-}
-
 // train on data
+// NOTE: the samples/labels are loaded via the binary sidecar of the csv-file (memory-mapped, see DataParser::LoadDataset),
+// i.e. the csv-file is only parsed in the first run
 void train_MNIST(SequentialNN& snn, int batchSize, int epochs, std::string file_path) {
     DataParser dp;
-    std::pair<Eigen::MatrixXd, Eigen::RowVectorXd> train_data = split_samples_labels(file_path);
+    Dataset train_data = dp.LoadDataset(file_path);
     auto sdg = SDG("cross_entropy", batchSize, 0.003);
-    // one-hot-encode before training
-    sdg.Train(snn, train_data.first, dp.OneHotEncoder(train_data.second, 9), epochs);
+    // class indices as labels (no one-hot-encoding)
+    sdg.Train(snn, train_data.Samples(), dp.ClassIndices(train_data.Labels(), 9), epochs);
 }
 
 // evaluate against test data
-void evaluate_test(SequentialNN& snn, Eigen::MatrixXd X_test, Eigen::RowVectorXd y_test) {
-    int total = X_test.cols();
-    int correct = 0;
-    Eigen::MatrixXd::Index max_index;
-
-    for (int i=0; i<total; i++) { // TODO: how to improve?
-        if ((snn(X_test.col(i)).col(0)).maxCoeff(&max_index) == (int)y_test(i)) { // CHECK!
-            correct++;
-        }
-    }
-    std::cout << "Correct: " << correct << "/" << total << std::endl;
+void evaluate_test(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& X_test, const Eigen::Ref<const Eigen::RowVectorXi>& y_test) {
+    double accuracy = snn.Accuracy(X_test, y_test);
+    std::cout << "Correct: " << (long)std::round(accuracy*X_test.cols()) << "/" << X_test.cols() << std::endl;
 }
 
 void test_MNIST(SequentialNN& snn, std::string file_path) {
-    std::pair<Eigen::MatrixXd, Eigen::RowVectorXd> test_data = split_samples_labels(file_path);
-    evaluate_test(snn, test_data.first, test_data.second);
+    DataParser dp;
+    Dataset test_data = dp.LoadDataset(file_path);
+    evaluate_test(snn, test_data.Samples(), dp.ClassIndices(test_data.Labels(), 9));
 }
 
 // training and evaluating a neural network on the MNIST data set
+// NOTE: the trained network is saved as a checkpoint, later runs load it (memory-mapped) instead of training again
 int main() {
+    std::string checkpoint = "./mnist.ckpt";
+    if (std::filesystem::exists(checkpoint)) {
+        SequentialNN snn = Checkpoint::Load(checkpoint);
+        test_MNIST(snn, "./tests/MNIST_test.csv");
+        return 0;
+    }
+
     // setup a basic neural network
     std::vector<Layer> layers{{LinearLayer(392, 784), 
                                ActivationLayer(392, "relu"), 
@@ -68,9 +61,10 @@ int main() {
     auto snn = SequentialNN(layers);
 
     // training
-    train_MNIST(snn, 50, 200, "./tests/MNIST_train.csv");
+    train_MNIST(snn, 50, 1, "./tests/MNIST_train.csv");
+    Checkpoint::Save(checkpoint, snn);
     // evaluate
     test_MNIST(snn, "./tests/MNIST_test.csv");
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,102 @@
+#include "allocation_tracker.h"
+#include <cerrno>
+#include <cstddef>
+
+/********************
+ * ALLOCATION HOOKS *
+ ********************/
+
+/**
+    Replacements of the allocation functions of the C library which report each allocation and free to the
+    AllocationTracker and forward to glibc (~__libc_malloc~ etc.). Linked into an executable via the object library
+    LibAllocationHooks, the definitions take precedence over the ones of the C library (symbol interposition), so
+    ~operator new~ of the C++ runtime and Eigen's aligned_malloc are counted as well. The sizes are the usable sizes of
+    the blocks (~malloc_usable_size~), so allocations and frees are consistent.
+
+    NOTE: only for glibc; otherwise this file is empty and AllocationTracker::Available() stays false.
+*/
+
+#if defined(__GLIBC__)
+
+#include <malloc.h>
+
+extern "C" {
+
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    if (ptr != nullptr) {
+        AllocationTracker::OnAllocate(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* ptr = __libc_calloc(count, size);
+    if (ptr != nullptr) {
+        AllocationTracker::OnAllocate(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    size_t previous = (ptr != nullptr) ? malloc_usable_size(ptr) : 0;
+    void* result = __libc_realloc(ptr, size);
+    if ((ptr != nullptr) && ((result != nullptr) || (size == 0))) {
+        AllocationTracker::OnFree(previous);
+    }
+    if (result != nullptr) {
+        AllocationTracker::OnAllocate(malloc_usable_size(result));
+    }
+    return result;
+}
+
+void* memalign(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    if (ptr != nullptr) {
+        AllocationTracker::OnAllocate(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if ((alignment % sizeof(void*) != 0) || ((alignment & (alignment - 1)) != 0)) {
+        return EINVAL;
+    }
+    void* result = memalign(alignment, size);
+    if (result == nullptr) {
+        return ENOMEM;
+    }
+    *ptr = result;
+    return 0;
+}
+
+void free(void* ptr) {
+    if (ptr != nullptr) {
+        AllocationTracker::OnFree(malloc_usable_size(ptr));
+        __libc_free(ptr);
+    }
+}
+
+}  // extern "C"
+
+namespace {
+
+struct RegisterHooks {
+    RegisterHooks() { AllocationTracker::SetAvailable(); }
+};
+
+RegisterHooks registerHooks;
+
+}  // namespace
+
+#endif // __GLIBC__
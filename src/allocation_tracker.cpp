@@ -0,0 +1,117 @@
+#include "allocation_tracker.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+/**********************
+ * ALLOCATION TRACKER *
+ **********************/
+
+namespace {
+
+// NOTE: only trivial types (constant initialization), so the hooks can use them before any constructor ran
+struct PhaseCounters {
+    std::atomic<long> allocations;
+    std::atomic<long> frees;
+    std::atomic<long> bytes;
+    std::atomic<long> peakBytes;
+};
+
+PhaseCounters phaseCounters[AllocationTracker::kPhases];
+std::atomic<long> liveBytes(0);
+std::atomic<bool> available(false);
+thread_local int currentPhase = 0;
+
+}  // namespace
+
+bool AllocationTracker::Available() {
+    return available.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::SetAvailable() {
+    available.store(true, std::memory_order_relaxed);
+}
+
+void AllocationTracker::SetPhase(Phase phase) {
+    currentPhase = (int)phase;
+}
+
+AllocationTracker::Phase AllocationTracker::CurrentPhase() {
+    return (Phase)currentPhase;
+}
+
+void AllocationTracker::OnAllocate(size_t bytes) {
+    PhaseCounters& counters = phaseCounters[currentPhase];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    long live = liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    long peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while ((live > peak) && !counters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+}
+
+// NOTE: a free is counted in the phase of the thread which frees the memory
+void AllocationTracker::OnFree(size_t bytes) {
+    phaseCounters[currentPhase].frees.fetch_add(1, std::memory_order_relaxed);
+    liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+AllocationTracker::Counters AllocationTracker::Get(Phase phase) {
+    PhaseCounters& counters = phaseCounters[(int)phase];
+    return {counters.allocations.load(std::memory_order_relaxed), counters.frees.load(std::memory_order_relaxed),
+            counters.bytes.load(std::memory_order_relaxed), counters.peakBytes.load(std::memory_order_relaxed)};
+}
+
+AllocationTracker::Counters AllocationTracker::Total() {
+    Counters total{0, 0, 0, 0};
+    for (int p=0; p<kPhases; p++) {
+        Counters counters = Get((Phase)p);
+        total.allocations += counters.allocations;
+        total.frees += counters.frees;
+        total.bytes += counters.bytes;
+        total.peakBytes = std::max(total.peakBytes, counters.peakBytes);
+    }
+    return total;
+}
+
+long AllocationTracker::LiveBytes() {
+    return liveBytes.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::Reset() {
+    for (PhaseCounters& counters: phaseCounters) {
+        counters.allocations.store(0, std::memory_order_relaxed);
+        counters.frees.store(0, std::memory_order_relaxed);
+        counters.bytes.store(0, std::memory_order_relaxed);
+        counters.peakBytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::string AllocationTracker::PhaseName(Phase phase) {
+    switch (phase) {
+        case Phase::kData: return "data";
+        case Phase::kForward: return "forward";
+        case Phase::kLoss: return "loss";
+        case Phase::kBackward: return "backward";
+        case Phase::kUpdate: return "update";
+        default: return "other";
+    }
+}
+
+std::string AllocationTracker::Text() {
+    std::ostringstream text;
+    if (!Available()) {
+        text << "Allocations are not tracked (link LibAllocationHooks).\n";
+        return text.str();
+    }
+    text << std::left << std::setw(10) << "phase" << std::right << std::setw(14) << "allocations" << std::setw(10)
+         << "frees" << std::setw(14) << "bytes" << std::setw(14) << "peak bytes" << "\n";
+    for (int p=0; p<kPhases; p++) {
+        Counters counters = Get((Phase)p);
+        text << std::left << std::setw(10) << PhaseName((Phase)p) << std::right << std::setw(14) << counters.allocations
+             << std::setw(10) << counters.frees << std::setw(14) << counters.bytes << std::setw(14) << counters.peakBytes
+             << "\n";
+    }
+    return text.str();
+}
@@ -0,0 +1,86 @@
+#ifndef ALLOCATION_TRACKER_H_
+#define ALLOCATION_TRACKER_H_
+
+#include <cstddef>
+#include <string>
+
+/**********************
+ * ALLOCATION TRACKER *
+ **********************/
+
+/**
+    Counts the heap allocations of the process per phase of a training step (data, forward pass, loss, backward pass,
+    update and everything else). The code regions are marked with an AllocationScope (SequentialNN, Optimizer and
+    BatchLoader do this already), the phase is kept per thread:
+        AllocationTracker::Reset();
+        sdg.Step(snn, batch, batchLabel);
+        std::cout << AllocationTracker::Text();
+
+    The allocations themselves are only counted if the executable links the hooks of LibAllocationHooks (an object
+    library which replaces malloc, free etc. of glibc and forwards to them, see allocation_hooks.cpp). Since
+    ~operator new~ and Eigen both allocate with malloc, this covers all allocations. Without the hooks, the phases
+    are still tracked (a thread local store per scope) but all counters stay zero and ~Available()~ is false.
+
+    For each phase, the tracker reports the number of allocations and frees, the bytes allocated and the peak of the
+    bytes in use by the whole process during an allocation of the phase (all since the last ~Reset~).
+
+    NOTE: the counters are atomics, i.e. they are exact with several threads but not a consistent snapshot.
+*/
+
+class AllocationTracker {
+    public:
+        enum class Phase { kOther = 0, kData = 1, kForward = 2, kLoss = 3, kBackward = 4, kUpdate = 5 };
+        static const int kPhases = 6;
+
+        struct Counters {
+            long allocations;
+            long frees;
+            long bytes;
+            long peakBytes;
+        };
+
+        // true if the hooks are linked (otherwise nothing is counted)
+        static bool Available();
+
+        // phase of the calling thread (see AllocationScope)
+        static void SetPhase(Phase);
+        static Phase CurrentPhase();
+
+        // counters of a phase and of all phases since the last Reset
+        static Counters Get(Phase);
+        static Counters Total();
+        // bytes currently in use (since the hooks are active, i.e. the start of the process)
+        static long LiveBytes();
+        static void Reset();
+
+        static std::string PhaseName(Phase);
+        // table of the counters of all phases
+        static std::string Text();
+
+        // called by the hooks (must not allocate)
+        static void OnAllocate(size_t bytes);
+        static void OnFree(size_t bytes);
+        static void SetAvailable();
+};
+
+
+/********************
+ * ALLOCATION SCOPE *
+ ********************/
+
+// sets the phase of the calling thread from its construction to its destruction (then the previous one is restored)
+class AllocationScope {
+    private:
+        AllocationTracker::Phase _previous;
+
+    public:
+        AllocationScope(AllocationTracker::Phase phase): _previous(AllocationTracker::CurrentPhase()) {
+            AllocationTracker::SetPhase(phase);
+        }
+        ~AllocationScope() { AllocationTracker::SetPhase(_previous); }
+
+        AllocationScope(const AllocationScope&) = delete;
+        AllocationScope& operator=(const AllocationScope&) = delete;
+};
+
+#endif // ALLOCATION_TRACKER_H_
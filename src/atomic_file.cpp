@@ -0,0 +1,128 @@
+#include <algorithm>
+#include "atomic_file.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/***************
+ * ATOMIC FILE *
+ ***************/
+
+static const size_t kBufferSize = 1 << 16;
+
+// random suffix of a temporary file (different for each thread and process)
+static std::string RandomSuffix() {
+    static thread_local std::mt19937_64 rng(std::random_device{}() ^ ((uint64_t)getpid() << 32));
+    static const char kDigits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    std::string suffix(8, '0');
+    for (char& c: suffix) {
+        c = kDigits[rng() % 36];
+    }
+    return suffix;
+}
+
+AtomicFile::AtomicFile(const std::string& path):
+    _path(path),
+    _fd(-1)
+    {
+        // NOTE: like mkstemp, but with mode 0666 (the umask is applied by open, as for std::ofstream)
+        for (int attempt=0; (_fd < 0) && (attempt < 100); attempt++) {
+            _temporary = path + "." + RandomSuffix() + ".tmp";
+            _fd = open(_temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+            if ((_fd < 0) && (errno != EEXIST)) {
+                break;
+            }
+        }
+        if (_fd < 0) {
+            throw std::runtime_error("Cannot create temporary file for " + path + ": " + std::strerror(errno));
+        }
+        _buffer.reserve(kBufferSize);
+    }
+
+AtomicFile::~AtomicFile() {
+    if (_fd >= 0) {
+        close(_fd);
+        std::remove(_temporary.c_str());
+    }
+}
+
+void AtomicFile::Fail(const std::string& action) {
+    int error = errno;
+    close(_fd);
+    _fd = -1;
+    std::remove(_temporary.c_str());
+    throw std::runtime_error("Cannot " + action + " " + _temporary + ": " + std::strerror(error));
+}
+
+void AtomicFile::WriteAll(const char* data, size_t size) {
+    // retry partial writes
+    while (size > 0) {
+        ssize_t written = write(_fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Fail("write");
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void AtomicFile::Flush() {
+    WriteAll(_buffer.data(), _buffer.size());
+    _buffer.clear();
+}
+
+void AtomicFile::Write(const char* data, size_t size) {
+    if (_fd < 0) {
+        throw std::logic_error("AtomicFile " + _path + " is already closed.");
+    }
+    if (_buffer.size() + size > kBufferSize) {
+        Flush();
+    }
+    // NOTE: large writes are not copied into the buffer
+    if (size >= kBufferSize) {
+        WriteAll(data, size);
+    } else {
+        _buffer.insert(_buffer.end(), data, data + size);
+    }
+}
+
+void AtomicFile::Commit() {
+    if (_fd < 0) {
+        throw std::logic_error("AtomicFile " + _path + " is already closed.");
+    }
+    Flush();
+    // the data has to be on disk before the rename makes it visible
+    if (fsync(_fd) != 0) {
+        Fail("sync");
+    }
+    int fd = _fd;
+    _fd = -1;
+    if (close(fd) != 0) {
+        int error = errno;
+        std::remove(_temporary.c_str());
+        throw std::runtime_error("Cannot write " + _temporary + ": " + std::strerror(error));
+    }
+    if (std::rename(_temporary.c_str(), _path.c_str()) != 0) {
+        int error = errno;
+        std::remove(_temporary.c_str());
+        throw std::runtime_error("Cannot rename " + _temporary + " to " + _path + ": " + std::strerror(error));
+    }
+    // persist the rename (best effort)
+    std::string directory = std::filesystem::path(_path).parent_path().string();
+    int directoryFd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directoryFd >= 0) {
+        fsync(directoryFd);
+        close(directoryFd);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef ATOMIC_FILE_H_
+#define ATOMIC_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/***************
+ * ATOMIC FILE *
+ ***************/
+
+/**
+    File which is written to a unique temporary file in the directory of its path and renamed to the path by
+    ~Commit~ (after the data is synced to disk). So readers of the path only ever see complete files (processes which
+    mapped the old file keep their version), and concurrent writers of the same path (threads or processes) never
+    write into the same file: the last ~Commit~ wins.
+
+    Usage:
+        AtomicFile file("./tests/generated.ckpt");
+        file.Write(data, size);
+        file.Commit();
+
+    The temporary file is created with the same permissions as by std::ofstream (0666 without the bits of the
+    umask) and removed if the AtomicFile is destroyed without ~Commit~ (e.g. when an exception is thrown while the
+    data is written). Small writes are buffered.
+*/
+
+class AtomicFile {
+    private:
+        std::string _path;
+        std::string _temporary;
+        int _fd;
+        std::vector<char> _buffer;
+
+        // write all bytes to the temporary file (retrying partial writes)
+        void WriteAll(const char* data, size_t size);
+        // write the buffered bytes to the temporary file
+        void Flush();
+        // throws std::runtime_error with the current errno (after removing the temporary file)
+        [[noreturn]] void Fail(const std::string& action);
+
+    public:
+        // constructor (creates the temporary file, throws std::runtime_error if it cannot be created)
+        explicit AtomicFile(const std::string& path);
+        // destructor (removes the temporary file if it was not committed)
+        ~AtomicFile();
+
+        // no copies
+        AtomicFile(const AtomicFile&) = delete;
+        AtomicFile& operator=(const AtomicFile&) = delete;
+
+        // getters
+        const std::string& Path() const { return _path; }
+        const std::string& TemporaryPath() const { return _temporary; }
+
+        // append size bytes (throws std::runtime_error)
+        void Write(const char* data, size_t size);
+        // sync the data to disk and rename the temporary file to the path (throws std::runtime_error)
+        void Commit();
+};
+
+#endif // ATOMIC_FILE_H_
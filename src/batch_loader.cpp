@@ -0,0 +1,187 @@
+#include "allocation_tracker.h"
+#include "batch_loader.h"
+#include <algorithm>
+#include <chrono>
+#include <Eigen/Dense>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include "trace.h"
+
+/****************
+ * BATCH LOADER *
+ ****************/
+
+// placeholders for the kind of labels which is not used
+static const Eigen::MatrixXd kNoLabels;
+static const Eigen::RowVectorXi kNoClasses;
+
+BatchLoader::BatchLoader(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::MatrixXd>& yLabel,
+                         int batchSize, unsigned seed, long startBatch):
+    BatchLoader(X, yLabel, kNoClasses, false, batchSize, seed, startBatch) {}
+
+BatchLoader::BatchLoader(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::RowVectorXi>& classes,
+                         int batchSize, unsigned seed, long startBatch):
+    BatchLoader(X, kNoLabels, classes, true, batchSize, seed, startBatch) {}
+
+BatchLoader::BatchLoader(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::MatrixXd>& yLabel,
+                         const Eigen::Ref<const Eigen::RowVectorXi>& classes, bool indexLabels, int batchSize, unsigned seed,
+                         long startBatch):
+    _X(X),
+    _yLabel(yLabel),
+    _classes(classes),
+    _indexLabels(indexLabels),
+    _batchSize(batchSize),
+    _rng(seed),
+    _permutation(X.cols()),
+    _position(0),
+    _epoch(0),
+    _filled{false, false},
+    _fill(0),
+    _take(0),
+    _inUse(-1),
+    _waitSeconds(0.0),
+    _batchesServed(0),
+    _stop(false)
+    {
+        if (X.cols() != (indexLabels ? classes.size() : yLabel.cols())) {
+            throw std::invalid_argument("Number of samples and labels do not coincide.");
+        }
+        if ((batchSize <= 0) || (batchSize > X.cols())) {
+            throw std::invalid_argument("Batch size has to be positive and must not exceed the number of samples.");
+        }
+        if (startBatch < 0) {
+            throw std::invalid_argument("Start batch has to be non-negative.");
+        }
+        // shuffle the first epoch
+        std::iota(_permutation.begin(), _permutation.end(), 0);
+        std::shuffle(_permutation.begin(), _permutation.end(), _rng);
+        // skip to the start batch (the same shuffles as in Gather, without gathering)
+        for (long e=0; e<startBatch/BatchesPerEpoch(); e++) {
+            std::shuffle(_permutation.begin(), _permutation.end(), _rng);
+            _epoch++;
+        }
+        _position = (startBatch % BatchesPerEpoch())*(long)batchSize;
+        // preallocate both buffers
+        for (int k=0; k<2; k++) {
+            _batches[k].resize(X.rows(), batchSize);
+            if (indexLabels) {
+                _batchClasses[k].resize(batchSize);
+            } else {
+                _labels[k].resize(yLabel.rows(), batchSize);
+            }
+        }
+        _worker = std::thread(&BatchLoader::WorkerLoop, this);
+    }
+
+BatchLoader::~BatchLoader() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+    _worker.join();
+}
+
+// NOTE: only called by the background thread on a buffer which is not in use by the training thread
+void BatchLoader::Gather(int k) {
+    TraceScope scope("gather batch", "data");
+    AllocationScope allocations(AllocationTracker::Phase::kData);
+    // new epoch: shuffle again
+    if (_position == (long)_permutation.size()) {
+        std::shuffle(_permutation.begin(), _permutation.end(), _rng);
+        _position = 0;
+        _epoch++;
+    }
+    int size = std::min<long>(_batchSize, _permutation.size() - _position);
+    // only reallocates for the last batch of an epoch (if it is smaller) and the first one after it
+    if (_batches[k].cols() != size) {
+        _batches[k].resize(_X.rows(), size);
+        if (_indexLabels) {
+            _batchClasses[k].resize(size);
+        } else {
+            _labels[k].resize(_yLabel.rows(), size);
+        }
+    }
+    for (int c=0; c<size; c++) {
+        int index = _permutation[_position + c];
+        _batches[k].col(c) = _X.col(index);
+        if (_indexLabels) {
+            _batchClasses[k](c) = _classes(index);
+        } else {
+            _labels[k].col(c) = _yLabel.col(index);
+        }
+    }
+    _position += size;
+}
+
+void BatchLoader::WorkerLoop() {
+    Trace::SetThreadName("batch loader");
+    while (true) {
+        int k;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [&]() { return _stop || (!_filled[_fill] && (_fill != _inUse)); });
+            if (_stop) {
+                return;
+            }
+            k = _fill;
+        }
+        Gather(k);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _filled[k] = true;
+            _fill = 1 - k;
+        }
+        _condition.notify_all();
+    }
+}
+
+int BatchLoader::Take() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    // release the buffer of the previous batch
+    _inUse = -1;
+    _condition.notify_all();
+
+    if (!_filled[_take]) {
+        TraceScope scope("wait for batch", "data");
+        auto start = std::chrono::steady_clock::now();
+        _condition.wait(lock, [&]() { return _filled[_take]; });
+        _waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    _inUse = _take;
+    _filled[_take] = false;
+    _take = 1 - _take;
+    _batchesServed++;
+    return _inUse;
+}
+
+void BatchLoader::Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) {
+    if (_indexLabels) {
+        throw std::logic_error("The labels of this BatchLoader are class indices.");
+    }
+    int k = Take();
+    batch = &_batches[k];
+    batchLabel = &_labels[k];
+}
+
+void BatchLoader::Next(const Eigen::MatrixXd*& batch, const Eigen::RowVectorXi*& batchClasses) {
+    if (!_indexLabels) {
+        throw std::logic_error("The labels of this BatchLoader are not class indices.");
+    }
+    int k = Take();
+    batch = &_batches[k];
+    batchClasses = &_batchClasses[k];
+}
+
+double BatchLoader::WaitSeconds() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _waitSeconds;
+}
+
+long BatchLoader::BatchesServed() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _batchesServed;
+}
@@ -0,0 +1,129 @@
+#ifndef BATCH_LOADER_H_
+#define BATCH_LOADER_H_
+
+#include <condition_variable>
+#include <Eigen/Dense>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/****************
+ * BATCH LOADER *
+ ****************/
+
+/**
+    Iterates over the (mini-)batches of a data set epoch by epoch. At the beginning of each epoch a permutation of
+    all samples is shuffled once, so that each sample is contained in exactly one batch per epoch (the last batch of
+    an epoch is smaller if the batch size does not divide the number of samples).
+
+    The batches are gathered on a background thread into two preallocated buffers (double buffering): while the
+    training thread works on one batch, the next one is assembled in the other buffer. Hence the next batch is
+    usually ready as soon as the training thread asks for it with ~Next~. The time the training thread had to wait
+    nevertheless is accumulated in ~WaitSeconds~.
+
+    Usage (the samples are the columns of X, the labels the columns of yLabel):
+        BatchLoader loader(X, yLabel, batchSize, seed);
+        for (int epoch=0; epoch<epochs; epoch++) {
+            for (int b=0; b<loader.BatchesPerEpoch(); b++) {
+                const Eigen::MatrixXd* batch;
+                const Eigen::MatrixXd* batchLabel;
+                loader.Next(batch, batchLabel);
+                ... // use *batch and *batchLabel until the next call of Next
+            }
+        }
+
+    The labels can also be class indices (Eigen::RowVectorXi, see ~LossFunction~), then the batches of labels are
+    obtained by the corresponding overload of ~Next~:
+        BatchLoader loader(X, classes, batchSize, seed);
+        const Eigen::RowVectorXi* batchClasses;
+        loader.Next(batch, batchClasses);
+
+    With ~startBatch~, the loader starts with the given batch (counted over all epochs), i.e. it hands out the same
+    batches as a loader with the same seed after ~startBatch~ calls of ~Next~ (e.g. to resume training, see
+    ~Optimizer::Resume~). The skipped batches are not gathered.
+
+    NOTE: X and yLabel are only referenced (no copy), so they have to outlive the BatchLoader.
+*/
+
+class BatchLoader {
+    private:
+        // data set (samples and labels are columns)
+        Eigen::Ref<const Eigen::MatrixXd> _X;
+        Eigen::Ref<const Eigen::MatrixXd> _yLabel;
+        // class indices (only used instead of yLabel if _indexLabels is true)
+        Eigen::Ref<const Eigen::RowVectorXi> _classes;
+        bool _indexLabels;
+        int _batchSize;
+
+        // sampling (only used by the background thread)
+        std::mt19937 _rng;
+        std::vector<int> _permutation;
+        // next position in the permutation
+        long _position;
+        // epoch of the next batch
+        int _epoch;
+
+        // double buffers
+        Eigen::MatrixXd _batches[2];
+        Eigen::MatrixXd _labels[2];
+        Eigen::RowVectorXi _batchClasses[2];
+        // true if the buffer contains a batch which was not handed out yet
+        bool _filled[2];
+        // buffer the background thread fills next
+        int _fill;
+        // buffer handed out next
+        int _take;
+        // buffer currently used by the training thread (-1 if none)
+        int _inUse;
+
+        // statistics
+        double _waitSeconds;
+        long _batchesServed;
+
+        // background thread
+        std::thread _worker;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _stop;
+
+        // constructor for both kinds of labels
+        BatchLoader(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::MatrixXd>& yLabel,
+                    const Eigen::Ref<const Eigen::RowVectorXi>& classes, bool indexLabels, int batchSize, unsigned seed,
+                    long startBatch);
+
+        void WorkerLoop();
+        // gather the next batch into buffer k
+        void Gather(int k);
+        // wait for the next batch and hand out its buffer
+        int Take();
+
+    public:
+        // constructor (starts the background thread)
+        BatchLoader(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::MatrixXd>& yLabel,
+                    int batchSize, unsigned seed, long startBatch=0);
+        // constructor with class indices as labels
+        BatchLoader(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::RowVectorXi>& classes,
+                    int batchSize, unsigned seed, long startBatch=0);
+        // destructor (stops the background thread)
+        ~BatchLoader();
+
+        // no copies
+        BatchLoader(const BatchLoader&) = delete;
+        BatchLoader& operator=(const BatchLoader&) = delete;
+
+        // getters
+        int NumberOfSamples() { return _X.cols(); }
+        int BatchesPerEpoch() { return (_X.cols() + _batchSize - 1)/_batchSize; }
+        // total time (in seconds) the training thread waited for batches in ~Next~
+        double WaitSeconds();
+        // number of batches handed out so far
+        long BatchesServed();
+
+        // next batch (blocks until it is ready); the pointers are valid until the next call of ~Next~
+        void Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel);
+        // same for class indices as labels
+        void Next(const Eigen::MatrixXd*& batch, const Eigen::RowVectorXi*& batchClasses);
+};
+
+#endif // BATCH_LOADER_H_
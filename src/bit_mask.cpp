@@ -0,0 +1,92 @@
+#include "bit_mask.h"
+#include <algorithm>
+#include <cstring>
+#include <Eigen/Dense>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/************
+ * BIT MASK *
+ ************/
+
+void BitMask::Resize(int features, int samples) {
+    if ((features == _features) && (samples == _samples)) {
+        return;
+    }
+    _features = features;
+    _samples = samples;
+    _wordsPerFeature = (samples + 63)/64;
+    _words.assign((size_t)_features*_wordsPerFeature, 0);
+}
+
+void BitMask::SetPositive(const Eigen::MatrixXd& matrix) {
+    Resize(matrix.rows(), matrix.cols());
+
+    // NOTE: we pack blocks of 64 samples. For a fixed block, the 64 columns are read 'row by row' which
+    // only touches 64 cache lines until we move on to the next row (i.e. it stays in the L1 cache).
+    for (int jb=0; jb<_samples; jb+=64) {
+        int block = std::min(64, _samples-jb);
+        for (int i=0; i<_features; i++) {
+            uint64_t word = 0;
+            for (int jj=0; jj<block; jj++) {
+                word |= uint64_t(matrix(i, jb+jj) > 0.0) << jj;
+            }
+            _words[(size_t)i*_wordsPerFeature + jb/64] = word;
+        }
+    }
+}
+
+// apply the bits of a single feature to n contiguous doubles (samples)
+static void ApplyWords(const uint64_t* words, const double* in, double* out, int n) {
+    int j = 0;
+#if defined(__AVX2__)
+    // four samples at once: expand four bits to four 64-bit lanes (all ones or all zeros) and use a bitwise and
+    const __m256i shifts = _mm256_set_epi64x(3, 2, 1, 0);
+    const __m256i one = _mm256_set1_epi64x(1);
+    for (; j+4 <= n; j+=4) {
+        // j is a multiple of 4, so the four bits are contained in the same word
+        __m256i word = _mm256_set1_epi64x((long long)(words[j/64] >> (j % 64)));
+        __m256i bits = _mm256_and_si256(_mm256_srlv_epi64(word, shifts), one);
+        __m256i lanes = _mm256_sub_epi64(_mm256_setzero_si256(), bits);
+        __m256d values = _mm256_loadu_pd(in + j);
+        _mm256_storeu_pd(out + j, _mm256_and_pd(values, _mm256_castsi256_pd(lanes)));
+    }
+#elif defined(__SSE2__)
+    // two samples at once (SSE2 is always available on x86-64)
+    for (; j+2 <= n; j+=2) {
+        uint64_t word = words[j/64] >> (j % 64);
+        __m128i lanes = _mm_set_epi64x(-(long long)((word >> 1) & 1), -(long long)(word & 1));
+        __m128d values = _mm_loadu_pd(in + j);
+        _mm_storeu_pd(out + j, _mm_and_pd(values, _mm_castsi128_pd(lanes)));
+    }
+#endif
+    // remaining samples (or everything if no SIMD instructions are available)
+    for (; j<n; j++) {
+        uint64_t lane = -((words[j/64] >> (j % 64)) & 1);
+        uint64_t bits;
+        std::memcpy(&bits, in + j, sizeof(double));
+        bits &= lane;
+        std::memcpy(out + j, &bits, sizeof(double));
+    }
+}
+
+void BitMask::Apply(const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) const {
+    if ((backward_input.rows() != _samples) || (backward_input.cols() != _features)) {
+        throw std::invalid_argument("Shape of backward input does not match the bit mask.");
+    }
+    if (&backward_output != &backward_input) {
+        // only reallocates if the shape changes
+        backward_output.resize(_samples, _features);
+    }
+
+    for (int i=0; i<_features; i++) {
+        ApplyWords(_words.data() + (size_t)i*_wordsPerFeature,
+                   backward_input.data() + (size_t)i*_samples,
+                   backward_output.data() + (size_t)i*_samples,
+                   _samples);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef BIT_MASK_H_
+#define BIT_MASK_H_
+
+#include <cstdint>
+#include <Eigen/Dense>
+#include <vector>
+
+/************
+ * BIT MASK *
+ ************/
+
+/**
+    Packed bit mask of the positive entries of a (forward) matrix. It replaces the full forward input
+    of activations whose derivative only depends on the sign of the input (so far only relu): instead
+    of 64 bits per entry we only keep a single bit.
+
+    The mask is created from a forward matrix of shape (features, samples) with ~SetPositive~ and applied to
+    a backward matrix of shape (samples, features) with ~Apply~. Since Eigen stores matrices column major,
+    the bits are laid out to match the backward matrix: the bits of the i-th feature (i.e. the i-th column of
+    the backward matrix) are stored contiguously in ~WordsPerFeature()~ 64-bit words, one bit per sample.
+    In particular, ~Apply~ runs over contiguous memory which allows to use SIMD instructions.
+*/
+
+class BitMask {
+    private:
+        // number of features (rows of the forward matrix)
+        int _features;
+        // number of samples (cols of the forward matrix)
+        int _samples;
+        // number of 64-bit words per feature
+        int _wordsPerFeature;
+        // packed bits
+        std::vector<uint64_t> _words;
+
+    public:
+        // constructor
+        BitMask(): _features(0), _samples(0), _wordsPerFeature(0) {}
+
+        // getters
+        int Features() const { return _features; }
+        int Samples() const { return _samples; }
+        int WordsPerFeature() const { return _wordsPerFeature; }
+        // memory used by the packed bits
+        size_t Bytes() const { return _words.size()*sizeof(uint64_t); }
+        // bit of the i-th feature of the j-th sample
+        bool Get(int i, int j) const { return (_words[i*_wordsPerFeature + j/64] >> (j % 64)) & 1; }
+
+        // resize (only reallocates if the shape actually changes)
+        void Resize(int features, int samples);
+
+        // set bit (i, j) if and only if matrix(i, j) > 0 (resizes if necessary)
+        void SetPositive(const Eigen::MatrixXd& matrix);
+
+        // backward_output(j, i) = backward_input(j, i) if bit (i, j) is set and zero otherwise
+        // NOTE: backward_input and backward_output may be the same matrix
+        void Apply(const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) const;
+};
+
+#endif // BIT_MASK_H_
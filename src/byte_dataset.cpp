@@ -0,0 +1,123 @@
+#include <algorithm>
+#include "byte_dataset.h"
+#include <cmath>
+#include <cstdint>
+#include <Eigen/Dense>
+#include "mapped_file.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************
+ * BYTE DATASET *
+ ****************/
+
+// IDX data type of unsigned bytes
+static const uint8_t kIDXUnsignedByte = 0x08;
+
+// parse the IDX header of a mapped file: sizes of the dimensions, returns the offset of the data
+static size_t ParseIDXHeader(const MappedFile& file, std::vector<long>& dims) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.Data());
+    if ((file.Size() < 4) || (data[0] != 0) || (data[1] != 0)) {
+        throw std::runtime_error("File " + file.Path() + " is not an IDX file.");
+    }
+    if (data[2] != kIDXUnsignedByte) {
+        throw std::runtime_error("Only IDX files of unsigned bytes are supported (" + file.Path() + ").");
+    }
+    int d = data[3];
+    size_t offset = 4 + 4*(size_t)d;
+    if ((d == 0) || (file.Size() < offset)) {
+        throw std::runtime_error("IDX header of " + file.Path() + " is truncated.");
+    }
+    dims.resize(d);
+    size_t size = 1;
+    for (int k=0; k<d; k++) {
+        // big-endian
+        const uint8_t* p = data + 4 + 4*k;
+        dims[k] = ((long)p[0] << 24) | ((long)p[1] << 16) | ((long)p[2] << 8) | (long)p[3];
+        size *= dims[k];
+    }
+    if (file.Size() < offset + size) {
+        throw std::runtime_error("Data of IDX file " + file.Path() + " is truncated.");
+    }
+    return offset;
+}
+
+ByteDataset::ByteDataset(const std::string& imagesPath, const std::string& labelsPath):
+    _images(std::make_unique<MappedFile>(imagesPath)),
+    _labels(std::make_unique<MappedFile>(labelsPath))
+    {
+        std::vector<long> imageDims, labelDims;
+        _imagesOffset = ParseIDXHeader(*_images, imageDims);
+        _labelsOffset = ParseIDXHeader(*_labels, labelDims);
+        if (labelDims.size() != 1) {
+            throw std::runtime_error("Labels " + labelsPath + " have to be one-dimensional.");
+        }
+        if (imageDims[0] != labelDims[0]) {
+            throw std::runtime_error("Number of samples and labels do not coincide.");
+        }
+        _samples = imageDims[0];
+        _features = 1;
+        for (size_t k=1; k<imageDims.size(); k++) {
+            _features *= imageDims[k];
+        }
+    }
+
+Eigen::Map<const ByteDataset::ByteMatrix> ByteDataset::Samples() const {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(_images->Data()) + _imagesOffset;
+    return Eigen::Map<const ByteMatrix>(data, _features, _samples);
+}
+
+Eigen::Map<const ByteDataset::ByteRowVector> ByteDataset::Labels() const {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(_labels->Data()) + _labelsOffset;
+    return Eigen::Map<const ByteRowVector>(data, _samples);
+}
+
+void ByteDataset::Moments(double& mean, double& stddev) const {
+    // a histogram is exact and needs a single pass without floating point operations
+    std::vector<long> histogram(256, 0);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(_images->Data()) + _imagesOffset;
+    long size = _features*_samples;
+    for (long i=0; i<size; i++) {
+        histogram[data[i]]++;
+    }
+    double sum = 0;
+    double squares = 0;
+    for (int b=0; b<256; b++) {
+        double value = b/255.0;
+        sum += histogram[b]*value;
+        squares += histogram[b]*value*value;
+    }
+    mean = (size > 0) ? sum/size : 0.0;
+    stddev = (size > 0) ? std::sqrt(std::max(squares/size - mean*mean, 0.0)) : 0.0;
+}
+
+ByteNormalization ByteDataset::Standardization() const {
+    double mean, stddev;
+    Moments(mean, stddev);
+    if (stddev == 0) {
+        throw std::domain_error("Samples are constant and cannot be standardized.");
+    }
+    return ByteNormalization::Standardize(mean, stddev);
+}
+
+// NOTE: raw pointers and no function calls in the inner loop, so that the compiler vectorizes the conversion
+void ByteDataset::Gather(const long* indices, int count, const ByteNormalization& normalization, Eigen::MatrixXd& batch) const {
+    // only reallocates if the shape changes
+    batch.resize(_features, count);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(_images->Data()) + _imagesOffset;
+    const double scale = normalization.scale;
+    const double shift = normalization.shift;
+    const long features = _features;
+    for (int c=0; c<count; c++) {
+        if ((indices[c] < 0) || (indices[c] >= _samples)) {
+            throw std::out_of_range("Index of sample out of range.");
+        }
+        const uint8_t* __restrict in = data + indices[c]*features;
+        double* __restrict out = batch.data() + (long)c*features;
+        for (long i=0; i<features; i++) {
+            out[i] = in[i]*scale + shift;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef BYTE_DATASET_H_
+#define BYTE_DATASET_H_
+
+#include <cstdint>
+#include <Eigen/Dense>
+#include <memory>
+#include "mapped_file.h"
+#include <string>
+
+/****************
+ * BYTE DATASET *
+ ****************/
+
+/**
+    Data set of uint8 samples (e.g. images) and uint8 labels read directly from IDX files, the format of MNIST
+    (e.g. ~train-images-idx3-ubyte~ and ~train-labels-idx1-ubyte~). Both files are memory-mapped and the samples stay
+    uint8 (8x smaller than doubles) until a batch is assembled with ~Gather~, which converts the bytes of the
+    selected samples to doubles and normalizes them in a single vectorized loop: value = byte*scale + shift,
+    see ByteNormalization.
+
+    IDX format: two zero bytes, the data type (0x08 = uint8), the number of dimensions d, then d big-endian uint32
+    sizes followed by the data (row major, i.e. the last dimension is contiguous). The first dimension is the number
+    of samples, all further dimensions are flattened into the features of a sample. Since the bytes of a sample
+    are contiguous, ~Samples()~ is a features x samples matrix (samples as columns, the layout of SequentialNN).
+
+    Usage (see also ByteStream in data_stream.h):
+        ByteDataset mnist("train-images-idx3-ubyte", "train-labels-idx1-ubyte");
+        ByteStream stream(mnist, batchSize, ByteNormalization::Unit(), 10, seed);
+        sdg.Train(snn, stream, epochs);
+*/
+
+// affine normalization of bytes: byte*scale + shift
+struct ByteNormalization {
+    double scale;
+    double shift;
+
+    // raw values 0, ..., 255
+    static ByteNormalization None() { return {1.0, 0.0}; }
+    // values in [0, 1]
+    static ByteNormalization Unit() { return {1.0/255.0, 0.0}; }
+    // (byte/255 - mean)/stddev where mean and stddev refer to values in [0, 1] (e.g. 0.1307 and 0.3081 for MNIST)
+    static ByteNormalization Standardize(double mean, double stddev) { return {1.0/(255.0*stddev), -mean/stddev}; }
+};
+
+class ByteDataset {
+    public:
+        typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> ByteMatrix;
+        typedef Eigen::Matrix<uint8_t, 1, Eigen::Dynamic> ByteRowVector;
+
+    private:
+        std::unique_ptr<MappedFile> _images;
+        std::unique_ptr<MappedFile> _labels;
+        long _features;
+        long _samples;
+        // offsets of the data (after the IDX headers)
+        size_t _imagesOffset;
+        size_t _labelsOffset;
+
+    public:
+        // constructor: memory-map IDX files of samples and labels (throws std::runtime_error for invalid files)
+        ByteDataset(const std::string& imagesPath, const std::string& labelsPath);
+
+        // getters
+        long Features() const { return _features; }
+        long NumberOfSamples() const { return _samples; }
+        // size of samples and labels in bytes
+        size_t Bytes() const { return _features*_samples + _samples; }
+
+        // zero-copy views
+        Eigen::Map<const ByteMatrix> Samples() const;
+        Eigen::Map<const ByteRowVector> Labels() const;
+
+        // mean and standard deviation of all sample values scaled to [0, 1] (via a histogram of the bytes)
+        void Moments(double& mean, double& stddev) const;
+        // standardization with the moments of this data set
+        ByteNormalization Standardization() const;
+
+        // write the normalized samples with the given indices into the columns of batch
+        void Gather(const long* indices, int count, const ByteNormalization&, Eigen::MatrixXd& batch) const;
+};
+
+#endif // BYTE_DATASET_H_
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include "atomic_file.h"
+#include "checkpoint.h"
+#include <chrono>
+#include <cstring>
+#include <Eigen/Dense>
+#include <future>
+#include <iostream>
+#include "layer.h"
+#include "mapped_file.h"
+#include <memory>
+#include "optimizer.h"
+#include "parameter_block.h"
+#include "sequential_nn.h"
+#include <stdexcept>
+#include <string>
+#include "trace.h"
+#include "transformation.h"
+#include <utility>
+#include <vector>
+
+/**************
+ * CHECKPOINT *
+ **************/
+
+static const char kMagic[8] = {'S', 'N', 'N', 'C', 'K', 'P', 'T', '\0'};
+// NOTE: version 2 added the progress of Train; version 1 files have zeros in its header fields (padding)
+static const uint32_t kVersion = 2;
+// alignment of the layer records (a cache line)
+static const int64_t kRecordAlignment = 64;
+// alignment of the parameter and optimizer state arrays (a page, so that they can be mapped)
+static const int64_t kDataAlignment = 4096;
+
+static int64_t Align(int64_t offset, int64_t alignment) {
+    return (offset + alignment - 1)/alignment*alignment;
+}
+
+// copy a string into a fixed-size field (zero-terminated)
+static void CopyName(char* field, size_t size, const std::string& name) {
+    if (name.size() >= size) {
+        throw std::invalid_argument("Name " + name + " is too long for a checkpoint.");
+    }
+    std::memset(field, 0, size);
+    std::memcpy(field, name.data(), name.size());
+}
+
+// zero-terminated string of a fixed-size field
+static std::string ReadName(const char* field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
+
+// zero the bytes of buffer from position up to the given offset (padding)
+static void Pad(std::vector<char>& buffer, int64_t position, int64_t offset) {
+    std::memset(buffer.data() + position, 0, offset - position);
+}
+
+void Checkpoint::Serialize(SequentialNN& snn, Optimizer* optimizer, std::vector<char>& buffer) {
+    int stateBuffers = (optimizer != nullptr) ? optimizer->StateBuffers() : 0;
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.layers = snn.Length();
+    if (optimizer != nullptr) {
+        CopyName(header.optimizer, sizeof(header.optimizer), optimizer->Name());
+        header.learningRate = optimizer->LearningRate();
+        header.updates = optimizer->Updates();
+        header.stateBuffers = stateBuffers;
+    }
+    header.layersOffset = Align(sizeof(Header), kRecordAlignment);
+
+    // progress of Train (only if it can be resumed)
+    TrainingRecord training;
+    std::memset(&training, 0, sizeof(training));
+    std::string rngState;
+    int64_t offset = header.layersOffset + snn.Length()*(int64_t)sizeof(LayerRecord);
+    if ((optimizer != nullptr) && optimizer->Progress().resumable) {
+        const TrainingProgress& progress = optimizer->Progress();
+        training.loaderSeed = progress.loaderSeed;
+        training.batches = progress.batches;
+        training.rngStateSize = progress.rngState.size();
+        rngState = progress.rngState;
+        header.trainingOffset = Align(offset, kRecordAlignment);
+        offset = header.trainingOffset + sizeof(TrainingRecord) + rngState.size();
+    }
+
+    // layout of the records and the data
+    std::vector<LayerRecord> records(snn.Length());
+    offset = Align(offset, kDataAlignment);
+    for (int i=0; i<snn.Length(); i++) {
+        LayerRecord& record = records[i];
+        std::memset(&record, 0, sizeof(record));
+        std::shared_ptr<Transformation>& transformation = snn.GetLayer(i).GetTransformation();
+        record.rows = transformation->Rows();
+        record.cols = transformation->Cols();
+        if (std::dynamic_pointer_cast<LinearTransformation>(transformation) != nullptr) {
+            record.kind = kLinear;
+            int64_t bytes = ((int64_t)record.rows*record.cols + record.rows)*(int64_t)sizeof(double);
+            record.parametersOffset = offset;
+            offset = Align(offset + bytes, kDataAlignment);
+            for (int k=0; k<stateBuffers; k++) {
+                record.stateOffset[k] = offset;
+                offset = Align(offset + bytes, kDataAlignment);
+            }
+        } else if (std::dynamic_pointer_cast<ActivationTransformation>(transformation) != nullptr) {
+            record.kind = kActivation;
+            CopyName(record.activation, sizeof(record.activation), transformation->Type());
+        } else {
+            throw std::invalid_argument("Layer " + std::to_string(i) + " cannot be saved in a checkpoint.");
+        }
+    }
+
+    // only reallocates if the checkpoint grows; everything which is not copied below is padding
+    buffer.resize(offset);
+    char* data = buffer.data();
+    int64_t position = 0;
+    std::memcpy(data, &header, sizeof(header));
+    Pad(buffer, sizeof(header), header.layersOffset);
+    std::memcpy(data + header.layersOffset, records.data(), records.size()*sizeof(LayerRecord));
+    position = header.layersOffset + records.size()*sizeof(LayerRecord);
+    if (header.trainingOffset != 0) {
+        Pad(buffer, position, header.trainingOffset);
+        std::memcpy(data + header.trainingOffset, &training, sizeof(training));
+        std::memcpy(data + header.trainingOffset + sizeof(training), rngState.data(), rngState.size());
+        position = header.trainingOffset + sizeof(training) + rngState.size();
+    }
+    for (int i=0; i<snn.Length(); i++) {
+        const LayerRecord& record = records[i];
+        if (record.kind != kLinear) {
+            continue;
+        }
+        auto linear = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation());
+        Pad(buffer, position, record.parametersOffset);
+        int64_t bytes = linear->Parameters()->Size()*sizeof(double);
+        std::memcpy(data + record.parametersOffset, linear->Parameters()->Data(), bytes);
+        position = record.parametersOffset + bytes;
+        for (int k=0; (k<stateBuffers) && (record.stateOffset[k] != 0); k++) {
+            // same layout as the parameters: weights followed by bias
+            TrainableParameter weights = snn.GetLayer(i).Parameter(0, stateBuffers);
+            TrainableParameter bias = snn.GetLayer(i).Parameter(1, stateBuffers);
+            Pad(buffer, position, record.stateOffset[k]);
+            std::memcpy(data + record.stateOffset[k], weights.state[k], weights.size*sizeof(double));
+            std::memcpy(data + record.stateOffset[k] + weights.size*sizeof(double), bias.state[k], bias.size*sizeof(double));
+            position = record.stateOffset[k] + bytes;
+        }
+    }
+    Pad(buffer, position, offset);
+}
+
+void Checkpoint::WriteFile(const std::string& path, const std::vector<char>& buffer) {
+    AtomicFile file(path);
+    file.Write(buffer.data(), buffer.size());
+    file.Commit();
+}
+
+void Checkpoint::Save(const std::string& path, SequentialNN& snn, Optimizer* optimizer) {
+    std::vector<char> buffer;
+    Serialize(snn, optimizer, buffer);
+    WriteFile(path, buffer);
+}
+
+// header of a mapped checkpoint (validated)
+static Checkpoint::Header ValidatedHeader(const MappedFile& file) {
+    Checkpoint::Header header;
+    if (file.Size() < sizeof(header)) {
+        throw std::runtime_error("File " + file.Path() + " is too small for a checkpoint.");
+    }
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("File " + file.Path() + " is not a checkpoint.");
+    }
+    if ((header.version != 1) && (header.version != kVersion)) {
+        throw std::runtime_error("Version " + std::to_string(header.version) + " of checkpoint " + file.Path() + " is not supported.");
+    }
+    if ((header.layers == 0) || (header.stateBuffers > 2) || (header.layersOffset < (int64_t)sizeof(header))
+        || ((uint64_t)header.layersOffset + header.layers*sizeof(Checkpoint::LayerRecord) > file.Size())) {
+        throw std::runtime_error("Checkpoint " + file.Path() + " is truncated or corrupted.");
+    }
+    return header;
+}
+
+Checkpoint::Header Checkpoint::ReadHeader(const std::string& path) {
+    return ValidatedHeader(MappedFile(path));
+}
+
+SequentialNN Checkpoint::Load(const std::string& path, Optimizer* optimizer, bool map) {
+    // NOTE: the mapping is only writable (copy-on-write) if the parameters are used in place
+    auto file = std::make_shared<MappedFile>(path, map);
+    Header header = ValidatedHeader(*file);
+    std::string optimizerName = ReadName(header.optimizer, sizeof(header.optimizer));
+    if (optimizer != nullptr) {
+        if (optimizerName.empty()) {
+            throw std::runtime_error("Checkpoint " + path + " does not contain an optimizer state.");
+        }
+        if ((optimizerName != optimizer->Name()) || ((int)header.stateBuffers != optimizer->StateBuffers())) {
+            throw std::invalid_argument("Checkpoint " + path + " contains the state of a different optimizer (" + optimizerName + ").");
+        }
+    }
+
+    std::vector<LayerRecord> records(header.layers);
+    std::memcpy(records.data(), file->Data() + header.layersOffset, header.layers*sizeof(LayerRecord));
+    std::vector<LayerVariant> layers;
+    for (const LayerRecord& record: records) {
+        if ((record.rows <= 0) || (record.cols <= 0)) {
+            throw std::runtime_error("Checkpoint " + path + " contains a layer of invalid shape.");
+        }
+        if (record.kind == kActivation) {
+            if (record.rows != record.cols) {
+                throw std::runtime_error("Checkpoint " + path + " contains an activation layer of invalid shape.");
+            }
+            layers.push_back(ActivationLayer(record.rows, ReadName(record.activation, sizeof(record.activation))));
+            continue;
+        }
+        if (record.kind != kLinear) {
+            throw std::runtime_error("Checkpoint " + path + " contains an unknown kind of layer.");
+        }
+        long size = (long)record.rows*record.cols + record.rows;
+        for (int64_t offset: {record.parametersOffset, record.stateOffset[0], record.stateOffset[1]}) {
+            if ((offset < 0) || (offset % sizeof(double) != 0) || ((uint64_t)offset + size*sizeof(double) > file->Size())) {
+                throw std::runtime_error("Checkpoint " + path + " is truncated or corrupted.");
+            }
+        }
+        std::shared_ptr<ParameterBlock> block;
+        if (map) {
+            block = std::make_shared<ParameterBlock>(file, record.parametersOffset, size);
+        } else {
+            block = std::make_shared<ParameterBlock>(size);
+            std::memcpy(block->Data(), file->Data() + record.parametersOffset, size*sizeof(double));
+        }
+        // NOTE: moved, so that the block is not shared (which would copy it on the first write, see ParameterBlock)
+        LinearLayer layer(std::make_shared<LinearTransformation>(record.rows, record.cols, std::move(block)));
+        // optimizer state is copied (it is written by each update anyway)
+        for (int k=0; (optimizer != nullptr) && (k<(int)header.stateBuffers) && (record.stateOffset[k] != 0); k++) {
+            TrainableParameter weights = layer.Parameter(0, header.stateBuffers);
+            TrainableParameter bias = layer.Parameter(1, header.stateBuffers);
+            const char* data = file->Data() + record.stateOffset[k];
+            std::memcpy(weights.state[k], data, weights.size*sizeof(double));
+            std::memcpy(bias.state[k], data + weights.size*sizeof(double), bias.size*sizeof(double));
+        }
+        layers.push_back(std::move(layer));
+    }
+    if (optimizer != nullptr) {
+        optimizer->SetLearningRate(header.learningRate);
+        optimizer->SetUpdates(header.updates);
+        if (header.trainingOffset != 0) {
+            TrainingRecord training;
+            if ((header.trainingOffset < 0) || ((uint64_t)header.trainingOffset + sizeof(training) > file->Size())) {
+                throw std::runtime_error("Checkpoint " + path + " is truncated or corrupted.");
+            }
+            std::memcpy(&training, file->Data() + header.trainingOffset, sizeof(training));
+            if ((training.rngStateSize < 0) 
+                || ((uint64_t)header.trainingOffset + sizeof(training) + training.rngStateSize > file->Size())) {
+                throw std::runtime_error("Checkpoint " + path + " is truncated or corrupted.");
+            }
+            TrainingProgress progress;
+            progress.resumable = true;
+            progress.loaderSeed = training.loaderSeed;
+            progress.batches = training.batches;
+            progress.rngState = std::string(file->Data() + header.trainingOffset + sizeof(training), training.rngStateSize);
+            optimizer->Resume(progress);
+        }
+    }
+    return SequentialNN(layers, false);
+}
+
+
+/************************
+ * CHECKPOINT SCHEDULER *
+ ************************/
+
+CheckpointScheduler::CheckpointScheduler(const std::string& path, long interval):
+    _path(path),
+    _interval(interval),
+    _steps(0),
+    _optimizer(nullptr),
+    _writeSeconds(0.0)
+    {
+        if (interval <= 0) {
+            throw std::invalid_argument("Interval of checkpoints has to be positive.");
+        }
+    }
+
+CheckpointScheduler::~CheckpointScheduler() {
+    Detach();
+    // NOTE: destructors must not throw, so errors of the last write are only reported
+    try {
+        Finish();
+    } catch (const std::exception& error) {
+        std::cerr << "Checkpoint " << _path << " failed: " << error.what() << std::endl;
+    }
+}
+
+void CheckpointScheduler::Attach(Optimizer& optimizer) {
+    Detach();
+    _optimizer = &optimizer;
+    optimizer.SetStepCallback([this](SequentialNN& snn) {
+        if (++_steps % _interval == 0) {
+            Snapshot(snn, _optimizer);
+        }
+    });
+}
+
+void CheckpointScheduler::Detach() {
+    if (_optimizer != nullptr) {
+        _optimizer->SetStepCallback(nullptr);
+        _optimizer = nullptr;
+    }
+}
+
+void CheckpointScheduler::Finish() {
+    if (_pending.valid()) {
+        _writeSeconds += _pending.get();
+    }
+}
+
+void CheckpointScheduler::Snapshot(SequentialNN& snn, Optimizer* optimizer) {
+    TraceScope scope("checkpoint snapshot", "checkpoint");
+    auto start = std::chrono::steady_clock::now();
+    // the staging buffer is free once the previous checkpoint is written
+    Finish();
+    Checkpoint::Serialize(snn, optimizer, _buffer);
+    _pending = std::async(std::launch::async, [this]() {
+        Trace::SetThreadName("checkpoint writer");
+        TraceScope scope("checkpoint write", "checkpoint");
+        auto start = std::chrono::steady_clock::now();
+        Checkpoint::WriteFile(_path, _buffer);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+    _stallSeconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void CheckpointScheduler::Wait() {
+    Finish();
+}
@@ -0,0 +1,168 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <future>
+#include "optimizer.h"
+#include "sequential_nn.h"
+#include <string>
+#include <vector>
+
+/**************
+ * CHECKPOINT *
+ **************/
+
+/**
+    Versioned binary checkpoints of a SequentialNN (and optionally the state of its Optimizer):
+        Checkpoint::Save("model.ckpt", snn, &adam);
+        SequentialNN snn = Checkpoint::Load("model.ckpt", &adam);
+
+    ~Load~ memory-maps the file by default: the weights and biases of the LinearLayers are used in place (see
+    ParameterBlock), i.e. they are neither copied nor read before they are used. Hence loading a large model only
+    takes the time to create its layers, and several processes loading the same checkpoint share the physical pages.
+    The mapping is copy-on-write, so the loaded network can be trained further without modifying the file. With
+    ~map~ false, the parameters are read into memory instead.
+
+    If the optimizer is inside ~Train~ (e.g. when a CheckpointScheduler saves the checkpoint), its progress (see
+    TrainingProgress) is saved as well and ~Load~ lets the optimizer resume it: the next ~Train~ (with the same data
+    and epochs) continues with the next batch and gives exactly the same result as an uninterrupted run.
+
+    Format (native byte order, version 2):
+        * Header: magic "SNNCKPT", version, number of layers, optimizer (name, learning rate, number of updates and
+          state arrays; empty name if no optimizer state is saved), offset of the TrainingRecord (zero if none)
+        * one LayerRecord per layer: kind (linear/activation), shape, activation and the offsets of the parameters
+          (weights in column-major order followed by the bias) and their optimizer state arrays (same layout)
+        * TrainingRecord followed by the state of the random number generator of the optimizer (text), if any
+        * the parameters and state arrays, each aligned to a page (so that the pages of different layers are
+          independent when the mapping is written)
+    Version 1 (without the progress of Train) can still be loaded.
+
+    ~Save~ writes to a temporary file which is synced to disk and renamed afterwards, so a checkpoint is always
+    complete (and processes which mapped the old file keep their version).
+*/
+
+class Checkpoint {
+    public:
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t layers;
+            char optimizer[32];
+            double learningRate;
+            int64_t updates;
+            uint32_t stateBuffers;
+            uint32_t reserved;
+            int64_t layersOffset;
+            // since version 2
+            int64_t trainingOffset;
+        };
+
+        struct LayerRecord {
+            uint32_t kind;
+            int32_t rows;
+            int32_t cols;
+            uint32_t reserved;
+            char activation[32];
+            // offsets in the file (zero if not present)
+            int64_t parametersOffset;
+            int64_t stateOffset[2];
+        };
+
+        struct TrainingRecord {
+            uint32_t loaderSeed;
+            uint32_t reserved;
+            int64_t batches;
+            int64_t rngStateSize;
+        };
+
+        enum LayerKind: uint32_t { kLinear = 0, kActivation = 1 };
+
+        // write snn (and the state of optimizer if not nullptr) to path
+        // NOTE: throws std::invalid_argument for layers which are neither linear nor activation layers
+        static void Save(const std::string& path, SequentialNN& snn, Optimizer* optimizer=nullptr);
+
+        // restore a network (and the state of optimizer, which has to be of the same kind, if not nullptr)
+        // NOTE: throws std::runtime_error for invalid files
+        static SequentialNN Load(const std::string& path, Optimizer* optimizer=nullptr, bool map=true);
+
+        // header of a checkpoint (e.g. to check the version)
+        static Header ReadHeader(const std::string& path);
+
+        // the two parts of ~Save~: write the checkpoint into buffer (only reallocates if it grows) and write buffer
+        // to path (synced to disk and renamed atomically)
+        static void Serialize(SequentialNN& snn, Optimizer* optimizer, std::vector<char>& buffer);
+        static void WriteFile(const std::string& path, const std::vector<char>& buffer);
+};
+
+
+/************************
+ * CHECKPOINT SCHEDULER *
+ ************************/
+
+/**
+    Periodic checkpoints during ~Optimizer::Train~ which do not block the training:
+        CheckpointScheduler scheduler("model.ckpt", 100); // every 100 updates
+        scheduler.Attach(sdg);
+        sdg.Train(snn, X, yLabel, epochs);
+        scheduler.Wait();
+
+    Between two steps, ~Snapshot~ copies the network, the optimizer state and the progress of Train into a staging
+    buffer (see ~Checkpoint::Serialize~), which is then written to disk on a background thread (synced and renamed
+    atomically) while the training continues. If the previous checkpoint is still being written, the snapshot waits
+    for it. The time the training thread was stalled is reported for each checkpoint (~StallSeconds~).
+
+    Resuming (e.g. after a crash): ~Checkpoint::Load(path, &sdg)~ and the same call of ~sdg.Train~.
+
+    NOTE: errors of the background thread are rethrown by the next ~Snapshot~ or ~Wait~. The optimizer it is attached
+    to has to outlive the scheduler.
+*/
+
+class CheckpointScheduler {
+    private:
+        std::string _path;
+        // checkpoint every _interval updates
+        long _interval;
+        long _steps;
+        Optimizer* _optimizer;
+
+        // staging buffer (only used by the background thread while a write is pending)
+        std::vector<char> _buffer;
+        // pending write (returns the time it took in seconds)
+        std::future<double> _pending;
+
+        // statistics
+        std::vector<double> _stallSeconds;
+        double _writeSeconds;
+
+        // wait for the pending write (if any)
+        void Finish();
+
+    public:
+        // constructor
+        CheckpointScheduler(const std::string& path, long interval);
+        // destructor (waits for the pending write and detaches from the optimizer)
+        ~CheckpointScheduler();
+
+        // no copies
+        CheckpointScheduler(const CheckpointScheduler&) = delete;
+        CheckpointScheduler& operator=(const CheckpointScheduler&) = delete;
+
+        // take snapshots every interval updates of Train of the optimizer (see ~Optimizer::SetStepCallback~)
+        void Attach(Optimizer&);
+        void Detach();
+
+        // checkpoint of snn (and optimizer if not nullptr) now, written in the background
+        void Snapshot(SequentialNN& snn, Optimizer* optimizer);
+        // wait until the last checkpoint is written
+        void Wait();
+
+        // getters
+        const std::string& Path() { return _path; }
+        long Checkpoints() { return _stallSeconds.size(); }
+        // time (in seconds) the training thread was stalled by each checkpoint
+        const std::vector<double>& StallSeconds() { return _stallSeconds; }
+        // total time (in seconds) the background thread wrote checkpoints (of finished writes)
+        double WriteSeconds() { return _writeSeconds; }
+};
+
+#endif // CHECKPOINT_H_
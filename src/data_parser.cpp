@@ -1,14 +1,249 @@
 #include <Eigen/Dense>
 #include "data_parser.h"
+#include <algorithm>
+#include <charconv>
 #include <cmath>
+#include <cstring>
+#include "dataset.h"
+#include <filesystem>
 #include <vector>
 #include <fstream>
+#include "mapped_file.h"
+#include <stdexcept>
+#include <string>
+#include "thread_pool.h"
 
-Eigen::MatrixXd DataParser::OneHotEncoder(const Eigen::RowVectorXd& vector, int max) {
+Eigen::MatrixXd DataParser::OneHotEncoder(const Eigen::Ref<const Eigen::RowVectorXd>& vector, int max) {
         Eigen::MatrixXd oneHotEncoded = Eigen::MatrixXd::Zero(max+1, vector.size());
         for (int i=0; i<vector.size(); i++) {
             int j = (int)vector(i);
             oneHotEncoded(j, i) = 1.0; // conversion should be ok; or is ther an issue with e.g. 5 saved as 4.99999999?
         }
         return oneHotEncoded;
-    }
\ No newline at end of file
+    }
+
+Eigen::RowVectorXi DataParser::ClassIndices(const Eigen::Ref<const Eigen::RowVectorXd>& labels, int max) {
+    Eigen::RowVectorXi classes(labels.size());
+    for (long i=0; i<labels.size(); i++) {
+        // labels are parsed from text, so they are exact integers
+        double label = labels(i);
+        if ((label != std::floor(label)) || (label < 0) || (label > max)) {
+            throw std::invalid_argument("Label " + std::to_string(label) + " is not a class index in [0, " + std::to_string(max) + "].");
+        }
+        classes(i) = (int)label;
+    }
+    return classes;
+}
+
+
+/***********************
+ * PARALLEL CSV LOADER *
+ ***********************/
+
+// chunks are at least this many bytes (smaller files are parsed by a single thread)
+const size_t kMinChunkBytes = 1 << 16;
+
+static bool IsBlank(char c) {
+    return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+// end of the line starting at begin (position of '\n' or end)
+static const char* LineEnd(const char* begin, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+    return (newline == nullptr) ? end : newline;
+}
+
+// true if the line only consists of blanks (such lines are skipped)
+static bool IsEmptyLine(const char* begin, const char* end) {
+    while ((begin < end) && IsBlank(*begin)) {
+        begin++;
+    }
+    return begin == end;
+}
+
+// number of cells of the first non-empty line
+static int CountCells(const char* begin, const char* end) {
+    while (begin < end) {
+        const char* line_end = LineEnd(begin, end);
+        if (!IsEmptyLine(begin, line_end)) {
+            return std::count(begin, line_end, ',') + 1;
+        }
+        begin = line_end + 1;
+    }
+    return 0;
+}
+
+// parse the cells of a line into values (the j-th cell is written to target(j)), returns an error message (or "")
+template<typename Target>
+static std::string ParseLine(const char* p, const char* end, int cells, Target target) {
+    for (int j=0; j<cells; j++) {
+        while ((p < end) && IsBlank(*p)) {
+            p++;
+        }
+        // NOTE: std::from_chars does not accept a leading plus sign
+        if ((p < end) && (*p == '+')) {
+            p++;
+        }
+        double value;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) {
+            return "cell " + std::to_string(j) + " is not a number";
+        }
+        target(j, value);
+        p = result.ptr;
+        while ((p < end) && IsBlank(*p)) {
+            p++;
+        }
+        if (j < cells-1) {
+            if ((p == end) || (*p != ',')) {
+                return "expected " + std::to_string(cells) + " cells but found " + std::to_string(j+1);
+            }
+            p++;
+        }
+    }
+    if (p != end) {
+        return "more than " + std::to_string(cells) + " cells";
+    }
+    return "";
+}
+
+/**
+    Parses the csv-file in parallel: the file is split into chunks at line boundaries, then
+        1. the non-empty lines of each chunk are counted (in parallel) to get the index of the first line of each chunk,
+        2. ~allocate(lines, cells)~ preallocates the output,
+        3. each chunk is parsed (in parallel) and the j-th cell of the i-th line is written with ~store(i, j, value)~.
+*/
+template<typename Allocate, typename Store>
+static void ParseCSVParallel(const std::string& path, Allocate allocate, Store store) {
+    MappedFile file(path);
+    const char* begin = file.Data();
+    const char* end = begin + file.Size();
+    int cells = CountCells(begin, end);
+
+    // split into chunks (a few per thread for load balancing) at line boundaries
+    ThreadPool& pool = ThreadPool::Global();
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(4*pool.NumThreads(), file.Size()/kMinChunkBytes));
+    std::vector<const char*> bounds(chunks + 1, end);
+    bounds[0] = begin;
+    for (size_t k=1; k<chunks; k++) {
+        const char* split = std::max(begin + k*(file.Size()/chunks), bounds[k-1]);
+        bounds[k] = (split >= end) ? end : std::min(end, LineEnd(split, end) + 1);
+    }
+
+    // first line of each chunk
+    std::vector<long> first(chunks + 1, 0);
+    pool.ParallelFor(0, chunks, 1, [&](long chunk_begin, long chunk_end) {
+        for (long k=chunk_begin; k<chunk_end; k++) {
+            long lines = 0;
+            for (const char* line = bounds[k]; line < bounds[k+1]; ) {
+                const char* line_end = LineEnd(line, bounds[k+1]);
+                lines += !IsEmptyLine(line, line_end);
+                line = line_end + 1;
+            }
+            first[k+1] = lines;
+        }
+    });
+    for (size_t k=0; k<chunks; k++) {
+        first[k+1] += first[k];
+    }
+    allocate(first[chunks], cells);
+
+    // parse (errors are collected per chunk, so that the first invalid line of the file is reported)
+    std::vector<std::string> errors(chunks);
+    pool.ParallelFor(0, chunks, 1, [&](long chunk_begin, long chunk_end) {
+        for (long k=chunk_begin; k<chunk_end; k++) {
+            long i = first[k];
+            for (const char* line = bounds[k]; line < bounds[k+1]; ) {
+                const char* line_end = LineEnd(line, bounds[k+1]);
+                if (!IsEmptyLine(line, line_end)) {
+                    std::string error = ParseLine(line, line_end, cells, [&](int j, double value) { store(i, j, value); });
+                    if (!error.empty()) {
+                        errors[k] = "Line " + std::to_string(i+1) + " (non-empty) of " + path + ": " + error;
+                        break;
+                    }
+                    i++;
+                }
+                line = line_end + 1;
+            }
+        }
+    });
+    for (const std::string& error: errors) {
+        if (!error.empty()) {
+            throw std::invalid_argument(error);
+        }
+    }
+}
+
+Eigen::MatrixXd DataParser::LoadCSVColumns(const std::string& path) {
+    Eigen::MatrixXd matrix;
+    double* data = nullptr;
+    long rows = 0;
+    ParseCSVParallel(path,
+        [&](long lines, int cells) {
+            matrix.resize(cells, lines);
+            data = matrix.data();
+            rows = cells;
+        },
+        // column major: the i-th line is the contiguous i-th column
+        [&](long i, int j, double value) { data[i*rows + j] = value; });
+    return matrix;
+}
+
+void DataParser::LoadSamplesLabels(const std::string& path, Eigen::MatrixXd& samples, Eigen::RowVectorXd& labels) {
+    double* samples_data = nullptr;
+    double* labels_data = nullptr;
+    long rows = 0;
+    ParseCSVParallel(path,
+        [&](long lines, int cells) {
+            if ((lines > 0) && (cells < 2)) {
+                throw std::invalid_argument("Each line of " + path + " needs a label and at least one feature.");
+            }
+            samples.resize(std::max(cells-1, 0), lines);
+            labels.resize(lines);
+            samples_data = samples.data();
+            labels_data = labels.data();
+            rows = samples.rows();
+        },
+        [&](long i, int j, double value) {
+            if (j == 0) {
+                labels_data[i] = value;
+            } else {
+                samples_data[i*rows + j-1] = value;
+            }
+        });
+}
+
+
+/*********************
+ * DATASET (SIDECAR) *
+ *********************/
+
+Dataset DataParser::LoadDataset(const std::string& path) {
+    // identify the version of the csv-file by its size and modification time
+    std::filesystem::path csv(path);
+    int64_t size = std::filesystem::file_size(csv);
+    int64_t time = std::filesystem::last_write_time(csv).time_since_epoch().count();
+    std::string sidecar = SidecarPath(path);
+
+    // reuse the sidecar if it is up to date (a corrupted or outdated one is simply replaced)
+    std::error_code error;
+    if (std::filesystem::exists(sidecar, error)) {
+        try {
+            Dataset dataset(sidecar);
+            const Dataset::Header& header = dataset.GetHeader();
+            if ((header.sourceSize == size) && (header.sourceTime == time) && (header.labelColumn == 0)) {
+                return dataset;
+            }
+        } catch (const std::runtime_error&) {}
+    }
+
+    Eigen::MatrixXd samples;
+    Eigen::RowVectorXd labels;
+    LoadSamplesLabels(path, samples, labels);
+    try {
+        Dataset::Write(sidecar, samples, labels, 0, size, time);
+        return Dataset(sidecar);
+    } catch (const std::runtime_error&) {
+        return Dataset(std::move(samples), std::move(labels));
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef _DATA_PARSER_H_
 #define _DATA_PARSER_H_
 
+#include "byte_dataset.h"
+#include "dataset.h"
 #include <Eigen/Dense>
 #include <fstream>
 #include <memory>
@@ -11,8 +13,19 @@
     Class to parse data from a csv-file and one-hot-encode the data. At the moment with very limited functionality since we focus on 
     neural networks for now. 
     
+    There are two ways to load a csv-file (one sample per line, cells separated by commas):
+        * ~LoadCSV~: reads the file line by line (row-major, as in the file), simple but slow
+        * ~LoadCSVColumns~/~LoadSamplesLabels~: memory-maps the file (see MappedFile), splits it at line boundaries
+          into chunks and parses the chunks in parallel on the global ThreadPool with std::from_chars. The values are
+          written straight into a preallocated matrix with the samples as columns (the layout of SequentialNN), i.e.
+          no intermediate vector and no transposition. Cells which are not numbers are rejected
+          (std::invalid_argument with the line).
+    ~LoadDataset~ additionally caches the parsed file in a binary sidecar (see Dataset) next to the csv-file, e.g.
+    ~train.csv.snn~ for ~train.csv~. As long as the size and modification time of the csv-file do not change, later
+    calls only memory-map the sidecar instead of parsing the csv-file again.
+    ~LoadIDX~ reads the original MNIST files (IDX format) without any text parsing, see ByteDataset.
+
     TODO: possible to add:
-    + rejecting non-convertible values
     + option of how to read data from file (e.g. exchange rows and cols?)
     + iterator for data?
     + if more functionality will be added: split class into parser (only loading csv-file) and transfomer (one-hot-encode)
@@ -46,9 +59,28 @@ class DataParser {
             return Eigen::Map<const Eigen::Matrix<typename M::Scalar, M::RowsAtCompileTime, M::ColsAtCompileTime, Eigen::RowMajor> >(values.data(), rows, values.size()/rows);
         }
 
+        // parallel loader: the i-th (non-empty) line of the csv-file becomes the i-th column
+        // NOTE: throws std::invalid_argument if a cell is not a number or the lines have a different number of cells
+        Eigen::MatrixXd LoadCSVColumns(const std::string& path);
+        // parallel loader for files whose first cell in each line is the label: the remaining cells of the i-th line
+        // become the i-th column of samples and the first cell the i-th entry of labels
+        void LoadSamplesLabels(const std::string& path, Eigen::MatrixXd& samples, Eigen::RowVectorXd& labels);
+
+        // load a csv-file with the label in the first column via its binary sidecar (created/updated if necessary)
+        // NOTE: if the sidecar cannot be written (e.g. read-only directory), the data set is kept in memory
+        Dataset LoadDataset(const std::string& path);
+        // path of the binary sidecar of a csv-file
+        static std::string SidecarPath(const std::string& path) { return path + ".snn"; }
+
+        // IDX files of samples and labels (e.g. MNIST), memory-mapped and kept as uint8 (see ByteDataset and ByteStream)
+        ByteDataset LoadIDX(const std::string& imagesPath, const std::string& labelsPath) { return ByteDataset(imagesPath, labelsPath); }
+
         // one-hot-encoder of an int (column) vector with values in [0, max]
         // TODO: sparse matrix better?
-        Eigen::MatrixXd OneHotEncoder(const Eigen::RowVectorXd& vector, int max); 
+        Eigen::MatrixXd OneHotEncoder(const Eigen::Ref<const Eigen::RowVectorXd>& vector, int max); 
+        // class indices of labels with (integral) values in [0, max], e.g. for training without one-hot-encoding
+        // (see Optimizer::Train); throws std::invalid_argument for other values
+        Eigen::RowVectorXi ClassIndices(const Eigen::Ref<const Eigen::RowVectorXd>& labels, int max);
 };
 
 #endif
\ No newline at end of file
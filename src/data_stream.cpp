@@ -0,0 +1,235 @@
+#include "byte_dataset.h"
+#include "data_parser.h"
+#include "data_stream.h"
+#include "dataset.h"
+#include <algorithm>
+#include <chrono>
+#include <Eigen/Dense>
+#include <exception>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "trace.h"
+#include <utility>
+#include <vector>
+
+/****************
+ * SHARD STREAM *
+ ****************/
+
+ShardStream::ShardStream(std::vector<std::string> shards, int batchSize, int window, int classes, unsigned seed):
+    _shards(std::move(shards)),
+    _batchSize(batchSize),
+    _window(window),
+    _classes(classes),
+    _features(0),
+    _rng(seed),
+    _shardOrder(_shards.size()),
+    _inEpoch(false),
+    _windowIndex(0),
+    _position(0),
+    _waitSeconds(0.0)
+    {
+        if (_shards.empty()) {
+            throw std::invalid_argument("No shards given.");
+        }
+        if ((batchSize <= 0) || (window <= 0) || (classes < 0)) {
+            throw std::invalid_argument("Batch size and window have to be positive, the number of classes non-negative.");
+        }
+        // dimension of the samples (NOTE: only the header of a binary shard is read here)
+        _features = LoadShard(_shards[0])->Features();
+        _batch.resize(_features, batchSize);
+        _batchLabel.resize(std::max(classes, 1), batchSize);
+        // first window of the first epoch
+        std::iota(_shardOrder.begin(), _shardOrder.end(), 0);
+        std::shuffle(_shardOrder.begin(), _shardOrder.end(), _rng);
+        Prefetch(0);
+    }
+
+ShardStream::~ShardStream() {
+    if (_prefetch.valid()) {
+        _prefetch.wait();
+    }
+}
+
+std::unique_ptr<Dataset> ShardStream::LoadShard(const std::string& path) {
+    // csv-files via their binary sidecar, so that they are only parsed once
+    if ((path.size() >= 4) && (path.compare(path.size() - 4, 4, ".csv") == 0)) {
+        DataParser dp;
+        return std::make_unique<Dataset>(dp.LoadDataset(path));
+    }
+    return std::make_unique<Dataset>(path);
+}
+
+void ShardStream::Prefetch(int windowIndex) {
+    std::vector<std::string> paths;
+    for (int k=windowIndex*_window; k<std::min<int>((windowIndex+1)*_window, _shards.size()); k++) {
+        paths.push_back(_shards[_shardOrder[k]]);
+    }
+    // NOTE: the background thread only works on its own copies (paths, seed)
+    unsigned seed = _rng();
+    long features = _features;
+    _prefetch = std::async(std::launch::async, [paths, seed, features]() {
+        Trace::SetThreadName("shard prefetch");
+        TraceScope scope("load shards", "data");
+        ShardWindow window;
+        for (int s=0; s<(int)paths.size(); s++) {
+            window.datasets.push_back(LoadShard(paths[s]));
+            if (window.datasets.back()->Features() != features) {
+                throw std::invalid_argument("Shard " + paths[s] + " has a different number of features.");
+            }
+            for (long j=0; j<window.datasets.back()->NumberOfSamples(); j++) {
+                window.order.emplace_back(s, j);
+            }
+        }
+        // shuffle the samples of all shards of the window together
+        std::mt19937 rng(seed);
+        std::shuffle(window.order.begin(), window.order.end(), rng);
+        return window;
+    });
+}
+
+void ShardStream::TakePrefetched() {
+    TraceScope scope("wait for shards", "data");
+    auto start = std::chrono::steady_clock::now();
+    // release the current shards before taking the next ones
+    _current = ShardWindow();
+    try {
+        _current = _prefetch.get();
+    } catch (...) {
+        // NOTE: the future is invalid after get, so keep the error for the next calls of Next
+        _error = std::current_exception();
+        throw;
+    }
+    _position = 0;
+    _waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ShardStream::Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) {
+    if (_error) {
+        std::rethrow_exception(_error);
+    }
+    if (!_inEpoch) {
+        TakePrefetched();
+        _windowIndex = 0;
+        _inEpoch = true;
+        if (NumberOfWindows() > 1) {
+            Prefetch(1);
+        }
+    }
+
+    // gather the samples of the batch (possibly from two consecutive windows)
+    int count = 0;
+    while (count < _batchSize) {
+        if (_position == _current.order.size()) {
+            if (_windowIndex + 1 >= NumberOfWindows()) {
+                break;
+            }
+            TakePrefetched();
+            _windowIndex++;
+            if (_windowIndex + 1 < NumberOfWindows()) {
+                Prefetch(_windowIndex + 1);
+            }
+            continue;
+        }
+        if (count == 0) {
+            // only reallocates after the (smaller) last batch of an epoch
+            _batch.resize(_features, _batchSize);
+            _batchLabel.resize(_batchLabel.rows(), _batchSize);
+        }
+        const std::pair<int, long>& sample = _current.order[_position++];
+        const Dataset& dataset = *(_current.datasets[sample.first]);
+        _batch.col(count) = dataset.Samples().col(sample.second);
+        double label = dataset.Labels()(sample.second);
+        if (_classes == 0) {
+            _batchLabel(0, count) = label;
+        } else {
+            if ((label < 0) || (label >= _classes)) {
+                throw std::out_of_range("Label " + std::to_string(label) + " exceeds the number of classes.");
+            }
+            _batchLabel.col(count).setZero();
+            _batchLabel((int)label, count) = 1.0;
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        // end of the epoch: release the shards, shuffle and prefetch the first window of the next epoch
+        _current = ShardWindow();
+        _inEpoch = false;
+        std::shuffle(_shardOrder.begin(), _shardOrder.end(), _rng);
+        Prefetch(0);
+        return false;
+    }
+    if (count < _batchSize) {
+        _batch.conservativeResize(Eigen::NoChange, count);
+        _batchLabel.conservativeResize(Eigen::NoChange, count);
+    }
+    batch = &_batch;
+    batchLabel = &_batchLabel;
+    return true;
+}
+
+
+/***************
+ * BYTE STREAM *
+ ***************/
+
+ByteStream::ByteStream(const ByteDataset& dataset, int batchSize, ByteNormalization normalization, int classes, unsigned seed):
+    _dataset(dataset),
+    _batchSize(batchSize),
+    _normalization(normalization),
+    _classes(classes),
+    _rng(seed),
+    _permutation(dataset.NumberOfSamples()),
+    _position(0),
+    _inEpoch(false)
+    {
+        if ((batchSize <= 0) || (classes < 0)) {
+            throw std::invalid_argument("Batch size has to be positive, the number of classes non-negative.");
+        }
+        std::iota(_permutation.begin(), _permutation.end(), 0);
+        _batch.resize(dataset.Features(), batchSize);
+        _batchLabel.resize(std::max(classes, 1), batchSize);
+    }
+
+bool ByteStream::Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) {
+    if (!_inEpoch) {
+        // shuffle once per epoch
+        std::shuffle(_permutation.begin(), _permutation.end(), _rng);
+        _position = 0;
+        _inEpoch = true;
+    }
+    int count = std::min<long>(_batchSize, _permutation.size() - _position);
+    if (count == 0) {
+        _inEpoch = false;
+        return false;
+    }
+    // convert and normalize the samples in one pass (the last batch of an epoch might be smaller)
+    TraceScope scope("gather batch", "data");
+    _dataset.Gather(_permutation.data() + _position, count, _normalization, _batch);
+    Eigen::Map<const ByteDataset::ByteRowVector> labels = _dataset.Labels();
+    if (_classes == 0) {
+        _batchLabel.resize(1, count);
+        for (int c=0; c<count; c++) {
+            _batchLabel(0, c) = labels(_permutation[_position + c]);
+        }
+    } else {
+        _batchLabel.setZero(_classes, count);
+        for (int c=0; c<count; c++) {
+            int label = labels(_permutation[_position + c]);
+            if (label >= _classes) {
+                throw std::out_of_range("Label " + std::to_string(label) + " exceeds the number of classes.");
+            }
+            _batchLabel(label, c) = 1.0;
+        }
+    }
+    _position += count;
+
+    batch = &_batch;
+    batchLabel = &_batchLabel;
+    return true;
+}
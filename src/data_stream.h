@@ -0,0 +1,156 @@
+#ifndef DATA_STREAM_H_
+#define DATA_STREAM_H_
+
+#include "byte_dataset.h"
+#include "dataset.h"
+#include <Eigen/Dense>
+#include <exception>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/***************
+ * DATA STREAM *
+ ***************/
+
+/**
+    Streams of (mini-)batches for training on data sets which do not fit into memory (see ~Optimizer::Train~).
+    A stream hands out the batches of an epoch with ~Next~ until it returns false; the next call of ~Next~ starts
+    the next epoch. The batches (samples as columns) and their labels are valid until the next call of ~Next~.
+
+    The abstract base class only defines the interface, the concrete implementations are
+        * ~ShardStream~: the data set is split into shards, i.e. files in the binary Dataset format or csv-files
+          (label in the first column, cached in their binary sidecar, see ~DataParser::LoadDataset~).
+        * ~ByteStream~: shuffled batches of a ByteDataset (e.g. MNIST in IDX format) which stays uint8 in memory;
+          the samples of a batch are converted and normalized when the batch is assembled (see ~ByteDataset::Gather~).
+
+    ShardStream keeps the memory bounded independently of the size of the data set: at most ~window~ shards are
+    used at a time and the next ~window~ shards are loaded (memory-mapped) on a background thread in the meantime,
+    i.e. at most 2*window shards are resident. Shuffling happens at two levels: the order of the shards is shuffled
+    in each epoch and the samples of the ~window~ shards used at a time are shuffled together. Hence each sample is
+    contained in exactly one batch per epoch (the last batch of an epoch might be smaller). If a window cannot be loaded
+    (e.g. a missing shard), ~Next~ throws the error of the background thread, also in all further calls.
+
+    Usage:
+        ShardStream stream({"train_0.bin", "train_1.bin", "train_2.bin"}, batchSize, window, classes, seed);
+        sdg.Train(snn, stream, epochs);
+*/
+
+/***********************
+ * ABSTRACT BASE CLASS *
+ ***********************/
+
+class DataStream {
+    public:
+        // virtual destructor
+        virtual ~DataStream() {}
+
+        // next batch of the current epoch (false at the end of an epoch)
+        virtual bool Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) = 0;
+
+        // getters
+        virtual int BatchSize() = 0;
+        // dimension of a sample
+        virtual long Features() = 0;
+        // time (in seconds) ~Next~ waited for data
+        virtual double WaitSeconds() { return 0.0; }
+};
+
+
+/****************
+ * SHARD STREAM *
+ ****************/
+
+class ShardStream: public DataStream {
+    private:
+        // shards used together (and the shuffled order of their samples as (shard, column))
+        struct ShardWindow {
+            std::vector<std::unique_ptr<Dataset> > datasets;
+            std::vector<std::pair<int, long> > order;
+        };
+
+        std::vector<std::string> _shards;
+        int _batchSize;
+        int _window;
+        // labels are one-hot-encoded with this many classes (raw labels as a single row if zero)
+        int _classes;
+        long _features;
+        std::mt19937 _rng;
+
+        // shuffled order of the shards in the current epoch
+        std::vector<int> _shardOrder;
+        bool _inEpoch;
+        // current window (index and next position in its order)
+        int _windowIndex;
+        ShardWindow _current;
+        size_t _position;
+        // next window (loaded on a background thread)
+        std::future<ShardWindow> _prefetch;
+        // error of loading a window (rethrown by all further calls of Next)
+        std::exception_ptr _error;
+
+        // batch buffers
+        Eigen::MatrixXd _batch;
+        Eigen::MatrixXd _batchLabel;
+        double _waitSeconds;
+
+        int NumberOfWindows() { return (_shards.size() + _window - 1)/_window; }
+        // load the shards of the given window of the current epoch (on a background thread)
+        void Prefetch(int windowIndex);
+        // wait for the prefetched window and make it the current one
+        void TakePrefetched();
+        // load a single shard
+        static std::unique_ptr<Dataset> LoadShard(const std::string& path);
+
+    public:
+        // constructor (the first window is loaded in the background right away)
+        ShardStream(std::vector<std::string> shards, int batchSize, int window, int classes, unsigned seed);
+        // destructor (waits for the background thread)
+        ~ShardStream();
+
+        bool Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) override;
+
+        int BatchSize() override { return _batchSize; }
+        long Features() override { return _features; }
+        double WaitSeconds() override { return _waitSeconds; }
+        int WindowSize() { return _window; }
+};
+
+
+/***************
+ * BYTE STREAM *
+ ***************/
+
+class ByteStream: public DataStream {
+    private:
+        // NOTE: only referenced, so it has to outlive the stream
+        const ByteDataset& _dataset;
+        int _batchSize;
+        ByteNormalization _normalization;
+        // labels are one-hot-encoded with this many classes (raw labels as a single row if zero)
+        int _classes;
+        std::mt19937 _rng;
+
+        // shuffled order of the samples in the current epoch and next position
+        std::vector<long> _permutation;
+        long _position;
+        bool _inEpoch;
+
+        // batch buffers
+        Eigen::MatrixXd _batch;
+        Eigen::MatrixXd _batchLabel;
+
+    public:
+        // constructor
+        ByteStream(const ByteDataset& dataset, int batchSize, ByteNormalization normalization, int classes, unsigned seed);
+
+        bool Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) override;
+
+        int BatchSize() override { return _batchSize; }
+        long Features() override { return _dataset.Features(); }
+};
+
+#endif // DATA_STREAM_H_
@@ -0,0 +1,109 @@
+#include "atomic_file.h"
+#include "dataset.h"
+#include <cstring>
+#include <Eigen/Dense>
+#include "mapped_file.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/***********
+ * DATASET *
+ ***********/
+
+static const char kMagic[8] = {'S', 'N', 'N', 'D', 'A', 'T', 'A', '\0'};
+static const uint32_t kVersion = 1;
+static const uint32_t kFloat64 = 0;
+// alignment of samples and labels in the binary file
+static const int64_t kAlignment = 64;
+
+static int64_t Align(int64_t offset) {
+    return (offset + kAlignment - 1)/kAlignment*kAlignment;
+}
+
+// header with offsets for the given shape
+static Dataset::Header CreateHeader(int64_t features, int64_t samples, int labelColumn, int64_t sourceSize, int64_t sourceTime) {
+    Dataset::Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.dtype = kFloat64;
+    header.features = features;
+    header.samples = samples;
+    header.labelColumn = labelColumn;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.samplesOffset = Align(sizeof(Dataset::Header));
+    header.labelsOffset = Align(header.samplesOffset + features*samples*(int64_t)sizeof(double));
+    return header;
+}
+
+Dataset::Dataset(Eigen::MatrixXd samples, Eigen::RowVectorXd labels):
+    _header(CreateHeader(samples.rows(), samples.cols(), 0, 0, 0)),
+    _samples(std::move(samples)),
+    _labels(std::move(labels))
+    {
+        if (_samples.cols() != _labels.size()) {
+            throw std::invalid_argument("Number of samples and labels do not coincide.");
+        }
+    }
+
+Dataset::Dataset(const std::string& path):
+    _file(std::make_unique<MappedFile>(path))
+    {
+        if (_file->Size() < sizeof(Header)) {
+            throw std::runtime_error("File " + path + " is too small for a data set.");
+        }
+        std::memcpy(&_header, _file->Data(), sizeof(Header));
+        if ((std::memcmp(_header.magic, kMagic, sizeof(kMagic)) != 0) || (_header.version != kVersion)) {
+            throw std::runtime_error("File " + path + " is not a data set (or has an unsupported version).");
+        }
+        if (_header.dtype != kFloat64) {
+            throw std::runtime_error("Data type of data set " + path + " is not supported.");
+        }
+        Header expected = CreateHeader(_header.features, _header.samples, _header.labelColumn, 0, 0);
+        int64_t size = expected.labelsOffset + _header.samples*(int64_t)sizeof(double);
+        if ((_header.features < 0) || (_header.samples < 0) || (_header.samplesOffset != expected.samplesOffset)
+            || (_header.labelsOffset != expected.labelsOffset) || ((int64_t)_file->Size() < size)) {
+            throw std::runtime_error("Data set " + path + " is truncated or corrupted.");
+        }
+    }
+
+void Dataset::Write(const std::string& path, const Eigen::Ref<const Eigen::MatrixXd>& samples,
+                    const Eigen::Ref<const Eigen::RowVectorXd>& labels, int labelColumn, int64_t sourceSize, int64_t sourceTime) {
+    if (samples.cols() != labels.size()) {
+        throw std::invalid_argument("Number of samples and labels do not coincide.");
+    }
+    Header header = CreateHeader(samples.rows(), samples.cols(), labelColumn, sourceSize, sourceTime);
+    // NOTE: concurrent conversions of the same CSV file write into different temporary files (see AtomicFile)
+    AtomicFile out(path);
+    const char zeros[kAlignment] = {};
+    out.Write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.Write(zeros, header.samplesOffset - sizeof(header));
+    // NOTE: Ref may have an outer stride, so write column by column
+    for (long j=0; j<samples.cols(); j++) {
+        out.Write(reinterpret_cast<const char*>(samples.col(j).data()), samples.rows()*sizeof(double));
+    }
+    out.Write(zeros, header.labelsOffset - header.samplesOffset - samples.size()*(int64_t)sizeof(double));
+    for (long j=0; j<labels.size(); j++) {
+        double label = labels(j);
+        out.Write(reinterpret_cast<const char*>(&label), sizeof(double));
+    }
+    out.Commit();
+}
+
+Eigen::Map<const Eigen::MatrixXd> Dataset::Samples() const {
+    if (!Mapped()) {
+        return Eigen::Map<const Eigen::MatrixXd>(_samples.data(), _samples.rows(), _samples.cols());
+    }
+    const double* data = reinterpret_cast<const double*>(_file->Data() + _header.samplesOffset);
+    return Eigen::Map<const Eigen::MatrixXd>(data, _header.features, _header.samples);
+}
+
+Eigen::Map<const Eigen::RowVectorXd> Dataset::Labels() const {
+    if (!Mapped()) {
+        return Eigen::Map<const Eigen::RowVectorXd>(_labels.data(), _labels.size());
+    }
+    const double* data = reinterpret_cast<const double*>(_file->Data() + _header.labelsOffset);
+    return Eigen::Map<const Eigen::RowVectorXd>(data, _header.samples);
+}
@@ -0,0 +1,84 @@
+#ifndef DATASET_H_
+#define DATASET_H_
+
+#include <cstdint>
+#include <Eigen/Dense>
+#include <memory>
+#include "mapped_file.h"
+#include <string>
+
+/***********
+ * DATASET *
+ ***********/
+
+/**
+    Data set of samples (as columns, the layout of SequentialNN) and their labels (one number per sample). The data
+    is either kept in memory or memory-mapped from a binary file, in both cases ~Samples()~ and ~Labels()~ are
+    zero-copy Eigen::Map views which can be passed directly to the optimizers (see ~Optimizer::Train~).
+
+    Binary format (native byte order, see ~Header~):
+        * header: magic number, version, dtype (so far only float64), number of features and samples, the column
+          of the labels in the original csv-file and the size and modification time of the csv-file (to decide
+          whether the binary file is still up to date, see ~DataParser::LoadDataset~)
+        * samples: features x samples doubles, column major (i.e. sample by sample), at ~samplesOffset~
+        * labels: samples doubles at ~labelsOffset~
+    Both offsets are multiples of 64 bytes (cache line), so the mapped data is suitably aligned for SIMD.
+
+    Usage:
+        Dataset::Write("train.bin", samples, labels);
+        Dataset data("train.bin"); // memory-mapped, pages are loaded lazily
+        sdg.Train(snn, data.Samples(), dp.ClassIndices(data.Labels(), 9), epochs);
+*/
+
+class Dataset {
+    public:
+        // header of the binary format
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            // 0: float64 (so far the only one)
+            uint32_t dtype;
+            int64_t features;
+            int64_t samples;
+            // column of the labels in the csv-file
+            int32_t labelColumn;
+            uint32_t reserved;
+            // size and modification time of the csv-file the data set was created from (zero if none)
+            int64_t sourceSize;
+            int64_t sourceTime;
+            // byte offsets of samples and labels
+            int64_t samplesOffset;
+            int64_t labelsOffset;
+        };
+
+    private:
+        // binary file (nullptr if the data is kept in memory)
+        std::unique_ptr<MappedFile> _file;
+        Header _header;
+        // data in memory (only if not mapped)
+        Eigen::MatrixXd _samples;
+        Eigen::RowVectorXd _labels;
+
+    public:
+        // constructor: data set in memory
+        Dataset(Eigen::MatrixXd samples, Eigen::RowVectorXd labels);
+        // constructor: memory-map a binary file (throws std::runtime_error if it is not a valid data set)
+        explicit Dataset(const std::string& path);
+
+        // write data set to a binary file (atomically: written to a temporary file which is renamed afterwards)
+        static void Write(const std::string& path, const Eigen::Ref<const Eigen::MatrixXd>& samples,
+                          const Eigen::Ref<const Eigen::RowVectorXd>& labels, int labelColumn=0,
+                          int64_t sourceSize=0, int64_t sourceTime=0);
+
+        // getters
+        bool Mapped() const { return _file != nullptr; }
+        const Header& GetHeader() const { return _header; }
+        long Features() const { return _header.features; }
+        long NumberOfSamples() const { return _header.samples; }
+
+        // zero-copy views
+        Eigen::Map<const Eigen::MatrixXd> Samples() const;
+        Eigen::Map<const Eigen::RowVectorXd> Labels() const;
+};
+
+#endif // DATASET_H_
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+#include "execution_plan.h"
+#include "layer.h"
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "transformation.h"
+#include <vector>
+
+/***********
+ * KERNELS *
+ ***********/
+
+namespace {
+
+using Call = ExecutionPlan::Call;
+
+// NOTE: the forward buffers are rows x batch, the gradients batch x rows (column-major, see LayerCache)
+
+// activations which are applied to each entry separately (F provides Apply and Derivative at the forward output)
+template<typename F>
+struct Elementwise {
+    // out = f(in + bias) with in and out rows x batch (may coincide), bias may be nullptr
+    static void Forward(const double* in, const double* bias, double* out, int rows, long batch) {
+        for (long j=0; j<batch; j++) {
+            const double* x = in + j*rows;
+            double* y = out + j*rows;
+            if (bias == nullptr) {
+                for (int i=0; i<rows; i++) {
+                    y[i] = F::Apply(x[i]);
+                }
+            } else {
+                for (int i=0; i<rows; i++) {
+                    y[i] = F::Apply(x[i] + bias[i]);
+                }
+            }
+        }
+    }
+    // out = g*f'(x) with the derivative given by the forward output y, g and out are batch x rows (may coincide)
+    static void Backward(const double* y, const double* g, double* out, int rows, long batch) {
+        for (int i=0; i<rows; i++) {
+            for (long j=0; j<batch; j++) {
+                out[i*batch + j] = g[i*batch + j]*F::Derivative(y[j*rows + i]);
+            }
+        }
+    }
+};
+
+struct Identity: Elementwise<Identity> {
+    static constexpr const char* kName = "identity";
+    static constexpr const char* kMatrixName = "gemm";
+    static constexpr const char* kVectorName = "gemv";
+    static double Apply(double x) { return x; }
+    static double Derivative(double) { return 1.0; }
+    // nothing to do in place
+    static void Backward(const double*, const double* g, double* out, int rows, long batch) {
+        if (g != out) {
+            std::copy(g, g + rows*batch, out);
+        }
+    }
+};
+
+struct Relu: Elementwise<Relu> {
+    static constexpr const char* kName = "relu";
+    static constexpr const char* kMatrixName = "gemm+relu";
+    static constexpr const char* kVectorName = "gemv+relu";
+    static double Apply(double x) { return (x > 0) ? x : 0.0; }
+    // the output is positive iff the input is
+    static double Derivative(double y) { return (y > 0) ? 1.0 : 0.0; }
+};
+
+struct Sigmoid: Elementwise<Sigmoid> {
+    static constexpr const char* kName = "sigmoid";
+    static constexpr const char* kMatrixName = "gemm+sigmoid";
+    static constexpr const char* kVectorName = "gemv+sigmoid";
+    static double Apply(double x) { return 1/(1 + std::exp(-x)); }
+    static double Derivative(double y) { return y*(1 - y); }
+};
+
+struct Tanh: Elementwise<Tanh> {
+    static constexpr const char* kName = "tanh";
+    static constexpr const char* kMatrixName = "gemm+tanh";
+    static constexpr const char* kVectorName = "gemv+tanh";
+    static double Apply(double x) { return std::tanh(x); }
+    static double Derivative(double y) { return 1 - y*y; }
+};
+
+// softmax of each sample (same as ActivationTransformation)
+struct Softmax {
+    static constexpr const char* kName = "softmax";
+    static constexpr const char* kMatrixName = "gemm+softmax";
+    static constexpr const char* kVectorName = "gemv+softmax";
+    static void Forward(const double* in, const double* bias, double* out, int rows, long batch) {
+        for (long j=0; j<batch; j++) {
+            const double* x = in + j*rows;
+            double* y = out + j*rows;
+            for (int i=0; i<rows; i++) {
+                y[i] = (bias == nullptr) ? x[i] : x[i] + bias[i];
+            }
+            // substract the max coefficient for numerical stability
+            double correction = *std::max_element(y, y + rows);
+            double sum = 0;
+            for (int i=0; i<rows; i++) {
+                y[i] = std::exp(y[i] - correction);
+                sum += y[i];
+            }
+            for (int i=0; i<rows; i++) {
+                y[i] /= sum;
+            }
+        }
+    }
+    // (g - <g, s>)*s for each sample with the forward output s
+    static void Backward(const double* y, const double* g, double* out, int rows, long batch) {
+        for (long j=0; j<batch; j++) {
+            const double* s = y + j*rows;
+            double inner = 0;
+            for (int i=0; i<rows; i++) {
+                inner += g[i*batch + j]*s[i];
+            }
+            for (int i=0; i<rows; i++) {
+                out[i*batch + j] = (g[i*batch + j] - inner)*s[i];
+            }
+        }
+    }
+};
+
+// W*x + b followed by the activation (single pass over the output after the product)
+template<typename Activation, bool kVector>
+void LinearForward(const Call& call, long batch, bool) {
+    Eigen::Map<const Eigen::MatrixXd> weights(call.weights, call.rows, call.cols);
+    if (kVector) {
+        Eigen::Map<Eigen::VectorXd>(call.output, call.rows).noalias()
+            = weights*Eigen::Map<const Eigen::VectorXd>(call.input, call.cols);
+    } else {
+        Eigen::Map<Eigen::MatrixXd>(call.output, call.rows, batch).noalias()
+            = weights*Eigen::Map<const Eigen::MatrixXd>(call.input, call.cols, batch);
+    }
+    Activation::Forward(call.output, call.bias, call.output, call.rows, batch);
+}
+
+// backward pass of the activation in place, then the Deltas and the backward output of the LinearLayer
+template<typename Activation>
+void LinearBackward(const Call& call, long batch, bool deltas) {
+    Activation::Backward(call.forwardOutput, call.gradient, call.gradient, call.rows, batch);
+    Eigen::Map<const Eigen::MatrixXd> gradient(call.gradient, batch, call.rows);
+    if (deltas && (call.deltaWeights != nullptr)) {
+        Eigen::Map<Eigen::MatrixXd>(call.deltaWeights, call.rows, call.cols).noalias()
+            += gradient.transpose()*Eigen::Map<const Eigen::MatrixXd>(call.input, call.cols, batch).transpose();
+        Eigen::Map<Eigen::VectorXd>(call.deltaBias, call.rows).noalias() += gradient.colwise().sum().transpose();
+    }
+    Eigen::Map<Eigen::MatrixXd>(call.output, batch, call.cols).noalias()
+        = gradient*Eigen::Map<const Eigen::MatrixXd>(call.weights, call.rows, call.cols);
+}
+
+// activation which does not follow a LinearLayer
+template<typename Activation>
+void ActivationForward(const Call& call, long batch, bool) {
+    Activation::Forward(call.input, nullptr, call.output, call.rows, batch);
+}
+
+template<typename Activation>
+void ActivationBackward(const Call& call, long batch, bool) {
+    Activation::Backward(call.forwardOutput, call.gradient, call.output, call.rows, batch);
+}
+
+template<typename Activation>
+void Bind(bool linear, bool vector, Call& forward, Call& backward) {
+    if (linear) {
+        forward.kernel = vector ? &LinearForward<Activation, true> : &LinearForward<Activation, false>;
+        forward.name = vector ? Activation::kVectorName : Activation::kMatrixName;
+        backward.kernel = &LinearBackward<Activation>;
+    } else {
+        forward.kernel = &ActivationForward<Activation>;
+        forward.name = Activation::kName;
+        backward.kernel = &ActivationBackward<Activation>;
+    }
+    backward.name = forward.name;
+}
+
+// kernels of a call (false if there are none for the activation)
+bool SelectKernels(const std::string& activation, bool linear, bool vector, Call& forward, Call& backward) {
+    if (activation == "identity") {
+        Bind<Identity>(linear, vector, forward, backward);
+    } else if (activation == "relu") {
+        Bind<Relu>(linear, vector, forward, backward);
+    } else if (activation == "sigmoid") {
+        Bind<Sigmoid>(linear, vector, forward, backward);
+    } else if (activation == "tanh") {
+        Bind<Tanh>(linear, vector, forward, backward);
+    } else if (activation == "softmax") {
+        Bind<Softmax>(linear, vector, forward, backward);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool IsActivation(const std::string& type) {
+    return (type == "identity") || (type == "relu") || (type == "sigmoid") || (type == "tanh") || (type == "softmax");
+}
+
+// buffers start at cache line boundaries
+long Padded(long size) {
+    return (size + 7)/8*8;
+}
+
+}  // namespace
+
+
+/******************
+ * EXECUTION PLAN *
+ ******************/
+
+ExecutionPlan::ExecutionPlan(std::vector<LayerVariant>& layers, int maxBatch, Mode mode):
+    _mode(mode),
+    _maxBatch(maxBatch),
+    _batch(0),
+    _inputSize(0),
+    _backwardInput(nullptr)
+    {
+        if (maxBatch <= 0) {
+            throw std::invalid_argument("Maximal batch size has to be positive.");
+        }
+        if (layers.empty()) {
+            throw std::invalid_argument("Layers are empty.");
+        }
+        _inputSize = AsLayer(layers[0]).Cols();
+
+        // group the layers into calls (a LinearLayer takes the following activation with it)
+        bool vector = (maxBatch == 1);
+        for (int i=0; i<(int)layers.size(); ) {
+            Layer& layer = AsLayer(layers[i]);
+            std::string type = layer.GetTransformation()->Type();
+            bool linear = (type == "LinearTransformation");
+            Call forward = {};
+            forward.layer = i;
+            forward.layers = 1;
+            forward.rows = layer.Rows();
+            forward.cols = layer.Cols();
+            std::string activation = type;
+            if (linear) {
+                LinearTransformation& transformation = static_cast<LinearTransformation&>(*layer.GetTransformation());
+                if (mode == Mode::kTraining) {
+                    // NOTE: the parameters are written by the optimizer, so they are detached before they are bound
+                    // (see LinearTransformation::Detach)
+                    forward.deltaWeights = layer.Parameter(0, 0).delta;
+                    forward.deltaBias = layer.Parameter(1, 0).delta;
+                }
+                forward.weights = std::as_const(transformation).Weights().data();
+                forward.bias = std::as_const(transformation).Bias().data();
+                _bindings.push_back({(int)_forward.size(), &transformation, transformation.Parameters().get()});
+                activation = "identity";
+                if ((i + 1 < (int)layers.size()) && IsActivation(AsLayer(layers[i+1]).GetTransformation()->Type())) {
+                    activation = AsLayer(layers[i+1]).GetTransformation()->Type();
+                    forward.layers = 2;
+                    forward.rows = AsLayer(layers[i+1]).Rows();
+                }
+            }
+            Call backward = forward;
+            if (!SelectKernels(activation, linear, vector, forward, backward)) {
+                throw std::invalid_argument("Layer " + std::to_string(i) + " (" + type + ") cannot be compiled.");
+            }
+            _forward.push_back(forward);
+            _backward.push_back(backward);
+            i += forward.layers;
+        }
+        int calls = _forward.size();
+
+        // plan the arena: forward buffer c is the input of call c, gradient c the backward output of call c
+        // (gradient calls is the backward input of the network)
+        std::vector<long> forwardOffsets(calls);
+        std::vector<long> gradientOffsets(calls + 1);
+        long size = 0;
+        if (mode == Mode::kInference) {
+            long slot = 0;
+            for (const Call& call: _forward) {
+                slot = std::max(slot, Padded((long)call.cols*maxBatch));
+            }
+            for (int c=0; c<calls; c++) {
+                forwardOffsets[c] = (c % 2)*slot;
+            }
+            size = std::min(calls, 2)*slot;
+        } else {
+            long slot = Padded((long)_forward.back().rows*maxBatch);
+            for (int c=0; c<calls; c++) {
+                forwardOffsets[c] = size;
+                size += Padded((long)_forward[c].cols*maxBatch);
+                slot = std::max(slot, Padded((long)_forward[c].cols*maxBatch));
+            }
+            for (int c=0; c<=calls; c++) {
+                gradientOffsets[c] = size + (c % 2)*slot;
+            }
+            size += 2*slot;
+        }
+        _arena.assign(size, 0.0);
+
+        // bind the buffers (the output of the last call is bound by BindOutput)
+        double* arena = _arena.data();
+        for (int c=0; c<calls; c++) {
+            _forward[c].input = arena + forwardOffsets[c];
+            _forward[c].output = (c + 1 < calls) ? arena + forwardOffsets[c+1] : nullptr;
+            Call& backward = _backward[c];
+            backward.input = _forward[c].input;
+            backward.forwardOutput = _forward[c].output;
+            backward.gradient = arena + gradientOffsets[c+1];
+            backward.output = arena + gradientOffsets[c];
+        }
+        _backwardInput = arena + gradientOffsets[calls];
+        // backward pass from the last call to the first one
+        std::reverse(_backward.begin(), _backward.end());
+        if (mode == Mode::kInference) {
+            _backward.clear();
+            _backwardInput = nullptr;
+        }
+        _output.resize(_forward.back().rows, 0);
+    }
+
+void ExecutionPlan::Rebind() {
+    for (Binding& binding: _bindings) {
+        if (binding.transformation->Parameters().get() == binding.parameters) {
+            continue;
+        }
+        const LinearTransformation& transformation = *binding.transformation;
+        binding.parameters = binding.transformation->Parameters().get();
+        Call& forward = _forward[binding.call];
+        forward.weights = transformation.Weights().data();
+        forward.bias = transformation.Bias().data();
+        if (!_backward.empty()) {
+            Call& backward = _backward[_backward.size() - 1 - binding.call];
+            backward.weights = forward.weights;
+            backward.bias = forward.bias;
+        }
+    }
+}
+
+void ExecutionPlan::BindOutput() {
+    _forward.back().output = _output.data();
+    if (!_backward.empty()) {
+        _backward.front().forwardOutput = _output.data();
+    }
+}
+
+// NOTE: the output is only reallocated if the batch size changes
+void ExecutionPlan::Input(const Eigen::Ref<const Eigen::MatrixXd>& input) {
+    if (input.rows() != _inputSize) {
+        throw std::invalid_argument("Input size does not match the network.");
+    }
+    if ((input.cols() <= 0) || (input.cols() > _maxBatch)) {
+        throw std::invalid_argument("Batch size has to be positive and at most the maximal batch size of the plan.");
+    }
+    _batch = input.cols();
+    Eigen::Map<Eigen::MatrixXd>(_arena.data(), _inputSize, _batch) = input;
+    if (_output.cols() != _batch) {
+        _output.resize(_output.rows(), _batch);
+        BindOutput();
+    }
+}
+
+void ExecutionPlan::BackwardInput(const Eigen::Ref<const Eigen::MatrixXd>& backward_input) {
+    if (_mode != Mode::kTraining) {
+        throw std::invalid_argument("Plan is compiled for inference (no backward pass).");
+    }
+    if ((backward_input.rows() != _batch) || (backward_input.cols() != _output.rows())) {
+        throw std::domain_error("Backward input does not match the forward pass.");
+    }
+    Eigen::Map<Eigen::MatrixXd>(_backwardInput, _batch, _output.rows()) = backward_input;
+}
+
+Eigen::MatrixXd ExecutionPlan::BackwardOutput() const {
+    if (_mode != Mode::kTraining) {
+        throw std::invalid_argument("Plan is compiled for inference (no backward pass).");
+    }
+    return Eigen::Map<const Eigen::MatrixXd>(_backward.back().output, _batch, _inputSize);
+}
+
+std::string ExecutionPlan::ModeName(Mode mode) {
+    return (mode == Mode::kInference) ? "inference" : "training";
+}
+
+std::string ExecutionPlan::Summary() const {
+    std::ostringstream summary;
+    summary << "Execution plan (" << ModeName(_mode) << ", batches of at most " << _maxBatch << " samples):\n";
+    for (const Call& call: _forward) {
+        summary << "layer " << call.layer;
+        if (call.layers > 1) {
+            summary << "-" << call.layer + call.layers - 1;
+        }
+        summary << ": " << call.name << " " << call.rows << "x" << call.cols << "\n";
+    }
+    summary << "arena: " << _arena.size() << " doubles (" << _arena.size()*8/1024 << " KB)\n";
+    return summary.str();
+}
@@ -0,0 +1,137 @@
+#ifndef EXECUTION_PLAN_H_
+#define EXECUTION_PLAN_H_
+
+#include <Eigen/Dense>
+#include "layer.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/******************
+ * EXECUTION PLAN *
+ ******************/
+
+/**
+    Compiled form of the layers of a SequentialNN (see ~SequentialNN::Compile~). The layer by layer passes resolve
+    virtual calls and the (string) types of the transformations, check the pointers of the LayerCaches and resize
+    their buffers in every step. The plan does all of this once for a fixed topology and a maximal batch size:
+        * Fusion: a LinearLayer followed by an ActivationLayer becomes a single call, which adds the bias and applies
+          the activation in one pass over the result of the matrix product (no separate buffer for the
+          pre-activation). The backward pass of the activation uses the forward output instead of the forward input
+          (relu: y > 0, sigmoid: y*(1-y), tanh: 1-y^2, softmax as before), so only one buffer per pair is kept.
+        * Kernels: each call gets a kernel specialized for its activation (no function pointer per element) and
+          shape (matrix-vector products if the maximal batch size is one).
+        * Memory: all buffers live in one arena which is allocated by the constructor. Its layout is planned with the
+          lifetimes of the buffers: in inference mode only two buffers are alive at a time (the input and output of
+          the current call), in training mode the forward outputs are kept for the backward pass, whose gradients
+          again alternate between two buffers.
+        * Calls: the forward and backward passes are flat vectors of ~Call~s, i.e. kernels with their arguments
+          (raw pointers into the arena and to the parameters and Deltas of the layers) bound at compile time.
+          A pass is a plain loop over these calls.
+
+    The output of the last call is kept in a separate matrix (see ~Output~), which is only reallocated if the batch
+    size changes (like the LayerCaches). The Deltas are accumulated into the Deltas of the layers, so the optimizers
+    work with compiled networks without changes.
+
+    NOTE: the plan keeps raw pointers to the parameters and Deltas of the layers, i.e. it has to be recompiled if
+    the layers are replaced. Parameter blocks which are replaced by copy-on-write are picked up by ~Rebind~.
+*/
+
+class ExecutionPlan {
+    public:
+        // inference plans only support the forward pass (and need less memory)
+        enum class Mode { kInference = 0, kTraining = 1 };
+
+        // kernel with its arguments (a fused pair of layers or a single layer)
+        // NOTE: the backward input (gradient) is batch x rows like in the LayerCaches and overwritten by the kernel
+        struct Call {
+            void (*kernel)(const Call&, long batch, bool deltas);
+            // forward: input (cols x batch) and output (rows x batch)
+            // backward: forward input and output of the call, backward input (gradient) and output (batch x cols)
+            const double* input;
+            double* output;
+            const double* forwardOutput;
+            double* gradient;
+            // parameters and Deltas of the LinearLayer (nullptr for activations)
+            const double* weights;
+            const double* bias;
+            double* deltaWeights;
+            double* deltaBias;
+            int rows;
+            int cols;
+            // first layer and number of layers of the call (e.g. for the profiler)
+            int layer;
+            int layers;
+            // e.g. "gemm+relu"
+            const char* name;
+        };
+
+    private:
+        Mode _mode;
+        int _maxBatch;
+        long _batch;
+        int _inputSize;
+        std::vector<Call> _forward;
+        std::vector<Call> _backward;
+        // buffers of the calls (see above)
+        std::vector<double, Eigen::aligned_allocator<double> > _arena;
+        // output of the last call (rows x batch)
+        Eigen::MatrixXd _output;
+        // backward input of the last call in the arena (batch x rows)
+        double* _backwardInput;
+
+        // parameter block each LinearLayer call was bound to (see ~Rebind~)
+        struct Binding {
+            int call;
+            LinearTransformation* transformation;
+            const ParameterBlock* parameters;
+        };
+        std::vector<Binding> _bindings;
+
+        // rebind the calls to the output (after it has been resized)
+        void BindOutput();
+
+    public:
+        // compile the layers (throws std::invalid_argument for layers without a kernel)
+        ExecutionPlan(std::vector<LayerVariant>&, int maxBatch, Mode);
+        // the calls point into the arena
+        ExecutionPlan(const ExecutionPlan&) = delete;
+        ExecutionPlan& operator=(const ExecutionPlan&) = delete;
+
+        // getters
+        Mode GetMode() const { return _mode; }
+        int MaxBatch() const { return _maxBatch; }
+        long Batch() const { return _batch; }
+        long ArenaSize() const { return _arena.size(); }
+        const std::vector<Call>& ForwardCalls() const { return _forward; }
+        const std::vector<Call>& BackwardCalls() const { return _backward; }
+        // one line per call
+        std::string Summary() const;
+
+        // rebind the calls to the parameters of the layers whose parameter block was replaced since the compilation
+        // (copy-on-write, see LinearTransformation::Detach); cheap if nothing changed (one comparison per call)
+        void Rebind();
+
+        // forward pass
+        // NOTE: the input is copied into the arena and sets the batch size (at most ~MaxBatch~)
+        void Input(const Eigen::Ref<const Eigen::MatrixXd>&);
+        void Forward() {
+            for (const Call& call: _forward) {
+                call.kernel(call, _batch, false);
+            }
+        }
+        Eigen::MatrixXd& Output() { return _output; }
+
+        // backward pass (training mode only), optionally adding the Deltas of the batch to the ones of the layers
+        void BackwardInput(const Eigen::Ref<const Eigen::MatrixXd>&);
+        void Backward(bool accumulateDeltas) {
+            for (const Call& call: _backward) {
+                call.kernel(call, _batch, accumulateDeltas);
+            }
+        }
+        Eigen::MatrixXd BackwardOutput() const;
+
+        static std::string ModeName(Mode);
+};
+
+#endif // EXECUTION_PLAN_H_
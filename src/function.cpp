@@ -30,7 +30,7 @@ double relu(double x) {
 }
 
 double relu_derivative(double x) {
-    return prelu_derivative(x, 1.0);
+    return prelu_derivative(x, 0.0);
 }
 
 double sigmoid(double x) {
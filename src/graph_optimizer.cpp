@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+#include "graph_optimizer.h"
+#include "layer.h"
+#include <memory>
+#include "sequential_nn.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "transformation.h"
+#include <vector>
+
+/*******************
+ * GRAPH OPTIMIZER *
+ *******************/
+
+// number of random samples of the equivalence check
+static const int kCheckSamples = 32;
+
+std::string GraphOptimizer::Report::Text() const {
+    std::stringstream ss;
+    ss << "Graph optimization: " << layersBefore << " -> " << layersAfter << " layers ("
+       << removedIdentities << " identities removed, " << mergedLinear << " linear layers merged, "
+       << foldedScalings << " scalings folded)\n"
+       << "  FLOPs per sample: " << flopsBefore << " -> " << flopsAfter << "\n"
+       << "  max. relative deviation: " << deviation << "\n";
+    return ss.str();
+}
+
+// floating point operations per sample of a linear layer (matrix-vector product and bias) or an activation
+static double NodeFlops(bool linear, int rows, int cols) {
+    return linear ? 2.0*rows*cols + rows : (double)rows;
+}
+
+double GraphOptimizer::Flops(SequentialNN& snn) {
+    double flops = 0;
+    for (int i=0; i<snn.Length(); i++) {
+        bool linear = std::dynamic_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation()) != nullptr;
+        flops += NodeFlops(linear, snn.GetLayer(i).Rows(), snn.GetLayer(i).Cols());
+    }
+    return flops;
+}
+
+bool GraphOptimizer::RemoveIdentities(std::vector<Node>& nodes, Report& report) {
+    bool changed = false;
+    for (int i=0; i<(int)nodes.size(); i++) {
+        // NOTE: a network consisting of a single identity is kept (a SequentialNN needs at least one layer)
+        if (!nodes[i].linear && (nodes[i].activation == "identity") && (nodes.size() > 1)) {
+            nodes.erase(nodes.begin() + i);
+            report.removedIdentities++;
+            changed = true;
+            i--;
+        }
+    }
+    return changed;
+}
+
+bool GraphOptimizer::MergeLinear(std::vector<Node>& nodes, Report& report) {
+    bool changed = false;
+    for (int i=0; i+1<(int)nodes.size(); i++) {
+        Node& first = nodes[i];
+        Node& second = nodes[i+1];
+        if (!first.linear || !second.linear) {
+            continue;
+        }
+        // only merge if the product is cheaper than the two layers (not for bottlenecks)
+        double separate = NodeFlops(true, first.weights.rows(), first.weights.cols())
+                          + NodeFlops(true, second.weights.rows(), second.weights.cols());
+        double merged = NodeFlops(true, second.weights.rows(), first.weights.cols());
+        if (merged >= separate) {
+            continue;
+        }
+        first.bias = second.weights*first.bias + second.bias;
+        first.weights = second.weights*first.weights;
+        first.size = first.weights.rows();
+        nodes.erase(nodes.begin() + i + 1);
+        report.mergedLinear++;
+        changed = true;
+        // the merged layer might be merged with its new successor
+        i--;
+    }
+    return changed;
+}
+
+// linear layer with a non-negative diagonal weight matrix and zero bias
+static bool IsScaling(const Eigen::MatrixXd& weights, const Eigen::VectorXd& bias) {
+    if ((weights.rows() != weights.cols()) || !bias.isZero(0)) {
+        return false;
+    }
+    Eigen::VectorXd diagonal = weights.diagonal();
+    Eigen::MatrixXd offDiagonal = weights;
+    offDiagonal.diagonal().setZero();
+    return offDiagonal.isZero(0) && (diagonal.minCoeff() >= 0);
+}
+
+bool GraphOptimizer::FoldScalings(std::vector<Node>& nodes, Report& report) {
+    bool changed = false;
+    // pattern: linear -> relu -> scaling  =>  scaled linear -> relu
+    for (int i=2; i<(int)nodes.size(); i++) {
+        Node& linear = nodes[i-2];
+        Node& relu = nodes[i-1];
+        Node& scaling = nodes[i];
+        if (!linear.linear || relu.linear || (relu.activation != "relu") || !scaling.linear
+            || !IsScaling(scaling.weights, scaling.bias)) {
+            continue;
+        }
+        Eigen::VectorXd diagonal = scaling.weights.diagonal();
+        linear.weights = diagonal.asDiagonal()*linear.weights;
+        linear.bias = linear.bias.cwiseProduct(diagonal);
+        nodes.erase(nodes.begin() + i);
+        report.foldedScalings++;
+        changed = true;
+        i--;
+    }
+    return changed;
+}
+
+SequentialNN GraphOptimizer::Optimize(SequentialNN& snn, Report* report, double tolerance) {
+    Report local;
+    Report& rep = (report != nullptr) ? *report : local;
+    rep = Report();
+    rep.layersBefore = snn.Length();
+    rep.flopsBefore = Flops(snn);
+
+    // copy the parameters (the original network stays untouched)
+    std::vector<Node> nodes;
+    for (int i=0; i<snn.Length(); i++) {
+        std::shared_ptr<Transformation>& transformation = snn.GetLayer(i).GetTransformation();
+        Node node;
+        node.size = transformation->Rows();
+        if (auto linear = std::dynamic_pointer_cast<const LinearTransformation>(transformation)) {
+            node.linear = true;
+            node.weights = linear->Weights();
+            node.bias = linear->Bias();
+        } else if (std::dynamic_pointer_cast<ActivationTransformation>(transformation) != nullptr) {
+            node.linear = false;
+            node.activation = transformation->Type();
+        } else {
+            throw std::invalid_argument("Layer " + std::to_string(i) + " cannot be optimized.");
+        }
+        nodes.push_back(node);
+    }
+
+    // passes (until nothing changes anymore)
+    bool changed = true;
+    while (changed) {
+        changed = RemoveIdentities(nodes, rep);
+        changed = MergeLinear(nodes, rep) || changed;
+        changed = FoldScalings(nodes, rep) || changed;
+    }
+
+    std::vector<LayerVariant> layers;
+    for (Node& node: nodes) {
+        if (node.linear) {
+            layers.push_back(LinearLayer(node.weights, node.bias));
+        } else {
+            layers.push_back(ActivationLayer(node.size, node.activation));
+        }
+    }
+    // NOTE: no initialization (the weights are the folded ones)
+    SequentialNN optimized(layers, false);
+    rep.layersAfter = optimized.Length();
+    rep.flopsAfter = Flops(optimized);
+
+    // equivalence check on random inputs (using a replica, so that the caches of snn are not changed)
+    SequentialNN reference = snn.Replicate();
+    int batch = kCheckSamples;
+    if (reference.Compiled()) {
+        batch = std::min(batch, reference.GetPlan()->MaxBatch());
+    }
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(snn.GetLayer(0).Cols(), batch);
+    reference.Input(X);
+    reference.Forward();
+    optimized.Input(X);
+    optimized.Forward();
+    const Eigen::MatrixXd& expected = reference.Output();
+    double scale = std::max(1.0, expected.cwiseAbs().maxCoeff());
+    rep.deviation = (optimized.Output() - expected).cwiseAbs().maxCoeff()/scale;
+    if (!(rep.deviation <= tolerance)) {
+        throw std::runtime_error("Optimized network is not equivalent (relative deviation "
+                                 + std::to_string(rep.deviation) + ").");
+    }
+    return optimized;
+}
@@ -0,0 +1,74 @@
+#ifndef GRAPH_OPTIMIZER_H_
+#define GRAPH_OPTIMIZER_H_
+
+#include <Eigen/Dense>
+#include <memory>
+#include "sequential_nn.h"
+#include <string>
+#include <vector>
+
+/*******************
+ * GRAPH OPTIMIZER *
+ *******************/
+
+/**
+    Inference-time simplification of a trained SequentialNN: ~GraphOptimizer::Optimize(snn)~ returns a smaller network
+    which computes the same outputs (up to rounding). The passes are applied until none of them changes the network:
+        * identity ActivationLayers are removed,
+        * adjacent LinearLayers are merged into one affine map (W2*(W1*x + b1) + b2 = (W2*W1)*x + (W2*b1 + b2)) if
+          this lowers the floating point operations per sample, i.e. not for bottlenecks like 784 -> 16 -> 784,
+        * scalings (LinearLayers with a non-negative diagonal weight matrix and zero bias, e.g. c*I) after a relu are
+          folded into the weights and bias of the LinearLayer before the relu (since relu(D*z) = D*relu(z) for D >= 0).
+          Scalings next to another LinearLayer are already covered by the merging.
+    Finally, the outputs of both networks for random inputs are compared (equivalence check), and the optimization
+    throws a std::runtime_error if the relative deviation exceeds the tolerance.
+
+    Usage:
+        GraphOptimizer::Report report;
+        SequentialNN optimized = GraphOptimizer::Optimize(snn, &report);
+        std::cout << report.Text();
+
+    NOTE: the optimized network is meant for inference only: it has its own (copied) parameters, so training it does
+    not change ~snn~, and the removed layers are gone for good. Activations other than identity are kept as they are.
+*/
+
+class GraphOptimizer {
+    public:
+        // what the passes did
+        struct Report {
+            int layersBefore = 0;
+            int layersAfter = 0;
+            int removedIdentities = 0;
+            int mergedLinear = 0;
+            int foldedScalings = 0;
+            // floating point operations per sample
+            double flopsBefore = 0;
+            double flopsAfter = 0;
+            // max. deviation of the outputs relative to the largest output (equivalence check)
+            double deviation = 0;
+
+            std::string Text() const;
+        };
+
+        // simplified copy of snn (see above)
+        static SequentialNN Optimize(SequentialNN& snn, Report* report=nullptr, double tolerance=1e-9);
+
+        // floating point operations per sample of the forward pass
+        static double Flops(SequentialNN&);
+
+    private:
+        // the layers of a network in the order of the forward pass (only linear and activation layers)
+        struct Node {
+            bool linear;
+            std::string activation;
+            Eigen::MatrixXd weights;
+            Eigen::VectorXd bias;
+            int size;
+        };
+
+        static bool RemoveIdentities(std::vector<Node>&, Report&);
+        static bool MergeLinear(std::vector<Node>&, Report&);
+        static bool FoldScalings(std::vector<Node>&, Report&);
+};
+
+#endif // GRAPH_OPTIMIZER_H_
@@ -1,8 +1,10 @@
 
+#include <algorithm>
 #include <Eigen/Dense>
 #include <iostream>
 #include <stdexcept>
 #include "layer_cache.h"
+#include "thread_pool.h"
 #include "transformation.h"
 #include "layer.h"
 
@@ -19,8 +21,15 @@ void Layer::SetLayerCache(std::unique_ptr<LayerCache> layer_cache) {
 // TODO: setting the in-/output of for-/backward pass needs to be refactored at some point (e.g. moved to LayerCache)
 
 // in-/output for forward pass
-void Layer::Input(Eigen::MatrixXd input_vector) {
-        _layer_cache->SetForwardInput(std::make_shared<Eigen::MatrixXd>(input_vector));
+// NOTE: the forward input is only created once, afterwards it is overwritten (no allocation in the steady state of
+// the training). Only the first layer of a SequentialNN gets its input this way, so it is not shared with a
+// previous layer.
+void Layer::Input(const Eigen::Ref<const Eigen::MatrixXd>& input_matrix) {
+        if (_layer_cache->GetForwardInput() == nullptr) {
+                _layer_cache->SetForwardInput(std::make_shared<Eigen::MatrixXd>(input_matrix));
+        } else {
+                *(_layer_cache->GetForwardInput()) = input_matrix;
+        }
 }
 
 Eigen::MatrixXd Layer::Output() {
@@ -41,20 +50,31 @@ void Layer::Forward() {
         if (GetLayerCache().GetForwardInput() == nullptr) {
                 throw std::invalid_argument("Pointer is null!");
         }
-        // TODO: do we copy the transformed matrix too often?
-        Eigen::MatrixXd transformed_matrix = _transformation->Transform(*(GetLayerCache().GetForwardInput()));
+        // training mode with mask: transform directly into the forward output (which might even coincide 
+        // with the forward input, see SequentialNN::SetTraining) and only keep the mask for the backward pass
+        if (UsesMask()) {
+                if (GetLayerCache().GetForwardOutput() == nullptr) {
+                        GetLayerCache().SetForwardOutput(std::make_shared<Eigen::MatrixXd>());
+                }
+                _transformation->MaskedTransform(*(GetLayerCache().GetForwardInput()), *(GetLayerCache().GetForwardOutput()), 
+                                                 GetLayerCache().GetForwardMask());
+                return;
+        }
+        // transform directly into the forward output (no temporary)
         if (GetLayerCache().GetForwardOutput() == nullptr){
-                GetLayerCache().SetForwardOutput(std::make_shared<Eigen::MatrixXd>(transformed_matrix));
-        } else {
-                // TODO: do we create an unecessary copy here?
-                *(GetLayerCache().GetForwardOutput()) = transformed_matrix;
+                GetLayerCache().SetForwardOutput(std::make_shared<Eigen::MatrixXd>());
         }
+        _transformation->BatchTransform(*(GetLayerCache().GetForwardInput()), *(GetLayerCache().GetForwardOutput()));
 }
 
 
 // in-/output for backward pass
-void Layer::BackwardInput(Eigen::MatrixXd input_matrix) {
-        _layer_cache->SetBackwardInput(std::make_shared<Eigen::MatrixXd>(input_matrix));
+void Layer::BackwardInput(const Eigen::Ref<const Eigen::MatrixXd>& input_matrix) {
+        if (_layer_cache->GetBackwardInput() == nullptr) {
+                _layer_cache->SetBackwardInput(std::make_shared<Eigen::MatrixXd>(input_matrix));
+        } else {
+                *(_layer_cache->GetBackwardInput()) = input_matrix;
+        }
 }
 
 Eigen::MatrixXd Layer::BackwardOutput() {
@@ -66,25 +86,39 @@ Eigen::MatrixXd Layer::BackwardOutput() {
 
 // backward pass
 void Layer::Backward() {
-        // get backward input which is the Delta of the previous layer in the the backward pass (backpropagation)
-        if ((GetLayerCache().GetBackwardInput() == nullptr) || (GetLayerCache().GetForwardInput() == nullptr)) {
-                throw std::invalid_argument("Pointer to backward/forward input is null!");
+        // training mode with mask: the forward input is not needed
+        if (UsesMask()) {
+                if (GetLayerCache().GetBackwardInput() == nullptr) {
+                        throw std::invalid_argument("Pointer to backward input is null!");
+                }
+                if (GetLayerCache().GetBackwardOutput() == nullptr) {
+                        GetLayerCache().SetBackwardOutput(std::make_shared<Eigen::MatrixXd>());
+                }
+                _transformation->MaskedBackwardTransform(GetLayerCache().GetForwardMask(), *(GetLayerCache().GetBackwardInput()), 
+                                                         *(GetLayerCache().GetBackwardOutput()));
+                return;
         }
-        Eigen::MatrixXd& backward_input = *(GetLayerCache().GetBackwardInput()); // number of rows = number of data samples
-        Eigen::MatrixXd& forward_input = *(GetLayerCache().GetForwardInput()); 
-        Eigen::MatrixXd transformed_matrix = Eigen::MatrixXd::Zero(backward_input.rows(), Cols());
-        // backward transform/backpropagation of the i-th row of the backward_input (= propagated loss function gradient of 
-        // the i-th sample) with respect to the derivative of the transformation at the i-th column of the forward_input
-        for (int i=0; i<backward_input.rows(); i++) {
-                transformed_matrix.row(i) = _transformation->BackwardTransform(forward_input.col(i), backward_input.row(i));
+        // get backward input which is the Delta of the previous layer in the the backward pass (backpropagation)
+        if ((GetLayerCache().GetBackwardInput() == nullptr) || (GetLayerCache().GetForwardInput() == nullptr)
+            || (GetLayerCache().GetForwardOutput() == nullptr)) {
+                throw std::invalid_argument("Pointer to backward input or forward in-/output is null!");
         }
-        // set backard output (which might be a null pointer) to transformed_matrix
         if (GetLayerCache().GetBackwardOutput() == nullptr) {
-                GetLayerCache().SetBackwardOutput(std::make_shared<Eigen::MatrixXd>(transformed_matrix));
-        } else {
-                // TODO: do we create an unecessary copy here
-                *(GetLayerCache().GetBackwardOutput()) = transformed_matrix;
+                GetLayerCache().SetBackwardOutput(std::make_shared<Eigen::MatrixXd>());
         }
+        // backward transform/backpropagation of the i-th row of the backward_input (= propagated loss function gradient of 
+        // the i-th sample) with respect to the derivative of the transformation at the i-th column of the forward_input
+        // NOTE: written directly into the backward output (the backward input of the previous layer)
+        _transformation->BatchBackwardTransform(*(GetLayerCache().GetForwardInput()), *(GetLayerCache().GetForwardOutput()),
+                                                *(GetLayerCache().GetBackwardInput()), *(GetLayerCache().GetBackwardOutput()));
+}
+
+// replica with the same transformation but its own LayerCache
+std::shared_ptr<Layer> Layer::Replicate() {
+        std::shared_ptr<Layer> replica = std::make_shared<Layer>(*this);
+        replica->_layer_cache = std::make_shared<LayerCache>();
+        replica->_training = false;
+        return replica;
 }
 
 
@@ -97,15 +131,12 @@ void LinearLayer::Initialize(std::string initialization_type) {
         //->Initialize(initialization_type);
 }
 
-// set _DeltaWeights and _DeltaBias to zero
+// set _DeltaWeights and _DeltaBias to zero (without reallocation)
 void LinearLayer::ZeroDeltaWeights() {
-        int rows = GetTransformation()->Rows();
-        int cols = GetTransformation()->Cols();
-        _DeltaWeights = Eigen::MatrixXd::Zero(rows, cols);
+        _DeltaWeights.setZero(Rows(), Cols());
 }
 void LinearLayer::ZeroDeltaBias() {
-        int rows = GetTransformation()->Rows();
-        _DeltaBias = Eigen::VectorXd::Zero(rows);
+        _DeltaBias.setZero(Rows());
 }
 
 // update _DeltaWeights and _DeltaBias
@@ -119,25 +150,230 @@ void LinearLayer::UpdateDeltaBias(Eigen::RowVectorXd backward_input) {
         _DeltaBias += backward_input.transpose();
 }
 
-// Apply UpdateDeltaWeights to each column of forward input (which corresponds to data samples in a batch)
-void LinearLayer::UpdateWeightsBias(double learning_rate=1.0) {
+// add the Deltas of the current batch, i.e. the sum of UpdateDeltaWeights/UpdateDeltaBias over all columns of the
+// forward input (which correspond to the data samples in a batch)
+// NOTE: the sum of the outer products is a single matrix product (no temporaries because of noalias())
+void LinearLayer::AccumulateDeltas() {
         if ((GetLayerCache().GetForwardInput() == nullptr) || (GetLayerCache().GetBackwardInput() == nullptr)) {
                 throw std::invalid_argument("Pointer to forward/backward input is null!");
         }
         Eigen::MatrixXd& forward_input = *(GetLayerCache().GetForwardInput());
         Eigen::MatrixXd& backward_input = *(GetLayerCache().GetBackwardInput());
-        // first set DeltaWeights and DeltaBias to zero
-        ZeroDeltaBias();
+        _DeltaWeights.noalias() += backward_input.transpose()*forward_input.transpose();
+        _DeltaBias.noalias() += backward_input.colwise().sum().transpose();
+}
+
+void LinearLayer::ZeroDeltas() {
         ZeroDeltaWeights();
-        // loop over columns of forward input (each column corresponds to a data sample of the batch)
-        for (int i=0; i<forward_input.cols(); i++) {
-                UpdateDeltaWeights(forward_input.col(i), backward_input.row(i));
-                UpdateDeltaBias(backward_input.row(i));
-        }
+        ZeroDeltaBias();
+}
+
+void LinearLayer::UpdateWeightsBias(double learning_rate=1.0) {
+        UpdateDeltas();
         // add Deltas to the weights/bias
+        // NOTE: noalias() and no temporary for learning_rate*_DeltaWeights, so this is a single pass
         // TODO: check sign!
-        GetTransformation()->AddToWeights(learning_rate*_DeltaWeights);
-        GetTransformation()->AddToBias(learning_rate*_DeltaBias);
+        Linear().Weights().noalias() += learning_rate*_DeltaWeights;
+        Linear().Bias().noalias() += learning_rate*_DeltaBias;
+}
+
+// replica shares the LinearTransformation (i.e. the weights/bias) but has its own LayerCache and Deltas
+std::shared_ptr<Layer> LinearLayer::Replicate() {
+        std::shared_ptr<LinearLayer> replica = std::make_shared<LinearLayer>(*this);
+        replica->_layer_cache = std::make_shared<LayerCache>();
+        replica->_training = false;
+        replica->ZeroDeltas();
+        // optimizer state is only kept by the original layer
+        for (int k=0; k<2; k++) {
+                replica->_stateWeights[k].resize(0, 0);
+                replica->_stateBias[k].resize(0);
+        }
+        return replica;
+}
+
+// parameters for optimizers
+TrainableParameter LinearLayer::Parameter(int i, int stateBuffers) {
+        if ((i < 0) || (i >= NumParameters())) {
+                throw std::out_of_range("Index of parameter out of range.");
+        }
+        if ((stateBuffers < 0) || (stateBuffers > 2)) {
+                throw std::invalid_argument("At most two optimizer state buffers are supported.");
+        }
+        // allocate state buffers (zero) if necessary
+        for (int k=0; k<stateBuffers; k++) {
+                if (_stateWeights[k].size() != _DeltaWeights.size()) {
+                        _stateWeights[k] = Eigen::MatrixXd::Zero(Rows(), Cols());
+                }
+                if (_stateBias[k].size() != _DeltaBias.size()) {
+                        _stateBias[k] = Eigen::VectorXd::Zero(Rows());
+                }
+        }
+
+        TrainableParameter parameter;
+        if (i == 0) {
+                parameter.values = Linear().Weights().data();
+                parameter.delta = _DeltaWeights.data();
+                parameter.size = _DeltaWeights.size();
+                parameter.decay = true;
+                for (int k=0; k<2; k++) {
+                        parameter.state[k] = (k < stateBuffers) ? _stateWeights[k].data() : nullptr;
+                }
+        } else {
+                parameter.values = Linear().Bias().data();
+                parameter.delta = _DeltaBias.data();
+                parameter.size = _DeltaBias.size();
+                parameter.decay = false;
+                for (int k=0; k<2; k++) {
+                        parameter.state[k] = (k < stateBuffers) ? _stateBias[k].data() : nullptr;
+                }
+        }
+        return parameter;
 }
 
 
+/*****************************
+ * CONV LAYER IMPLEMENTATION *
+ *****************************/
+
+// Deltas of a batch: the sum over all samples of gradient^T*columns (gradient of the output as Positions() x
+// outChannels matrix, im2col patches of the forward input) and the column sums of the gradients (bias)
+// NOTE: the samples are split into one chunk per thread whose Deltas are summed up afterwards (in a fixed order)
+void ConvLayer::AccumulateDeltas() {
+        if ((GetLayerCache().GetForwardInput() == nullptr) || (GetLayerCache().GetBackwardInput() == nullptr)) {
+                throw std::invalid_argument("Pointer to forward/backward input is null!");
+        }
+        const Eigen::MatrixXd& forward_input = *(GetLayerCache().GetForwardInput());
+        const Eigen::MatrixXd& backward_input = *(GetLayerCache().GetBackwardInput());
+        ConvTransformation& conv = Conv();
+        long samples = forward_input.cols();
+        long positions = conv.Positions();
+        long patchSize = conv.PatchSize();
+        int outChannels = conv.OutChannels();
+        long chunks = std::min<long>(ThreadPool::Global().NumThreads(), samples);
+        if ((long)_chunkDeltas.size() < chunks) {
+                _chunkDeltas.resize(chunks);
+                _chunkColumns.resize(chunks);
+                _chunkGradients.resize(chunks);
+        }
+        ThreadPool::Global().ParallelFor(0, chunks, 1, [&](long begin, long end) {
+                for (long c=begin; c<end; c++) {
+                        // NOTE: only allocated in the first batch (or if the batch has more chunks than before)
+                        Eigen::MatrixXd& delta = _chunkDeltas[c];
+                        Eigen::MatrixXd& columns = _chunkColumns[c];
+                        Eigen::MatrixXd& gradient = _chunkGradients[c];
+                        delta.setZero(outChannels, patchSize + 1);
+                        columns.resize(positions, patchSize);
+                        gradient.resize(positions, outChannels);
+                        for (long j=samples*c/chunks; j<samples*(c + 1)/chunks; j++) {
+                                conv.Im2Col(forward_input.col(j).data(), columns.data());
+                                Eigen::Map<Eigen::RowVectorXd>(gradient.data(), gradient.size()) = backward_input.row(j);
+                                delta.leftCols(patchSize).noalias() += gradient.transpose()*columns;
+                                delta.col(patchSize) += gradient.colwise().sum().transpose();
+                        }
+                }
+        });
+        for (long c=0; c<chunks; c++) {
+                _DeltaWeights += _chunkDeltas[c].leftCols(patchSize);
+                _DeltaBias += _chunkDeltas[c].col(patchSize);
+        }
+}
+
+void ConvLayer::ZeroDeltas() {
+        _DeltaWeights.setZero();
+        _DeltaBias.setZero();
+}
+
+void ConvLayer::UpdateWeightsBias(double learning_rate=1.0) {
+        UpdateDeltas();
+        Conv().Weights().noalias() += learning_rate*_DeltaWeights;
+        Conv().Bias().noalias() += learning_rate*_DeltaBias;
+}
+
+// replica shares the ConvTransformation but has its own LayerCache and Deltas (see LinearLayer::Replicate)
+std::shared_ptr<Layer> ConvLayer::Replicate() {
+        std::shared_ptr<ConvLayer> replica = std::make_shared<ConvLayer>(*this);
+        replica->_layer_cache = std::make_shared<LayerCache>();
+        replica->_training = false;
+        replica->ZeroDeltas();
+        for (int k=0; k<2; k++) {
+                replica->_stateWeights[k].resize(0, 0);
+                replica->_stateBias[k].resize(0);
+        }
+        replica->_chunkDeltas.clear();
+        replica->_chunkColumns.clear();
+        replica->_chunkGradients.clear();
+        return replica;
+}
+
+// parameters for optimizers (see LinearLayer::Parameter)
+TrainableParameter ConvLayer::Parameter(int i, int stateBuffers) {
+        if ((i < 0) || (i >= NumParameters())) {
+                throw std::out_of_range("Index of parameter out of range.");
+        }
+        if ((stateBuffers < 0) || (stateBuffers > 2)) {
+                throw std::invalid_argument("At most two optimizer state buffers are supported.");
+        }
+        for (int k=0; k<stateBuffers; k++) {
+                if (_stateWeights[k].size() != _DeltaWeights.size()) {
+                        _stateWeights[k] = Eigen::MatrixXd::Zero(_DeltaWeights.rows(), _DeltaWeights.cols());
+                }
+                if (_stateBias[k].size() != _DeltaBias.size()) {
+                        _stateBias[k] = Eigen::VectorXd::Zero(_DeltaBias.size());
+                }
+        }
+
+        TrainableParameter parameter;
+        if (i == 0) {
+                parameter.values = Conv().Weights().data();
+                parameter.delta = _DeltaWeights.data();
+                parameter.size = _DeltaWeights.size();
+                parameter.decay = true;
+                for (int k=0; k<2; k++) {
+                        parameter.state[k] = (k < stateBuffers) ? _stateWeights[k].data() : nullptr;
+                }
+        } else {
+                parameter.values = Conv().Bias().data();
+                parameter.delta = _DeltaBias.data();
+                parameter.size = _DeltaBias.size();
+                parameter.decay = false;
+                for (int k=0; k<2; k++) {
+                        parameter.state[k] = (k < stateBuffers) ? _stateBias[k].data() : nullptr;
+                }
+        }
+        return parameter;
+}
+
+
+/*****************
+ * LAYER VARIANT *
+ *****************/
+
+LayerVariant ToLayerVariant(Layer& layer) {
+        if (auto linear = dynamic_cast<LinearLayer*>(&layer)) {
+                return *linear;
+        }
+        if (auto activation = dynamic_cast<ActivationLayer*>(&layer)) {
+                return *activation;
+        }
+        if (auto conv = dynamic_cast<ConvLayer*>(&layer)) {
+                return *conv;
+        }
+        if (auto maxPool = dynamic_cast<MaxPoolLayer*>(&layer)) {
+                return *maxPool;
+        }
+        // sliced copy: the transformation still has its concrete type
+        std::shared_ptr<Transformation>& transformation = layer.GetTransformation();
+        if (auto linear = std::dynamic_pointer_cast<LinearTransformation>(transformation)) {
+                return LinearLayer(linear);
+        }
+        if (auto activation = std::dynamic_pointer_cast<ActivationTransformation>(transformation)) {
+                return ActivationLayer(activation);
+        }
+        if (auto conv = std::dynamic_pointer_cast<ConvTransformation>(transformation)) {
+                return ConvLayer(conv);
+        }
+        if (auto maxPool = std::dynamic_pointer_cast<MaxPoolTransformation>(transformation)) {
+                return MaxPoolLayer(maxPool);
+        }
+        throw std::invalid_argument("Layer type is not supported.");
+}
@@ -4,7 +4,10 @@
 #include <Eigen/Dense>
 #include "layer_cache.h"
 #include "transformation.h"
+#include <stdexcept>
 #include <string>
+#include <variant>
+#include <vector>
 
 /*********
  * LAYER *
@@ -26,10 +29,20 @@
         
         * ~BackwardInput~, ~Backward~ and ~BackwardOutput: work analogously as ~Input~, ~Forward~ and ~Output~
           only with the derivative of the transformation
+        * ~SetTraining~: in training mode, layers whose transformation only needs the sign of the forward input
+          for the backward pass (relu) save a BitMask in the LayerCache during ~Forward~ and use it in ~Backward~.
+          In particular, the forward input is not needed anymore after ~Forward~ (see ~SequentialNN::SetTraining~).
     
     NOTE: some of the member variables, e.g. ~Cols~, ~Rows~, ~UpdateWeightsBias~, just simplify the access
     to the corresponding member functions of Transformation.
 
+    For optimizers (see optimizer.h), layers with trainable parameters additionally provide
+        * ~AccumulateDeltas~: adds the Deltas of the batch in the LayerCache to the Deltas of the parameters
+          (backpropagation), so that the Deltas of several (micro-)batches can be summed up before an update
+        * ~ZeroDeltas~: resets the Deltas (after an update); ~UpdateDeltas~ does both for a single batch
+        * ~NumParameters~, ~Parameter~: raw access to the parameters, their Deltas and the optimizer state
+          which is kept next to the parameters (see TrainableParameter).
+
     NOTE: Both the forward pass (using ~Forward~) and backward pass (using ~Backward~)
     transform the data and update the corresponding LayerCaches. In particular, applying
     ~Forward~ and ~Backward~ does not return a vector. Instead we have to use ~Output~ and
@@ -37,6 +50,21 @@
 
 */
 
+/**
+    View of one trainable parameter array of a layer (e.g. weights or bias) for the optimizers: ~values~,
+    its ~delta~ (NOTE: the Delta is the _negative_ gradient, see LinearLayer) and up to two optimizer
+    state arrays (e.g. first and second moments), all of the same ~size~. The Delta is writable so that Deltas of
+    several replicas of a layer can be reduced into it (see ~SequentialNN::Replicate~). Weight decay is only applied
+    if ~decay~ is true (i.e. not to biases).
+*/
+struct TrainableParameter {
+    double* values;
+    double* delta;
+    double* state[2];
+    long size;
+    bool decay;
+};
+
 // forward declarations
 // TODO: really needed here?
 class LayerCache;
@@ -54,10 +82,14 @@ class Layer {
         // TODO: better would be to include a std::unique_ptr<Transformation> _transformation.
         // But this caused some issues (e.g. could not make _transformation.Transform() work).
 
+        // training mode (see SetTraining)
+        bool _training;
+
         // constructor (needed for all concrete derived classes)
         Layer(std::shared_ptr<Transformation> transformation): 
             _layer_cache(std::make_shared<LayerCache>()),
-            _transformation(transformation)
+            _transformation(transformation),
+            _training(false)
             {}
 
         // used for updating the weights/bias (empty for ActivationLayer)
@@ -85,19 +117,45 @@ class Layer {
         int Rows() { return _transformation->Rows(); }
         std::string Summary() { return _transformation->Summary(); } // TODO: this might change in the future to contain more specific data of the layer
 
+        // training mode
+        void SetTraining(bool training) { _training = training; }
+        bool Training() { return _training; }
+        // true if the forward/backward pass uses the mask in the LayerCache (training mode only)
+        bool UsesMask() { return _training && _transformation->UsesMask(); }
+
         // forward pass
-        void Input(Eigen::MatrixXd); // TODO: do we copy too often here?
+        // NOTE: the input is copied into the forward input of the LayerCache (only reallocated if the shape changes)
+        void Input(const Eigen::Ref<const Eigen::MatrixXd>&);
         void Forward();
         Eigen::MatrixXd Output(); // TODO: better to return const ref?
 
         // backward pass
         //void Derivative();
-        void BackwardInput(Eigen::MatrixXd);
+        // NOTE: copied into the backward input like ~Input~
+        void BackwardInput(const Eigen::Ref<const Eigen::MatrixXd>&);
         void Backward();
         Eigen::MatrixXd BackwardOutput();
 
         // update weights/bias (empty for ActivationLayers)
         virtual void UpdateWeightsBias(double learning_rate) {}
+
+        // replica of the layer which shares the transformation (i.e. the parameters) but has its own LayerCache
+        // and Deltas (not connected to other layers)
+        virtual std::shared_ptr<Layer> Replicate();
+
+        // for optimizers (empty for ActivationLayers)
+        // add the Deltas of the batch in the LayerCache to the Deltas of the parameters
+        virtual void AccumulateDeltas() {}
+        // set the Deltas of the parameters to zero
+        virtual void ZeroDeltas() {}
+        // compute Deltas of the parameters with the LayerCache (of a single batch)
+        void UpdateDeltas() { ZeroDeltas(); AccumulateDeltas(); }
+        // number of trainable parameter arrays
+        virtual int NumParameters() { return 0; }
+        // i-th trainable parameter array with (at least) stateBuffers optimizer state arrays (initialized to zero)
+        virtual TrainableParameter Parameter(int i, int stateBuffers) { 
+            throw std::out_of_range("Layer has no trainable parameters.");
+        }
 };
 
 
@@ -107,12 +165,20 @@ class Layer {
  
 // NOTE: possible IDEA for refactoring: use a factory pattern for creating various layers?
 
-class LinearLayer: public Layer {
+class LinearLayer final: public Layer {
     protected:
         // Delta of weights/bias used in backpropagation to update weights/bias
         Eigen::MatrixXd _DeltaWeights;
         Eigen::VectorXd _DeltaBias;
 
+        // optimizer state of weights/bias (e.g. moments of Adam, see TrainableParameter)
+        // NOTE: only allocated if an optimizer needs them
+        Eigen::MatrixXd _stateWeights[2];
+        Eigen::VectorXd _stateBias[2];
+
+        // the transformation of a LinearLayer is always a LinearTransformation
+        LinearTransformation& Linear() { return static_cast<LinearTransformation&>(*_transformation); }
+
         // update Delta of weights/bias with the LayerCache
         virtual void UpdateDeltaWeights(Eigen::VectorXd, Eigen::RowVectorXd) override;
         virtual void UpdateDeltaBias(Eigen::RowVectorXd) override;
@@ -132,12 +198,26 @@ class LinearLayer: public Layer {
             _DeltaWeights(Eigen::MatrixXd::Zero(rows, cols)),
             _DeltaBias(Eigen::VectorXd::Zero(rows))
             {}
+        // constructor with the given transformation (e.g. with weights mapped from a checkpoint, see Checkpoint::Load)
+        LinearLayer(std::shared_ptr<LinearTransformation> transformation):
+            Layer(transformation),
+            _DeltaWeights(Eigen::MatrixXd::Zero(transformation->Rows(), transformation->Cols())),
+            _DeltaBias(Eigen::VectorXd::Zero(transformation->Rows()))
+            {}
 
         // initialize weights
         void Initialize(std::string initialization_type);
 
         // update weights and bias
         void UpdateWeightsBias(double learning_rate) override;
+
+        std::shared_ptr<Layer> Replicate() override;
+
+        // for optimizers: weights (i=0) and bias (i=1)
+        void AccumulateDeltas() override;
+        void ZeroDeltas() override;
+        int NumParameters() override { return 2; }
+        TrainableParameter Parameter(int i, int stateBuffers) override;
 };
 
 
@@ -145,7 +225,7 @@ class LinearLayer: public Layer {
  * ACTIVATION LAYER *
  ********************/
 
-class ActivationLayer: public Layer {
+class ActivationLayer final: public Layer {
     private:
         std::string _activation;
 
@@ -155,9 +235,119 @@ class ActivationLayer: public Layer {
             Layer(std::make_shared<ActivationTransformation>(m, activation_fct)),
             _activation(activation_fct) 
             {}
+        // constructor with the given transformation (see ToLayerVariant)
+        ActivationLayer(std::shared_ptr<ActivationTransformation> transformation):
+            Layer(transformation),
+            _activation(transformation->Type())
+            {}
 
         // getters
         std::string GetActivationString() { return _activation; }
+
+        std::shared_ptr<Layer> Replicate() override {
+            std::shared_ptr<ActivationLayer> replica = std::make_shared<ActivationLayer>(*this);
+            replica->_layer_cache = std::make_shared<LayerCache>();
+            replica->_training = false;
+            return replica;
+        }
+};
+
+
+/**************
+ * CONV LAYER *
+ **************/
+
+// layer of a 2D convolution (see ConvTransformation); the Deltas are computed like those of a LinearLayer with the
+// im2col patches of the forward input instead of the forward input itself
+class ConvLayer final: public Layer {
+    protected:
+        // Delta of weights/bias (negative gradient, see LinearLayer)
+        Eigen::MatrixXd _DeltaWeights;
+        Eigen::VectorXd _DeltaBias;
+
+        // optimizer state of weights/bias (see LinearLayer)
+        Eigen::MatrixXd _stateWeights[2];
+        Eigen::VectorXd _stateBias[2];
+
+        // Deltas of the chunks of a batch which are accumulated in parallel (weights and bias as last column) and
+        // their im2col patches and output gradients of a single sample
+        std::vector<Eigen::MatrixXd> _chunkDeltas;
+        std::vector<Eigen::MatrixXd> _chunkColumns;
+        std::vector<Eigen::MatrixXd> _chunkGradients;
+
+        // the transformation of a ConvLayer is always a ConvTransformation
+        ConvTransformation& Conv() { return static_cast<ConvTransformation&>(*_transformation); }
+
+    public:
+        // constructor (see ConvTransformation)
+        ConvLayer(int inChannels, int height, int width, int outChannels, int kernel, int stride=1, int padding=0):
+            Layer(std::make_shared<ConvTransformation>(inChannels, height, width, outChannels, kernel, stride, padding)),
+            _DeltaWeights(Eigen::MatrixXd::Zero(outChannels, (long)inChannels*kernel*kernel)),
+            _DeltaBias(Eigen::VectorXd::Zero(outChannels))
+            {}
+        // constructor with the given transformation (see ToLayerVariant)
+        ConvLayer(std::shared_ptr<ConvTransformation> transformation):
+            Layer(transformation),
+            _DeltaWeights(Eigen::MatrixXd::Zero(transformation->OutChannels(), transformation->PatchSize())),
+            _DeltaBias(Eigen::VectorXd::Zero(transformation->OutChannels()))
+            {}
+
+        // update weights and bias
+        void UpdateWeightsBias(double learning_rate) override;
+
+        std::shared_ptr<Layer> Replicate() override;
+
+        // for optimizers: weights (i=0) and bias (i=1)
+        void AccumulateDeltas() override;
+        void ZeroDeltas() override;
+        int NumParameters() override { return 2; }
+        TrainableParameter Parameter(int i, int stateBuffers) override;
+};
+
+
+/******************
+ * MAX-POOL LAYER *
+ ******************/
+
+class MaxPoolLayer final: public Layer {
+    public:
+        // constructor (see MaxPoolTransformation)
+        MaxPoolLayer(int channels, int height, int width, int size):
+            Layer(std::make_shared<MaxPoolTransformation>(channels, height, width, size))
+            {}
+        MaxPoolLayer(std::shared_ptr<MaxPoolTransformation> transformation):
+            Layer(transformation)
+            {}
+
+        std::shared_ptr<Layer> Replicate() override {
+            std::shared_ptr<MaxPoolLayer> replica = std::make_shared<MaxPoolLayer>(*this);
+            replica->_layer_cache = std::make_shared<LayerCache>();
+            replica->_training = false;
+            return replica;
+        }
 };
 
+
+/*****************
+ * LAYER VARIANT *
+ *****************/
+
+/**
+    The concrete layers by value, e.g. as contiguous storage of the layers of a SequentialNN. Unlike ~Layer~ objects,
+    copies are not sliced to the base class, and ~std::visit~ calls the member functions of the concrete type (which
+    are final, so the virtual calls are resolved at compile time and can be inlined):
+        std::visit([](auto& layer) { layer.Forward(); }, variant);
+    ~AsLayer~ gives access through the base class where the type does not matter.
+*/
+using LayerVariant = std::variant<LinearLayer, ActivationLayer, ConvLayer, MaxPoolLayer>;
+
+inline Layer& AsLayer(LayerVariant& variant) {
+    return std::visit([](Layer& layer) -> Layer& { return layer; }, variant);
+}
+
+// copy of a concrete layer (sharing its transformation and LayerCache, but with its own copy of the Deltas and the
+// optimizer state); a Layer which was sliced to the base class becomes the concrete layer of its transformation
+// (with zero Deltas)
+LayerVariant ToLayerVariant(Layer&);
+
 #endif // LAYER_H_
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef LAYER_CACHE_H_
 #define LAYER_CACHE_H_
 
+#include "bit_mask.h"
 #include <Eigen/Dense>
 #include <memory>
 
@@ -39,6 +40,12 @@ class LayerCache {
         std::shared_ptr<Eigen::MatrixXd> _backward_input;
         std::shared_ptr<Eigen::MatrixXd> _backward_output;
 
+        /** Mask of the positive entries of the forward input:
+            used instead of the forward input in the backward pass of relu layers in training mode
+            (see ~Layer::SetTraining~). In contrast to the above, it is not shared with other LayerCaches.
+        */
+        BitMask _forward_mask;
+
      public:
         // constructor
         LayerCache():
@@ -59,6 +66,7 @@ class LayerCache {
             _forward_output = source._forward_output;
             _backward_input = source._backward_input;
             _backward_output = source._backward_output;
+            _forward_mask = source._forward_mask;
         }
         
         // copy assignment operator
@@ -71,6 +79,7 @@ class LayerCache {
             _forward_output = source._forward_output;
             _backward_input = source._backward_input;
             _backward_output = source._backward_output;
+            _forward_mask = source._forward_mask;
 
             return *this;
         }
@@ -102,6 +111,9 @@ class LayerCache {
         std::shared_ptr<Eigen::MatrixXd> GetBackwardOutput() { return _backward_output; }
         std::shared_ptr<Eigen::MatrixXd> GetBackwardInput() { return _backward_input; }
 
+        // mask
+        BitMask& GetForwardMask() { return _forward_mask; }
+
         // set (mini-)batch size (number of columns in the forward cache or rows in the backward cache)
         // NOTE: sets values to zero if the batch size is actually changed 
         void SetBatchSize(int);
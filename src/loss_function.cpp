@@ -19,41 +19,119 @@ LossFunction::LossFunction(std::string name) {
 }
 
 // check size of input vectors and compare with ~cols~ (input size)
-void LossFunction::CheckSize(Eigen::MatrixXd& y, const Eigen::MatrixXd& yLabel) {
+void LossFunction::CheckSize(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::MatrixXd>& yLabel) {
      if ((y.cols() != yLabel.cols()) || (y.rows() != yLabel.rows())) {
         throw std::invalid_argument("Shapes of predictions and labels do not coincide.");
     }
 }
 
+void LossFunction::CheckSize(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::RowVectorXi>& classes) {
+    if (y.cols() != classes.size()) {
+        throw std::invalid_argument("Number of predictions and labels do not coincide.");
+    }
+    if ((classes.size() > 0) && ((classes.minCoeff() < 0) || (classes.maxCoeff() >= y.rows()))) {
+        throw std::out_of_range("Class index exceeds the number of classes of the predictions.");
+    }
+}
+
 double Log(double x) {
     return std::log(x);
 }
 
 // TODO: the following methods need to be refactored at some point (e.g. by making LossFunction abstract and MSE etc. concrete)
 // overload () by evaluating the prediction and corresponding label
-double LossFunction::operator()(Eigen::MatrixXd& y, const Eigen::MatrixXd& yLabel) {
+double LossFunction::operator()(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::MatrixXd>& yLabel) {
     CheckSize(y, yLabel);
     double loss = 0;
      
     // any of the following cases is guaranteed by the constructor
-    if (Name() == "mse") {
+    if (_name == "mse") {
         double avg = 1/double(y.rows());
         for (int i=0; i<y.cols(); i++) {
-            loss += ((y-yLabel).col(i)).dot((y-yLabel).col(i)); // scalar/dot product
+            loss += (y.col(i)-yLabel.col(i)).squaredNorm(); // scalar/dot product
         }
         return avg*loss;
     }
-    else if (Name() == "cross_entropy") {
-        Eigen::MatrixXd yLog = Eigen::MatrixXd::Zero(y.rows(), y.cols()); 
-        // TODO: did not mange to get Eigen's unaryExpr to work...
+    // cross entropy
+    // TODO: did not mange to get Eigen's unaryExpr to work...
+    for (int j=0; j<y.cols(); j++) {
+        // off-set to avoid log(0)
+        loss -= (yLabel.col(j).array()*(y.col(j).array()+1e-9).log()).sum();
+    }
+    return loss;
+}
+
+// loss and gradients in one pass over the columns of y and yLabel 
+// NOTE: the expressions below are evaluated lazily by Eigen, i.e. each column is read once from memory 
+// (the second use is from the cache) and no temporary matrices are created
+double LossFunction::Evaluate(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::MatrixXd>& yLabel, Eigen::MatrixXd& grads_out) {
+    CheckSize(y, yLabel);
+    // only reallocates if the shape changes
+    grads_out.resize(y.cols(), y.rows());
+    double loss = 0;
+
+    if (_name == "mse") {
+        double scale = 2/double(y.rows());
         for (int j=0; j<y.cols(); j++) {
-            for (int i=0; i<y.rows(); i++) {
-                yLog(i, j) = Log(y(i, j)+1e-9); // off-set to avoid log(0)
-            }
-            loss += (-yLog.col(j)).dot(yLabel.col(j)); 
+            auto difference = y.col(j) - yLabel.col(j);
+            loss += difference.squaredNorm();
+            grads_out.row(j) = scale*difference.transpose();
+        }
+        return loss/double(y.rows());
+    }
+    // cross entropy (off-set to avoid log(0) and division by zero)
+    for (int j=0; j<y.cols(); j++) {
+        auto shifted = y.col(j).array() + 1e-9;
+        loss -= (yLabel.col(j).array()*shifted.log()).sum();
+        grads_out.row(j) = (-yLabel.col(j).array()/shifted).matrix().transpose();
+    }
+    return loss;
+}
+
+// class indices: the labels are (implicit) unit vectors e_c, so only y(c, j) has to be gathered for each sample
+double LossFunction::operator()(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::RowVectorXi>& classes) {
+    CheckSize(y, classes);
+    double loss = 0;
+
+    if (_name == "mse") {
+        // |y - e_c|^2 = |y|^2 - 2*y(c) + 1
+        for (int j=0; j<y.cols(); j++) {
+            loss += y.col(j).squaredNorm() - 2*y(classes(j), j) + 1;
         }
-        return loss;
+        return loss/double(y.rows());
+    }
+    // cross entropy
+    for (int j=0; j<y.cols(); j++) {
+        loss -= std::log(y(classes(j), j) + 1e-9);
+    }
+    return loss;
+}
+
+double LossFunction::Evaluate(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::RowVectorXi>& classes, Eigen::MatrixXd& grads_out) {
+    CheckSize(y, classes);
+    // only reallocates if the shape changes
+    grads_out.resize(y.cols(), y.rows());
+    double loss = 0;
+
+    if (_name == "mse") {
+        double scale = 2/double(y.rows());
+        for (int j=0; j<y.cols(); j++) {
+            int c = classes(j);
+            loss += y.col(j).squaredNorm() - 2*y(c, j) + 1;
+            grads_out.row(j) = scale*y.col(j).transpose();
+            grads_out(j, c) -= scale;
+        }
+        return loss/double(y.rows());
+    }
+    // cross entropy: the gradient is zero apart from the entry of the labelled class
+    grads_out.setZero();
+    for (int j=0; j<y.cols(); j++) {
+        int c = classes(j);
+        double shifted = y(c, j) + 1e-9;
+        loss -= std::log(shifted);
+        grads_out(j, c) = -1/shifted;
     }
+    return loss;
 }
 
 // update gradients of loss function at given vectors
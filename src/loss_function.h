@@ -13,6 +13,15 @@
 
 /** 
     Class encoding loss functions (vectors -> double) and their derivatives.
+
+    ~Evaluate~ computes the loss of a batch and its gradients in a single pass over the predictions and labels
+    without allocating memory (unless the shape of the gradients changes). It is used by the optimizers; 
+    ~operator()~ and ~GradsAtPoints~ compute the loss and the gradients separately.
+
+    Labels of classification problems can also be passed as class indices (Eigen::RowVectorXi, the j-th entry is the
+    class of the j-th sample) instead of one-hot-encoded columns. Then the loss and the gradients only gather the
+    predicted probability of the labelled class of each sample, i.e. no (classes x samples) label matrix is stored
+    or read. For cross entropy: loss = -log(y(c, j)), the only non-zero entry of the gradient is -1/y(c, j).
 */
 
 class LossFunction {
@@ -36,10 +45,27 @@ class LossFunction {
         }
 
         // check if sizes of input vectors (columns of the two matrices) coincide
-        void CheckSize(Eigen::MatrixXd&, const Eigen::MatrixXd&);
+        void CheckSize(const Eigen::MatrixXd&, const Eigen::Ref<const Eigen::MatrixXd>&);
+        // check if there is a class index in [0, y.rows()) for each column of y
+        void CheckSize(const Eigen::MatrixXd&, const Eigen::Ref<const Eigen::RowVectorXi>&);
 
         // compute total loss of a batch (sum of the losses of each data sample in the batch)
-        double operator()(Eigen::MatrixXd&, const Eigen::MatrixXd&);
+        double operator()(const Eigen::MatrixXd&, const Eigen::Ref<const Eigen::MatrixXd>&);
+        // same with class indices as labels
+        double operator()(const Eigen::MatrixXd&, const Eigen::Ref<const Eigen::RowVectorXi>&);
+
+        // compute total loss of a batch and write the gradients (i-th row = gradient of the i-th sample) 
+        // into grads_out in a single pass
+        double Evaluate(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::MatrixXd>& yLabel, Eigen::MatrixXd& grads_out);
+        // same with class indices as labels
+        double Evaluate(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::RowVectorXi>& classes, Eigen::MatrixXd& grads_out);
+        // same with the gradients stored in this LossFunction (see GetGrads)
+        double Evaluate(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::MatrixXd>& yLabel) { 
+            return Evaluate(y, yLabel, _gradients); 
+        }
+        double Evaluate(const Eigen::MatrixXd& y, const Eigen::Ref<const Eigen::RowVectorXi>& classes) { 
+            return Evaluate(y, classes, _gradients); 
+        }
 
         // update derivative/gradient 
         void GradsAtPoints(Eigen::MatrixXd&, const Eigen::MatrixXd&);
@@ -0,0 +1,60 @@
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/***************
+ * MAPPED FILE *
+ ***************/
+
+MappedFile::MappedFile(const std::string& path, bool writable):
+    _path(path),
+    _data(nullptr),
+    _size(0),
+    _writable(writable)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file " + path + ": " + std::strerror(errno));
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Cannot read size of file " + path + ": " + std::strerror(error));
+        }
+        _size = status.st_size;
+        if (_size > 0) {
+            // NOTE: MAP_PRIVATE, i.e. writes are never carried through to the file
+            int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            void* data = mmap(nullptr, _size, protection, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                int error = errno;
+                close(fd);
+                throw std::runtime_error("Cannot map file " + path + ": " + std::strerror(error));
+            }
+            // the file is read sequentially (by each thread)
+            madvise(data, _size, MADV_SEQUENTIAL);
+            _data = static_cast<char*>(data);
+        }
+        // NOTE: the mapping stays valid after closing the file descriptor
+        close(fd);
+    }
+
+MappedFile::~MappedFile() {
+    if (_data != nullptr) {
+        munmap(_data, _size);
+    }
+}
+
+char* MappedFile::MutableData() {
+    if (!_writable) {
+        throw std::logic_error("File " + _path + " is mapped read-only.");
+    }
+    return _data;
+}
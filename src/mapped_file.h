@@ -0,0 +1,56 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+/***************
+ * MAPPED FILE *
+ ***************/
+
+/**
+    Read-only memory mapping of a whole file (POSIX mmap). The file is mapped in the constructor and unmapped in
+    the destructor, so the data is valid as long as the object exists. The pages are loaded lazily by the operating
+    system, i.e. reading a mapped file does neither copy it into a buffer of the process nor read it into memory
+    before it is actually accessed.
+
+    Usage:
+        MappedFile file("./tests/train.csv");
+        const char* data = file.Data();
+        for (size_t i=0; i<file.Size(); i++) { ... }
+
+    With ~writable~, the mapping is private and copy-on-write: the pages are shared with the page cache (and with
+    other processes mapping the same file) until they are written, then the process gets its own copy of the
+    written pages. The file itself is never modified (e.g. weights of a checkpoint which are trained further, see
+    ParameterBlock).
+
+    NOTE: empty files are not mapped (~Data()~ is a nullptr and ~Size()~ is zero).
+*/
+
+class MappedFile {
+    private:
+        std::string _path;
+        char* _data;
+        size_t _size;
+        bool _writable;
+
+    public:
+        // constructor (throws std::runtime_error if the file cannot be opened/mapped)
+        explicit MappedFile(const std::string& path, bool writable=false);
+        // destructor (unmaps the file)
+        ~MappedFile();
+
+        // no copies
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // getters
+        const std::string& Path() const { return _path; }
+        const char* Data() const { return _data; }
+        size_t Size() const { return _size; }
+        bool Writable() const { return _writable; }
+        // data of a writable (copy-on-write) mapping (throws std::logic_error for read-only mappings)
+        char* MutableData();
+};
+
+#endif // MAPPED_FILE_H_
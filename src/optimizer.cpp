@@ -1,70 +1,384 @@
+#include "allocation_tracker.h"
 #include "loss_function.h"
 #include "optimizer.h"
 #include "sequential_nn.h"
+#include <algorithm>
+#include <cmath>
 #include <Eigen/Dense>
+#include "batch_loader.h"
 #include <iostream>
-#include <set>
+#include <memory>
+#include "profiler.h"
+#include <sstream>
 #include <string>
 #include <stdexcept>
 #include <random>
+#include "thread_pool.h"
+#include "trace.h"
 
-// create random number
-int SDG::createRandomNumber(int min, int max) {
-    if (min > max) {
-        throw std::invalid_argument("Not a valid interval for creating random numbers.");
+void Optimizer::SetBatchSize(int batchSize) {
+    if (batchSize <= 0) {
+        throw std::invalid_argument("Batch size has to be positive.");
     }
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<int> dis(min, max); // for uniformly distributed ints in the closed interval [min, max]
+    _batchSize = batchSize;
+}
+
+void Optimizer::SetAccumulationSteps(int steps) {
+    if (steps <= 0) {
+        throw std::invalid_argument("Number of accumulation steps has to be positive.");
+    }
+    _accumulationSteps = steps;
+}
+
+/*********************
+ * PARAMETER UPDATES *
+ *********************/
+
+// parameter arrays are updated in chunks of (at least) this many doubles in parallel
+const long kMinChunk = 1 << 14;
+
+void Optimizer::UpdateParameter(const TrainableParameter& parameter) {
+    ThreadPool::Global().ParallelFor(0, parameter.size, kMinChunk, [&](long begin, long end) {
+        UpdateRange(parameter, begin, end);
+    });
+}
+
+void Optimizer::Update(SequentialNN& snn) {
+    TraceScope scope("update", "optimizer");
+    AllocationScope allocations(AllocationTracker::Phase::kUpdate);
+    _updates++;
+    Profiler* profiler = snn.GetProfiler().get();
+    for (int i=0; i<snn.Length(); i++) {
+        Layer& layer = snn.GetLayer(i);
+        if ((profiler != nullptr) && (layer.NumParameters() > 0)) {
+            auto start = profiler->Begin(Profiler::Phase::kUpdate, i);
+            double parameters = 0;
+            for (int j=0; j<layer.NumParameters(); j++) {
+                TrainableParameter parameter = layer.Parameter(j, StateBuffers());
+                UpdateParameter(parameter);
+                parameters += parameter.size;
+            }
+            layer.ZeroDeltas();
+            // parameters and state read and written, Delta read and zeroed
+            profiler->End(Profiler::Phase::kUpdate, i, start, FlopsPerParameter()*parameters, 
+                          8*parameters*(4 + 2*StateBuffers()));
+            continue;
+        }
+        for (int j=0; j<layer.NumParameters(); j++) {
+            UpdateParameter(layer.Parameter(j, StateBuffers()));
+        }
+        // start accumulating the Deltas of the next update
+        layer.ZeroDeltas();
+    }
+}
+
+// NOTE: the following kernels only use raw pointers and no function calls in the loops, so that the compiler 
+// can vectorize them. Each parameter is read and written exactly once (together with its Delta and state).
 
-    return dis(gen);
+void SDG::UpdateRange(const TrainableParameter& p, long begin, long end) {
+    const double lr = _learningRate;
+    double* __restrict w = p.values;
+    const double* __restrict d = p.delta;
+    for (long i=begin; i<end; i++) {
+        w[i] += lr*d[i];
+    }
 }
 
-// create pairwise distinct random numbers by filling a set until it has distinctNumbers elements
-// NOTE: this is not needed at the moment and will only be relevant for mini-batch training
-std::set<int> SDG::createDistinctRandomNumbers(int min, int max, int distinctNumbers) {
-    if (distinctNumbers > (max-min+1)) {
-        throw std::invalid_argument("Too many distinct numbers.");
+void Momentum::UpdateRange(const TrainableParameter& p, long begin, long end) {
+    const double lr = _learningRate;
+    const double mu = _momentum;
+    double* __restrict w = p.values;
+    const double* __restrict d = p.delta;
+    double* __restrict v = p.state[0];
+    for (long i=begin; i<end; i++) {
+        v[i] = mu*v[i] + d[i];
+        w[i] += lr*v[i];
     }
-    std::set<int> randomNums;
-    while (randomNums.size() < distinctNumbers) {
-        randomNums.insert(SDG::createRandomNumber(min, max)); // TODO: this might not be the most efficient way since sets are internally always kept sorted
+}
+
+void RMSProp::UpdateRange(const TrainableParameter& p, long begin, long end) {
+    const double lr = _learningRate;
+    const double rho = _decay;
+    const double eps = _epsilon;
+    double* __restrict w = p.values;
+    const double* __restrict d = p.delta;
+    double* __restrict s = p.state[0];
+    for (long i=begin; i<end; i++) {
+        s[i] = rho*s[i] + (1-rho)*d[i]*d[i];
+        w[i] += lr*d[i]/(std::sqrt(s[i]) + eps);
     }
-    return randomNums;
 }
 
-// single batch training step
-// NOTE: this would be in the superclass if we created it at some point
-void SDG::Step(SequentialNN& snn, const Eigen::MatrixXd& batch, const Eigen::MatrixXd& batchLabel) {
+void Adam::UpdateRange(const TrainableParameter& p, long begin, long end) {
+    // bias corrections
+    const double c1 = 1/(1 - std::pow(_beta1, (double)_updates));
+    const double c2 = 1/(1 - std::pow(_beta2, (double)_updates));
+    const double lr = _learningRate;
+    const double b1 = _beta1;
+    const double b2 = _beta2;
+    const double eps = _epsilon;
+    const double decay = p.decay ? lr*_weightDecay : 0.0;
+    double* __restrict w = p.values;
+    const double* __restrict d = p.delta;
+    double* __restrict m = p.state[0];
+    double* __restrict v = p.state[1];
+    for (long i=begin; i<end; i++) {
+        m[i] = b1*m[i] + (1-b1)*d[i];
+        v[i] = b2*v[i] + (1-b2)*d[i]*d[i];
+        w[i] += lr*(c1*m[i])/(std::sqrt(c2*v[i]) + eps) - decay*w[i];
+    }
+}
+
+
+/************
+ * TRAINING *
+ ************/
+
+// forward and backward pass of a (micro-)batch, the Deltas are added to the ones of the layers
+double Optimizer::Accumulate(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& batch, const Eigen::Ref<const Eigen::MatrixXd>& batchLabel, Eigen::MatrixXd& grads) {
+    // training mode (e.g. relu layers only keep a bit mask for the backward pass)
+    snn.SetTraining(true);
     // forward pass (also updates the LayerCaches etc.)
-    snn(batch);
-    // set input size and gradient of loss function if necessary
-    // if (_lossFct->Cols() != snn.OutputSize()) {
-    //     _lossFct->SetCols(snn.OutputSize());
-    // }
-    // loss
+    snn.Input(batch);
+    snn.Forward();
+    // loss and gradient of _lossFct with yLabel and the output of snn (in a single pass)
     double loss;
-    loss = (*_lossFct)(snn.Output(), batchLabel);
-    // TODO: output to file? At least give option for not printing all losses.
-    //std::cout << "Loss: " << (*_lossFct)(snn.Output(), yLabel) << std::endl;
-
-    //snn.Derivative(); // update derivatives in all layers
-    // compute gradient of _lossFct with yLabel and the output of snn
-    _lossFct->ZeroGrads();
-    _lossFct->GradsAtPoints(snn.Output(), batchLabel);
+    {
+        TraceScope scope("loss", "optimizer");
+        AllocationScope allocations(AllocationTracker::Phase::kLoss);
+        loss = _lossFct->Evaluate(snn.Output(), batchLabel, grads);
+    }
     // update backward input of snn
-    // NOTE: the minus sign is crucial!
-    snn.BackwardInput(-_lossFct->GetGrads());
-    // backward pass
-    snn.Backward(); 
+    // NOTE: the minus sign is crucial! (negated in place, so no temporary is allocated)
+    grads = -grads;
+    snn.BackwardInput(grads);
+    // backward pass which also adds the Deltas of weights/bias
+    snn.Backward(true);
+    return loss;
+}
+
+// same with class indices (only the loss and its gradient differ)
+double Optimizer::Accumulate(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& batch, const Eigen::Ref<const Eigen::RowVectorXi>& batchClasses, Eigen::MatrixXd& grads) {
+    snn.SetTraining(true);
+    snn.Input(batch);
+    snn.Forward();
+    double loss;
+    {
+        TraceScope scope("loss", "optimizer");
+        AllocationScope allocations(AllocationTracker::Phase::kLoss);
+        loss = _lossFct->Evaluate(snn.Output(), batchClasses, grads);
+    }
+    grads = -grads;
+    snn.BackwardInput(grads);
+    snn.Backward(true);
+    return loss;
+}
+
+double Optimizer::Accumulate(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& batch, const Eigen::Ref<const Eigen::MatrixXd>& batchLabel) {
+    return Accumulate(snn, batch, batchLabel, _grads[0]);
+}
+
+double Optimizer::Accumulate(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& batch, const Eigen::Ref<const Eigen::RowVectorXi>& batchClasses) {
+    return Accumulate(snn, batch, batchClasses, _grads[0]);
+}
+
+// replicas are reused as long as they belong to snn (i.e. share its transformations)
+void Optimizer::PrepareReplicas(SequentialNN& snn, int replicas) {
+    if (!_replicas.empty()) {
+        bool shared = (_replicas[0].Length() == snn.Length());
+        for (int i=0; shared && (i<snn.Length()); i++) {
+            shared = (_replicas[0].GetLayer(i).GetTransformation() == snn.GetLayer(i).GetTransformation());
+        }
+        if (!shared) {
+            _replicas.clear();
+        }
+    }
+    while ((int)_replicas.size() < replicas) {
+        _replicas.push_back(snn.Replicate());
+    }
+    _grads.resize(std::max<size_t>(_grads.size(), replicas + 1));
+}
+
+// reduce the Deltas of the replicas into snn (in a single pass which also resets the Deltas of the replicas)
+void Optimizer::ReduceReplicas(SequentialNN& snn, int replicas) {
+    TraceScope scope("reduce replicas", "optimizer");
+    for (int i=0; i<snn.Length(); i++) {
+        Layer& layer = snn.GetLayer(i);
+        for (int j=0; j<layer.NumParameters(); j++) {
+            double* __restrict delta = layer.Parameter(j, 0).delta;
+            ThreadPool::Global().ParallelFor(0, layer.Parameter(j, 0).size, kMinChunk, [&](long begin, long end) {
+                for (int r=0; r<replicas; r++) {
+                    double* __restrict d = _replicas[r].GetLayer(i).Parameter(j, 0).delta;
+                    for (long k=begin; k<end; k++) {
+                        delta[k] += d[k];
+                        d[k] = 0.0;
+                    }
+                }
+            });
+        }
+    }
+}
+
+// shapes of the labels and range of the class indices (checked before the micro-batches are distributed)
+static void CheckLabels(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& batchLabel) {
+    if (batchLabel.rows() != snn.OutputSize()) {
+        throw std::invalid_argument("Shapes of predictions and labels do not coincide.");
+    }
+}
+
+static void CheckLabels(SequentialNN& snn, const Eigen::Ref<const Eigen::RowVectorXi>& batchClasses) {
+    if ((batchClasses.size() > 0) && ((batchClasses.minCoeff() < 0) || (batchClasses.maxCoeff() >= snn.OutputSize()))) {
+        throw std::out_of_range("Class index exceeds the output size of the network.");
+    }
+}
+
+// single batch training step (returns the loss of the batch)
+// NOTE: the batch is split into micro-batches of (at most) _batchSize samples whose Deltas are summed up before the
+// update. With several threads, the micro-batches are distributed round-robin over snn and its replicas.
+template<typename Labels>
+double Optimizer::StepLabels(SequentialNN& snn, const Eigen::MatrixXd& batch, const Labels& batchLabel) {
+    if (batch.cols() != batchLabel.cols()) {
+        throw std::invalid_argument("Number of samples and labels do not coincide.");
+    }
+    if (batch.rows() != snn.InputSize()) {
+        throw std::invalid_argument("Input size does not match the network.");
+    }
+    CheckLabels(snn, batchLabel);
+    TraceScope scope("step", "optimizer");
+    int samples = batch.cols();
+    int microBatches = std::max(1, (samples + _batchSize - 1)/_batchSize);
+    double loss = 0;
+
+    if (microBatches == 1) {
+        loss = Accumulate(snn, batch, batchLabel, _grads[0]);
+    } else {
+        // snn is network 0, the others are replicas
+        int networks = std::min(microBatches, ThreadPool::Global().NumThreads());
+        snn.SetTraining(true);
+        PrepareReplicas(snn, networks - 1);
+        _losses.assign(networks, 0.0);
+
+        ThreadPool::Global().ParallelFor(0, networks, 1, [&](long begin, long end) {
+            for (long n=begin; n<end; n++) {
+                SequentialNN& network = (n == 0) ? snn : _replicas[n-1];
+                for (int m=n; m<microBatches; m+=networks) {
+                    TraceScope scope("micro-batch", "optimizer", m);
+                    int first = m*_batchSize;
+                    int size = std::min(_batchSize, samples - first);
+                    _losses[n] += Accumulate(network, batch.middleCols(first, size), batchLabel.middleCols(first, size), _grads[n]);
+                }
+            }
+        });
+        ReduceReplicas(snn, networks - 1);
+        for (int n=0; n<networks; n++) {
+            loss += _losses[n];
+        }
+    }
     // update weights/bias
-    snn.UpdateWeightsBias(_learningRate);
-    //snn.UpdateBias(_learningRate);
+    Update(snn);
+
+    return loss;
+}
+
+double Optimizer::Step(SequentialNN& snn, const Eigen::MatrixXd& batch, const Eigen::Ref<const Eigen::MatrixXd>& batchLabel) {
+    return StepLabels(snn, batch, batchLabel);
+}
+
+double Optimizer::Step(SequentialNN& snn, const Eigen::MatrixXd& batch, const Eigen::Ref<const Eigen::RowVectorXi>& batchClasses) {
+    return StepLabels(snn, batch, batchClasses);
+}
+
+
+// epochs over the batches of the loader (starting at the batch the loader starts with)
+template<typename Labels>
+void Optimizer::TrainLabels(SequentialNN& snn, BatchLoader& loader, int epochs) {
+    const Eigen::MatrixXd* batch;
+    const Labels* batchLabel;
+    double loss = 0;
+    long batchesPerEpoch = loader.BatchesPerEpoch();
+    std::shared_ptr<Profiler> previousProfiler = StartProfiling(snn);
+    // NOTE: the training runs on the calling thread, so keep a name given by the caller
+    if (Trace::ThreadName().empty()) {
+        Trace::SetThreadName("training");
+    }
+
+    // each sample is contained in exactly one batch per epoch
+    for (long b=_progress.batches; b<epochs*batchesPerEpoch; b++) {
+        loader.Next(batch, batchLabel);
+        // train with batch
+        loss = Step(snn, *batch, *batchLabel);
+        _progress.batches = b + 1;
+        if (_stepCallback) {
+            _stepCallback(snn);
+        }
+        // print loss (of the last batch of an epoch)
+        int i = b/batchesPerEpoch;
+        if ((b + 1 == (i + 1)*batchesPerEpoch) && ((i % 100 == 0) || (i == epochs-1))) {
+            std::cout << "=========== Epoch " << i+1 << " ===========" << std::endl;
+            // TODO: add option to log to a file
+            std::cout << "Loss: " << loss << std::endl;
+            //std::cout << snn.Summary() << std::endl;
+            //std::cout << "SNN backward output: " << snn.BackwardOutput() << std::endl; 
+            //std::cout << "SNN output: \n" << snn.Output() << std::endl;
+        }
+    }
+    _dataWaitSeconds = loader.WaitSeconds();
+    _progress.resumable = false;
+    if (_profiler != nullptr) {
+        snn.SetProfiler(previousProfiler);
+    }
+    // back to inference mode
+    snn.SetTraining(false);
+}
+
+void Optimizer::SetProfiling(bool profiling, bool counters) {
+    if (!profiling) {
+        _profiler = nullptr;
+        return;
+    } else if (_profiler == nullptr) {
+        _profiler = std::make_shared<Profiler>();
+    }
+    _profiler->SetCounters(counters);
 }
 
+// NOTE: the samples of the previous Train are removed
+std::shared_ptr<Profiler> Optimizer::StartProfiling(SequentialNN& snn) {
+    std::shared_ptr<Profiler> previous = snn.GetProfiler();
+    if (_profiler != nullptr) {
+        _profiler->Reset();
+        snn.SetProfiler(_profiler);
+    }
+    return previous;
+}
+
+void Optimizer::Resume(const TrainingProgress& progress) {
+    if (!progress.resumable || (progress.batches < 0)) {
+        throw std::invalid_argument("Training cannot be resumed from this progress.");
+    }
+    _progress = progress;
+    _resume = true;
+}
+
+// NOTE: the state of the random number generator is saved after drawing the seed of the loader, so a resumed
+// Train continues with the same random numbers as an uninterrupted one
+uint32_t Optimizer::StartTraining(long& startBatch) {
+    if (_resume) {
+        std::istringstream(_progress.rngState) >> _rng;
+        _resume = false;
+    } else {
+        _progress.loaderSeed = _rng();
+        _progress.batches = 0;
+        std::ostringstream state;
+        state << _rng;
+        _progress.rngState = state.str();
+    }
+    _progress.resumable = true;
+    startBatch = _progress.batches;
+    return _progress.loaderSeed;
+}
 
 // trainining
-void SDG::Train(SequentialNN& snn, const Eigen::MatrixXd& X, const Eigen::MatrixXd& yLabel, int epochs) {
+void Optimizer::Train(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::MatrixXd>& yLabel, int epochs) {
     // number of data points/samples
     int totalSamples = X.cols();
 
@@ -75,32 +389,71 @@ void SDG::Train(SequentialNN& snn, const Eigen::MatrixXd& X, const Eigen::Matrix
         throw std::invalid_argument("Batch size exceeds number of samples.");
     }
 
-    // data for batch training
-    Eigen::MatrixXd batch = Eigen::MatrixXd::Zero(X.rows(), _batchSize);
-    Eigen::MatrixXd batchLabel = Eigen::MatrixXd::Zero(yLabel.rows(), _batchSize);
- 
-    // loop over epochs
+    // batches are shuffled and gathered on a background thread
+    // NOTE: each batch consists of _accumulationSteps micro-batches (see Step)
+    long accumulatedBatchSize = std::min<long>((long)_batchSize*_accumulationSteps, totalSamples);
+    long startBatch;
+    uint32_t seed = StartTraining(startBatch);
+    BatchLoader loader(X, yLabel, accumulatedBatchSize, seed, startBatch);
+    TrainLabels<Eigen::MatrixXd>(snn, loader, epochs);
+}
+
+void Optimizer::Train(SequentialNN& snn, const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::RowVectorXi>& classes, int epochs) {
+    int totalSamples = X.cols();
+
+    if (totalSamples != classes.size()) {
+        throw std::invalid_argument("Number of samples and labels do not coincide.");
+    }
+    if (totalSamples < _batchSize) {
+        throw std::invalid_argument("Batch size exceeds number of samples.");
+    }
+    if ((classes.size() > 0) && ((classes.minCoeff() < 0) || (classes.maxCoeff() >= snn.OutputSize()))) {
+        throw std::out_of_range("Class index exceeds the output size of the network.");
+    }
+
+    long accumulatedBatchSize = std::min<long>((long)_batchSize*_accumulationSteps, totalSamples);
+    long startBatch;
+    uint32_t seed = StartTraining(startBatch);
+    BatchLoader loader(X, classes, accumulatedBatchSize, seed, startBatch);
+    TrainLabels<Eigen::RowVectorXi>(snn, loader, epochs);
+}
+
+// training from a stream of batches (e.g. data sets larger than the memory)
+void Optimizer::Train(SequentialNN& snn, DataStream& stream, int epochs) {
+    if (stream.Features() != snn.InputSize()) {
+        throw std::invalid_argument("Dimension of the samples does not match the input size of the network.");
+    }
+    if (_resume) {
+        throw std::logic_error("Training from a DataStream cannot be resumed.");
+    }
+    const Eigen::MatrixXd* batch;
+    const Eigen::MatrixXd* batchLabel;
+    double waitSeconds = stream.WaitSeconds();
+    double loss = 0;
+    _progress = {false, 0, 0, ""};
+    std::shared_ptr<Profiler> previousProfiler = StartProfiling(snn);
+    // NOTE: the training runs on the calling thread, so keep a name given by the caller
+    if (Trace::ThreadName().empty()) {
+        Trace::SetThreadName("training");
+    }
+
     for (int i=0; i<epochs; i++) {
-        // create a random batch
-        std::set<int> batchIndices = SDG::createDistinctRandomNumbers(0, totalSamples-1, _batchSize);        
-        //index = SDG::createRandomNumber(0, N-1);
-        int count=0;
-        // TODO: range-loop was problematic
-        for (std::set<int>::iterator it=batchIndices.begin(); it != batchIndices.end(); ++it) {
-            batch.col(count) = X.col(*it);
-            batchLabel.col(count) = yLabel.col(*it);
-            count++;
+        // NOTE: the batch size of the stream is used; Step splits the batches into micro-batches of _batchSize
+        while (stream.Next(batch, batchLabel)) {
+            loss = Step(snn, *batch, *batchLabel);
+            _progress.batches++;
+            if (_stepCallback) {
+                _stepCallback(snn);
+            }
         }
-        // train with batch
-        Step(snn, batch, batchLabel);
-        // print loss
-        if (i % 100 == 0) {
+        if ((i % 100 == 0) || (i == epochs-1)) {
             std::cout << "=========== Epoch " << i+1 << " ===========" << std::endl;
-            // TODO: add option to log to a file
-            std::cout << "Loss: " << (*_lossFct)(snn.Output(), batchLabel) << std::endl;
-            //std::cout << snn.Summary() << std::endl;
-            //std::cout << "SNN backward output: " << snn.BackwardOutput() << std::endl; 
-            //std::cout << "SNN output: \n" << snn.Output() << std::endl;
+            std::cout << "Loss: " << loss << std::endl;
         }
     }
-}
\ No newline at end of file
+    _dataWaitSeconds = stream.WaitSeconds() - waitSeconds;
+    if (_profiler != nullptr) {
+        snn.SetProfiler(previousProfiler);
+    }
+    snn.SetTraining(false);
+}
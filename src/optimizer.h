@@ -1,16 +1,36 @@
 #ifndef OPTIMIZER_H_
 #define OPTIMIZER_H_
 
+#include "data_stream.h"
 #include <Eigen/Dense>
+#include <functional>
+#include "layer.h"
 #include "loss_function.h"
+#include <memory>
+#include "profiler.h"
+#include <random>
 #include "sequential_nn.h"
-#include <set>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
-/** 
-    Optimizer class (currently only stochastic gradient descent) for training 
-    sequential neural networks using backpropagation. If ~snn~ is an object of
+// forward declaration
+class BatchLoader;
+
+// position of ~Optimizer::Train~ in its batches, e.g. saved in checkpoints to resume training exactly (see Resume)
+struct TrainingProgress {
+    // only true for Train with in-memory samples (not for DataStreams)
+    bool resumable;
+    // seed of the BatchLoader of the current Train
+    uint32_t loaderSeed;
+    // number of batches trained in the current Train
+    long batches;
+    // state of the random number generator of the optimizer after drawing the loader seed
+    std::string rngState;
+};
+
+/**
+    Optimizers for training sequential neural networks using backpropagation. If ~snn~ is an object of
     SequentialNN, then it is trained using the mean squared error as loss function
     and training data ~X~ (Eigen::MatrixXd) with labels ~yLabel~ (Eigen::MatrixXd)
     as follows:
@@ -21,48 +41,299 @@
         // train the model
         sdg.Train(snn, X, y, numberOfEpochs);
 
-    There is also the option for a single training step using ~Step~.
+    Each epoch iterates over all samples exactly once in shuffled batches. The batches are assembled on a background
+    thread (see BatchLoader) and ~DataWaitSeconds~ reports how long the training thread had to wait for them.
+    There is also the option for a single training step using ~Step~. Data sets which do not fit into memory can be
+    streamed from shards on disk instead (see DataStream):
+        ShardStream stream(shardPaths, batchSize, window, classes, seed);
+        sdg.Train(snn, stream, numberOfEpochs);
+
+    The abstract base class ~Optimizer~ implements ~Step~ and ~Train~. Concrete optimizers only differ in how
+    a parameter array is updated with its Delta (the negative gradient of the loss, summed over the batch), see
+    ~UpdateRange~. The update is a single fused loop over the parameters which is split into chunks that are run
+    in parallel on the global ThreadPool. Optimizer state (e.g. moments) is kept in the layers next to the
+    parameters (see TrainableParameter in layer.h), so it is read and written in the same loop.
 
-    NOTE: for now we only offer one optimizer, namely stochastic gradient descent.
-          We might add a class hierarchy later if we introduce more optimizers.
+    The concrete implementations are (w = parameter, d = Delta, lr = learning rate, t = number of updates):
+        * ~SDG~:      w += lr*d
+        * ~Momentum~: v = momentum*v + d, w += lr*v
+        * ~RMSProp~:  s = decay*s + (1-decay)*d^2, w += lr*d/(sqrt(s) + epsilon)
+        * ~Adam~:     m = beta1*m + (1-beta1)*d, v = beta2*v + (1-beta2)*d^2,
+                      w += lr*(m/(1-beta1^t))/(sqrt(v/(1-beta2^t)) + epsilon)
+        * ~AdamW~:    Adam with decoupled weight decay w -= lr*weightDecay*w (not applied to biases)
 
+    Gradient accumulation: the batch size is the size of the micro-batches which are passed through the network at
+    once, i.e. it bounds the memory of the LayerCaches. With ~SetAccumulationSteps(k)~, ~Train~ uses batches of
+    k*batchSize samples for each update. In general, ~Step~ splits its batch into micro-batches of (at most) batchSize
+    samples, sums up their Deltas (see ~Layer::AccumulateDeltas~) and updates the parameters once, which gives the same
+    update as a single batch. If the global ThreadPool has several threads, the micro-batches are distributed over
+    replicas of the network (see ~SequentialNN::Replicate~, each replica needs its own LayerCaches) and the Deltas of
+    the replicas are reduced into the network before the update. ~Accumulate~ and ~Update~ allow to do the same by hand.
+
+    Labels of classification problems can be class indices (Eigen::RowVectorXi) instead of one-hot-encoded matrices
+    for ~Train~, ~Step~ and ~Accumulate~, e.g. with the labels of a Dataset converted by ~DataParser::ClassIndices~:
+        sdg.Train(snn, data.Samples(), dp.ClassIndices(data.Labels(), 9), numberOfEpochs);
+    The loss and its gradient then gather the prediction of the labelled class instead of reading a dense
+    (classes x samples) label matrix (see LossFunction).
+
+    Resuming: ~Progress~ is the position of the current ~Train~ in its batches (together with the seed of its
+    BatchLoader and the state of the random number generator). After ~Resume(progress)~, the next ~Train~ (with the
+    same data and number of epochs) continues right after that position and yields exactly the same network as an
+    uninterrupted run. Checkpoints save and restore the progress (see Checkpoint and CheckpointScheduler, which
+    writes checkpoints in the background during ~Train~ via ~SetStepCallback~).
+
+    Profiling: with ~SetProfiling(true)~, ~Train~ attaches a Profiler to the network which records the forward pass,
+    the backward pass and the update of each layer in every step (see profiler.h). The report of the last Train is
+    available as text and JSON:
+        sdg.SetProfiling(true);
+        sdg.Train(snn, X, yLabel, numberOfEpochs);
+        std::cout << sdg.Profile()->Text();
+    With ~SetProfiling(true, true)~ the report also contains the hardware counters (IPC, cache and branch misses) of
+    each layer and phase, if ~perf_event_open~ is available.
+    The timeline of the steps, micro-batches, reductions and updates across the threads (together with the layers,
+    the batch assembly and checkpoints) can be recorded with the Trace (see trace.h).
 
     TODO: it might be better to include (references to) snn, X, yLabel into the optimizer class to avoid
           methods with a very long list of parameters
-*/ 
+*/
 
-class SDG {
-    private:
+/***********************
+ * ABSTRACT BASE CLASS *
+ ***********************/
+
+class Optimizer {
+    protected:
         // loss function for optimzation
-        std::unique_ptr<LossFunction> _lossFct; 
+        std::unique_ptr<LossFunction> _lossFct;
         double _learningRate;
         // batch size
         int _batchSize;
-        // create random number
-        static int createRandomNumber(int min, int max);
-        // create pairwise distinct numbers
-        static std::set<int> createDistinctRandomNumbers(int min, int max, int distinctNumbers);
+        // number of updates so far (e.g. for the bias correction of Adam)
+        long _updates;
+        // random number generator for shuffling the training data
+        std::mt19937 _rng;
+        // time (in seconds) the last call of Train waited for batches
+        double _dataWaitSeconds;
+        // number of micro-batches per update in Train
+        int _accumulationSteps;
 
-    public:
-        // constructor
-        SDG(std::string lossFctName, int batchSize, double learningRate): 
+        // replicas of the trained network for concurrent micro-batches (created on demand)
+        std::vector<SequentialNN> _replicas;
+        // backward input of the network (index 0) and the replicas
+        std::vector<Eigen::MatrixXd> _grads;
+        // loss per network/replica in Step
+        std::vector<double> _losses;
+
+        // position of Train (and whether the next Train resumes from it)
+        TrainingProgress _progress;
+        bool _resume;
+        // called after each update in Train
+        std::function<void(SequentialNN&)> _stepCallback;
+        // profiler of Train (nullptr if not profiling)
+        std::shared_ptr<Profiler> _profiler;
+
+        // constructor (needed for concrete implementations)
+        Optimizer(std::string lossFctName, int batchSize, double learningRate):
             _lossFct(std::make_unique<LossFunction>(LossFunction(lossFctName))),
-            _learningRate(learningRate), 
-            _batchSize(batchSize) {}
+            _learningRate(learningRate),
+            _batchSize(batchSize),
+            _updates(0),
+            _rng(std::random_device{}()),
+            _dataWaitSeconds(0.0),
+            _accumulationSteps(1),
+            _grads(1),
+            _progress{false, 0, 0, ""},
+            _resume(false) {}
+
+        // update the indices [begin, end) of the given parameter array (called in parallel on disjoint ranges)
+        virtual void UpdateRange(const TrainableParameter&, long begin, long end) = 0;
+        // floating point operations of UpdateRange per parameter (for profiling)
+        virtual double FlopsPerParameter() { return 2; }
+
+        // forward and backward pass of a (micro-)batch which adds the Deltas to the layers (returns the loss)
+        double Accumulate(SequentialNN&, const Eigen::Ref<const Eigen::MatrixXd>&, const Eigen::Ref<const Eigen::MatrixXd>&, Eigen::MatrixXd& grads);
+        double Accumulate(SequentialNN&, const Eigen::Ref<const Eigen::MatrixXd>&, const Eigen::Ref<const Eigen::RowVectorXi>&, Eigen::MatrixXd& grads);
+        // Step and Train for both kinds of labels (one-hot-encoded or class indices)
+        template<typename Labels>
+        double StepLabels(SequentialNN&, const Eigen::MatrixXd&, const Labels&);
+        template<typename Labels>
+        void TrainLabels(SequentialNN&, BatchLoader&, int epochs);
+        // seed of the BatchLoader of Train and number of batches to skip (if Train resumes)
+        uint32_t StartTraining(long& startBatch);
+        // attach the profiler of Train to snn (returns the previous profiler of snn)
+        std::shared_ptr<Profiler> StartProfiling(SequentialNN&);
+        // make sure that there are (at least) the given number of replicas of snn
+        void PrepareReplicas(SequentialNN&, int replicas);
+        // add the Deltas of the first replicas to the ones of snn (and reset the Deltas of the replicas)
+        void ReduceReplicas(SequentialNN&, int replicas);
+
+    public:
+        // virtual destructor
+        virtual ~Optimizer() {}
 
         // setters
         void SetLearningRate(double a) { _learningRate=a; }
         void SetBatchSize(int);
-        
+        // number of micro-batches (of batch size) per update in Train
+        void SetAccumulationSteps(int);
+        // seed for shuffling the training data (random by default)
+        void SetSeed(unsigned seed) { _rng.seed(seed); }
+        // number of updates so far (e.g. when resuming from a checkpoint)
+        void SetUpdates(long updates) { _updates = updates; }
+        // the next Train continues at the given position (see above)
+        void Resume(const TrainingProgress&);
+        // function called after each update in Train (between two steps), e.g. to write checkpoints
+        void SetStepCallback(std::function<void(SequentialNN&)> callback) { _stepCallback = callback; }
+        // profile each step of Train, optionally with the hardware counters of the calling thread (see above)
+        void SetProfiling(bool, bool counters=false);
+
         // getters
         double LearningRate() { return _learningRate; }
+        int BatchSize() { return _batchSize; }
+        int AccumulationSteps() { return _accumulationSteps; }
+        long Updates() { return _updates; }
+        // number of optimizer state arrays per parameter array (at most two)
+        virtual int StateBuffers() { return 0; }
+        double DataWaitSeconds() { return _dataWaitSeconds; }
+        const TrainingProgress& Progress() { return _progress; }
+        // profile of the last Train (nullptr if not profiling)
+        std::shared_ptr<Profiler> Profile() { return _profiler; }
+        virtual std::string Name() = 0;
+
+        // update a single parameter array with its Delta
+        void UpdateParameter(const TrainableParameter&);
+        // update all parameters of snn with the Deltas accumulated since the last update (and reset them)
+        void Update(SequentialNN&);
+        // forward and backward pass of a batch which adds its Deltas to the ones of snn (no update), returns the loss
+        double Accumulate(SequentialNN&, const Eigen::Ref<const Eigen::MatrixXd>&, const Eigen::Ref<const Eigen::MatrixXd>&);
+        double Accumulate(SequentialNN&, const Eigen::Ref<const Eigen::MatrixXd>&, const Eigen::Ref<const Eigen::RowVectorXi>&);
 
         // optimize
-        // single step of stochastic gradient descent (mini-batch learning)
-        void Step(SequentialNN&, const Eigen::MatrixXd&, const Eigen::MatrixXd&);
+        // single step of stochastic gradient descent (mini-batch learning) with micro-batches of (at most) batch size,
+        // returns the loss of the batch
+        double Step(SequentialNN&, const Eigen::MatrixXd&, const Eigen::Ref<const Eigen::MatrixXd>&);
+        // same with class indices as labels
+        double Step(SequentialNN&, const Eigen::MatrixXd&, const Eigen::Ref<const Eigen::RowVectorXi>&);
+
+        // mini-batch training for the given number of epochs
+        // NOTE: X and yLabel can be any matrix expressions with contiguous columns, e.g. memory-mapped Eigen::Maps of a
+        // Dataset, without copying them
+        void Train(SequentialNN&, const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::MatrixXd>& yLabel, int epochs);
+        // same with class indices as labels
+        void Train(SequentialNN&, const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::RowVectorXi>& classes, int epochs);
+        // mini-batch training with the batches of a DataStream (e.g. ShardStream for data sets larger than the memory)
+        void Train(SequentialNN&, DataStream&, int epochs);
+};
+
+
+/*******************************
+ * STOCHASTIC GRADIENT DESCENT *
+ *******************************/
+
+class SDG: public Optimizer {
+    protected:
+        void UpdateRange(const TrainableParameter&, long begin, long end) override;
+
+    public:
+        // constructor
+        SDG(std::string lossFctName, int batchSize, double learningRate):
+            Optimizer(lossFctName, batchSize, learningRate) {}
+
+        std::string Name() override { return "SDG"; }
+};
+
+
+/************
+ * MOMENTUM *
+ ************/
+
+class Momentum: public Optimizer {
+    private:
+        double _momentum;
+
+    protected:
+        void UpdateRange(const TrainableParameter&, long begin, long end) override;
+        double FlopsPerParameter() override { return 4; }
+
+    public:
+        // constructor
+        Momentum(std::string lossFctName, int batchSize, double learningRate, double momentum=0.9):
+            Optimizer(lossFctName, batchSize, learningRate),
+            _momentum(momentum) {}
+
+        std::string Name() override { return "Momentum"; }
+        int StateBuffers() override { return 1; }
+};
+
+
+/***********
+ * RMSPROP *
+ ***********/
+
+class RMSProp: public Optimizer {
+    private:
+        double _decay;
+        double _epsilon;
+
+    protected:
+        void UpdateRange(const TrainableParameter&, long begin, long end) override;
+        double FlopsPerParameter() override { return 9; }
+
+    public:
+        // constructor
+        RMSProp(std::string lossFctName, int batchSize, double learningRate, double decay=0.9, double epsilon=1e-8):
+            Optimizer(lossFctName, batchSize, learningRate),
+            _decay(decay),
+            _epsilon(epsilon) {}
+
+        std::string Name() override { return "RMSProp"; }
+        int StateBuffers() override { return 1; }
+};
+
+
+/********
+ * ADAM *
+ ********/
+
+class Adam: public Optimizer {
+    protected:
+        double _beta1;
+        double _beta2;
+        double _epsilon;
+        // decoupled weight decay (zero for Adam, see AdamW)
+        double _weightDecay;
+
+        void UpdateRange(const TrainableParameter&, long begin, long end) override;
+        double FlopsPerParameter() override { return 15; }
+
+    public:
+        // constructor
+        Adam(std::string lossFctName, int batchSize, double learningRate, double beta1=0.9, double beta2=0.999, double epsilon=1e-8):
+            Optimizer(lossFctName, batchSize, learningRate),
+            _beta1(beta1),
+            _beta2(beta2),
+            _epsilon(epsilon),
+            _weightDecay(0.0) {}
+
+        std::string Name() override { return "Adam"; }
+        int StateBuffers() override { return 2; }
+};
+
+
+/*********
+ * ADAMW *
+ *********/
+
+class AdamW: public Adam {
+    public:
+        // constructor
+        AdamW(std::string lossFctName, int batchSize, double learningRate, double weightDecay=0.01, double beta1=0.9,
+              double beta2=0.999, double epsilon=1e-8):
+            Adam(lossFctName, batchSize, learningRate, beta1, beta2, epsilon) {
+                _weightDecay = weightDecay;
+            }
 
-        // online-training
-        void Train(SequentialNN&, const Eigen::MatrixXd&, const Eigen::MatrixXd&, int epochs);
+        std::string Name() override { return "AdamW"; }
 };
 
-#endif // OPTIMIZER_H_
\ No newline at end of file
+#endif // OPTIMIZER_H_
@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstdint>
+#include "mapped_file.h"
+#include <memory>
+#include "parameter_block.h"
+#include <stdexcept>
+#include <string>
+
+/*******************
+ * PARAMETER BLOCK *
+ *******************/
+
+ParameterBlock::ParameterBlock(long size):
+    _storage(std::max(size, 0L), 0.0),
+    _data(_storage.data()),
+    _size(size)
+    {
+        if (size < 0) {
+            throw std::invalid_argument("Size of a parameter block has to be non-negative.");
+        }
+    }
+
+ParameterBlock::ParameterBlock(std::shared_ptr<MappedFile> file, size_t offset, long size):
+    _file(file),
+    _data(nullptr),
+    _size(size)
+    {
+        if ((size < 0) || (offset + size*sizeof(double) > file->Size())) {
+            throw std::out_of_range("Parameter block exceeds the mapped file " + file->Path());
+        }
+        if ((offset % alignof(double)) != 0) {
+            throw std::invalid_argument("Parameter block in " + file->Path() + " is not aligned.");
+        }
+        if (size > 0) {
+            _data = reinterpret_cast<double*>(file->MutableData() + offset);
+        }
+    }
+
+std::shared_ptr<ParameterBlock> ParameterBlock::Clone() const {
+    auto clone = std::make_shared<ParameterBlock>(_size);
+    std::copy(_data, _data + _size, clone->Data());
+    return clone;
+}
+
+bool ParameterBlock::MakeUnique(std::shared_ptr<ParameterBlock>& block) {
+    if ((block == nullptr) || (block.use_count() == 1)) {
+        return false;
+    }
+    block = block->Clone();
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef PARAMETER_BLOCK_H_
+#define PARAMETER_BLOCK_H_
+
+#include <Eigen/Dense>
+#include "mapped_file.h"
+#include <memory>
+#include <vector>
+
+/*******************
+ * PARAMETER BLOCK *
+ *******************/
+
+/**
+    Contiguous array of doubles which holds the parameters of a transformation (e.g. the weights followed by the bias
+    of a LinearTransformation, which are Eigen::Maps into the block). The storage is either
+        * owned: allocated (and zero-initialized) on the heap, or
+        * mapped: a view into a writable (copy-on-write) MappedFile, e.g. a checkpoint (see Checkpoint::Load). The
+          parameters are used in place without copying them; the pages are loaded lazily and shared with other
+          processes which map the same file until they are written (e.g. by an optimizer).
+
+    Usage:
+        auto block = std::make_shared<ParameterBlock>(rows*cols + rows);
+        Eigen::Map<Eigen::MatrixXd> weights(block->Data(), rows, cols);
+
+    A block can be shared by several transformations (e.g. the fine-tuned variants of a base network, see
+    ~SequentialNN::Clone~). It is then read-only for all of them: a transformation which writes its parameters first
+    replaces the block by an owned copy with ~MakeUnique~ (copy-on-write), so the memory of a clone only grows with
+    the layers it actually changes.
+
+    NOTE: the mapped file is kept alive by the block (shared by all blocks of the file).
+*/
+
+class ParameterBlock {
+    private:
+        // owned storage (empty if mapped)
+        std::vector<double, Eigen::aligned_allocator<double> > _storage;
+        // mapped storage (nullptr if owned)
+        std::shared_ptr<MappedFile> _file;
+        double* _data;
+        long _size;
+
+    public:
+        // constructor (owned, all zeros)
+        explicit ParameterBlock(long size);
+        // constructor (view of size doubles at the given offset of a writable mapped file)
+        ParameterBlock(std::shared_ptr<MappedFile> file, size_t offset, long size);
+
+        // no copies (use Clone)
+        ParameterBlock(const ParameterBlock&) = delete;
+        ParameterBlock& operator=(const ParameterBlock&) = delete;
+
+        // getters
+        double* Data() { return _data; }
+        const double* Data() const { return _data; }
+        long Size() const { return _size; }
+        bool Mapped() const { return _file != nullptr; }
+
+        // owned copy of the block
+        std::shared_ptr<ParameterBlock> Clone() const;
+        // copy-on-write: replaces the block by a copy if it is shared with other owners (true if it was copied)
+        // NOTE: not thread-safe, i.e. blocks must not be made unique while other threads use them
+        static bool MakeUnique(std::shared_ptr<ParameterBlock>& block);
+};
+
+#endif // PARAMETER_BLOCK_H_
@@ -0,0 +1,133 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include "perf_counters.h"
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*****************
+ * PERF COUNTERS *
+ *****************/
+
+std::string PerfCounters::EventName(Event event) {
+    switch (event) {
+        case Event::kCycles: return "cycles";
+        case Event::kInstructions: return "instructions";
+        case Event::kCacheMisses: return "cache_misses";
+        case Event::kL1DMisses: return "l1d_load_misses";
+        case Event::kLLCMisses: return "llc_load_misses";
+        case Event::kBranchMisses: return "branch_misses";
+    }
+    return "";
+}
+
+#if defined(__linux__)
+
+namespace {
+
+// type and config of the events (in the order of PerfCounters::Event)
+void EventConfig(int event, uint32_t& type, uint64_t& config) {
+    const uint64_t readMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch (event) {
+        case 0: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case 1: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case 2: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case 3: type = PERF_TYPE_HW_CACHE; config = PERF_COUNT_HW_CACHE_L1D | readMiss; break;
+        case 4: type = PERF_TYPE_HW_CACHE; config = PERF_COUNT_HW_CACHE_LL | readMiss; break;
+        default: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    }
+}
+
+int OpenEvent(int event, int leader) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    uint32_t type;
+    uint64_t config;
+    EventConfig(event, type, config);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // the group is enabled with its leader
+    attr.disabled = (leader == -1) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // calling thread on any CPU
+    return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+}  // namespace
+
+PerfCounters::PerfCounters(): _leader(-1), _opened(0) {
+    _fds.fill(-1);
+    _index.fill(-1);
+    int firstError = 0;
+    for (int e=0; e<kEvents; e++) {
+        int fd = OpenEvent(e, _leader);
+        if (fd < 0) {
+            int error = errno;
+            firstError = (firstError == 0) ? error : firstError;
+            _error += (_error.empty() ? "" : "; ") + EventName((Event)e) + ": " + std::strerror(error);
+            continue;
+        }
+        if (_leader == -1) {
+            _leader = fd;
+        }
+        _fds[e] = fd;
+        _index[e] = _opened++;
+    }
+    if (_leader == -1) {
+        _error = std::string("perf_event_open failed: ") + std::strerror(firstError);
+    } else {
+        ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd: _fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+// layout of the group: number of events, time enabled, time running, values
+void PerfCounters::Read(Values& values) const {
+    values.fill(0.0);
+    if (_leader == -1) {
+        return;
+    }
+    uint64_t buffer[3 + kEvents];
+    ssize_t bytes = read(_leader, buffer, sizeof(buffer));
+    if ((bytes < (ssize_t)(3*sizeof(uint64_t))) || (buffer[0] != (uint64_t)_opened) || (buffer[2] == 0)) {
+        return;
+    }
+    double scale = (double)buffer[1]/buffer[2];
+    for (int e=0; e<kEvents; e++) {
+        if (_index[e] >= 0) {
+            values[e] = buffer[3 + _index[e]]*scale;
+        }
+    }
+}
+
+#else
+
+PerfCounters::PerfCounters(): _leader(-1), _opened(0), _error("perf_event_open is only available on Linux") {
+    _fds.fill(-1);
+    _index.fill(-1);
+}
+
+PerfCounters::~PerfCounters() {}
+
+void PerfCounters::Read(Values& values) const {
+    values.fill(0.0);
+}
+
+#endif // __linux__
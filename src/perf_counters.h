@@ -0,0 +1,67 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <array>
+#include <string>
+
+/*****************
+ * PERF COUNTERS *
+ *****************/
+
+/**
+    Hardware performance counters of the calling thread via Linux' ~perf_event_open~: cycles, instructions, cache
+    misses, L1 data cache and last level cache (LLC) load misses and branch misses. Used by the Profiler to attribute
+    the counters to the layers (see ~Profiler::SetCounters~), but it can also be used directly:
+        PerfCounters counters;
+        PerfCounters::Values start, end;
+        counters.Read(start);
+        ...
+        counters.Read(end);
+
+    The counters are opened as a single group (read with one system call, scheduled together) and only count user
+    space. If the kernel multiplexes the group with other events, the values are scaled with the fraction of the time
+    the group was running.
+
+    Counters are often not available, e.g. in containers (seccomp), with a restrictive ~perf_event_paranoid~, in virtual
+    machines without a virtual PMU or on other operating systems. Then the constructor does not throw: ~Available()~
+    is false (or false for single events) with the reason in ~Error()~, and the values of the missing counters are zero.
+
+    NOTE: only the thread which constructed the object is counted (not e.g. the workers of the ThreadPool).
+*/
+
+class PerfCounters {
+    public:
+        enum class Event { kCycles = 0, kInstructions = 1, kCacheMisses = 2, kL1DMisses = 3, kLLCMisses = 4,
+                           kBranchMisses = 5 };
+        static const int kEvents = 6;
+        using Values = std::array<double, kEvents>;
+
+    private:
+        // file descriptor of the group leader and of each event (-1 if not available)
+        int _leader;
+        std::array<int, kEvents> _fds;
+        // position of each event in the values of the group (-1 if not available)
+        std::array<int, kEvents> _index;
+        int _opened;
+        std::string _error;
+
+    public:
+        // opens the counters of the calling thread (never throws)
+        PerfCounters();
+        ~PerfCounters();
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        // true if at least one (or the given) counter is available
+        bool Available() const { return _opened > 0; }
+        bool Available(Event event) const { return _index[(int)event] >= 0; }
+        // reason why (some of) the counters are not available (empty if all are)
+        const std::string& Error() const { return _error; }
+
+        // current values of the counters since the construction (zero for counters which are not available)
+        void Read(Values&) const;
+
+        static std::string EventName(Event);
+};
+
+#endif // PERF_COUNTERS_H_
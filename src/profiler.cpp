@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include "profiler.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "trace.h"
+#include <vector>
+
+/************
+ * PROFILER *
+ ************/
+
+void Profiler::Grow(int layer) {
+    if (layer < 0) {
+        throw std::out_of_range("Layer index has to be non-negative.");
+    }
+    if (layer >= (int)_samples.size()) {
+        _samples.resize(layer + 1);
+        _names.resize(layer + 1);
+    }
+}
+
+void Profiler::SetLayerName(int layer, const std::string& name) {
+    Grow(layer);
+    _names[layer] = name;
+}
+
+void Profiler::Reset() {
+    for (auto& phases: _samples) {
+        for (Samples& samples: phases) {
+            samples = Samples();
+        }
+    }
+}
+
+void Profiler::SetCounters(bool counters) {
+    if (!counters) {
+        _counters = nullptr;
+    } else if (_counters == nullptr) {
+        _counters = std::make_shared<PerfCounters>();
+    }
+}
+
+std::string Profiler::CountersError() const {
+    return (_counters == nullptr) ? "hardware counters not enabled" : _counters->Error();
+}
+
+void Profiler::RecordCounters(Phase phase, int layer) {
+    PerfCounters::Values end;
+    _counters->Read(end);
+    Grow(layer);
+    Samples& samples = _samples[layer][(int)phase];
+    for (int e=0; e<PerfCounters::kEvents; e++) {
+        samples.counters[e] += end[e] - _start[e];
+    }
+    samples.counted++;
+}
+
+void Profiler::Record(Phase phase, int layer, double seconds, double flops, double bytes) {
+    Grow(layer);
+    Samples& samples = _samples[layer][(int)phase];
+    samples.seconds.push_back(seconds);
+    samples.flops += flops;
+    samples.bytes += bytes;
+}
+
+std::string Profiler::PhaseName(Phase phase) {
+    switch (phase) {
+        case Phase::kForward: return "forward";
+        case Phase::kBackward: return "backward";
+        case Phase::kUpdate: return "update";
+    }
+    return "";
+}
+
+// nearest-rank percentile of sorted samples
+static double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    long rank = (long)std::ceil(p*sorted.size());
+    return sorted[std::min<long>(std::max<long>(rank, 1), sorted.size()) - 1];
+}
+
+std::vector<Profiler::LayerStats> Profiler::Report() const {
+    std::vector<LayerStats> report(_samples.size());
+    for (size_t i=0; i<_samples.size(); i++) {
+        report[i].name = _names[i].empty() ? "layer " + std::to_string(i) : _names[i];
+        for (int p=0; p<kPhases; p++) {
+            const Samples& samples = _samples[i][p];
+            std::vector<double> sorted(samples.seconds);
+            std::sort(sorted.begin(), sorted.end());
+            PhaseStats& stats = report[i].phases[p];
+            stats.calls = sorted.size();
+            stats.totalSeconds = 0;
+            for (double seconds: sorted) {
+                stats.totalSeconds += seconds;
+            }
+            stats.meanSeconds = (stats.calls > 0) ? stats.totalSeconds/stats.calls : 0.0;
+            stats.p50Seconds = Percentile(sorted, 0.5);
+            stats.p90Seconds = Percentile(sorted, 0.9);
+            stats.p99Seconds = Percentile(sorted, 0.99);
+            stats.gflops = (stats.totalSeconds > 0) ? samples.flops/stats.totalSeconds*1e-9 : 0.0;
+            stats.bytesPerCall = (stats.calls > 0) ? samples.bytes/stats.calls : 0.0;
+            stats.gbytesPerSecond = (stats.totalSeconds > 0) ? samples.bytes/stats.totalSeconds*1e-9 : 0.0;
+            for (int e=0; e<PerfCounters::kEvents; e++) {
+                bool available = CountersAvailable() && _counters->Available((PerfCounters::Event)e) && (samples.counted > 0);
+                stats.counters[e] = available ? samples.counters[e]/samples.counted : -1.0;
+            }
+            double cycles = stats.counters[(int)PerfCounters::Event::kCycles];
+            double instructions = stats.counters[(int)PerfCounters::Event::kInstructions];
+            stats.ipc = ((cycles > 0) && (instructions >= 0)) ? instructions/cycles : -1.0;
+        }
+    }
+    return report;
+}
+
+std::string Profiler::Text() const {
+    std::ostringstream text;
+    text << std::left << std::setw(24) << "layer" << std::setw(10) << "phase" << std::right
+         << std::setw(8) << "calls" << std::setw(12) << "mean[us]" << std::setw(12) << "p50[us]"
+         << std::setw(12) << "p90[us]" << std::setw(12) << "p99[us]" << std::setw(10) << "GFLOP/s"
+         << std::setw(12) << "KB/call" << std::setw(8) << "GB/s" << "\n";
+    text << std::fixed;
+    double totalSeconds = 0;
+    for (const LayerStats& layer: Report()) {
+        for (int p=0; p<kPhases; p++) {
+            const PhaseStats& stats = layer.phases[p];
+            if (stats.calls == 0) {
+                continue;
+            }
+            totalSeconds += stats.totalSeconds;
+            text << std::left << std::setw(24) << layer.name << std::setw(10) << PhaseName((Phase)p) << std::right
+                 << std::setw(8) << stats.calls << std::setprecision(1)
+                 << std::setw(12) << stats.meanSeconds*1e6 << std::setw(12) << stats.p50Seconds*1e6
+                 << std::setw(12) << stats.p90Seconds*1e6 << std::setw(12) << stats.p99Seconds*1e6
+                 << std::setprecision(2) << std::setw(10) << stats.gflops
+                 << std::setprecision(1) << std::setw(12) << stats.bytesPerCall/1024
+                 << std::setprecision(2) << std::setw(8) << stats.gbytesPerSecond << "\n";
+        }
+    }
+    text << "total: " << std::setprecision(3) << totalSeconds*1e3 << " ms\n";
+    if (Counters()) {
+        text << CountersText();
+    }
+    return text.str();
+}
+
+// mean of the hardware counters per call (- if not available)
+std::string Profiler::CountersText() const {
+    std::ostringstream text;
+    if (!CountersAvailable()) {
+        text << "hardware counters not available: " << CountersError() << "\n";
+        return text.str();
+    }
+    text << std::left << std::setw(24) << "layer" << std::setw(10) << "phase" << std::right << std::setw(8) << "IPC";
+    for (int e=0; e<PerfCounters::kEvents; e++) {
+        text << std::setw(17) << PerfCounters::EventName((PerfCounters::Event)e);
+    }
+    text << "\n" << std::fixed;
+    for (const LayerStats& layer: Report()) {
+        for (int p=0; p<kPhases; p++) {
+            const PhaseStats& stats = layer.phases[p];
+            if (stats.calls == 0) {
+                continue;
+            }
+            text << std::left << std::setw(24) << layer.name << std::setw(10) << PhaseName((Phase)p) << std::right
+                 << std::setprecision(2) << std::setw(8);
+            (stats.ipc >= 0) ? (text << stats.ipc) : (text << "-");
+            text << std::setprecision(0);
+            for (int e=0; e<PerfCounters::kEvents; e++) {
+                text << std::setw(17);
+                (stats.counters[e] >= 0) ? (text << stats.counters[e]) : (text << "-");
+            }
+            text << "\n";
+        }
+    }
+    return text.str();
+}
+
+std::string Profiler::JSON() const {
+    std::ostringstream json;
+    json << std::setprecision(9);
+    json << "{\"layers\": [";
+    std::vector<LayerStats> report = Report();
+    for (size_t i=0; i<report.size(); i++) {
+        json << (i > 0 ? ", " : "") << "{\"index\": " << i << ", \"name\": \"" << Trace::Escape(report[i].name) << "\"";
+        for (int p=0; p<kPhases; p++) {
+            const PhaseStats& stats = report[i].phases[p];
+            json << ", \"" << PhaseName((Phase)p) << "\": {\"calls\": " << stats.calls
+                 << ", \"total_seconds\": " << stats.totalSeconds << ", \"mean_seconds\": " << stats.meanSeconds
+                 << ", \"p50_seconds\": " << stats.p50Seconds << ", \"p90_seconds\": " << stats.p90Seconds
+                 << ", \"p99_seconds\": " << stats.p99Seconds << ", \"gflops\": " << stats.gflops
+                 << ", \"bytes_per_call\": " << stats.bytesPerCall << ", \"gbytes_per_second\": " << stats.gbytesPerSecond;
+            // counters per call (null if not available)
+            if (Counters()) {
+                json << ", \"counters\": {\"ipc\": ";
+                (stats.ipc >= 0) ? (json << stats.ipc) : (json << "null");
+                for (int e=0; e<PerfCounters::kEvents; e++) {
+                    json << ", \"" << PerfCounters::EventName((PerfCounters::Event)e) << "\": ";
+                    (stats.counters[e] >= 0) ? (json << stats.counters[e]) : (json << "null");
+                }
+                json << "}";
+            }
+            json << "}";
+        }
+        json << "}";
+    }
+    json << "]";
+    if (Counters()) {
+        json << ", \"counters_available\": " << (CountersAvailable() ? "true" : "false") << ", \"counters_error\": \""
+             << Trace::Escape(CountersError()) << "\"";
+    }
+    json << "}";
+    return json.str();
+}
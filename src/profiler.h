@@ -0,0 +1,155 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include "perf_counters.h"
+#include <string>
+#include <vector>
+
+/************
+ * PROFILER *
+ ************/
+
+/**
+    Per-layer instrumentation of the three phases of a training step: forward pass, backward pass (including the
+    accumulation of the Deltas) and the update of the parameters. A profiler is attached to a network with
+    ~SequentialNN::SetProfiler~ (or by the optimizer during ~Train~, see ~Optimizer::SetProfiling~):
+        auto profiler = std::make_shared<Profiler>();
+        snn.SetProfiler(profiler);
+        sdg.Step(snn, batch, batchLabel);
+        std::cout << profiler->Text();
+
+    For each layer and phase, the network calls ~Begin~ and ~End~ around the work of the layer. They
+        * call the optional pre- and post-hooks (~SetHooks~), e.g. to count calls or to check the LayerCaches,
+        * time the work with a monotonic clock (unless ~SetTiming(false)~) and record the duration together with
+          the number of floating point operations and bytes moved (estimated from the shapes by the caller).
+    Without a profiler, the network runs its plain loops, so turning it off costs a single branch per pass.
+
+    ~Report~ aggregates the samples per layer and phase: number of calls, mean and percentiles (p50/p90/p99) of the
+    duration, GFLOP/s and bytes moved. ~Text~ and ~JSON~ format the report.
+
+    Hardware counters: with ~SetCounters(true)~, ~Begin~ and ~End~ also read the PerfCounters of the calling thread
+    (cycles, instructions, cache, L1D and LLC misses, branch misses), and the report contains their mean per call and
+    the instructions per cycle. If the counters are not available (e.g. in containers), the profiler works as before:
+    ~CountersAvailable()~ is false, ~CountersError()~ gives the reason and the report marks the counters as missing.
+
+    NOTE: a profiler is not thread-safe. It is only attached to the network itself, not to its replicas (see
+    ~SequentialNN::Replicate~), so with several threads only the micro-batches of the network itself are recorded.
+*/
+
+class Profiler {
+    public:
+        enum class Phase { kForward = 0, kBackward = 1, kUpdate = 2 };
+        static const int kPhases = 3;
+
+        using Clock = std::chrono::steady_clock;
+        // hook called with the phase and the index of the layer
+        using Hook = std::function<void(Phase, int)>;
+
+        // aggregated samples of one layer and phase
+        struct PhaseStats {
+            long calls;
+            double totalSeconds;
+            double meanSeconds;
+            double p50Seconds;
+            double p90Seconds;
+            double p99Seconds;
+            double gflops;
+            double bytesPerCall;
+            double gbytesPerSecond;
+            // mean of the hardware counters per call and instructions per cycle (-1 if not available)
+            PerfCounters::Values counters;
+            double ipc;
+        };
+
+        struct LayerStats {
+            std::string name;
+            PhaseStats phases[kPhases];
+        };
+
+    private:
+        struct Samples {
+            std::vector<double> seconds;
+            double flops = 0;
+            double bytes = 0;
+            // sums of the differences of the counters and the number of calls with counters
+            PerfCounters::Values counters{};
+            long counted = 0;
+        };
+
+        bool _timing;
+        // hardware counters (nullptr if not enabled) and their values at the last Begin
+        std::shared_ptr<PerfCounters> _counters;
+        PerfCounters::Values _start;
+        Hook _pre;
+        Hook _post;
+        // samples per layer and phase
+        std::vector<std::array<Samples, kPhases> > _samples;
+        std::vector<std::string> _names;
+
+        void Grow(int layer);
+        // add the difference of the counters since Begin
+        void RecordCounters(Phase phase, int layer);
+
+    public:
+        // constructor
+        explicit Profiler(bool timing=true): _timing(timing) {}
+
+        // setters
+        void SetTiming(bool timing) { _timing = timing; }
+        // read the hardware counters of the calling thread around each layer (opened here, see above)
+        void SetCounters(bool);
+        // hooks before and after the work of a layer (empty functions to remove them)
+        void SetHooks(Hook pre, Hook post) { _pre = pre; _post = post; }
+        // name of a layer in the report
+        void SetLayerName(int layer, const std::string& name);
+        // remove all samples (the names and hooks are kept)
+        void Reset();
+
+        // getters
+        bool Timing() const { return _timing; }
+        int Layers() const { return _samples.size(); }
+        bool Counters() const { return _counters != nullptr; }
+        bool CountersAvailable() const { return (_counters != nullptr) && _counters->Available(); }
+        std::string CountersError() const;
+
+        // called by the network around the work of a layer in the given phase
+        Clock::time_point Begin(Phase phase, int layer) {
+            if (_pre) {
+                _pre(phase, layer);
+            }
+            if (_counters != nullptr) {
+                _counters->Read(_start);
+            }
+            return _timing ? Clock::now() : Clock::time_point();
+        }
+        void End(Phase phase, int layer, Clock::time_point start, double flops, double bytes) {
+            Clock::time_point end = _timing ? Clock::now() : Clock::time_point();
+            if (_counters != nullptr) {
+                RecordCounters(phase, layer);
+            }
+            if (_timing) {
+                Record(phase, layer, std::chrono::duration<double>(end - start).count(), flops, bytes);
+            }
+            if (_post) {
+                _post(phase, layer);
+            }
+        }
+        // add a sample by hand
+        void Record(Phase phase, int layer, double seconds, double flops, double bytes);
+
+        // aggregated samples per layer
+        std::vector<LayerStats> Report() const;
+        // report as table and as JSON
+        std::string Text() const;
+        std::string JSON() const;
+        // table of the hardware counters (part of Text)
+        std::string CountersText() const;
+
+        static std::string PhaseName(Phase);
+};
+
+#endif // PROFILER_H_
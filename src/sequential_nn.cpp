@@ -1,13 +1,22 @@
 #include <algorithm>
+#include <cmath>
 #include <Eigen/Dense>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <variant>
 #include <vector>
 
+#include "allocation_tracker.h"
+#include "execution_plan.h"
+#include "function.h"
 #include "layer.h"
 #include "layer_cache.h"
 #include "loss_function.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include "transformation.h"
 #include "sequential_nn.h"
 
@@ -15,12 +24,12 @@
  * HELPER FUNCTIONS *
  ********************/
 
-bool SequentialNN::ComposabilityCheck(const std::vector<std::shared_ptr<Layer> >& layers) {
+bool SequentialNN::ComposabilityCheck(std::vector<LayerVariant>& layers) {
     bool composable = true;
     int N = layers.size();
 
     for (int i=0; i<N-1; i++) {
-        if (layers[i]->Rows() != layers[i+1]->Cols()) {
+        if (AsLayer(layers[i]).Rows() != AsLayer(layers[i+1]).Cols()) {
             composable = false;
             break;
         }
@@ -28,16 +37,17 @@ bool SequentialNN::ComposabilityCheck(const std::vector<std::shared_ptr<Layer> >
     return composable;
 }
 
-std::string SequentialNN::GetInitializationType(const std::shared_ptr<Layer>& layer, const std::shared_ptr<Layer>& next_layer) {
-    std::string layer_type = layer->GetTransformation()->Type();
-    std::string next_layer_type = next_layer->GetTransformation()->Type();
+std::string SequentialNN::GetInitializationType(Layer& layer, Layer& next_layer) {
+    std::string layer_type = layer.GetTransformation()->Type();
+    std::string next_layer_type = next_layer.GetTransformation()->Type();
     
-    if (layer_type != "LinearTransformation") { // TODO: this is not ideal if we e.g. add further layers
+    if ((layer_type != "LinearTransformation") && (layer_type != "ConvTransformation")) { // TODO: this is not ideal if we e.g. add further layers
         return "";
     }
 
     std::vector<std::string> approximate_linear = {"identity", "sigmoid", "tanh", "softmax"};
-    std::vector<std::string> other_activation = {"relu", "prelu"};
+    // NOTE: a max-pool directly after a convolution is usually followed by a relu
+    std::vector<std::string> other_activation = {"relu", "prelu", "MaxPoolTransformation"};
 
     // search for different activations
     // TODO: couldn't this be optimized? (e.g. consider case where next_layer_transformation_type == "LinearTransformation")
@@ -61,39 +71,75 @@ std::string SequentialNN::GetInitializationType(const std::shared_ptr<Layer>& la
  ********************************************/
 
 // constructor
-SequentialNN::SequentialNN(std::vector<std::shared_ptr<Layer> > layers) {
-    if (ComposabilityCheck(layers) == false) {
+SequentialNN::SequentialNN(std::vector<LayerVariant> layers, bool initialize):
+    _layers(std::move(layers))
+    {
+    if (ComposabilityCheck(_layers) == false) {
         throw std::invalid_argument("Layers are not composable.");
     } else {
-        int N = layers.size();
-
-        for (int i = 0; i < N; i++) {
-            _layers.emplace_back(std::move(layers[i])); // TODO: move necessary?
-        }
+        int N = _layers.size();
 
         // connect layers
         for (int i = 0; i < N-1; i++) {
             // only one sample for initialization/connecting the layers
             int batchSize = 1;
-            _layers[i]->GetLayerCache().Connect(_layers[i]->Rows(), batchSize, _layers[i+1]->Cols(), _layers[i+1]->GetLayerCache());
+            AsLayer(_layers[i]).GetLayerCache().Connect(AsLayer(_layers[i]).Rows(), batchSize, AsLayer(_layers[i+1]).Cols(), AsLayer(_layers[i+1]).GetLayerCache());
         }
     }
     // finally initialize the weights
-    Initialize();
+    if (initialize) {
+        Initialize();
+    }
+}
+
+// replica (the weights are shared, so no initialization)
+SequentialNN SequentialNN::Replicate() {
+    std::vector<LayerVariant> layers;
+    layers.reserve(Length());
+    for (int i=0; i < Length(); i++) {
+        layers.push_back(ToLayerVariant(*AsLayer(_layers[i]).Replicate()));
+    }
+    SequentialNN replica(layers, false);
+    replica.SetTraining(Training());
+    if (_plan != nullptr) {
+        replica.Compile(_plan->MaxBatch(), _plan->GetMode());
+    }
+    return replica;
+}
+
+// clone (the parameter blocks are shared, so no initialization)
+SequentialNN SequentialNN::Clone() {
+    std::vector<LayerVariant> layers;
+    layers.reserve(Length());
+    for (int i=0; i < Length(); i++) {
+        Layer& layer = AsLayer(_layers[i]);
+        if (auto linear = std::dynamic_pointer_cast<LinearTransformation>(layer.GetTransformation())) {
+            layers.push_back(LinearLayer(std::make_shared<LinearTransformation>(linear->Rows(), linear->Cols(),
+                                                                                linear->Parameters())));
+        } else if (auto conv = std::dynamic_pointer_cast<ConvTransformation>(layer.GetTransformation())) {
+            layers.push_back(ConvLayer(std::make_shared<ConvTransformation>(*conv)));
+        } else {
+            // no parameters (as for replicas, the transformation is shared)
+            layers.push_back(ToLayerVariant(*layer.Replicate()));
+        }
+    }
+    SequentialNN clone(layers, false);
+    clone.SetTraining(Training());
+    return clone;
 }
 
 // getters
 int SequentialNN::InputSize() {
-    if (_layers[0] == nullptr || _layers.empty()) {
+    if (_layers.empty()) {
         throw std::invalid_argument("Layers are empty.");
     }
-    return _layers[0]->Cols();
+    return AsLayer(_layers[0]).Cols();
 }
 int SequentialNN::OutputSize() {
-    if (_layers[0] == nullptr || _layers.empty()) {
+    if (_layers.empty()) {
         throw std::invalid_argument("Layers are empty.");
     }
-    return _layers.back()->Rows();
+    return AsLayer(_layers.back()).Rows();
 }
 
 // methods
@@ -101,17 +147,143 @@ void SequentialNN::Initialize() {
     int N = _layers.size();
 
     for (int i=0; i < N-1; i++) {
-        _layers[i]->GetTransformation()->Initialize(SequentialNN::GetInitializationType(_layers[i], _layers[i+1]));
+        AsLayer(_layers[i]).GetTransformation()->Initialize(SequentialNN::GetInitializationType(AsLayer(_layers[i]), AsLayer(_layers[i+1])));
     }
     // TODO: here might be some room to optimize (e.g. jump over the ones which have "" as initialization type)
 }
 
+// switch training mode on/off
+// NOTE: layers which use a mask in training mode (relu) transform in place, i.e. their forward output points to 
+// their forward input. This does not work for the first layer because ~Input~ copies into its forward input and is only
+// done after LinearLayers because other layers (e.g. softmax) might need their forward output in the backward pass.
+void SequentialNN::SetTraining(bool training) {
+    if (Training() == training) {
+        return;
+    }
+    int N = _layers.size();
+
+    for (int i=0; i < N; i++) {
+        AsLayer(_layers[i]).SetTraining(training);
+        if ((i == 0) || !(AsLayer(_layers[i]).GetTransformation()->UsesMask()) 
+            || (AsLayer(_layers[i-1]).GetTransformation()->Type() != "LinearTransformation")) {
+            continue;
+        }
+        LayerCache& layer_cache = AsLayer(_layers[i]).GetLayerCache();
+        std::shared_ptr<Eigen::MatrixXd> output = training ? 
+            layer_cache.GetForwardInput() : std::make_shared<Eigen::MatrixXd>(*(layer_cache.GetForwardInput()));
+        // release (training) or recreate (no training) the separate forward output and reconnect to the next layer
+        layer_cache.SetForwardOutput(output);
+        if (i < N-1) {
+            AsLayer(_layers[i+1]).GetLayerCache().SetForwardInput(output);
+        }
+    }
+}
+
+void SequentialNN::Compile(int maxBatch, ExecutionPlan::Mode mode) {
+    _plan = std::make_unique<ExecutionPlan>(_layers, maxBatch, mode);
+}
+
+// NOTE: the calls of fused layers are recorded as the first of them (with the costs of all of them)
+void SequentialNN::RunPlan(Profiler::Phase phase, bool accumulateDeltas) {
+    bool forward = (phase == Profiler::Phase::kForward);
+    _plan->Rebind();
+    if ((_profiler == nullptr) && !Trace::Enabled()) {
+        if (forward) {
+            _plan->Forward();
+        } else {
+            _plan->Backward(accumulateDeltas);
+        }
+        return;
+    }
+    const std::vector<ExecutionPlan::Call>& calls = forward ? _plan->ForwardCalls() : _plan->BackwardCalls();
+    long batchSize = _plan->Batch();
+    double flops, bytes, layerFlops, layerBytes;
+    for (const ExecutionPlan::Call& call: calls) {
+        TraceScope scope(forward ? "forward" : "backward", "layer", call.layer);
+        if (_profiler == nullptr) {
+            call.kernel(call, batchSize, accumulateDeltas);
+            continue;
+        }
+        auto start = _profiler->Begin(phase, call.layer);
+        call.kernel(call, batchSize, accumulateDeltas);
+        flops = bytes = 0;
+        for (int i=call.layer; i < call.layer + call.layers; i++) {
+            LayerCost(i, phase, batchSize, layerFlops, layerBytes, accumulateDeltas);
+            flops += layerFlops;
+            bytes += layerBytes;
+        }
+        _profiler->End(phase, call.layer, start, flops, bytes);
+    }
+}
+
+void SequentialNN::SetProfiler(std::shared_ptr<Profiler> profiler) {
+    _profiler = profiler;
+    if (_profiler == nullptr) {
+        return;
+    }
+    for (int i=0; i < Length(); i++) {
+        std::string type = AsLayer(_layers[i]).GetTransformation()->Type();
+        std::string name = std::to_string(i) + " ";
+        if (type == "LinearTransformation") {
+            name += "linear " + std::to_string(AsLayer(_layers[i]).Rows()) + "x" + std::to_string(AsLayer(_layers[i]).Cols());
+        } else {
+            name += type + " " + std::to_string(AsLayer(_layers[i]).Rows());
+        }
+        _profiler->SetLayerName(i, name);
+    }
+}
+
+// NOTE: rough estimates (doubles read and written once per pass), e.g. to compare the layers with the peak
+// performance and memory bandwidth of the machine
+void SequentialNN::LayerCost(int i, Profiler::Phase phase, long batchSize, double& flops, double& bytes, bool deltas) {
+    double r = AsLayer(_layers.at(i)).Rows();
+    double c = AsLayer(_layers[i]).Cols();
+    double n = batchSize;
+    if (AsLayer(_layers[i]).GetTransformation()->Type() == "LinearTransformation") {
+        if (phase == Profiler::Phase::kForward) {
+            // W*X + b
+            flops = 2*r*c*n + r*n;
+            bytes = 8*(r*c + r + c*n + r*n);
+        } else if (deltas) {
+            // backward output and Deltas (backward input^T * X^T, summed backward input)
+            flops = 4*r*c*n + r*n;
+            bytes = 8*(3*r*c + 2*r + 2*r*n + 2*c*n);
+        } else {
+            // backward input * W
+            flops = 2*r*c*n;
+            bytes = 8*(r*c + r*n + c*n);
+        }
+    } else if (auto conv = std::dynamic_pointer_cast<ConvTransformation>(AsLayer(_layers[i]).GetTransformation())) {
+        // like a linear layer with the im2col patches (k = patch size) as input of each output pixel
+        double k = conv->PatchSize();
+        double patches = conv->Positions()*k*n;
+        if (phase == Profiler::Phase::kForward) {
+            flops = 2*r*k*n + r*n;
+            bytes = 8*(conv->Weights().size() + c*n + 2*patches + r*n);
+        } else if (deltas) {
+            flops = 4*r*k*n + r*n;
+            bytes = 8*(3*conv->Weights().size() + 2*r*n + 4*patches + 2*c*n);
+        } else {
+            flops = 2*r*k*n;
+            bytes = 8*(conv->Weights().size() + r*n + 2*patches + c*n);
+        }
+    } else {
+        // elementwise
+        flops = r*n;
+        bytes = (phase == Profiler::Phase::kForward) ? 16*r*n : 24*r*n;
+    }
+}
+
+bool SequentialNN::Training() {
+    return (!_layers.empty()) && AsLayer(_layers[0]).Training();
+}
+
 std::string SequentialNN::Summary() {
     std::string summary = "Summary of sequential neural network: \n";
     int N = _layers.size();
 
     for (int i=0; i < N; i++) {
-        summary += "\nLayer " + std::to_string(i) + ":\n" + _layers[i]->Summary() + "\n";
+        summary += "\nLayer " + std::to_string(i) + ":\n" + AsLayer(_layers[i]).Summary() + "\n";
     }
 
     return summary;
@@ -121,62 +293,244 @@ std::string SequentialNN::Summary() {
 /****************
  * FORWARD PASS *
  ****************/
-void SequentialNN::Input(Eigen::MatrixXd input) {
-    _layers[0]->Input(input);
+void SequentialNN::Input(const Eigen::Ref<const Eigen::MatrixXd>& input) {
+    if (_plan != nullptr) {
+        _plan->Input(input);
+        return;
+    }
+    AsLayer(_layers[0]).Input(input);
     // now adjust the batch size if necessary
     int batchSize = input.cols();
     for (int i=0; i < Length(); i++) {
-        _layers[i]->GetLayerCache().SetBatchSize(batchSize); 
+        AsLayer(_layers[i]).GetLayerCache().SetBatchSize(batchSize); 
     }
 }
 
 void SequentialNN::Forward() {
-    for (int i=0; i < Length(); i++) {
-        _layers[i]->Forward();
+    AllocationScope allocations(AllocationTracker::Phase::kForward);
+    if (_plan != nullptr) {
+        RunPlan(Profiler::Phase::kForward, false);
+        return;
+    }
+    ForwardLayers(Length());
+}
+void SequentialNN::ForwardLayers(int count) {
+    if ((_profiler == nullptr) && !Trace::Enabled()) {
+        // NOTE: static dispatch over the concrete layer types (see LayerVariant)
+        for (int i=0; i < count; i++) {
+            std::visit([](auto& concrete) { concrete.Forward(); }, _layers[i]);
+        }
+        return;
+    }
+    long batchSize = AsLayer(_layers[0]).GetLayerCache().GetForwardInput()->cols();
+    double flops, bytes;
+    for (int i=0; i < count; i++) {
+        TraceScope scope("forward", "layer", i);
+        if (_profiler == nullptr) {
+            AsLayer(_layers[i]).Forward();
+            continue;
+        }
+        auto start = _profiler->Begin(Profiler::Phase::kForward, i);
+        AsLayer(_layers[i]).Forward();
+        LayerCost(i, Profiler::Phase::kForward, batchSize, flops, bytes);
+        _profiler->End(Profiler::Phase::kForward, i, start, flops, bytes);
     }
 }
 Eigen::MatrixXd& SequentialNN::Output() {
-    if ((_layers.back())->GetLayerCache().GetForwardOutput() == nullptr) {
+    if (_plan != nullptr) {
+        return _plan->Output();
+    }
+    if (AsLayer(_layers.back()).GetLayerCache().GetForwardOutput() == nullptr) {
         throw std::invalid_argument("Forward output is null.");
     }
-    return *((_layers.back())->GetLayerCache().GetForwardOutput());
+    return *(AsLayer(_layers.back()).GetLayerCache().GetForwardOutput());
 }
-Eigen::MatrixXd SequentialNN::operator()(Eigen::MatrixXd input) {
+Eigen::MatrixXd SequentialNN::operator()(const Eigen::Ref<const Eigen::MatrixXd>& input) {
     Input(input);
     Forward();
     return Output();
 }
 
+// activations which do not change the order of the outputs of a sample (the classification can stop before them)
+static bool PreservesOrder(const std::string& type) {
+    return (type == "softmax") || (type == "sigmoid") || (type == "tanh") || (type == "identity");
+}
+
+// indices of the k largest entries of each column of scores (in descending order) into the columns of classes
+// starting at offset
+// NOTE: insertion into the sorted column of ~classes~, i.e. most entries only need a single comparison with the
+// smallest selected entry
+static void SelectTopK(const Eigen::MatrixXd& scores, int k, Eigen::MatrixXi& classes, long offset) {
+    ThreadPool::Global().ParallelFor(0, scores.cols(), 64, [&](long begin, long end) {
+        for (long j=begin; j<end; j++) {
+            int* selected = classes.col(offset + j).data();
+            if (k == 1) {
+                scores.col(j).maxCoeff(selected);
+                continue;
+            }
+            const double* column = scores.col(j).data();
+            int count = 0;
+            for (int i=0; i<scores.rows(); i++) {
+                if ((count == k) && !(column[i] > column[selected[k-1]])) {
+                    continue;
+                }
+                int position = (count < k) ? count++ : k - 1;
+                while ((position > 0) && (column[i] > column[selected[position-1]])) {
+                    selected[position] = selected[position-1];
+                    position--;
+                }
+                selected[position] = i;
+            }
+        }
+    });
+}
+
+SequentialNN::TopK SequentialNN::PredictTopK(const Eigen::Ref<const Eigen::MatrixXd>& X, int k, bool probabilities, int batchSize) {
+    if (batchSize <= 0) {
+        throw std::invalid_argument("Batch size has to be positive.");
+    }
+    if ((k <= 0) || (k > OutputSize())) {
+        throw std::invalid_argument("k has to be between 1 and the output size.");
+    }
+    // compiled networks are evaluated in batches the plan supports
+    if (_plan != nullptr) {
+        batchSize = std::min(batchSize, _plan->MaxBatch());
+    }
+    // stop at the logits if the last layer does not change the order (see above)
+    std::string type = AsLayer(_layers.back()).GetTransformation()->Type();
+    bool logits = (_plan == nullptr) && (Length() > 1) && PreservesOrder(type);
+    bool softmax = logits && (type == "softmax");
+    Function activation(logits ? type : "identity");
+
+    TopK topK;
+    topK.classes.resize(k, X.cols());
+    if (probabilities) {
+        topK.probabilities.resize(k, X.cols());
+    }
+    for (long begin=0; begin<X.cols(); begin+=batchSize) {
+        long size = std::min<long>(batchSize, X.cols() - begin);
+        Input(X.middleCols(begin, size));
+        const Eigen::MatrixXd* scores;
+        if (logits) {
+            AllocationScope allocations(AllocationTracker::Phase::kForward);
+            ForwardLayers(Length() - 1);
+            scores = AsLayer(_layers.back()).GetLayerCache().GetForwardInput().get();
+        } else {
+            Forward();
+            scores = &Output();
+        }
+        SelectTopK(*scores, k, topK.classes, begin);
+        if (!probabilities) {
+            continue;
+        }
+        for (long j=0; j<size; j++) {
+            auto column = scores->col(j);
+            // log of the softmax normalization (relative to the largest logit for numerical stability)
+            double logSum = 0;
+            if (softmax) {
+                double max = column(topK.classes(0, begin + j));
+                logSum = max + std::log((column.array() - max).exp().sum());
+            }
+            for (int i=0; i<k; i++) {
+                double z = column(topK.classes(i, begin + j));
+                topK.probabilities(i, begin + j) = softmax ? std::exp(z - logSum) : activation(z);
+            }
+        }
+    }
+    return topK;
+}
+
+Eigen::RowVectorXi SequentialNN::PredictClasses(const Eigen::Ref<const Eigen::MatrixXd>& X, int batchSize) {
+    return PredictTopK(X, 1, false, batchSize).classes.row(0);
+}
+
+double SequentialNN::Accuracy(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::RowVectorXi>& classes, int batchSize) {
+    if (X.cols() != classes.size()) {
+        throw std::invalid_argument("Number of samples and labels do not coincide.");
+    }
+    if (X.cols() == 0) {
+        return 0.0;
+    }
+    return (PredictClasses(X, batchSize).array() == classes.array()).count()/(double)X.cols();
+}
+
 
 /*****************
  * BACKWARD PASS *
  *****************/
-void SequentialNN::BackwardInput(Eigen::MatrixXd backward_input) {
-    _layers.back()->BackwardInput(backward_input);
+void SequentialNN::BackwardInput(const Eigen::Ref<const Eigen::MatrixXd>& backward_input) {
+    if (_plan != nullptr) {
+        _plan->BackwardInput(backward_input);
+        return;
+    }
+    AsLayer(_layers.back()).BackwardInput(backward_input);
     // adjust the batch size if necessary 
     int batchSize = backward_input.rows();
     for (int i=0; i < Length(); i++) {
-        _layers[i]->GetLayerCache().SetBatchSize(batchSize); 
+        AsLayer(_layers[i]).GetLayerCache().SetBatchSize(batchSize); 
     }
 }
-void SequentialNN::Backward() {
+// NOTE: the Deltas of a layer only depend on its own LayerCache, so they can be accumulated before the backward pass
+// of the previous layer (while the backward input of the layer is still in the cache)
+void SequentialNN::Backward(bool accumulateDeltas) {
+    AllocationScope allocations(AllocationTracker::Phase::kBackward);
+    if (_plan != nullptr) {
+        if (_plan->GetMode() != ExecutionPlan::Mode::kTraining) {
+            throw std::invalid_argument("Network is compiled for inference (no backward pass).");
+        }
+        RunPlan(Profiler::Phase::kBackward, accumulateDeltas);
+        return;
+    }
+    if ((_profiler == nullptr) && !Trace::Enabled()) {
+        for (int i = Length()-1; i >= 0; i--) {
+            std::visit([accumulateDeltas](auto& layer) {
+                layer.Backward();
+                if (accumulateDeltas) {
+                    layer.AccumulateDeltas();
+                }
+            }, _layers[i]);
+        }
+        return;
+    }
+    long batchSize = AsLayer(_layers.back()).GetLayerCache().GetBackwardInput()->rows();
+    double flops, bytes;
     for (int i = Length()-1; i >= 0; i--) {
-        _layers[i]->Backward();
+        TraceScope scope("backward", "layer", i);
+        if (_profiler == nullptr) {
+            AsLayer(_layers[i]).Backward();
+            if (accumulateDeltas) {
+                AsLayer(_layers[i]).AccumulateDeltas();
+            }
+            continue;
+        }
+        auto start = _profiler->Begin(Profiler::Phase::kBackward, i);
+        AsLayer(_layers[i]).Backward();
+        if (accumulateDeltas) {
+            AsLayer(_layers[i]).AccumulateDeltas();
+        }
+        LayerCost(i, Profiler::Phase::kBackward, batchSize, flops, bytes, accumulateDeltas);
+        _profiler->End(Profiler::Phase::kBackward, i, start, flops, bytes);
     }
 }
 Eigen::MatrixXd SequentialNN::BackwardOutput() {
-     if (_layers[0]->GetLayerCache().GetBackwardOutput() == nullptr) {
+    if (_plan != nullptr) {
+        return _plan->BackwardOutput();
+    }
+     if (AsLayer(_layers[0]).GetLayerCache().GetBackwardOutput() == nullptr) {
         throw std::invalid_argument("Backward output is null.");
     }
-    return *(_layers[0]->GetLayerCache().GetBackwardOutput());
+    return *(AsLayer(_layers[0]).GetLayerCache().GetBackwardOutput());
 }
 
 /*************************
  * UPDATE WEIGHTS & BIAS *
  *************************/
 void SequentialNN::UpdateWeightsBias(double learning_rate=1.0) {
+    if (_plan != nullptr) {
+        throw std::invalid_argument("Compiled networks are updated by the optimizers (the LayerCaches are not used).");
+    }
     for (int i = 0; i < Length(); i++) {
-        _layers[i]->UpdateWeightsBias(learning_rate);
+        AsLayer(_layers[i]).UpdateWeightsBias(learning_rate);
     }
 }
 
@@ -1,10 +1,14 @@
 #ifndef SEQUENTIAL_NN_H_
 #define SEQUENTIAL_NN_H_
 
+#include "execution_plan.h"
 #include <memory>
 #include "layer.h"
 #include "loss_function.h"
+#include "profiler.h"
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 /*****************************
  * SEQUENTIAL NEURAL NETWORK *
@@ -15,15 +19,19 @@
     of Layers, i.e. all hidden Layers have precisely one input and output Layer. 
 
     To initialize an SNN, we first initialize a vector of Layers, e.g. 
-        std::vector<Layer> vlayers{{LinearLayer(8, 16), 
-                                    ActivationLayer(8, "relu"),
-                                    LinearLayer(4, 8),
-                                    ActivationLayer(4, "softmax")
-                                    }};
+        std::vector<LayerVariant> vlayers{{LinearLayer(8, 16), 
+                                           ActivationLayer(8, "relu"),
+                                           LinearLayer(4, 8),
+                                           ActivationLayer(4, "softmax")
+                                           }};
     Then ~vlayer~ is passed to the constructor
         SequentialNN snn(vlayers);
     This already initializes the weights of the LinearLayers according to the corresponding consequent ActivationLayers
-    (He or Xavier initialization).
+    (He or Xavier initialization). The layers are kept by value (see LayerVariant), so the passes dispatch over the
+    concrete layer types with ~std::visit~. Vectors of shared_ptrs to Layers and of (sliced) ~Layer~ objects are
+    accepted as well, but the network takes copies of their layers: the copies share the transformations (weights)
+    and LayerCaches, while the Deltas and the optimizer state are their own. So Deltas, ~UpdateWeightsBias~ and
+    optimizer state have to be accessed through ~snn.GetLayer(i)~, not through the passed layers.
 
     Next we summarize the most important member functions:
 
@@ -32,9 +40,19 @@
         * ~snn.InputSize()~: input size of the first Layer
         * ~snn.OutputSize()~: output size of the last layer
         * ~snn.Summary()~: summary of snn (summaries of each layer which is very verbose at the moment)
+        * ~snn.GetLayer(i)~: reference to the i-th Layer
     
     Evaluating a vector (~Eigen::VectorXd~) ~input~ of the correct size:
         ~snn(input)~
+    Classification (samples as columns of ~X~, class indices as labels, evaluated in batches):
+        * ~snn.PredictClasses(X)~: index of the largest output for each sample
+        * ~snn.Accuracy(X, classes)~: fraction of samples whose predicted class coincides with the label
+        * ~snn.PredictTopK(X, k, probabilities)~: indices (and optionally outputs) of the k largest outputs for each
+          sample, in descending order
+    If the last layer is an activation which does not change the order of the outputs of a sample (softmax, sigmoid,
+    tanh, identity), the classification stops at its input (the logits), i.e. the softmax normalization (exp, column
+    sum and division for every output) is skipped. The outputs of the selected classes are computed only if they are
+    requested (for the softmax from the log-sum-exp of the logits). Compiled networks run their full plan.
 
     The remaining methods are for the forward and backward pass.
 
@@ -48,39 +66,119 @@
         * ~BackwardOutput~: returns reference to backward output of first layer
     
     Finally, we can update the weights and bias with ~UpdateWeightsBias~ according to the backpropagation algorithm.
+
+    Training mode (~SetTraining~, set by the optimizer): relu layers only keep a bit mask of their forward input for the
+    backward pass. Since the pre-activation is not needed anymore, they transform their forward input in place, i.e. the
+    separate buffer for their forward output is released (only if the previous layer is a LinearLayer, whose backward 
+    pass does not need its forward output).
+
+    Checkpoints: ~Checkpoint::Save(path, snn)~ writes the network (and optionally the state of an optimizer) to a
+    binary file, ~Checkpoint::Load(path)~ restores it with the weights memory-mapped from the file (see checkpoint.h).
+
+    Profiling: with ~SetProfiler~, the forward and backward pass (and the updates of the optimizers) call the hooks
+    of the Profiler and record the time of each layer (see profiler.h). If the Trace is enabled, the passes of each layer
+    are recorded in the timeline of the training (see trace.h). Otherwise, the passes are plain loops.
+
+    Compilation (~Compile(maxBatch, mode)~): freezes the topology into an ExecutionPlan with one arena for all buffers,
+    fused LinearLayer/ActivationLayer pairs and a kernel per pair which is chosen once from its shape and activation
+    (see execution_plan.h). Afterwards ~Input~, ~Forward~, ~Output~, ~BackwardInput~, ~Backward~ and ~BackwardOutput~
+    run the flat plan instead of the layers (the LayerCaches are not used anymore), so the optimizers train compiled
+    networks as before:
+        snn.Compile(batchSize, ExecutionPlan::Mode::kTraining);
+        sdg.Train(snn, X, yLabel, numberOfEpochs);
+    Batches must not be larger than ~maxBatch~, networks compiled for inference have no backward pass and
+    ~UpdateWeightsBias~ needs the LayerCaches (i.e. an uncompiled network). Fused layers are profiled and traced as
+    one (the first of them). ~Decompile~ returns to the layer by layer passes; uncompiled networks are not affected.
+    The plan is owned by ~snn~ (it points into the Deltas and the arena of ~snn~), so networks are moved, not copied;
+    ~Replicate~ compiles its own plan.
+
+    Replicas (~Replicate~): networks which share the transformations (in particular the weights) with ~snn~ but have
+    their own LayerCaches and Deltas. They are used by the optimizers to run the forward and backward passes of several
+    micro-batches concurrently (see ~Optimizer::SetAccumulationSteps~).
+
+    Clones (~Clone~): independent networks (e.g. fine-tuned variants of a base network) whose LinearLayers start with
+    the parameter blocks of ~snn~. A block is copied only when the clone or ~snn~ first writes it, e.g. when an
+    optimizer updates the layer (copy-on-write, see ParameterBlock). So cloning is cheap, and a clone only needs
+    memory for the layers it changes:
+        SequentialNN variant = base.Clone();
+        adam.Train(variant, X, y, epochs); // copies the blocks of the trained layers only
+    Convolutions are copied right away. Compiled networks rebind their plans to replaced blocks (see
+    ~ExecutionPlan::Rebind~).
  */
 
 
-// forward declaration
+// forward declarations
 class Layer;
+class Checkpoint;
 
 class SequentialNN {
     private:
-        // shared_ptrs to Layers of sequential NN
-        std::vector<std::shared_ptr<Layer> > _layers; // TODO: use unique_ptrs instead?
+        // Layers of sequential NN (by value, see LayerVariant)
+        std::vector<LayerVariant> _layers;
+        // instrumentation of the passes (nullptr if not profiled)
+        std::shared_ptr<Profiler> _profiler;
+        // compiled passes (nullptr if not compiled)
+        // NOTE: owned by this network (the plan points into its Deltas and arena), so a network cannot be copied
+        std::unique_ptr<ExecutionPlan> _plan;
         
         // helper functions //
         // check for composability of layers in a SequentialNN
-        static bool ComposabilityCheck(const std::vector<std::shared_ptr<Layer> >&);
-        // convert vector of Layers to pass to second constructor
-        static std::vector<std::shared_ptr<Layer> > ConvertToSharedPtrs(const std::vector<Layer>& vlayers) {
-            std::vector<std::shared_ptr<Layer>> ptrs_layers;
-            for (int i=0; i<vlayers.size(); i++) {
-                ptrs_layers.emplace_back(std::make_shared<Layer>(vlayers[i]));
+        static bool ComposabilityCheck(std::vector<LayerVariant>&);
+        // convert vector of (pointers to) Layers to pass to the main constructor (see ToLayerVariant)
+        static std::vector<LayerVariant> ConvertToVariants(const std::vector<std::shared_ptr<Layer> >& layers) {
+            std::vector<LayerVariant> variants;
+            variants.reserve(layers.size());
+            for (const std::shared_ptr<Layer>& layer: layers) {
+                variants.push_back(ToLayerVariant(*layer));
+            }
+            return variants;
+        }
+        static std::vector<LayerVariant> ConvertToVariants(std::vector<Layer>& vlayers) {
+            std::vector<LayerVariant> variants;
+            variants.reserve(vlayers.size());
+            for (Layer& layer: vlayers) {
+                variants.push_back(ToLayerVariant(layer));
             }
-            return ptrs_layers;
+            return variants;
         }
 
+        // forward pass through the first ~count~ layers (without a plan)
+        void ForwardLayers(int count);
+        // instrumented loop over the calls of the plan (see ~Compile~)
+        void RunPlan(Profiler::Phase, bool accumulateDeltas);
+
+        // connect the layers (and initialize the weights if ~initialize~ is true)
+        SequentialNN(std::vector<LayerVariant>, bool initialize);
+        // checkpoints create networks with the loaded weights (no initialization)
+        friend class Checkpoint;
+        // as does the inference-time simplification
+        friend class GraphOptimizer;
+
     public: 
-        // constructor with vector of shared_ptrs to Layers
+        // constructor with vector of Layers
         // NOTE: the constructor automatically initializes the weights (He/Xavier initialization) using ~Initialize()~
-        SequentialNN(std::vector<std::shared_ptr<Layer> >); 
+        SequentialNN(std::vector<LayerVariant> layers): SequentialNN(std::move(layers), true) {}
 
-        // constructor with vector of Layers (using delegating constructor (introduced in C++11))
-        SequentialNN(std::vector<Layer> vlayers): SequentialNN(ConvertToSharedPtrs(vlayers)) {}
+        // constructor with vector of shared_ptrs to Layers (using delegating constructor (introduced in C++11))
+        // NOTE: takes copies of the layers (see above)
+        SequentialNN(const std::vector<std::shared_ptr<Layer> >& layers): SequentialNN(ConvertToVariants(layers)) {}
+
+        // constructor with vector of Layers which were sliced to the base class
+        // NOTE: a template, so that braced lists of layers select the constructor with LayerVariants
+        template<typename L, typename = std::enable_if_t<std::is_same_v<L, Layer> > >
+        SequentialNN(std::vector<L> vlayers): SequentialNN(ConvertToVariants(vlayers)) {}
+
+        // no copies: a copy would share the LayerCaches and transformations but not the Deltas (use ~Replicate~ or
+        // ~Clone~ instead)
+        SequentialNN(const SequentialNN&) = delete;
+        SequentialNN& operator=(const SequentialNN&) = delete;
+        SequentialNN(SequentialNN&&) = default;
+        SequentialNN& operator=(SequentialNN&&) = default;
 
         // setters/getters   
         int Length() { return _layers.size(); }
+        // i-th layer (e.g. for optimizers)
+        Layer& GetLayer(int i) { return AsLayer(_layers.at(i)); }
         // get input and output size
         int InputSize();
         int OutputSize();
@@ -93,17 +191,53 @@ class SequentialNN {
         // initialize the sequential network (called by constructors)
         void Initialize();
 
+        // training mode (see above)
+        void SetTraining(bool);
+        bool Training();
+
+        // network sharing the transformations/weights but with its own LayerCaches and Deltas (see above)
+        // NOTE: replicas are not profiled
+        SequentialNN Replicate();
+        // independent network sharing the parameters until they are written (see above), not compiled or profiled
+        SequentialNN Clone();
+
+        // compile into an ExecutionPlan for batches of at most maxBatch samples (see above)
+        void Compile(int maxBatch, ExecutionPlan::Mode mode=ExecutionPlan::Mode::kTraining);
+        void Decompile() { _plan = nullptr; }
+        bool Compiled() { return _plan != nullptr; }
+        ExecutionPlan* GetPlan() { return _plan.get(); }
+
+        // profiling (see above), nullptr to turn it off
+        void SetProfiler(std::shared_ptr<Profiler>);
+        std::shared_ptr<Profiler>& GetProfiler() { return _profiler; }
+        // estimated floating point operations and bytes moved by the i-th layer in the given phase for a batch
+        // (forward and backward pass with or without the Deltas only, the update depends on the optimizer)
+        void LayerCost(int i, Profiler::Phase, long batchSize, double& flops, double& bytes, bool deltas=true);
+
         // forward pass
-        // TODO: better use (const) reference/move semantics?
-        void Input(Eigen::MatrixXd);
+        // NOTE: the input is copied into the LayerCache of the first layer (see ~Layer::Input~)
+        void Input(const Eigen::Ref<const Eigen::MatrixXd>&);
         void Forward();
         Eigen::MatrixXd& Output(); // TODO: check if reference is really useful/reasonable here
-        Eigen::MatrixXd operator()(Eigen::MatrixXd);
+        Eigen::MatrixXd operator()(const Eigen::Ref<const Eigen::MatrixXd>&);
+
+        // classification (see above)
+        // k largest outputs of each sample (k x samples, in descending order, ties in favor of the smaller index)
+        struct TopK {
+            Eigen::MatrixXi classes;
+            // outputs of the network for ~classes~ (empty if not requested)
+            Eigen::MatrixXd probabilities;
+        };
+        TopK PredictTopK(const Eigen::Ref<const Eigen::MatrixXd>& X, int k, bool probabilities=false, int batchSize=256);
+        Eigen::RowVectorXi PredictClasses(const Eigen::Ref<const Eigen::MatrixXd>& X, int batchSize=256);
+        double Accuracy(const Eigen::Ref<const Eigen::MatrixXd>& X, const Eigen::Ref<const Eigen::RowVectorXi>& classes, int batchSize=256);
 
         // backward pass
         //void Derivative(); // update derivative with forward LayerCache
-        void BackwardInput(Eigen::MatrixXd);
-        void Backward();
+        void BackwardInput(const Eigen::Ref<const Eigen::MatrixXd>&);
+        // with ~accumulateDeltas~, each layer also adds the Deltas of the batch to the Deltas of its parameters right
+        // after its backward pass (see ~Layer::AccumulateDeltas~)
+        void Backward(bool accumulateDeltas=false);
         Eigen::MatrixXd BackwardOutput();
 
         // update weights/bias
@@ -111,7 +245,10 @@ class SequentialNN {
 
         // helper function
         // get initialization type of layers
-        static std::string GetInitializationType(const std::shared_ptr<Layer>&, const std::shared_ptr<Layer>&);
+        static std::string GetInitializationType(Layer&, Layer&);
+        static std::string GetInitializationType(const std::shared_ptr<Layer>& layer, const std::shared_ptr<Layer>& next_layer) {
+            return GetInitializationType(*layer, *next_layer);
+        }
 };
 
 #endif // SEQUENTIAL_NN_H_
\ No newline at end of file
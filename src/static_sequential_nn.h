@@ -0,0 +1,340 @@
+#ifndef STATIC_SEQUENTIAL_NN_H_
+#define STATIC_SEQUENTIAL_NN_H_
+
+#include <cmath>
+#include <cstddef>
+#include <Eigen/Dense>
+#include "layer.h"
+#include "sequential_nn.h"
+#include <stdexcept>
+#include <string>
+#include "transformation.h"
+#include <tuple>
+
+/************************************
+ * STATIC SEQUENTIAL NEURAL NETWORK *
+ ************************************/
+
+/**
+    Sequential neural network whose layers (shapes and activations) are template parameters, for tiny models where the
+    dynamic matrices, shared_ptrs and virtual calls of SequentialNN cost more than the arithmetic. The parameters and
+    the buffers of the passes are fixed-size Eigen matrices inside the object (no heap allocation at all, also not on
+    construction), and the passes are unrolled at compile time:
+        StaticSequentialNN<StaticLinear<32, 16>, StaticRelu<32>, StaticLinear<8, 32>, StaticSoftmax<8> > tiny;
+        tiny.Load(snn);                         // weights of a trained SequentialNN with the same layers
+        auto y = tiny(x);                       // x: StaticSequentialNN<...>::InputVector (16 doubles)
+
+    The layers are
+        * ~StaticLinear<Rows, Cols>~: weights (Rows x Cols) and bias (Rows),
+        * ~StaticRelu<Size>~, ~StaticSigmoid<Size>~, ~StaticTanh<Size>~, ~StaticSoftmax<Size>~ and
+          ~StaticIdentity<Size>~: the activations of ActivationLayer (computed in the same way).
+    Layers which are not composable do not compile.
+
+    Training (single samples): ~Accumulate(x, yLabel, loss)~ runs the forward and backward pass of a sample and adds
+    its Deltas (the _negative_ gradients like in LinearLayer) to the Deltas of the linear layers, ~Update(learningRate)~
+    adds the Deltas times the learning rate to the parameters and resets them (i.e. a step of plain gradient descent
+    like SDG over the accumulated samples). The losses are the ones of LossFunction.
+
+    NOTE: all matrices are members, so the object should be small (e.g. a 64x64 linear layer is 32 KB plus the same for
+    its Deltas). Large networks belong into a SequentialNN (which can be compiled, see ~SequentialNN::Compile~).
+*/
+
+// loss functions of ~Accumulate~ (see LossFunction)
+enum class StaticLoss { kMSE, kCrossEntropy };
+
+/****************
+ * LINEAR LAYER *
+ ****************/
+
+template<int Rows, int Cols>
+class StaticLinear {
+    public:
+        static constexpr int kRows = Rows;
+        static constexpr int kCols = Cols;
+        using InputVector = Eigen::Matrix<double, Cols, 1>;
+        using OutputVector = Eigen::Matrix<double, Rows, 1>;
+        using WeightMatrix = Eigen::Matrix<double, Rows, Cols>;
+
+    private:
+        WeightMatrix _weights;
+        OutputVector _bias;
+        WeightMatrix _DeltaWeights;
+        OutputVector _DeltaBias;
+
+    public:
+        StaticLinear():
+            _weights(WeightMatrix::Zero()),
+            _bias(OutputVector::Zero()),
+            _DeltaWeights(WeightMatrix::Zero()),
+            _DeltaBias(OutputVector::Zero())
+            {}
+
+        // getters
+        WeightMatrix& Weights() { return _weights; }
+        OutputVector& Bias() { return _bias; }
+        WeightMatrix& DeltaWeights() { return _DeltaWeights; }
+        OutputVector& DeltaBias() { return _DeltaBias; }
+
+        void Forward(const InputVector& x, OutputVector& y) const {
+            y.noalias() = _weights*x;
+            y += _bias;
+        }
+        // delta is the backward input (negative gradient with respect to the output)
+        void Backward(const InputVector& x, const OutputVector&, const OutputVector& delta, InputVector& backward) {
+            backward.noalias() = _weights.transpose()*delta;
+            _DeltaWeights.noalias() += delta*x.transpose();
+            _DeltaBias += delta;
+        }
+        void Update(double learningRate) {
+            _weights += learningRate*_DeltaWeights;
+            _bias += learningRate*_DeltaBias;
+            _DeltaWeights.setZero();
+            _DeltaBias.setZero();
+        }
+
+        // copy the parameters of a LinearLayer with the same shape
+        void Load(Layer& layer) {
+            if ((layer.GetTransformation()->Type() != "LinearTransformation") || (layer.Rows() != Rows)
+                || (layer.Cols() != Cols)) {
+                throw std::invalid_argument("Layer is not a linear layer of shape " + std::to_string(Rows) + "x"
+                                            + std::to_string(Cols) + ".");
+            }
+            const LinearTransformation& linear = static_cast<LinearTransformation&>(*layer.GetTransformation());
+            _weights = linear.Weights();
+            _bias = linear.Bias();
+        }
+};
+
+/*********************
+ * ACTIVATION LAYERS *
+ *********************/
+
+// activation given by F (Name, Forward and Backward of a single sample)
+template<int Size, typename F>
+class StaticActivation {
+    public:
+        static constexpr int kRows = Size;
+        static constexpr int kCols = Size;
+        using InputVector = Eigen::Matrix<double, Size, 1>;
+        using OutputVector = Eigen::Matrix<double, Size, 1>;
+
+        void Forward(const InputVector& x, OutputVector& y) const { F::Forward(x, y); }
+        void Backward(const InputVector& x, const OutputVector& y, const OutputVector& delta, InputVector& backward) {
+            F::Backward(x, y, delta, backward);
+        }
+        void Update(double) {}
+
+        // check that the layer has the same activation and size
+        void Load(Layer& layer) {
+            if ((layer.GetTransformation()->Type() != F::Name()) || (layer.Rows() != Size)) {
+                throw std::invalid_argument("Layer is not a " + std::string(F::Name()) + " layer of size "
+                                            + std::to_string(Size) + ".");
+            }
+        }
+};
+
+// NOTE: the scalar functions are the ones of Function (no vectorized approximations), so the results coincide with
+// the ones of ActivationLayer
+struct StaticIdentityFunction {
+    static const char* Name() { return "identity"; }
+    template<typename V>
+    static void Forward(const V& x, V& y) { y = x; }
+    template<typename V>
+    static void Backward(const V&, const V&, const V& delta, V& backward) { backward = delta; }
+};
+
+struct StaticReluFunction {
+    static const char* Name() { return "relu"; }
+    template<typename V>
+    static void Forward(const V& x, V& y) { y = x.cwiseMax(0.0); }
+    template<typename V>
+    static void Backward(const V& x, const V&, const V& delta, V& backward) {
+        backward = (x.array() > 0).select(delta.array(), 0.0).matrix();
+    }
+};
+
+struct StaticSigmoidFunction {
+    static const char* Name() { return "sigmoid"; }
+    template<typename V>
+    static void Forward(const V& x, V& y) { y = x.unaryExpr([](double v) { return 1/(1 + std::exp(-v)); }); }
+    template<typename V>
+    static void Backward(const V&, const V& y, const V& delta, V& backward) {
+        backward = delta.cwiseProduct(y.cwiseProduct((1 - y.array()).matrix()));
+    }
+};
+
+struct StaticTanhFunction {
+    static const char* Name() { return "tanh"; }
+    template<typename V>
+    static void Forward(const V& x, V& y) { y = x.unaryExpr([](double v) { return std::tanh(v); }); }
+    template<typename V>
+    static void Backward(const V&, const V& y, const V& delta, V& backward) {
+        backward = delta.cwiseProduct((1 - y.array().square()).matrix());
+    }
+};
+
+struct StaticSoftmaxFunction {
+    static const char* Name() { return "softmax"; }
+    template<typename V>
+    static void Forward(const V& x, V& y) {
+        double correction = x.maxCoeff();
+        y = x.unaryExpr([correction](double v) { return std::exp(v - correction); });
+        y /= y.sum();
+    }
+    // (delta - <delta, y>)*y
+    template<typename V>
+    static void Backward(const V&, const V& y, const V& delta, V& backward) {
+        backward = ((delta.array() - delta.dot(y))*y.array()).matrix();
+    }
+};
+
+template<int Size> using StaticIdentity = StaticActivation<Size, StaticIdentityFunction>;
+template<int Size> using StaticRelu = StaticActivation<Size, StaticReluFunction>;
+template<int Size> using StaticSigmoid = StaticActivation<Size, StaticSigmoidFunction>;
+template<int Size> using StaticTanh = StaticActivation<Size, StaticTanhFunction>;
+template<int Size> using StaticSoftmax = StaticActivation<Size, StaticSoftmaxFunction>;
+
+/***********
+ * NETWORK *
+ ***********/
+
+template<typename... Layers>
+class StaticSequentialNN {
+    public:
+        static constexpr int kLength = sizeof...(Layers);
+        static_assert(kLength > 0, "A network needs at least one layer.");
+
+        template<int I>
+        using LayerType = typename std::tuple_element<I, std::tuple<Layers...> >::type;
+        using InputVector = typename LayerType<0>::InputVector;
+        using OutputVector = typename LayerType<kLength - 1>::OutputVector;
+        static constexpr int kInputSize = LayerType<0>::kCols;
+        static constexpr int kOutputSize = LayerType<kLength - 1>::kRows;
+
+    private:
+        // the output size of each layer is the input size of the next one
+        template<int I>
+        static constexpr bool Composable() {
+            if constexpr (I + 1 >= kLength) {
+                return true;
+            } else {
+                return (LayerType<I>::kRows == LayerType<I+1>::kCols) && Composable<I+1>();
+            }
+        }
+        static_assert(Composable<0>(), "Layers are not composable.");
+
+        std::tuple<Layers...> _layers;
+        // forward input of the network and forward output of each layer
+        InputVector _input;
+        std::tuple<typename Layers::OutputVector...> _outputs;
+        // backward output of each layer (backward input of the previous one)
+        std::tuple<typename Layers::InputVector...> _backward;
+        OutputVector _backwardInput;
+
+        template<int I>
+        const typename LayerType<I>::InputVector& ForwardInput() const {
+            if constexpr (I == 0) {
+                return _input;
+            } else {
+                return std::get<I-1>(_outputs);
+            }
+        }
+
+        template<int I>
+        void ForwardFrom() {
+            std::get<I>(_layers).Forward(ForwardInput<I>(), std::get<I>(_outputs));
+            if constexpr (I + 1 < kLength) {
+                ForwardFrom<I+1>();
+            }
+        }
+
+        template<int I>
+        void BackwardFrom(const typename LayerType<I>::OutputVector& delta) {
+            std::get<I>(_layers).Backward(ForwardInput<I>(), std::get<I>(_outputs), delta, std::get<I>(_backward));
+            if constexpr (I > 0) {
+                BackwardFrom<I-1>(std::get<I>(_backward));
+            }
+        }
+
+        template<int I>
+        void UpdateFrom(double learningRate) {
+            std::get<I>(_layers).Update(learningRate);
+            if constexpr (I + 1 < kLength) {
+                UpdateFrom<I+1>(learningRate);
+            }
+        }
+
+        template<int I>
+        void LoadFrom(SequentialNN& snn) {
+            std::get<I>(_layers).Load(snn.GetLayer(I));
+            if constexpr (I + 1 < kLength) {
+                LoadFrom<I+1>(snn);
+            }
+        }
+
+    public:
+        StaticSequentialNN():
+            _input(InputVector::Zero()),
+            _outputs(Layers::OutputVector::Zero()...),
+            _backward(Layers::InputVector::Zero()...),
+            _backwardInput(OutputVector::Zero())
+            {}
+
+        // i-th layer (e.g. to set its weights)
+        template<int I>
+        LayerType<I>& GetLayer() { return std::get<I>(_layers); }
+
+        // parameters of a SequentialNN with the same layers (throws std::invalid_argument otherwise)
+        void Load(SequentialNN& snn) {
+            if (snn.Length() != kLength) {
+                throw std::invalid_argument("Number of layers does not coincide.");
+            }
+            LoadFrom<0>(snn);
+        }
+
+        // forward pass
+        void Forward(const InputVector& x) {
+            _input = x;
+            ForwardFrom<0>();
+        }
+        const OutputVector& Output() const { return std::get<kLength - 1>(_outputs); }
+        OutputVector operator()(const InputVector& x) {
+            Forward(x);
+            return Output();
+        }
+        // index of the largest output
+        int PredictClass(const InputVector& x) {
+            Eigen::Index index;
+            Forward(x);
+            Output().maxCoeff(&index);
+            return index;
+        }
+
+        // backward pass with the given backward input (negative gradient of the loss with respect to the output)
+        void Backward(const OutputVector& backwardInput) {
+            _backwardInput = backwardInput;
+            BackwardFrom<kLength - 1>(_backwardInput);
+        }
+        const InputVector& BackwardOutput() const { return std::get<0>(_backward); }
+
+        // training with single samples (see above), returns the loss of the sample
+        double Accumulate(const InputVector& x, const OutputVector& yLabel, StaticLoss loss) {
+            Forward(x);
+            const OutputVector& y = Output();
+            double value;
+            if (loss == StaticLoss::kMSE) {
+                _backwardInput = (2/double(kOutputSize))*(yLabel - y);
+                value = (y - yLabel).squaredNorm()/double(kOutputSize);
+            } else {
+                // off-set to avoid log(0) and division by zero
+                auto shifted = y.array() + 1e-9;
+                _backwardInput = (yLabel.array()/shifted).matrix();
+                value = -(yLabel.array()*shifted.log()).sum();
+            }
+            BackwardFrom<kLength - 1>(_backwardInput);
+            return value;
+        }
+        void Update(double learningRate) { UpdateFrom<0>(learningRate); }
+};
+
+#endif // STATIC_SEQUENTIAL_NN_H_
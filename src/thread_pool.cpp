@@ -0,0 +1,144 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "trace.h"
+
+/***************
+ * THREAD POOL *
+ ***************/
+
+// true on worker threads (nested loops are run serially)
+static thread_local bool t_isWorker = false;
+// true while the calling thread runs the chunks of a loop (nested loops are run serially as well, since the thread
+// already holds _runMutex)
+static thread_local bool t_inLoop = false;
+
+ThreadPool::ThreadPool(int numThreads):
+    _generation(0),
+    _active(0),
+    _stop(false),
+    _job(nullptr),
+    _context(nullptr),
+    _end(0),
+    _chunk(1),
+    _next(0)
+    {
+        for (int i=1; i<numThreads; i++) {
+            _workers.emplace_back([this, i]() {
+                Trace::SetThreadName("worker " + std::to_string(i));
+                WorkerLoop();
+            });
+        }
+    }
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _start.notify_all();
+    for (std::thread& worker: _workers) {
+        worker.join();
+    }
+}
+
+// grab chunks of the current loop until there are none left
+void ThreadPool::RunChunks() {
+    while (true) {
+        long begin = _next.fetch_add(_chunk);
+        if (begin >= _end) {
+            break;
+        }
+        try {
+            _job(_context, begin, std::min(begin + _chunk, _end));
+        } catch (...) {
+            // keep the first exception and do not hand out further chunks
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_error) {
+                _error = std::current_exception();
+            }
+            _next = _end;
+            break;
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    t_isWorker = true;
+    unsigned long seen = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _start.wait(lock, [&]() { return _stop || (_generation != seen); });
+            if (_stop) {
+                return;
+            }
+            seen = _generation;
+        }
+        RunChunks();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_active == 0) {
+                _done.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::Run(void (*job)(void*, long, long), void* context, long begin, long end, long minChunk) {
+    if (t_isWorker || t_inLoop) {
+        job(context, begin, end);
+        return;
+    }
+    std::unique_lock<std::mutex> run(_runMutex, std::try_to_lock);
+    if (!run.owns_lock()) {
+        job(context, begin, end);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = job;
+        _context = context;
+        _end = end;
+        // a few chunks per thread for load balancing
+        _chunk = std::max(minChunk, (end - begin + 4*NumThreads() - 1)/(4*NumThreads()));
+        _next = begin;
+        _active = _workers.size();
+        _generation++;
+    }
+    _start.notify_all();
+    // NOTE: RunChunks does not throw (exceptions of the loop body are stored in _error)
+    t_inLoop = true;
+    RunChunks();
+    t_inLoop = false;
+    // wait for the workers (they might still work on their last chunk), also if the loop body threw, since they use
+    // the loop body on the caller's stack
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [&]() { return _active == 0; });
+        std::swap(error, _error);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// global pool
+static std::unique_ptr<ThreadPool>& GlobalPool() {
+    static std::unique_ptr<ThreadPool> pool = std::make_unique<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+ThreadPool& ThreadPool::Global() {
+    return *GlobalPool();
+}
+
+void ThreadPool::SetGlobalThreads(int numThreads) {
+    GlobalPool() = std::make_unique<ThreadPool>(std::max(1, numThreads));
+}
@@ -0,0 +1,103 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/***************
+ * THREAD POOL *
+ ***************/
+
+/**
+    Minimal pool of persistent worker threads to run loops in parallel, e.g. the parameter updates of the
+    optimizers. The calling thread participates in the work, so a pool with ~NumThreads() == 1~ has no
+    worker threads at all and simply runs everything on the caller.
+
+    Usage (f is called with half-open index ranges [begin, end)):
+        ThreadPool::Global().ParallelFor(0, n, 4096, [&](long begin, long end) {
+            for (long i=begin; i<end; i++) { ... }
+        });
+
+    If the loop body throws, no further chunks are started, ~ParallelFor~ waits for the chunks which are still running
+    and rethrows the first exception on the calling thread.
+
+    NOTE: ~ParallelFor~ does not allocate memory (the loop body is passed via a pointer to the caller's stack) and
+    runs the loop serially if it is too small (less than ~minChunk~ indices), if it is called from inside the body of
+    another loop (nested loops, on a worker or on the calling thread) or if the pool is busy with a loop of another
+    thread.
+*/
+
+class ThreadPool {
+    private:
+        std::vector<std::thread> _workers;
+
+        // synchronization
+        std::mutex _mutex;
+        std::condition_variable _start;
+        std::condition_variable _done;
+        // only one loop at a time
+        std::mutex _runMutex;
+        // incremented for each loop so that workers know that there is new work
+        unsigned long _generation;
+        // number of workers which have not finished the current loop
+        int _active;
+        bool _stop;
+
+        // current loop
+        void (*_job)(void*, long, long);
+        void* _context;
+        long _end;
+        long _chunk;
+        std::atomic<long> _next;
+        // first exception thrown by the loop body (rethrown on the calling thread)
+        std::exception_ptr _error;
+
+        void WorkerLoop();
+        void RunChunks();
+        void Run(void (*job)(void*, long, long), void* context, long begin, long end, long minChunk);
+
+        // calls the loop body of ParallelFor
+        template<typename F>
+        static void Trampoline(void* context, long begin, long end) {
+            (*static_cast<F*>(context))(begin, end);
+        }
+
+    public:
+        // constructor (numThreads includes the calling thread)
+        explicit ThreadPool(int numThreads);
+        // destructor (joins the workers)
+        ~ThreadPool();
+
+        // no copies
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // number of threads including the calling thread
+        int NumThreads() const { return _workers.size() + 1; }
+
+        // run f(begin, end) on disjoint ranges covering [begin, end) in parallel
+        template<typename F>
+        void ParallelFor(long begin, long end, long minChunk, F&& f) {
+            if ((end - begin <= minChunk) || _workers.empty()) {
+                if (end > begin) {
+                    f(begin, end);
+                }
+                return;
+            }
+            using Fct = typename std::remove_reference<F>::type;
+            Run(&Trampoline<Fct>, (void*)&f, begin, end, minChunk);
+        }
+
+        // pool shared by the library (by default one thread per hardware thread)
+        static ThreadPool& Global();
+        // change the number of threads of the global pool
+        // NOTE: must not be called while the global pool is in use
+        static void SetGlobalThreads(int numThreads);
+};
+
+#endif // THREAD_POOL_H_
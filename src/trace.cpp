@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "trace.h"
+#include <vector>
+
+/*********
+ * TRACE *
+ *********/
+
+std::atomic<bool> Trace::_enabled(false);
+
+namespace {
+
+// ring buffer of a single thread (only written by its thread)
+struct ThreadBuffer {
+    std::vector<Trace::Event> events;
+    // number of events recorded so far (the last events.size() of them are kept)
+    std::atomic<uint64_t> head;
+    // number of events at the last Clear
+    std::atomic<uint64_t> cleared;
+    int thread;
+    std::string name;
+    // false after its thread finished (then the buffer can be reused by a new thread)
+    bool active;
+
+    ThreadBuffer(long capacity, int thread): events(capacity), head(0), cleared(0), thread(thread), active(true) {}
+};
+
+// buffers of all threads which recorded events (kept after the threads finish)
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+    long capacity = 1 << 16;
+};
+
+Registry& GlobalRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+const std::chrono::steady_clock::time_point kProcessStart = std::chrono::steady_clock::now();
+
+// buffer of the calling thread (created with the first event), released when the thread finishes
+struct ThreadSlot {
+    ThreadBuffer* buffer = nullptr;
+    std::string name;
+
+    ~ThreadSlot() {
+        if (buffer != nullptr) {
+            std::lock_guard<std::mutex> lock(GlobalRegistry().mutex);
+            buffer->active = false;
+        }
+    }
+};
+
+thread_local ThreadSlot threadSlot;
+
+// NOTE: threads come and go (e.g. a BatchLoader per Train, a thread per checkpoint), so the buffers of finished threads
+// are reused: preferably one whose events are cleared, otherwise one of a thread with the same name whose oldest events
+// are overwritten (the threads then share a row of the timeline). So the number of buffers is bounded by the number of
+// threads which record at the same time (per name).
+ThreadBuffer& CurrentBuffer() {
+    if (threadSlot.buffer == nullptr) {
+        Registry& registry = GlobalRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto& buffer: registry.buffers) {
+            if (buffer->active || ((long)buffer->events.size() != registry.capacity)) {
+                continue;
+            }
+            if (buffer->cleared.load(std::memory_order_relaxed) == buffer->head.load(std::memory_order_relaxed)) {
+                threadSlot.buffer = buffer.get();
+                break;
+            }
+            if ((threadSlot.buffer == nullptr) && (buffer->name == threadSlot.name)) {
+                threadSlot.buffer = buffer.get();
+            }
+        }
+        if (threadSlot.buffer == nullptr) {
+            registry.buffers.push_back(std::make_unique<ThreadBuffer>(registry.capacity, registry.buffers.size()));
+            threadSlot.buffer = registry.buffers.back().get();
+        }
+        threadSlot.buffer->active = true;
+        threadSlot.buffer->name = threadSlot.name;
+    }
+    return *threadSlot.buffer;
+}
+
+}  // namespace
+
+void Trace::SetCapacity(long events) {
+    if (events <= 0) {
+        throw std::invalid_argument("Capacity of the trace has to be positive.");
+    }
+    Registry& registry = GlobalRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.capacity = events;
+}
+
+// NOTE: only creates a buffer if the thread already recorded events
+void Trace::SetThreadName(const std::string& name) {
+    threadSlot.name = name;
+    if (threadSlot.buffer != nullptr) {
+        std::lock_guard<std::mutex> lock(GlobalRegistry().mutex);
+        threadSlot.buffer->name = name;
+    }
+}
+
+std::string Trace::ThreadName() {
+    return threadSlot.name;
+}
+
+std::string Trace::Escape(const std::string& text) {
+    std::string escaped;
+    for (char c: text) {
+        if ((c == '"') || (c == '\\')) {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            // control characters (e.g. line breaks)
+            char code[7];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+int64_t Trace::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - kProcessStart).count();
+}
+
+void Trace::Record(const char* name, const char* category, int64_t start, int64_t end, long arg) {
+    ThreadBuffer& buffer = CurrentBuffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % buffer.events.size()] = Event{name, category, start, end - start, arg, buffer.thread};
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<Trace::Event> Trace::Events() {
+    Registry& registry = GlobalRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<Event> events;
+    for (auto& buffer: registry.buffers) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = std::max<uint64_t>(buffer->cleared.load(std::memory_order_relaxed),
+                                            (head > buffer->events.size()) ? head - buffer->events.size() : 0);
+        size_t begin = events.size();
+        for (uint64_t i=first; i<head; i++) {
+            events.push_back(buffer->events[i % buffer->events.size()]);
+        }
+        // scopes are recorded when they end, i.e. nested scopes before the enclosing ones
+        std::stable_sort(events.begin() + begin, events.end(), [](const Event& a, const Event& b) {
+            return a.start < b.start;
+        });
+    }
+    return events;
+}
+
+void Trace::Clear() {
+    Registry& registry = GlobalRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto& buffer: registry.buffers) {
+        buffer->cleared.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+// complete events ("X") with timestamps in microseconds and the names of the threads as metadata ("M")
+std::string Trace::JSON() {
+    std::vector<Event> events = Events();
+    std::ostringstream json;
+    json.precision(3);
+    json << std::fixed << "{\"traceEvents\": [";
+    bool first = true;
+    {
+        Registry& registry = GlobalRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto& buffer: registry.buffers) {
+            std::string name = buffer->name.empty() ? "thread " + std::to_string(buffer->thread) : buffer->name;
+            json << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+                 << buffer->thread << ", \"args\": {\"name\": \"" << Escape(name) << "\"}}";
+            first = false;
+        }
+    }
+    for (const Event& event: events) {
+        json << (first ? "" : ",\n") << "{\"name\": \"" << Escape(event.name) << "\", \"cat\": \"" << Escape(event.category)
+             << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " << event.start*1e-3
+             << ", \"dur\": " << event.duration*1e-3;
+        if (event.arg >= 0) {
+            json << ", \"args\": {\"index\": " << event.arg << "}";
+        }
+        json << "}";
+        first = false;
+    }
+    json << "],\n\"displayTimeUnit\": \"ms\"}";
+    return json.str();
+}
+
+void Trace::Export(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path + " for the trace.");
+    }
+    file << JSON() << std::endl;
+}
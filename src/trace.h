@@ -0,0 +1,110 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*********
+ * TRACE *
+ *********/
+
+/**
+    Timeline of the training for chrome://tracing or Perfetto (Chrome trace-event format). Code regions are recorded
+    with a TraceScope, e.g. the passes of each layer (SequentialNN), steps, micro-batches and the reduction of the
+    replicas (Optimizer), the waits for batches and their assembly (BatchLoader, ShardStream) and checkpoints
+    (CheckpointScheduler):
+        Trace::Enable(true);
+        sdg.Train(snn, X, yLabel, epochs);
+        Trace::Enable(false);
+        Trace::Export("train.trace.json");
+
+    Each thread records into its own ring buffer (the oldest events are overwritten), so recording takes no locks and
+    does not allocate once the thread recorded its first event (which allocates the buffer or takes over the one of a
+    finished thread). The buffers of finished threads are reused by new threads, so that long runs which start many
+    short-lived threads (e.g. a thread per checkpoint) do not allocate more and more buffers: after ~Clear~ by any new
+    thread, otherwise by a new thread with the same name (see ~SetThreadName~), which then continues the row of the
+    finished thread in the timeline. Recording can be switched on and off at any time; when it is off, a TraceScope only loads an
+    atomic flag.
+
+    NOTE: the names and categories of events have to be string literals (only the pointers are stored). ~Export~,
+    ~Events~ and ~Clear~ should only be called while no thread records (e.g. after ~Enable(false)~ and the end of
+    Train), otherwise events written at the same time might be garbled.
+*/
+
+class Trace {
+    public:
+        struct Event {
+            const char* name;
+            const char* category;
+            // nanoseconds since the start of the process (steady clock)
+            int64_t start;
+            int64_t duration;
+            // optional argument (e.g. index of a layer), negative if none
+            long arg;
+            // thread which recorded the event
+            int thread;
+        };
+
+    private:
+        static std::atomic<bool> _enabled;
+
+    public:
+        // switch recording on/off
+        static void Enable(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+        static bool Enabled() { return _enabled.load(std::memory_order_relaxed); }
+        // number of events per thread (for threads which record their first event afterwards, default 1 << 16)
+        static void SetCapacity(long events);
+        // name of the calling thread in the trace
+        static void SetThreadName(const std::string& name);
+        // name of the calling thread, empty if it was not named
+        static std::string ThreadName();
+
+        // nanoseconds since the start of the process
+        static int64_t Now();
+        // record an event of the calling thread
+        static void Record(const char* name, const char* category, int64_t start, int64_t end, long arg=-1);
+
+        // recorded events of all threads (ordered by thread and start)
+        static std::vector<Event> Events();
+        // remove all events recorded so far
+        static void Clear();
+        // trace-event JSON
+        static std::string JSON();
+        // text escaped for a JSON string (quotes, backslashes and control characters)
+        static std::string Escape(const std::string& text);
+        static void Export(const std::string& path);
+};
+
+
+/***************
+ * TRACE SCOPE *
+ ***************/
+
+// records the time from its construction to its destruction (if the trace is enabled at construction)
+class TraceScope {
+    private:
+        const char* _name;
+        const char* _category;
+        long _arg;
+        int64_t _start;
+
+    public:
+        TraceScope(const char* name, const char* category, long arg=-1):
+            _name(name),
+            _category(category),
+            _arg(arg),
+            _start(Trace::Enabled() ? Trace::Now() : -1)
+            {}
+        ~TraceScope() {
+            if (_start >= 0) {
+                Trace::Record(_name, _category, _start, Trace::Now(), _arg);
+            }
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif // TRACE_H_
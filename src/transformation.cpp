@@ -1,17 +1,29 @@
 #include "transformation.h"
+#include <algorithm>
 #include <Eigen/Dense>
 
 #include <iostream>
 #include <memory>
 #include <random>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include "thread_pool.h"
 #include <vector>
 
 /******************
  * TRANSFORMATION *
  ******************/
 
+// default batched backward pass: ~BackwardTransform~ for each sample
+void Transformation::BatchBackwardTransform(const Eigen::MatrixXd& forward_input, const Eigen::MatrixXd& forward_output,
+                                            const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {
+    backward_output.resize(backward_input.rows(), Cols());
+    for (int i=0; i<backward_input.rows(); i++) {
+        backward_output.row(i) = BackwardTransform(forward_input.col(i), backward_input.row(i));
+    }
+}
+
 /**************************************
  * HELPER FUNCTION FOR RANDOM NUMBERS *
  **************************************/
@@ -46,6 +58,7 @@ void LinearTransformation::Initialize(std::string initialization_type) {
 
     int rows = Rows();
     int cols = Cols();
+    Detach();
 
     // actual initialization of weights
     if (initialization_type == "Xavier") {      
@@ -78,16 +91,70 @@ void LinearTransformation::Initialize(std::string initialization_type) {
     }
 }
 
+LinearTransformation::LinearTransformation(int rows, int cols, std::shared_ptr<ParameterBlock> parameters):
+    Transformation(rows, cols, "LinearTransformation"),
+    _parameters(parameters),
+    _weights(nullptr, rows, cols),
+    _bias(nullptr, rows)
+    {
+        if ((_parameters == nullptr) || (_parameters->Size() != (long)rows*cols + rows)) {
+            throw std::invalid_argument("Parameter block does not match the shape of the linear transformation.");
+        }
+        Bind();
+    }
+
+LinearTransformation::LinearTransformation(const LinearTransformation& other):
+    LinearTransformation(other._rows, other._cols, other._parameters->Clone())
+    {}
+
+// NOTE: placement new is the documented way to rebind an Eigen::Map
+void LinearTransformation::Bind() {
+    new (&_weights) Eigen::Map<Eigen::MatrixXd>(_parameters->Data(), _rows, _cols);
+    new (&_bias) Eigen::Map<Eigen::VectorXd>(_parameters->Data() + (long)_rows*_cols, _rows);
+}
+
+void LinearTransformation::Detach() {
+    if (ParameterBlock::MakeUnique(_parameters)) {
+        Bind();
+    }
+}
+
+void LinearTransformation::SetWeights(const Eigen::MatrixXd& weight_matrix) {
+    if ((weight_matrix.rows() != _rows) || (weight_matrix.cols() != _cols)) {
+        throw std::invalid_argument("Shape of the weights does not match the linear transformation.");
+    }
+    Weights() = weight_matrix;
+}
+
+void LinearTransformation::SetBias(const Eigen::VectorXd& bias) {
+    if (bias.size() != _rows) {
+        throw std::invalid_argument("Size of the bias does not match the linear transformation.");
+    }
+    Bias() = bias;
+}
+
 // transform method
 Eigen::MatrixXd LinearTransformation::Transform(Eigen::MatrixXd inputMatrix) {
-    if (inputMatrix.rows() != Cols()) {
+    Eigen::MatrixXd result;
+    BatchTransform(inputMatrix, result);
+    return result;
+}
+
+// NOTE: noalias() writes the product directly into output (no temporary)
+void LinearTransformation::BatchTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output) {
+    if (input.rows() != Cols()) {
         throw std::domain_error("Matrix cannot be evaluated.");
-    } else {
-        Eigen::MatrixXd result = _weights*inputMatrix;
-        // apply broadcasting for adding the bias (add _bias to each column of result)
-        result.colwise() += _bias;
-        return result;
     }
+    output.resize(Rows(), input.cols());
+    output.noalias() = _weights*input;
+    // apply broadcasting for adding the bias (add _bias to each column of result)
+    output.colwise() += _bias;
+}
+
+// backward pass of the whole batch with a single matrix product
+void LinearTransformation::BatchBackwardTransform(const Eigen::MatrixXd&, const Eigen::MatrixXd&,
+                                                  const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {
+    backward_output.noalias() = backward_input*_weights;
 }
 
 // Summary
@@ -120,34 +187,29 @@ std::string LinearTransformation::Summary() {
 
 // transform methods for ActivationTransformation
 Eigen::MatrixXd ActivationTransformation::Transform(Eigen::MatrixXd inputMatrix) {
-    Eigen::MatrixXd outputMatrix = Eigen::MatrixXd::Zero(inputMatrix.rows(), inputMatrix.cols());
-    // correction term, see below
-    double correction = 0.0;
+    Eigen::MatrixXd outputMatrix;
+    BatchTransform(inputMatrix, outputMatrix);
+    return outputMatrix;
+}
+
+void ActivationTransformation::BatchTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output) {
+    output.resize(input.rows(), input.cols());
+    bool softmax = (_type == "softmax");
 
     // TODO: optimize with Eigen's  unaryExpr?
     // NOTE: Eigen uses 'column major' storage by default so that this is cache-friendly
-    for (int j=0; j < inputMatrix.cols(); j++) {
-        for (int i = 0; i < inputMatrix.rows(); i++) {
-            if (_type == "softmax") {
-                // substracting the max coefficient for numerical stability (see https://cs231n.github.io/linear-classify/#softmax-classifier)
-                // from each column
-                correction = inputMatrix.col(j).maxCoeff();
-            }
-            outputMatrix(i, j) = _function(inputMatrix(i, j)-correction); 
+    for (int j=0; j < input.cols(); j++) {
+        // substracting the max coefficient for numerical stability (see https://cs231n.github.io/linear-classify/#softmax-classifier)
+        // from each column
+        double correction = softmax ? input.col(j).maxCoeff() : 0.0;
+        for (int i = 0; i < input.rows(); i++) {
+            output(i, j) = _function(input(i, j)-correction); 
         }
-    }
-
-    if (_type == "softmax") {
-        double colSum = 0;
-        for (int j=0; j<outputMatrix.cols(); j++) {
-            colSum = outputMatrix.col(j).sum();
-            for (int i = 0; i < outputMatrix.rows(); i++) {
-                outputMatrix(i, j) /= colSum; // Note: this is safe because _function = exp for softmax
-            }
+        if (softmax) {
+            // Note: this is safe because _function = exp for softmax
+            output.col(j) /= output.col(j).sum();
         }
     }
-
-    return outputMatrix;
 }
 
 // update derivative
@@ -180,6 +242,54 @@ void ActivationTransformation::Derivative(Eigen::VectorXd vector) {
     }
 }
 
+// batched backward pass
+// NOTE: the Jacobian of an elementwise activation is diagonal, so each entry of backward_input is only multiplied with
+// the derivative at the corresponding entry of forward_input. For softmax s, the backward transform of a row g is
+// (g - <g, s>)*s with the forward output s of the sample (instead of recomputing the softmax).
+void ActivationTransformation::BatchBackwardTransform(const Eigen::MatrixXd& forward_input, const Eigen::MatrixXd& forward_output,
+                                                      const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {
+    int samples = backward_input.rows();
+    if (forward_input.cols() != samples) {
+        throw std::domain_error("Batch sizes of forward and backward pass do not coincide.");
+    }
+    backward_output.resize(samples, Cols());
+
+    if (_type == "softmax") {
+        if ((forward_output.rows() != Rows()) || (forward_output.cols() != samples)) {
+            throw std::domain_error("Forward output does not match the backward input.");
+        }
+        for (int j=0; j<samples; j++) {
+            double inner = backward_input.row(j)*forward_output.col(j);
+            backward_output.row(j) = (backward_input.row(j).array() - inner)*forward_output.col(j).transpose().array();
+        }
+        return;
+    }
+    // outer loop over the columns of backward_output (column-major)
+    for (int i=0; i<Cols(); i++) {
+        for (int j=0; j<samples; j++) {
+            backward_output(j, i) = backward_input(j, i)*_function.Derivative(forward_input(i, j));
+        }
+    }
+}
+
+// masked forward pass: relu and the mask of positive entries (needs to be computed before the 
+// output is written because input and output might coincide)
+void ActivationTransformation::MaskedTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output, BitMask& mask) {
+    if (!UsesMask()) {
+        throw std::domain_error("Transformation does not support a masked forward pass.");
+    }
+    mask.SetPositive(input);
+    output = input.cwiseMax(0.0);
+}
+
+// masked backward pass: the derivative of relu is 1 on positive entries and 0 otherwise
+void ActivationTransformation::MaskedBackwardTransform(const BitMask& mask, const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {
+    if (!UsesMask()) {
+        throw std::domain_error("Transformation does not support a masked backward pass.");
+    }
+    mask.Apply(backward_input, backward_output);
+}
+
 std::string ActivationTransformation::Summary() {
     std::string rows = std::to_string(Rows());
     std::string cols = std::to_string(Cols());
@@ -192,4 +302,274 @@ std::string ActivationTransformation::Summary() {
     derivative_string += ss_derivative.str();
 
     return shape + "Function name: " + Type() + "\n" + derivative_string;
-}
\ No newline at end of file
+}
+
+
+/***********************
+ * CONV TRANSFORMATION *
+ ***********************/
+
+// per-thread scratch buffers for im2col (only grow, i.e. no allocations in the steady state of the training)
+// NOTE: not members of the transformation because replicas share it and run concurrently (see SequentialNN::Replicate)
+static double* ConvScratch(int slot, long size) {
+    thread_local std::vector<double> buffers[4];
+    if ((long)buffers[slot].size() < size) {
+        buffers[slot].resize(size);
+    }
+    return buffers[slot].data();
+}
+
+ConvTransformation::ConvTransformation(int inChannels, int height, int width, int outChannels, int kernel, int stride, int padding):
+    Transformation(0, inChannels*height*width, "ConvTransformation"),
+    _inChannels(inChannels),
+    _height(height),
+    _width(width),
+    _outChannels(outChannels),
+    _kernel(kernel),
+    _stride(stride),
+    _padding(padding),
+    _outHeight(0),
+    _outWidth(0),
+    _weights(nullptr, outChannels, PatchSize()),
+    _bias(nullptr, outChannels)
+    {
+        if ((inChannels <= 0) || (outChannels <= 0) || (kernel <= 0) || (stride <= 0) || (padding < 0)
+            || (height + 2*padding < kernel) || (width + 2*padding < kernel)) {
+            throw std::invalid_argument("Shape of the convolution is invalid.");
+        }
+        _outHeight = (height + 2*padding - kernel)/stride + 1;
+        _outWidth = (width + 2*padding - kernel)/stride + 1;
+        _rows = outChannels*_outHeight*_outWidth;
+        _parameters = std::make_shared<ParameterBlock>((long)outChannels*PatchSize() + outChannels);
+        // NOTE: placement new is the documented way to rebind an Eigen::Map
+        new (&_weights) Eigen::Map<Eigen::MatrixXd>(_parameters->Data(), outChannels, PatchSize());
+        new (&_bias) Eigen::Map<Eigen::VectorXd>(_parameters->Data() + (long)outChannels*PatchSize(), outChannels);
+    }
+
+ConvTransformation::ConvTransformation(const ConvTransformation& other):
+    ConvTransformation(other._inChannels, other._height, other._width, other._outChannels, other._kernel,
+                       other._stride, other._padding)
+    {
+        _weights = other._weights;
+        _bias = other._bias;
+    }
+
+// same as for LinearTransformations with the patch size as fan-in (and the patch size of the output as fan-out)
+void ConvTransformation::Initialize(std::string initialization_type) {
+    if (initialization_type != "He" && initialization_type != "Xavier") {
+        throw std::domain_error("Initialization type is unknown.");
+    }
+    double fanIn = PatchSize();
+    double fanOut = (double)_outChannels*_kernel*_kernel;
+    for (long j=0; j<_weights.cols(); j++) {
+        for (long i=0; i<_weights.rows(); i++) {
+            _weights(i, j) = (initialization_type == "Xavier") ? RandomNumberUniform(-sqrt(6/(fanIn + fanOut)), sqrt(6/(fanIn + fanOut)))
+                                                              : RandomNumberNormal(0.0, sqrt(2.0/fanIn));
+        }
+    }
+    _bias.setZero();
+}
+
+// NOTE: outer loop over the columns of columns (column-major), so the writes are contiguous
+void ConvTransformation::Im2Col(const double* sample, double* columns) const {
+    long positions = Positions();
+    for (int c=0; c<_inChannels; c++) {
+        for (int ky=0; ky<_kernel; ky++) {
+            for (int kx=0; kx<_kernel; kx++) {
+                double* column = columns + ((long)(c*_kernel + ky)*_kernel + kx)*positions;
+                for (int oy=0; oy<_outHeight; oy++) {
+                    int y = oy*_stride - _padding + ky;
+                    for (int ox=0; ox<_outWidth; ox++) {
+                        int x = ox*_stride - _padding + kx;
+                        bool inside = (y >= 0) && (y < _height) && (x >= 0) && (x < _width);
+                        column[oy*_outWidth + ox] = inside ? sample[((long)c*_height + y)*_width + x] : 0.0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ConvTransformation::Col2Im(const double* columns, double* sample) const {
+    long positions = Positions();
+    for (int c=0; c<_inChannels; c++) {
+        for (int ky=0; ky<_kernel; ky++) {
+            for (int kx=0; kx<_kernel; kx++) {
+                const double* column = columns + ((long)(c*_kernel + ky)*_kernel + kx)*positions;
+                for (int oy=0; oy<_outHeight; oy++) {
+                    int y = oy*_stride - _padding + ky;
+                    if ((y < 0) || (y >= _height)) {
+                        continue;
+                    }
+                    for (int ox=0; ox<_outWidth; ox++) {
+                        int x = ox*_stride - _padding + kx;
+                        if ((x >= 0) && (x < _width)) {
+                            sample[((long)c*_height + y)*_width + x] += column[oy*_outWidth + ox];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+Eigen::MatrixXd ConvTransformation::Transform(Eigen::MatrixXd inputMatrix) {
+    Eigen::MatrixXd result;
+    BatchTransform(inputMatrix, result);
+    return result;
+}
+
+// each output sample, seen as a Positions() x outChannels matrix (channels are contiguous), is columns*weights^T + bias
+void ConvTransformation::BatchTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output) {
+    if (input.rows() != Cols()) {
+        throw std::domain_error("Matrix cannot be evaluated.");
+    }
+    output.resize(Rows(), input.cols());
+    long positions = Positions();
+    ThreadPool::Global().ParallelFor(0, input.cols(), 1, [&](long begin, long end) {
+        double* scratch = ConvScratch(0, positions*PatchSize());
+        Eigen::Map<Eigen::MatrixXd> columns(scratch, positions, PatchSize());
+        for (long j=begin; j<end; j++) {
+            Im2Col(input.col(j).data(), scratch);
+            Eigen::Map<Eigen::MatrixXd> out(output.col(j).data(), positions, _outChannels);
+            out.noalias() = columns*_weights.transpose();
+            out.rowwise() += _bias.transpose();
+        }
+    });
+}
+
+Eigen::RowVectorXd ConvTransformation::BackwardTransform(Eigen::VectorXd point, Eigen::RowVectorXd rowVector) {
+    Eigen::MatrixXd backward_output;
+    BatchBackwardTransform(point, Eigen::MatrixXd(), rowVector, backward_output);
+    return backward_output;
+}
+
+// backward pass of each sample: gradient of the columns (gradient*weights) added back to the pixels (col2im)
+void ConvTransformation::BatchBackwardTransform(const Eigen::MatrixXd&, const Eigen::MatrixXd&,
+                                                const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {
+    if (backward_input.cols() != Rows()) {
+        throw std::domain_error("Backward input does not match the convolution.");
+    }
+    backward_output.resize(backward_input.rows(), Cols());
+    long positions = Positions();
+    ThreadPool::Global().ParallelFor(0, backward_input.rows(), 1, [&](long begin, long end) {
+        Eigen::Map<Eigen::MatrixXd> gradient(ConvScratch(1, positions*_outChannels), positions, _outChannels);
+        Eigen::Map<Eigen::MatrixXd> columns(ConvScratch(2, positions*PatchSize()), positions, PatchSize());
+        Eigen::Map<Eigen::RowVectorXd> sample(ConvScratch(3, Cols()), Cols());
+        for (long i=begin; i<end; i++) {
+            // NOTE: the row of the backward input is the gradient of the output image (channels are contiguous)
+            Eigen::Map<Eigen::RowVectorXd>(gradient.data(), Rows()) = backward_input.row(i);
+            columns.noalias() = gradient*_weights;
+            sample.setZero();
+            Col2Im(columns.data(), sample.data());
+            backward_output.row(i) = sample;
+        }
+    });
+}
+
+std::string ConvTransformation::Summary() {
+    std::stringstream ss;
+    ss << Type() << "\n"
+       << "Input: " << _inChannels << "x" << _height << "x" << _width << ", kernel: " << _outChannels << "x" << _inChannels
+       << "x" << _kernel << "x" << _kernel << " (stride " << _stride << ", padding " << _padding << "), output: "
+       << _outChannels << "x" << _outHeight << "x" << _outWidth << "\n";
+    return ss.str();
+}
+
+
+/***************************
+ * MAX-POOL TRANSFORMATION *
+ ***************************/
+
+MaxPoolTransformation::MaxPoolTransformation(int channels, int height, int width, int size):
+    Transformation(channels*(height/std::max(size, 1))*(width/std::max(size, 1)), channels*height*width, "MaxPoolTransformation"),
+    _channels(channels),
+    _height(height),
+    _width(width),
+    _size(size)
+    {
+        if ((channels <= 0) || (size <= 0) || (height < size) || (width < size)) {
+            throw std::invalid_argument("Shape of the max-pool is invalid.");
+        }
+    }
+
+Eigen::MatrixXd MaxPoolTransformation::Transform(Eigen::MatrixXd inputMatrix) {
+    Eigen::MatrixXd result;
+    BatchTransform(inputMatrix, result);
+    return result;
+}
+
+void MaxPoolTransformation::BatchTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output) {
+    if (input.rows() != Cols()) {
+        throw std::domain_error("Matrix cannot be evaluated.");
+    }
+    output.resize(Rows(), input.cols());
+    int outHeight = OutHeight();
+    int outWidth = OutWidth();
+    ThreadPool::Global().ParallelFor(0, input.cols(), 1, [&](long begin, long end) {
+        for (long j=begin; j<end; j++) {
+            const double* in = input.col(j).data();
+            double* out = output.col(j).data();
+            for (int c=0; c<_channels; c++) {
+                for (int oy=0; oy<outHeight; oy++) {
+                    for (int ox=0; ox<outWidth; ox++) {
+                        double maximum = in[((long)c*_height + oy*_size)*_width + ox*_size];
+                        for (int y=oy*_size; y<(oy + 1)*_size; y++) {
+                            for (int x=ox*_size; x<(ox + 1)*_size; x++) {
+                                maximum = std::max(maximum, in[((long)c*_height + y)*_width + x]);
+                            }
+                        }
+                        out[((long)c*outHeight + oy)*outWidth + ox] = maximum;
+                    }
+                }
+            }
+        }
+    });
+}
+
+Eigen::RowVectorXd MaxPoolTransformation::BackwardTransform(Eigen::VectorXd point, Eigen::RowVectorXd rowVector) {
+    Eigen::MatrixXd backward_output;
+    BatchBackwardTransform(point, Eigen::MatrixXd(), rowVector, backward_output);
+    return backward_output;
+}
+
+void MaxPoolTransformation::BatchBackwardTransform(const Eigen::MatrixXd& forward_input, const Eigen::MatrixXd&,
+                                                   const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {
+    int samples = backward_input.rows();
+    if ((forward_input.cols() != samples) || (forward_input.rows() != Cols())) {
+        throw std::domain_error("Batch sizes of forward and backward pass do not coincide.");
+    }
+    backward_output.setZero(samples, Cols());
+    int outHeight = OutHeight();
+    int outWidth = OutWidth();
+    ThreadPool::Global().ParallelFor(0, samples, 1, [&](long begin, long end) {
+        for (long i=begin; i<end; i++) {
+            const double* in = forward_input.col(i).data();
+            for (int c=0; c<_channels; c++) {
+                for (int oy=0; oy<outHeight; oy++) {
+                    for (int ox=0; ox<outWidth; ox++) {
+                        // position of the (first) maximum of the window
+                        long argmax = ((long)c*_height + oy*_size)*_width + ox*_size;
+                        for (int y=oy*_size; y<(oy + 1)*_size; y++) {
+                            for (int x=ox*_size; x<(ox + 1)*_size; x++) {
+                                long k = ((long)c*_height + y)*_width + x;
+                                if (in[k] > in[argmax]) {
+                                    argmax = k;
+                                }
+                            }
+                        }
+                        backward_output(i, argmax) = backward_input(i, ((long)c*outHeight + oy)*outWidth + ox);
+                    }
+                }
+            }
+        }
+    });
+}
+
+std::string MaxPoolTransformation::Summary() {
+    std::stringstream ss;
+    ss << Type() << "\n"
+       << "Input: " << _channels << "x" << _height << "x" << _width << ", window: " << _size << "x" << _size
+       << ", output: " << _channels << "x" << OutHeight() << "x" << OutWidth() << "\n";
+    return ss.str();
+}
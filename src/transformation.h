@@ -1,9 +1,11 @@
 #ifndef TRANSFORMATION_H_
 #define TRANSFORMATION_H_
 
+#include "bit_mask.h"
 #include <cmath>
 #include <Eigen/Dense>
 #include "function.h"
+#include "parameter_block.h"
 #include <memory>
 #include <vector>
 #include <string>
@@ -26,18 +28,31 @@
     The most important member functions, which need to be implemented by derived concrete classes, are:
         * ~Transform~: transforms the input, typically a vector or matrix 
           (NOTE: we work with _column vectors_ as our input. This might be a bit unconvential because often row vectors are used.)
+        * ~BatchTransform~: same as ~Transform~ but writes into the given output (used by ~Layer::Forward~), which is
+          only reallocated if its shape changes. By default it assigns the result of ~Transform~.
         * ~Initialize~: initializes the parameters of the transformation (so far only for LinearTransformation)
         * ~Derivative~: updates the derivative of the transformation at a data point
         * ~BackwardTransform~: used for backward pass/backpropagation (TODO: better suited in Layer class?)
+        * ~BatchBackwardTransform~: backward pass of all samples of a batch at once (used by ~Layer::Backward~). Unlike
+          ~BackwardTransform~, it does not write to the transformation, so several networks sharing a transformation
+          can run their backward passes concurrently (see ~SequentialNN::Replicate~). By default it applies
+          ~BackwardTransform~ to each sample.
         * ~Summary~: summarizes most important parameters (TODO: too verbose at the moment)
     
     The following methods have an _empty_ implementation by default and do not have to be implemented by derived concrete classes:
         * ~UpdateWeightsBias~: only needed for linear transformations (TODO: could be replaced with 
           a more general member function e.g. ~UpdateParameters~)
+        * ~UsesMask~, ~MaskedTransform~ and ~MaskedBackwardTransform~: only needed for transformations whose
+          derivative only depends on the sign of the input (so far relu). In training mode, a Layer then only keeps
+          a BitMask of the forward input for the backward pass (see ~Layer::SetTraining~).
 
     The concrete implementations of the abstract base class are:
         * ~LinearTransforamtion~: encapsulates an affine-linear transformation with weights and biases
         * ~ActivationTransformation~: could be a vectorized activation function or others, e.g. softmax.
+        * ~ConvTransformation~: 2D convolution of images (e.g. MNIST) with weights and biases per output channel
+        * ~MaxPoolTransformation~: maximum over non-overlapping windows of each channel of an image
+    Images are column vectors as well, with the pixel (c, y, x) (channel, row, column) at (c*height + y)*width + x,
+    i.e. MNIST samples are images with a single channel.
     
     TODO: - ~BackwardTransform~ could be unified by including the derivative into the ~Transformation~ class.
 */
@@ -74,14 +89,28 @@ class Transformation {
         
         // TODO: can the following be improved using references?
         virtual Eigen::MatrixXd Transform(Eigen::MatrixXd) = 0;
+        // transform all samples (columns) of input into output (must not coincide with input)
+        virtual void BatchTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output) { output = Transform(input); }
         
         // 'backward transformation' for backpropagation; depends on the derivative
         // of the transformation at a given point (which is the first argument)
         virtual Eigen::RowVectorXd BackwardTransform(Eigen::VectorXd, Eigen::RowVectorXd) = 0;
 
+        // backward transformation of all samples (rows of backward_input) given the forward in-/output of the batch
+        // (samples are columns); backward_output must not coincide with backward_input
+        virtual void BatchBackwardTransform(const Eigen::MatrixXd& forward_input, const Eigen::MatrixXd& forward_output,
+                                            const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output);
+
         // compute derivative/jacobian of the transformation at the given vector
         virtual void Derivative(Eigen::VectorXd) = 0;
 
+        // true if the backward pass only needs a BitMask of the forward input
+        virtual bool UsesMask() { return false; }
+        // transform input into output (which may be the same matrix) and save the mask needed for the backward pass
+        virtual void MaskedTransform(const Eigen::MatrixXd& input, Eigen::MatrixXd& output, BitMask& mask) {}
+        // backward transformation of all samples in backward_input using the mask saved by ~MaskedTransform~
+        virtual void MaskedBackwardTransform(const BitMask& mask, const Eigen::MatrixXd& backward_input, Eigen::MatrixXd& backward_output) {}
+
         // initialize transformation
         virtual void Initialize(std::string initialize_type="") {}
 
@@ -98,32 +127,60 @@ class Transformation {
  * CONCRETE IMPLEMENTATION: LINEAR TRANSFORMATION *
  **************************************************/
 
+/**
+    Affine-linear transformation x -> W*x + b. The parameters may be shared with other LinearTransformations (see
+    ~SequentialNN::Clone~), so every write access goes through ~Detach~ (copy-on-write, see ParameterBlock):
+    the non-const ~Weights~/~Bias~, the setters, ~Initialize~ and ~AddToWeights~/~AddToBias~. The passes and the
+    const getters only read the parameters and keep sharing them.
+*/
+
 class LinearTransformation: public Transformation {
     private:    
-        Eigen::MatrixXd _weights;
-        Eigen::VectorXd _bias;
+        // weights (rows x cols) followed by the bias (rows) in a single contiguous block (see ParameterBlock)
+        std::shared_ptr<ParameterBlock> _parameters;
+        Eigen::Map<Eigen::MatrixXd> _weights;
+        Eigen::Map<Eigen::VectorXd> _bias;
+
+        // point the weights and bias to _parameters
+        void Bind();
 
     public:
         // constructors
         // constructor for (affine) linear transformations
         LinearTransformation(Eigen::MatrixXd weights, Eigen::VectorXd bias): 
-            Transformation(weights.rows(), weights.cols(), "LinearTransformation"),
-            _weights(weights),
-            _bias(bias)
-            {}
+            LinearTransformation(weights.rows(), weights.cols())
+            {
+                SetWeights(weights);
+                SetBias(bias);
+            }
 
         // constructor (all zeros)
         LinearTransformation(int rows, int cols): 
-            Transformation(rows, cols, "LinearTransformation"),
-            _weights(Eigen::MatrixXd::Zero(rows, cols)), 
-            _bias(Eigen::VectorXd::Zero(rows))
+            LinearTransformation(rows, cols, std::make_shared<ParameterBlock>((long)rows*cols + rows))
             {}
 
+        // constructor with the given parameters (e.g. mapped from a checkpoint, see Checkpoint::Load, or shared with
+        // another transformation, see above)
+        LinearTransformation(int rows, int cols, std::shared_ptr<ParameterBlock> parameters);
+
+        // copies have their own (owned) parameters
+        LinearTransformation(const LinearTransformation&);
+        LinearTransformation& operator=(const LinearTransformation&) = delete;
+
         // setters & getters
-        Eigen::MatrixXd& Weights() { return _weights; }
-        void SetWeights(Eigen::MatrixXd weight_matrix) { _weights = weight_matrix; }
-        Eigen::VectorXd& Bias() { return _bias; }
-        void SetBias(Eigen::VectorXd bias) { _bias = bias; }
+        // NOTE: the non-const getters are for writing (see above)
+        Eigen::Map<Eigen::MatrixXd>& Weights() { Detach(); return _weights; }
+        const Eigen::Map<Eigen::MatrixXd>& Weights() const { return _weights; }
+        void SetWeights(const Eigen::MatrixXd& weight_matrix);
+        Eigen::Map<Eigen::VectorXd>& Bias() { Detach(); return _bias; }
+        const Eigen::Map<Eigen::VectorXd>& Bias() const { return _bias; }
+        void SetBias(const Eigen::VectorXd& bias);
+        // block of weights and bias
+        std::shared_ptr<ParameterBlock>& Parameters() { return _parameters; }
+        // true if the parameters are shared with another transformation
+        bool Shared() const { return _parameters.use_count() > 1; }
+        // copy-on-write: own copy of the parameters if they are shared (before writing them)
+        void Detach();
 
         // random initialize (either via "He" or "Normalized Xavier")
         void Initialize(std::string) override;
@@ -133,6 +190,7 @@ class LinearTransformation: public Transformation {
 
         // transform methods (just right matrix multiplication with input (a column vector))
         Eigen::MatrixXd Transform(Eigen::MatrixXd) override; 
+        void BatchTransform(const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
 
         // get derivative (trivial here because it coincides with weights)
         void Derivative(Eigen::VectorXd) override {}
@@ -141,13 +199,14 @@ class LinearTransformation: public Transformation {
         Eigen::RowVectorXd BackwardTransform(Eigen::VectorXd point, Eigen::RowVectorXd rowVector) override {
             return rowVector*(_weights);
         }
+        void BatchBackwardTransform(const Eigen::MatrixXd&, const Eigen::MatrixXd&, const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
 
         // update weights/bias
         void AddToWeights(Eigen::MatrixXd deltaWeights) override {
-            _weights += deltaWeights;
+            Weights() += deltaWeights;
         }
         void AddToBias(Eigen::VectorXd deltaBias) override {
-            _bias += deltaBias;
+            Bias() += deltaBias;
         }
 
         // summary
@@ -174,6 +233,7 @@ class ActivationTransformation: public Transformation {
             
         // transform method
         Eigen::MatrixXd Transform(Eigen::MatrixXd) override;
+        void BatchTransform(const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
 
         // set derivative at the given point
         void Derivative(Eigen::VectorXd) override;
@@ -184,9 +244,145 @@ class ActivationTransformation: public Transformation {
             Derivative(input);
             return input_matrix*(*(_derivative));
         }
+        // elementwise (or per sample for softmax) without the Jacobian _derivative
+        void BatchBackwardTransform(const Eigen::MatrixXd&, const Eigen::MatrixXd&, const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
+
+        // masked forward/backward pass (only relu)
+        bool UsesMask() override { return _type == "relu"; }
+        void MaskedTransform(const Eigen::MatrixXd&, Eigen::MatrixXd&, BitMask&) override;
+        void MaskedBackwardTransform(const BitMask&, const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
 
         // Summary of transformation
         std::string Summary() override; 
 };
 
+
+/****************************************************
+ * CONCRETE IMPLEMENTATION: CONVOLUTION (2D IMAGES) *
+ ****************************************************/
+
+/**
+    Convolution of an image with ~inChannels~ channels of size height x width with ~outChannels~ kernels of size
+    kernel x kernel (and the given stride and zero padding). The output is again an image (with ~outChannels~ channels
+    of size OutHeight() x OutWidth()).
+
+    Forward and backward pass go through im2col: the patches of a sample are copied into the rows of a matrix
+    (Positions() x PatchSize()), so that the convolution is a single matrix product with the weights
+    (outChannels x PatchSize()), i.e. it uses the same (blocked) Eigen kernels as a LinearTransformation. The samples
+    of a batch are processed in parallel (ThreadPool::Global()) with per-thread scratch buffers for the patches. Inside
+    another loop of the pool, e.g. the optimizer's loop over the replicas of a network, they are processed serially
+    (nested loops, see ThreadPool).
+*/
+
+class ConvTransformation: public Transformation {
+    private:
+        int _inChannels;
+        int _height;
+        int _width;
+        int _outChannels;
+        int _kernel;
+        int _stride;
+        int _padding;
+        int _outHeight;
+        int _outWidth;
+        // weights (outChannels x PatchSize()) followed by the bias (outChannels) in a single block (see ParameterBlock)
+        std::shared_ptr<ParameterBlock> _parameters;
+        Eigen::Map<Eigen::MatrixXd> _weights;
+        Eigen::Map<Eigen::VectorXd> _bias;
+
+    public:
+        // constructor (all zeros)
+        ConvTransformation(int inChannels, int height, int width, int outChannels, int kernel, int stride=1, int padding=0);
+
+        // copies have their own (owned) parameters
+        ConvTransformation(const ConvTransformation&);
+        ConvTransformation& operator=(const ConvTransformation&) = delete;
+
+        // getters
+        int InChannels() const { return _inChannels; }
+        int Height() const { return _height; }
+        int Width() const { return _width; }
+        int OutChannels() const { return _outChannels; }
+        int Kernel() const { return _kernel; }
+        int Stride() const { return _stride; }
+        int Padding() const { return _padding; }
+        int OutHeight() const { return _outHeight; }
+        int OutWidth() const { return _outWidth; }
+        // number of output pixels per channel and number of inputs of a single output pixel
+        long Positions() const { return (long)_outHeight*_outWidth; }
+        long PatchSize() const { return (long)_inChannels*_kernel*_kernel; }
+
+        Eigen::Map<Eigen::MatrixXd>& Weights() { return _weights; }
+        Eigen::Map<Eigen::VectorXd>& Bias() { return _bias; }
+        std::shared_ptr<ParameterBlock>& Parameters() { return _parameters; }
+
+        // random initialize (He or normalized Xavier with the fan-in/-out of a patch)
+        void Initialize(std::string) override;
+
+        // patches of a single sample (Cols() doubles) as rows of columns (Positions() x PatchSize(), column-major)
+        void Im2Col(const double* sample, double* columns) const;
+        // inverse of Im2Col: adds the rows of columns to the pixels of sample (which has to be zeroed before)
+        void Col2Im(const double* columns, double* sample) const;
+
+        // transform methods
+        Eigen::MatrixXd Transform(Eigen::MatrixXd) override;
+        void BatchTransform(const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
+
+        // trivial (see LinearTransformation)
+        void Derivative(Eigen::VectorXd) override {}
+
+        // backward pass (independent of the point as for LinearTransformations)
+        Eigen::RowVectorXd BackwardTransform(Eigen::VectorXd, Eigen::RowVectorXd) override;
+        void BatchBackwardTransform(const Eigen::MatrixXd&, const Eigen::MatrixXd&, const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
+
+        // update weights/bias
+        void AddToWeights(Eigen::MatrixXd deltaWeights) override {
+            _weights += deltaWeights;
+        }
+        void AddToBias(Eigen::VectorXd deltaBias) override {
+            _bias += deltaBias;
+        }
+
+        // summary
+        std::string Summary() override;
+};
+
+
+/**********************************************
+ * CONCRETE IMPLEMENTATION: MAX-POOL (IMAGES) *
+ **********************************************/
+
+// maximum over non-overlapping size x size windows of each channel (remaining rows/columns are dropped)
+// NOTE: the backward pass routes the gradient to the (first) maximum of each window of the forward input
+class MaxPoolTransformation: public Transformation {
+    private:
+        int _channels;
+        int _height;
+        int _width;
+        int _size;
+
+    public:
+        // constructor
+        MaxPoolTransformation(int channels, int height, int width, int size);
+
+        // getters
+        int Channels() const { return _channels; }
+        int Size() const { return _size; }
+        int OutHeight() const { return _height/_size; }
+        int OutWidth() const { return _width/_size; }
+
+        // transform methods
+        Eigen::MatrixXd Transform(Eigen::MatrixXd) override;
+        void BatchTransform(const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
+
+        // nothing to do (the maxima are looked up in the backward pass)
+        void Derivative(Eigen::VectorXd) override {}
+
+        Eigen::RowVectorXd BackwardTransform(Eigen::VectorXd, Eigen::RowVectorXd) override;
+        void BatchBackwardTransform(const Eigen::MatrixXd&, const Eigen::MatrixXd&, const Eigen::MatrixXd&, Eigen::MatrixXd&) override;
+
+        // summary
+        std::string Summary() override;
+};
+
 #endif // TRANSFORMATION_H_
\ No newline at end of file
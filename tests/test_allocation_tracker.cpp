@@ -0,0 +1,106 @@
+#include "../src/allocation_tracker.h"
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include <Eigen/Dense>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Tests for AllocationTracker class (with the hooks of LibAllocationHooks).
+ */
+
+void test_Phases() {
+    // allocations are counted in the phase of the scope
+    if (!AllocationTracker::Available()) {
+        throw std::runtime_error("Allocation hooks are not linked.");
+    }
+    AllocationTracker::Reset();
+    {
+        AllocationScope scope(AllocationTracker::Phase::kForward);
+        std::vector<double> data(1000);
+        Eigen::MatrixXd matrix = Eigen::MatrixXd::Zero(10, 10);
+    }
+    AllocationTracker::Counters forward = AllocationTracker::Get(AllocationTracker::Phase::kForward);
+    AllocationTracker::Counters update = AllocationTracker::Get(AllocationTracker::Phase::kUpdate);
+    std::cout << "Vector and matrix in the forward phase:\n" << AllocationTracker::Text();
+    bool correct = (forward.allocations == 2) && (forward.frees == 2) && (forward.bytes >= 8000 + 800)
+                   && (forward.peakBytes >= forward.bytes) && (update.allocations == 0)
+                   && (AllocationTracker::CurrentPhase() == AllocationTracker::Phase::kOther);
+    if (!correct) {
+        throw std::runtime_error("Allocations are not counted in their phase.");
+    }
+}
+
+// steady state allocations of Step for a network with the given layer sizes (relu and sigmoid alternately, softmax)
+template<typename Labels>
+long steady_state_allocations(const std::vector<int>& sizes, Optimizer& optimizer, const Eigen::MatrixXd& X,
+                              const Labels& labels, bool compiled=false) {
+    std::vector<std::shared_ptr<Layer> > layers;
+    for (size_t i=1; i<sizes.size(); i++) {
+        layers.push_back(std::make_shared<LinearLayer>(sizes[i], sizes[i-1]));
+        std::string activation = (i + 1 == sizes.size()) ? "softmax" : ((i % 2 == 1) ? "relu" : "sigmoid");
+        layers.push_back(std::make_shared<ActivationLayer>(sizes[i], activation));
+    }
+    SequentialNN snn(layers);
+    if (compiled) {
+        snn.Compile(optimizer.BatchSize());
+    }
+    // warm-up: the buffers of the LayerCaches, gradients and optimizer state are allocated by the first step
+    for (int s=0; s<2; s++) {
+        optimizer.Step(snn, X, labels);
+    }
+    AllocationTracker::Reset();
+    for (int s=0; s<5; s++) {
+        optimizer.Step(snn, X, labels);
+    }
+    // NOTE: before printing (which allocates)
+    long allocations = AllocationTracker::Total().allocations;
+    std::cout << optimizer.Name() << (compiled ? " compiled" : "") << " " << sizes.front() << "-...-" << sizes.back()
+              << " (steady state):\n" << AllocationTracker::Text();
+    return allocations;
+}
+
+// after the warm-up, a Step does not allocate (with class indices and one-hot-encoded labels, and with two
+// micro-batches per step)
+long zero_allocation_steps(const std::vector<int>& sizes) {
+    int batchSize = 50;
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(sizes.front(), batchSize).cwiseAbs();
+    Eigen::RowVectorXi classes(batchSize);
+    Eigen::MatrixXd yLabel = Eigen::MatrixXd::Zero(10, batchSize);
+    for (int j=0; j<batchSize; j++) {
+        classes(j) = j % 10;
+        yLabel(j % 10, j) = 1;
+    }
+    SDG sdg("cross_entropy", batchSize, 0.003);
+    Adam adam("mse", batchSize, 0.001);
+    Momentum momentum("cross_entropy", batchSize/2, 0.003);
+    return steady_state_allocations(sizes, sdg, X, classes) + steady_state_allocations(sizes, adam, X, yLabel)
+           + steady_state_allocations(sizes, momentum, X, classes) + steady_state_allocations(sizes, sdg, X, classes, true)
+           + steady_state_allocations(sizes, momentum, X, classes, true);
+}
+
+void test_ZeroAllocationStep() {
+    // NOTE: all operands of the matrix products are smaller than Eigen's default stack limit for the blocks of a
+    // product (128 KB), and the blocks are never larger than the operands, so the products do not allocate
+    // independently of the cache sizes (which determine the blocking) and of SEQUENTIALNN_STACK_GEMM_BLOCKS
+    if (zero_allocation_steps({96, 64, 32, 10}) != 0) {
+        throw std::runtime_error("Steady state training step allocates memory.");
+    }
+#ifdef SEQUENTIALNN_STACK_GEMM_BLOCKS
+    // network of main.cpp and BenchmarkTraining: the blocks of its products only fit on the stack with the option
+    if (zero_allocation_steps({784, 392, 196, 10}) != 0) {
+        throw std::runtime_error("Steady state training step of a large network allocates memory.");
+    }
+#endif
+}
+
+int main() {
+    test_Phases();
+    test_ZeroAllocationStep();
+
+    return 0;
+}
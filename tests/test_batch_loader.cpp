@@ -0,0 +1,115 @@
+#include "../src/batch_loader.h"
+#include <Eigen/Dense>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Tests for BatchLoader class.
+ */
+
+void test_Epochs() {
+    // sample i has all entries equal to i and label -i
+    int samples = 103;
+    int batchSize = 10;
+    Eigen::MatrixXd X(4, samples);
+    Eigen::MatrixXd yLabel(1, samples);
+    for (int i=0; i<samples; i++) {
+        X.col(i).setConstant(i);
+        yLabel(0, i) = -i;
+    }
+
+    BatchLoader loader(X, yLabel, batchSize, 42);
+    std::cout << "Batches per epoch: " << loader.BatchesPerEpoch() << std::endl;
+
+    const Eigen::MatrixXd* batch;
+    const Eigen::MatrixXd* batchLabel;
+    for (int epoch=0; epoch<3; epoch++) {
+        std::vector<int> count(samples, 0);
+        for (int b=0; b<loader.BatchesPerEpoch(); b++) {
+            loader.Next(batch, batchLabel);
+            for (int c=0; c<batch->cols(); c++) {
+                int i = (int)(*batch)(0, c);
+                if ((*batchLabel)(0, c) != -i) {
+                    throw std::runtime_error("Label does not belong to sample.");
+                }
+                count[i]++;
+            }
+            if (b == loader.BatchesPerEpoch()-1) {
+                std::cout << "Size of last batch: " << batch->cols() << std::endl;
+            }
+        }
+        for (int c: count) {
+            if (c != 1) {
+                throw std::runtime_error("Sample not contained exactly once in an epoch.");
+            }
+        }
+        std::cout << "Epoch " << epoch << ": each sample exactly once" << std::endl;
+    }
+    std::cout << "Batches served: " << loader.BatchesServed() << ", waited for data: " << loader.WaitSeconds() << " s" << std::endl;
+}
+
+void test_ClassIndices() {
+    // sample i has all entries equal to i and class i % 7
+    int samples = 31;
+    Eigen::MatrixXd X(3, samples);
+    Eigen::RowVectorXi classes(samples);
+    for (int i=0; i<samples; i++) {
+        X.col(i).setConstant(i);
+        classes(i) = i % 7;
+    }
+
+    BatchLoader loader(X, classes, 8, 1);
+    const Eigen::MatrixXd* batch;
+    const Eigen::RowVectorXi* batchClasses;
+    std::vector<int> count(samples, 0);
+    for (int b=0; b<loader.BatchesPerEpoch(); b++) {
+        loader.Next(batch, batchClasses);
+        for (int c=0; c<batch->cols(); c++) {
+            int i = (int)(*batch)(0, c);
+            if ((*batchClasses)(c) != i % 7) {
+                throw std::runtime_error("Class index does not belong to sample.");
+            }
+            count[i]++;
+        }
+    }
+    for (int c: count) {
+        if (c != 1) {
+            throw std::runtime_error("Sample not contained exactly once in an epoch.");
+        }
+    }
+    std::cout << "Class indices: each sample exactly once with its class" << std::endl;
+}
+
+void test_StartBatch() {
+    // a loader starting at a batch hands out the same batches as a loader with the same seed after as many batches
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(2, 23);
+    Eigen::MatrixXd yLabel = Eigen::MatrixXd::Random(1, 23);
+    BatchLoader loader(X, yLabel, 5, 9);
+    BatchLoader started(X, yLabel, 5, 9, 7);
+    const Eigen::MatrixXd* batch;
+    const Eigen::MatrixXd* batchLabel;
+    const Eigen::MatrixXd* startedBatch;
+    const Eigen::MatrixXd* startedLabel;
+    for (int b=0; b<7; b++) {
+        loader.Next(batch, batchLabel);
+    }
+    bool same = true;
+    for (int b=0; b<12; b++) {
+        loader.Next(batch, batchLabel);
+        started.Next(startedBatch, startedLabel);
+        same = same && (*batch == *startedBatch) && (*batchLabel == *startedLabel);
+    }
+    std::cout << "Start batch: same batches " << same << std::endl;
+    if (!same) {
+        throw std::runtime_error("Loader with start batch does not hand out the same batches.");
+    }
+}
+
+int main() {
+    test_Epochs();
+    test_StartBatch();
+    test_ClassIndices();
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include "../src/checkpoint.h"
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include <chrono>
+#include <cstdio>
+#include <Eigen/Dense>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Tests for Checkpoint class.
+ */
+
+// maximal deviation of the weights and biases of two networks (with the same architecture)
+double max_deviation(SequentialNN& snn1, SequentialNN& snn2) {
+    double deviation = 0;
+    for (int i=0; i<snn1.Length(); i+=2) {
+        auto linear1 = std::static_pointer_cast<LinearTransformation>(snn1.GetLayer(i).GetTransformation());
+        auto linear2 = std::static_pointer_cast<LinearTransformation>(snn2.GetLayer(i).GetTransformation());
+        deviation = std::max(deviation, (linear1->Weights() - linear2->Weights()).cwiseAbs().maxCoeff());
+        deviation = std::max(deviation, (linear1->Bias() - linear2->Bias()).cwiseAbs().maxCoeff());
+    }
+    return deviation;
+}
+
+void test_SaveLoad() {
+    // a loaded network (mapped and in memory) coincides with the saved one, also when training is resumed with Adam
+    std::string path = "./tests/generated_checkpoint.ckpt";
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(8, 30);
+    Eigen::RowVectorXi classes(30);
+    for (int j=0; j<30; j++) {
+        X.col(j).head(3).maxCoeff(&classes(j));
+    }
+    SequentialNN snn({LinearLayer(12, 8), ActivationLayer(12, "relu"), LinearLayer(3, 12),
+                      ActivationLayer(3, "softmax")});
+    Adam adam("cross_entropy", 10, 0.01);
+    adam.SetSeed(1);
+    adam.Train(snn, X, classes, 5);
+    Checkpoint::Save(path, snn, &adam);
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> saved((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    bool correct = true;
+    for (bool map: {true, false}) {
+        Adam resumed("cross_entropy", 10, 0.5);
+        auto start = std::chrono::steady_clock::now();
+        SequentialNN loaded = Checkpoint::Load(path, &resumed, map);
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bool mapped = std::static_pointer_cast<LinearTransformation>(loaded.GetLayer(0).GetTransformation())->Parameters()->Mapped();
+        double outputDeviation = (loaded(X) - snn(X)).cwiseAbs().maxCoeff();
+
+        // resume training: same optimizer state, same updates
+        Adam original("cross_entropy", 10, 0.01);
+        SequentialNN copy = Checkpoint::Load(path, &original, false);
+        original.SetSeed(2);
+        resumed.SetSeed(2);
+        original.Train(copy, X, classes, 3);
+        resumed.Train(loaded, X, classes, 3);
+        double trainingDeviation = max_deviation(copy, loaded);
+
+        std::cout << (map ? "Mapped" : "In memory") << ": loaded in " << milliseconds << " ms, mapped: " << mapped
+                  << ", output deviation: " << outputDeviation << ", deviation after resumed training: " << trainingDeviation
+                  << ", updates: " << resumed.Updates() << std::endl;
+        correct = correct && (mapped == map) && (outputDeviation == 0) && (trainingDeviation == 0)
+                  && (resumed.Updates() == adam.Updates() + 9) && (resumed.LearningRate() == 0.01);
+    }
+    // training the mapped weights does not modify the file (copy-on-write)
+    std::ifstream in_after(path, std::ios::binary);
+    std::vector<char> after((std::istreambuf_iterator<char>(in_after)), std::istreambuf_iterator<char>());
+    std::cout << "File unchanged after training: " << (saved == after) << std::endl;
+    std::remove(path.c_str());
+    if (!correct || (saved != after)) {
+        throw std::runtime_error("Loaded checkpoint does not coincide with the saved network.");
+    }
+}
+
+void test_InvalidFiles() {
+    // wrong magic/version and a different optimizer are detected
+    std::string path = "./tests/generated_checkpoint_invalid.ckpt";
+    SequentialNN snn({LinearLayer(12, 8), ActivationLayer(12, "relu"), LinearLayer(3, 12),
+                      ActivationLayer(3, "softmax")});
+    SDG sdg("mse", 5, 0.1);
+    Checkpoint::Save(path, snn, &sdg);
+    int detected = 0;
+    try {
+        Adam adam("mse", 5, 0.1);
+        Checkpoint::Load(path, &adam);
+    } catch (const std::invalid_argument&) {
+        detected++;
+    }
+    {
+        // bump the version
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        uint32_t version = 99;
+        file.seekp(8);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    }
+    try {
+        Checkpoint::Load(path);
+    } catch (const std::runtime_error& error) {
+        std::cout << error.what() << std::endl;
+        detected++;
+    }
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << "not a checkpoint";
+    }
+    try {
+        Checkpoint::Load(path);
+    } catch (const std::runtime_error& error) {
+        std::cout << error.what() << std::endl;
+        detected++;
+    }
+    std::remove(path.c_str());
+    if (detected != 3) {
+        throw std::runtime_error("Invalid checkpoints were not detected.");
+    }
+}
+
+void test_Resume() {
+    // training resumed from a checkpoint of the scheduler coincides with an uninterrupted training
+    std::string initial = "./tests/generated_checkpoint_initial.ckpt";
+    std::string path = "./tests/generated_checkpoint_scheduled.ckpt";
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(8, 30);
+    Eigen::RowVectorXi classes(30);
+    for (int j=0; j<30; j++) {
+        X.col(j).head(3).maxCoeff(&classes(j));
+    }
+    SequentialNN snn({LinearLayer(12, 8), ActivationLayer(12, "relu"), LinearLayer(3, 12),
+                      ActivationLayer(3, "softmax")});
+    Checkpoint::Save(initial, snn);
+
+    // uninterrupted: 4 epochs of 3 batches
+    SequentialNN uninterrupted = Checkpoint::Load(initial, nullptr, false);
+    Adam adam("cross_entropy", 10, 0.01);
+    adam.SetSeed(5);
+    adam.Train(uninterrupted, X, classes, 4);
+
+    // checkpoints after 5 and 10 updates, the last one is used to resume
+    SequentialNN scheduled = Checkpoint::Load(initial, nullptr, false);
+    Adam adamScheduled("cross_entropy", 10, 0.01);
+    adamScheduled.SetSeed(5);
+    CheckpointScheduler scheduler(path, 5);
+    scheduler.Attach(adamScheduled);
+    adamScheduled.Train(scheduled, X, classes, 4);
+    scheduler.Wait();
+
+    Adam adamResumed("cross_entropy", 10, 0.01);
+    SequentialNN resumed = Checkpoint::Load(path, &adamResumed);
+    long resumedAt = adamResumed.Progress().batches;
+    adamResumed.Train(resumed, X, classes, 4);
+
+    double deviation = max_deviation(uninterrupted, resumed);
+    std::cout << "Checkpoints: " << scheduler.Checkpoints() << ", stalls: ";
+    for (double stall: scheduler.StallSeconds()) {
+        std::cout << stall*1e3 << " ms ";
+    }
+    std::cout << "(written in " << scheduler.WriteSeconds()*1e3 << " ms), resumed at batch " << resumedAt 
+              << ", deviation from uninterrupted training: " << deviation << std::endl;
+    std::remove(initial.c_str());
+    std::remove(path.c_str());
+    if ((scheduler.Checkpoints() != 2) || (resumedAt != 10) || (deviation != 0) || (adamResumed.Updates() != adam.Updates())) {
+        throw std::runtime_error("Resumed training does not coincide with the uninterrupted training.");
+    }
+}
+
+void test_ConcurrentSave() {
+    // concurrent saves of the same path (e.g. the CheckpointScheduler and a manual Save) leave a valid checkpoint and no
+    // temporary files
+    std::string path = "./tests/generated_concurrent.ckpt";
+    SequentialNN snn1({LinearLayer(12, 8), ActivationLayer(12, "relu"), LinearLayer(3, 12),
+                       ActivationLayer(3, "softmax")});
+    SequentialNN snn2({LinearLayer(12, 8), ActivationLayer(12, "relu"), LinearLayer(3, 12),
+                       ActivationLayer(3, "softmax")});
+    auto save = [&path](SequentialNN& snn) {
+        for (int i=0; i<20; i++) {
+            Checkpoint::Save(path, snn);
+        }
+    };
+    std::thread writer1(save, std::ref(snn1));
+    std::thread writer2(save, std::ref(snn2));
+    writer1.join();
+    writer2.join();
+
+    SequentialNN loaded = Checkpoint::Load(path, nullptr, false);
+    double deviation = std::min(max_deviation(loaded, snn1), max_deviation(loaded, snn2));
+    int leftover = 0;
+    for (const auto& entry: std::filesystem::directory_iterator("./tests")) {
+        std::string name = entry.path().filename().string();
+        leftover += (name != "generated_concurrent.ckpt") && (name.rfind("generated_concurrent.ckpt", 0) == 0);
+    }
+
+    // the permissions of the checkpoint respect the umask (like std::ofstream)
+    mode_t previous = umask(077);
+    Checkpoint::Save(path, snn1);
+    umask(previous);
+    auto permissions = std::filesystem::status(path).permissions();
+    bool ownerOnly = (permissions == (std::filesystem::perms::owner_read | std::filesystem::perms::owner_write));
+    std::cout << "Concurrent saves: deviation: " << deviation << ", leftover temporary files: " << leftover
+              << ", umask respected: " << ownerOnly << std::endl;
+    std::remove(path.c_str());
+    if ((deviation != 0) || (leftover != 0) || !ownerOnly) {
+        throw std::runtime_error("Concurrent saves corrupted the checkpoint.");
+    }
+}
+
+int main() {
+    test_SaveLoad();
+    test_InvalidFiles();
+    test_Resume();
+    test_ConcurrentSave();
+    return 0;
+}
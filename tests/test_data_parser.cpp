@@ -1,7 +1,13 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <Eigen/Dense>
 #include "../src/data_parser.h"
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 void test_data_parser() {
@@ -34,8 +40,124 @@ void test_MNIST() {
     std::cout << "Cols of X_train: " << X_train.cols() << std::endl;
 }
 
+void test_LoadSamplesLabels() {
+    // the parallel loader has to coincide with LoadCSV (samples as columns)
+    // small file with blanks (single chunk) and a larger generated file (several chunks)
+    std::string generated = "./tests/generated_parser_test.csv";
+    std::ofstream out(generated);
+    out << std::setprecision(17);
+    for (int i=0; i<4000; i++) {
+        out << (i % 10);
+        Eigen::RowVectorXd row = Eigen::RowVectorXd::Random(20)*1000;
+        for (int j=0; j<row.size(); j++) {
+            out << "," << row(j);
+        }
+        out << "\n";
+    }
+    out.close();
+
+    DataParser dp;
+    for (std::string path: std::vector<std::string>{"./tests/train.csv", generated}) {
+        Eigen::MatrixXd X = dp.LoadCSV<Eigen::MatrixXd>(path);
+        Eigen::MatrixXd samples;
+        Eigen::RowVectorXd labels;
+        dp.LoadSamplesLabels(path, samples, labels);
+        Eigen::MatrixXd columns = dp.LoadCSVColumns(path);
+
+        bool equal = (samples == X.rightCols(X.cols()-1).transpose()) && (labels == X.col(0).transpose())
+                     && (columns == X.transpose());
+        std::cout << "Parallel loader coincides with LoadCSV for " << path << " (" << samples.cols() << " samples): "
+                  << equal << std::endl;
+        if (!equal) {
+            throw std::runtime_error("Parallel loader does not coincide with LoadCSV.");
+        }
+    }
+    std::remove(generated.c_str());
+
+    // malformed cells are rejected
+    std::ofstream malformed(generated);
+    malformed << "1, 2, 3\n4, x, 6\n";
+    malformed.close();
+    bool rejected = false;
+    try {
+        dp.LoadCSVColumns(generated);
+    } catch (const std::invalid_argument& e) {
+        std::cout << "Rejected: " << e.what() << std::endl;
+        rejected = true;
+    }
+    std::remove(generated.c_str());
+    if (!rejected) {
+        throw std::runtime_error("Malformed csv-file was not rejected.");
+    }
+}
+
+// write an IDX file of unsigned bytes
+void write_idx(const std::string& path, const std::vector<int>& dims, const std::vector<uint8_t>& bytes) {
+    std::ofstream out(path, std::ios::binary);
+    out.put(0); out.put(0); out.put(0x08); out.put((char)dims.size());
+    for (int d: dims) {
+        // big-endian
+        for (int shift=24; shift>=0; shift-=8) {
+            out.put((char)((d >> shift) & 0xFF));
+        }
+    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+void test_LoadIDX() {
+    // 30 'images' of 4x5 pixels, pixel j of image i has value (7*i + j) % 256, label i % 10
+    std::string images = "./tests/generated_images.idx";
+    std::string labels = "./tests/generated_labels.idx";
+    std::vector<uint8_t> pixels, digits;
+    for (int i=0; i<30; i++) {
+        for (int j=0; j<20; j++) {
+            pixels.push_back((7*i + j) % 256);
+        }
+        digits.push_back(i % 10);
+    }
+    write_idx(images, {30, 4, 5}, pixels);
+    write_idx(labels, {30}, digits);
+
+    DataParser dp;
+    ByteDataset mnist = dp.LoadIDX(images, labels);
+    bool equal = (mnist.Features() == 20) && (mnist.NumberOfSamples() == 30);
+    for (int i=0; i<30; i++) {
+        equal = equal && (mnist.Labels()(i) == i % 10);
+        for (int j=0; j<20; j++) {
+            equal = equal && (mnist.Samples()(j, i) == (7*i + j) % 256);
+        }
+    }
+    // moments (of values in [0, 1]) coincide with the direct computation
+    Eigen::ArrayXd values(pixels.size());
+    for (size_t k=0; k<pixels.size(); k++) {
+        values(k) = pixels[k]/255.0;
+    }
+    double mean, stddev;
+    mnist.Moments(mean, stddev);
+    double expected = std::sqrt((values - values.mean()).square().mean());
+    bool moments = (std::abs(mean - values.mean()) < 1e-12) && (std::abs(stddev - expected) < 1e-12);
+    std::cout << "IDX samples/labels coincide: " << equal << ", moments coincide: " << moments << ", bytes: " << mnist.Bytes()
+              << " (as doubles: " << (mnist.Features() + 1)*mnist.NumberOfSamples()*sizeof(double) << ")" << std::endl;
+
+    // wrong data type is rejected
+    std::ofstream(labels, std::ios::binary).write("\0\0\x0d\x01", 4);
+    bool rejected = false;
+    try {
+        dp.LoadIDX(images, labels);
+    } catch (const std::runtime_error& e) {
+        rejected = true;
+    }
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    if (!equal || !moments || !rejected) {
+        throw std::runtime_error("IDX files are not read correctly.");
+    }
+}
+
 int main() {
     test_data_parser();
+    test_LoadSamplesLabels();
+    test_LoadIDX();
     //test_MNIST();
 
     return 0;
@@ -0,0 +1,232 @@
+#include "../src/data_parser.h"
+#include "../src/data_stream.h"
+#include "../src/dataset.h"
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <Eigen/Dense>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Tests for DataStream classes (ShardStream, ByteStream).
+ */
+
+// current resident memory (in MB) of the process
+double resident_mb() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident*(double)sysconf(_SC_PAGESIZE)/(1 << 20);
+}
+
+// stream which forwards to another one and records the maximal resident memory and the number of samples
+class ProbeStream: public DataStream {
+    private:
+        DataStream& _stream;
+    public:
+        double maxResidentMB = 0;
+        long samples = 0;
+
+        ProbeStream(DataStream& stream): _stream(stream) {}
+        bool Next(const Eigen::MatrixXd*& batch, const Eigen::MatrixXd*& batchLabel) override {
+            maxResidentMB = std::max(maxResidentMB, resident_mb());
+            bool next = _stream.Next(batch, batchLabel);
+            samples += next ? batch->cols() : 0;
+            return next;
+        }
+        int BatchSize() override { return _stream.BatchSize(); }
+        long Features() override { return _stream.Features(); }
+};
+
+void test_Epochs() {
+    // each sample (label = global index) is contained in exactly one batch per epoch, shards in binary and csv format
+    std::vector<std::string> shards;
+    long index = 0;
+    for (int s=0; s<4; s++) {
+        int samples = 10 + 7*s;
+        Eigen::MatrixXd X = Eigen::MatrixXd::Random(3, samples);
+        Eigen::RowVectorXd labels(samples);
+        for (int j=0; j<samples; j++) {
+            labels(j) = index++;
+        }
+        if (s < 3) {
+            shards.push_back("./tests/generated_stream_" + std::to_string(s) + ".bin");
+            Dataset::Write(shards.back(), X, labels);
+        } else {
+            shards.push_back("./tests/generated_stream_" + std::to_string(s) + ".csv");
+            std::ofstream out(shards.back());
+            for (int j=0; j<samples; j++) {
+                out << labels(j) << "," << X(0, j) << "," << X(1, j) << "," << X(2, j) << "\n";
+            }
+        }
+    }
+
+    ShardStream stream(shards, 7, 2, 0, 42);
+    const Eigen::MatrixXd* batch;
+    const Eigen::MatrixXd* batchLabel;
+    std::vector<std::vector<long> > orders(2);
+    for (int epoch=0; epoch<2; epoch++) {
+        while (stream.Next(batch, batchLabel)) {
+            for (int j=0; j<batchLabel->cols(); j++) {
+                orders[epoch].push_back((long)(*batchLabel)(0, j));
+            }
+        }
+    }
+    bool shuffled = (orders[0] != orders[1]);
+    bool complete = true;
+    for (std::vector<long>& order: orders) {
+        std::sort(order.begin(), order.end());
+        for (long i=0; i<index; i++) {
+            complete = complete && ((long)order.size() == index) && (order[i] == i);
+        }
+    }
+    std::cout << "Each sample once per epoch: " << complete << ", shuffled: " << shuffled << std::endl;
+
+    for (const std::string& shard: shards) {
+        std::remove(shard.c_str());
+    }
+    std::remove(DataParser::SidecarPath(shards.back()).c_str());
+    if (!complete || !shuffled) {
+        throw std::runtime_error("ShardStream does not iterate correctly over the samples.");
+    }
+}
+
+void test_MemoryBound() {
+    // train on a data set which is several times larger than the memory cap; the resident memory has to stay bounded
+    const double capMB = 40;
+    const int shards = 12;
+    const int samplesPerShard = 8000;
+    const int features = 128;
+    const int classes = 10;
+    double baselineMB = resident_mb();
+
+    std::vector<std::string> paths;
+    for (int s=0; s<shards; s++) {
+        // label: index of the largest of the first classes features
+        Eigen::MatrixXd X = Eigen::MatrixXd::Random(features, samplesPerShard);
+        Eigen::RowVectorXd labels(samplesPerShard);
+        for (int j=0; j<samplesPerShard; j++) {
+            Eigen::Index label;
+            X.col(j).head(classes).maxCoeff(&label);
+            labels(j) = label;
+        }
+        paths.push_back("./tests/generated_stream_large_" + std::to_string(s) + ".bin");
+        Dataset::Write(paths.back(), X, labels);
+    }
+    double datasetMB = shards*(double)samplesPerShard*features*sizeof(double)/(1 << 20);
+
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<LinearLayer>(classes, features),
+                                                std::make_shared<ActivationLayer>(classes, "softmax")};
+    SequentialNN snn(layers);
+    SDG sdg("cross_entropy", 100, 0.01);
+    ShardStream stream(paths, 100, 1, classes, 7);
+    ProbeStream probe(stream);
+    sdg.Train(snn, probe, 1);
+
+    double growthMB = probe.maxResidentMB - baselineMB;
+    std::cout << "Data set: " << datasetMB << " MB, samples trained: " << probe.samples << ", max. resident memory growth: "
+              << growthMB << " MB (cap " << capMB << " MB)" << std::endl;
+    for (const std::string& path: paths) {
+        std::remove(path.c_str());
+    }
+    if ((probe.samples != (long)shards*samplesPerShard) || (growthMB > capMB) || (datasetMB < 2*capMB)) {
+        throw std::runtime_error("Streaming training exceeded the memory cap or missed samples.");
+    }
+}
+
+void test_InvalidShard() {
+    // a shard which cannot be loaded: Next throws its error, also when it is called again
+    std::vector<std::string> paths{"./tests/generated_stream_valid.bin", "./tests/generated_stream_invalid.bin"};
+    Dataset::Write(paths[0], Eigen::MatrixXd::Random(4, 10), Eigen::RowVectorXd::Zero(10));
+    Dataset::Write(paths[1], Eigen::MatrixXd::Random(5, 10), Eigen::RowVectorXd::Zero(10));
+    ShardStream stream(paths, 4, 1, 2, 3);
+    const Eigen::MatrixXd* batch;
+    const Eigen::MatrixXd* batchLabel;
+    std::vector<std::string> errors;
+    for (int call=0; (call < 20) && (errors.size() < 2); call++) {
+        try {
+            stream.Next(batch, batchLabel);
+        } catch (const std::invalid_argument& e) {
+            errors.push_back(e.what());
+        }
+    }
+    for (const std::string& path: paths) {
+        std::remove(path.c_str());
+    }
+    std::cout << "Invalid shard: " << errors.size() << " errors" << (errors.empty() ? "" : ", " + errors[0]) << std::endl;
+    if ((errors.size() != 2) || (errors[0] != errors[1])) {
+        throw std::runtime_error("Error of an invalid shard is not rethrown consistently.");
+    }
+}
+
+void test_ByteStream() {
+    // batches of a ByteDataset are normalized during assembly and contain each sample once per epoch
+    std::string images = "./tests/generated_stream_images.idx";
+    std::string labels = "./tests/generated_stream_labels.idx";
+    {
+        // 25 samples of 6 bytes (sample i has bytes 10*i + j), labels i % 3
+        std::ofstream out(images, std::ios::binary);
+        out.write("\0\0\x08\x02\0\0\0\x19\0\0\0\x06", 12);
+        for (int i=0; i<25; i++) {
+            for (int j=0; j<6; j++) {
+                out.put((char)(10*i + j));
+            }
+        }
+        std::ofstream out_labels(labels, std::ios::binary);
+        out_labels.write("\0\0\x08\x01\0\0\0\x19", 8);
+        for (int i=0; i<25; i++) {
+            out_labels.put((char)(i % 3));
+        }
+    }
+    ByteDataset dataset(images, labels);
+    ByteNormalization standardize = dataset.Standardization();
+    bool correct = true;
+    for (ByteNormalization normalization: {ByteNormalization::Unit(), standardize}) {
+        ByteStream stream(dataset, 4, normalization, 3, 1);
+        const Eigen::MatrixXd* batch;
+        const Eigen::MatrixXd* batchLabel;
+        std::vector<int> seen(25, 0);
+        while (stream.Next(batch, batchLabel)) {
+            for (int c=0; c<batch->cols(); c++) {
+                // recover the sample from its first value
+                int i = (int)std::round(((*batch)(0, c) - normalization.shift)/normalization.scale)/10;
+                seen[i]++;
+                for (int j=0; j<6; j++) {
+                    correct = correct && (std::abs((*batch)(j, c) - ((10*i + j)*normalization.scale + normalization.shift)) < 1e-12);
+                }
+                correct = correct && ((*batchLabel)(i % 3, c) == 1.0) && (batchLabel->col(c).sum() == 1.0);
+            }
+        }
+        correct = correct && (std::count(seen.begin(), seen.end(), 1) == 25);
+    }
+    // standardized samples have mean zero and standard deviation one
+    ByteStream stream(dataset, 25, standardize, 0, 1);
+    const Eigen::MatrixXd* batch;
+    const Eigen::MatrixXd* batchLabel;
+    stream.Next(batch, batchLabel);
+    double mean = batch->mean();
+    double stddev = std::sqrt((batch->array() - mean).square().mean());
+    std::cout << "Byte stream correct: " << correct << ", standardized mean: " << mean << ", standard deviation: " << stddev << std::endl;
+    std::remove(images.c_str());
+    std::remove(labels.c_str());
+    if (!correct || (std::abs(mean) > 1e-12) || (std::abs(stddev - 1) > 1e-12)) {
+        throw std::runtime_error("ByteStream does not assemble/normalize the batches correctly.");
+    }
+}
+
+int main() {
+    test_Epochs();
+    test_InvalidShard();
+    test_ByteStream();
+    test_MemoryBound();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "../src/data_parser.h"
+#include "../src/dataset.h"
+#include <chrono>
+#include <cstdio>
+#include <Eigen/Dense>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/**
+ * Tests for Dataset class (and its use as sidecar of csv-files in DataParser).
+ */
+
+void write_csv(const std::string& path, int samples, int features, double offset) {
+    std::ofstream out(path);
+    for (int i=0; i<samples; i++) {
+        out << (i % 10);
+        for (int j=0; j<features; j++) {
+            out << "," << offset + i*features + j;
+        }
+        out << "\n";
+    }
+}
+
+void test_WriteRead() {
+    // written and memory-mapped data set coincide
+    std::string path = "./tests/generated_dataset_test.bin";
+    Eigen::MatrixXd samples = Eigen::MatrixXd::Random(7, 13);
+    Eigen::RowVectorXd labels = Eigen::RowVectorXd::Random(13);
+    Dataset::Write(path, samples, labels);
+
+    Dataset dataset(path);
+    bool equal = dataset.Mapped() && (dataset.Samples() == samples) && (dataset.Labels() == labels);
+    std::cout << "Mapped data set coincides: " << equal << std::endl;
+    std::remove(path.c_str());
+    if (!equal) {
+        throw std::runtime_error("Mapped data set does not coincide with the written one.");
+    }
+}
+
+void test_Sidecar() {
+    std::string path = "./tests/generated_dataset_test.csv";
+    std::string sidecar = DataParser::SidecarPath(path);
+    std::remove(sidecar.c_str());
+    write_csv(path, 50, 6, 0.5);
+    DataParser dp;
+
+    // first load creates the sidecar, the second one reuses it
+    Dataset first = dp.LoadDataset(path);
+    auto created = std::filesystem::last_write_time(sidecar);
+    Dataset second = dp.LoadDataset(path);
+    Eigen::MatrixXd samples;
+    Eigen::RowVectorXd labels;
+    dp.LoadSamplesLabels(path, samples, labels);
+    bool reused = second.Mapped() && (std::filesystem::last_write_time(sidecar) == created)
+                  && (second.Samples() == samples) && (second.Labels() == labels) && (first.Samples() == samples);
+    std::cout << "Sidecar created and reused: " << reused << std::endl;
+
+    // changing the csv-file (different size) updates the sidecar
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    write_csv(path, 60, 6, 1.5);
+    Dataset third = dp.LoadDataset(path);
+    dp.LoadSamplesLabels(path, samples, labels);
+    bool updated = (third.NumberOfSamples() == 60) && (third.Samples() == samples) && (third.Labels() == labels);
+    std::cout << "Sidecar updated after change of csv-file: " << updated << std::endl;
+
+    std::remove(path.c_str());
+    std::remove(sidecar.c_str());
+    if (!reused || !updated) {
+        throw std::runtime_error("Sidecar of csv-file is not reused/updated correctly.");
+    }
+}
+
+int main() {
+    test_WriteRead();
+    test_Sidecar();
+    return 0;
+}
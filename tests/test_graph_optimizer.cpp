@@ -0,0 +1,119 @@
+#include "../src/graph_optimizer.h"
+#include "../src/layer.h"
+#include "../src/sequential_nn.h"
+#include "../src/transformation.h"
+#include <Eigen/Dense>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Tests for GraphOptimizer class.
+ */
+
+// network with random weights and biases in all linear layers (also in the last one, which is not initialized)
+SequentialNN random_network(std::vector<std::shared_ptr<Layer> > layers) {
+    SequentialNN snn(layers);
+    for (int i=0; i<snn.Length(); i++) {
+        auto linear = std::dynamic_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation());
+        if (linear != nullptr) {
+            linear->Weights().setRandom();
+            linear->Bias().setRandom();
+        }
+    }
+    return snn;
+}
+
+// scaling layer (diagonal weights, zero bias)
+std::shared_ptr<Layer> scaling_layer(Eigen::VectorXd diagonal) {
+    Eigen::MatrixXd weights = diagonal.asDiagonal();
+    return std::make_shared<LinearLayer>(weights, Eigen::VectorXd::Zero(diagonal.size()));
+}
+
+// max. deviation of the outputs of both networks for random inputs
+double output_deviation(SequentialNN& snn1, SequentialNN& snn2) {
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(snn1.GetLayer(0).Cols(), 50);
+    return (snn1(X) - snn2(X)).cwiseAbs().maxCoeff();
+}
+
+// optimize snn and check the number of layers and the equivalence
+void check(const std::string& name, SequentialNN& snn, int expectedLength) {
+    GraphOptimizer::Report report;
+    SequentialNN optimized = GraphOptimizer::Optimize(snn, &report);
+    double deviation = output_deviation(snn, optimized);
+    std::cout << name << ":\n" << report.Text() << "  deviation of the outputs: " << deviation << std::endl;
+    for (int i=0; i<optimized.Length(); i++) {
+        Layer& layer = optimized.GetLayer(i);
+        std::cout << "  " << layer.GetTransformation()->Type() << " (" << layer.Rows() << ", " << layer.Cols() << ")\n";
+    }
+    if ((optimized.Length() != expectedLength) || (report.layersAfter != expectedLength) || (deviation > 1e-12)
+        || (report.flopsAfter > report.flopsBefore)) {
+        throw std::runtime_error("Optimized network (" + name + ") is not as expected.");
+    }
+}
+
+void test_MergeLinear() {
+    // the identities are removed and the three linear layers become one (fewer FLOPs)
+    SequentialNN snn = random_network({std::make_shared<LinearLayer>(16, 8),
+                                       std::make_shared<ActivationLayer>(16, "identity"),
+                                       std::make_shared<LinearLayer>(12, 16),
+                                       std::make_shared<ActivationLayer>(12, "identity"),
+                                       std::make_shared<LinearLayer>(4, 12),
+                                       std::make_shared<ActivationLayer>(4, "softmax")});
+    check("Linear layers", snn, 2);
+}
+
+void test_Bottleneck() {
+    // the identity is removed but the layers of the bottleneck are not merged (more FLOPs)
+    SequentialNN snn = random_network({std::make_shared<LinearLayer>(2, 16),
+                                       std::make_shared<ActivationLayer>(2, "identity"),
+                                       std::make_shared<LinearLayer>(16, 2),
+                                       std::make_shared<ActivationLayer>(16, "sigmoid")});
+    check("Bottleneck", snn, 3);
+}
+
+void test_FoldScalings() {
+    // the non-negative scaling after the relu is folded into the first layer, the negative one is kept
+    Eigen::VectorXd positive = Eigen::VectorXd::Random(8).cwiseAbs();
+    Eigen::VectorXd negative = -positive;
+    SequentialNN snn = random_network({std::make_shared<LinearLayer>(8, 6),
+                                       std::make_shared<ActivationLayer>(8, "relu"),
+                                       scaling_layer(positive),
+                                       std::make_shared<ActivationLayer>(8, "tanh"),
+                                       std::make_shared<LinearLayer>(8, 8),
+                                       std::make_shared<ActivationLayer>(8, "relu"),
+                                       scaling_layer(negative),
+                                       std::make_shared<ActivationLayer>(8, "sigmoid")});
+    // NOTE: random_network overwrites the scalings
+    for (int i: {2, 6}) {
+        auto linear = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation());
+        linear->Weights() = (Eigen::MatrixXd)(i == 2 ? positive : negative).asDiagonal();
+        linear->Bias().setZero();
+    }
+    check("Scalings", snn, 7);
+}
+
+void test_Compiled() {
+    // compiled networks are optimized as well (the check respects the max. batch size)
+    SequentialNN snn = random_network({std::make_shared<LinearLayer>(10, 5),
+                                       std::make_shared<ActivationLayer>(10, "identity"),
+                                       std::make_shared<LinearLayer>(3, 10),
+                                       std::make_shared<ActivationLayer>(3, "softmax")});
+    snn.Compile(4, ExecutionPlan::Mode::kInference);
+    GraphOptimizer::Report report;
+    SequentialNN optimized = GraphOptimizer::Optimize(snn, &report);
+    std::cout << "Compiled:\n" << report.Text();
+    if ((optimized.Length() != 2) || optimized.Compiled() || (report.mergedLinear != 1)) {
+        throw std::runtime_error("Optimized compiled network is not as expected.");
+    }
+}
+
+int main() {
+    test_MergeLinear();
+    test_Bottleneck();
+    test_FoldScalings();
+    test_Compiled();
+    return 0;
+}
@@ -1,12 +1,16 @@
 
+#include <algorithm>
 #include <Eigen/Dense>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include "../src/transformation.h"
 #include "../src/layer.h"
 #include "../src/layer_cache.h"
 #include "../src/loss_function.h"
+#include "../src/thread_pool.h"
 
 /**
  * Smoke tests for Layer class.
@@ -106,8 +110,189 @@ void test_LayerVector() {
     std::cout << "Count of objects: " << w[1].use_count() << std::endl;
 }
 
+void test_ReluMask() {
+    // relu layer in training mode (with mask) has to coincide with the usual relu layer
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(70, 130);
+    Eigen::MatrixXd G = Eigen::MatrixXd::Random(130, 70);
+
+    ActivationLayer al(70, "relu");
+    al.Input(X);
+    al.Forward();
+    al.BackwardInput(G);
+    al.Backward();
+
+    ActivationLayer al_masked(70, "relu");
+    al_masked.SetTraining(true);
+    al_masked.Input(X);
+    al_masked.Forward();
+    al_masked.BackwardInput(G);
+    al_masked.Backward();
+
+    std::cout << "Mask bytes: " << al_masked.GetLayerCache().GetForwardMask().Bytes() << std::endl;
+    std::cout << "Forward output coincides: " << (al.Output() == al_masked.Output()) << std::endl;
+    std::cout << "Backward output coincides: " << (al.BackwardOutput() == al_masked.BackwardOutput()) << std::endl;
+    if ((al.Output() != al_masked.Output()) || (al.BackwardOutput() != al_masked.BackwardOutput())) {
+        throw std::runtime_error("Masked relu layer does not coincide with relu layer.");
+    }
+}
+
+void test_BatchBackward() {
+    // backward pass of the whole batch has to coincide with the backward transform of each sample
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(7, 11);
+    Eigen::MatrixXd G = Eigen::MatrixXd::Random(11, 7);
+
+    for (std::string activation: {"softmax", "tanh", "sigmoid", "relu"}) {
+        ActivationLayer al(7, activation);
+        al.Input(X);
+        al.Forward();
+        al.BackwardInput(G);
+        al.Backward();
+
+        Eigen::MatrixXd expected(11, 7);
+        for (int i=0; i<11; i++) {
+            expected.row(i) = al.GetTransformation()->BackwardTransform(X.col(i), G.row(i));
+        }
+        double error = (al.BackwardOutput() - expected).cwiseAbs().maxCoeff();
+        std::cout << "Batch backward (" << activation << "), max. deviation: " << error << std::endl;
+        if (error > 1e-12) {
+            throw std::runtime_error("Batch backward pass does not coincide with the backward pass per sample.");
+        }
+    }
+}
+
+void test_ConvLayer() {
+    // convolution (2 channels, stride 2, padding 1) against a direct loop; backward pass and Deltas are checked with
+    // the adjoint identities <G, W*X> = <backward output, X> = <Delta of the weights, W> (bias zero)
+    int channels = 2, height = 7, width = 6, outChannels = 3, kernel = 3, stride = 2, padding = 1;
+    ConvLayer cl(channels, height, width, outChannels, kernel, stride, padding);
+    auto conv = std::static_pointer_cast<ConvTransformation>(cl.GetTransformation());
+    conv->Weights().setRandom();
+    int outHeight = conv->OutHeight(), outWidth = conv->OutWidth();
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(channels*height*width, 9);
+    Eigen::MatrixXd G = Eigen::MatrixXd::Random(9, cl.Rows());
+
+    Eigen::MatrixXd expected = Eigen::MatrixXd::Zero(cl.Rows(), 9);
+    for (int j=0; j<9; j++) {
+        for (int o=0; o<outChannels; o++) {
+            for (int oy=0; oy<outHeight; oy++) {
+                for (int ox=0; ox<outWidth; ox++) {
+                    double sum = 0;
+                    for (int c=0; c<channels; c++) {
+                        for (int ky=0; ky<kernel; ky++) {
+                            for (int kx=0; kx<kernel; kx++) {
+                                int y = oy*stride - padding + ky, x = ox*stride - padding + kx;
+                                if ((y >= 0) && (y < height) && (x >= 0) && (x < width)) {
+                                    sum += conv->Weights()(o, (c*kernel + ky)*kernel + kx)*X((c*height + y)*width + x, j);
+                                }
+                            }
+                        }
+                    }
+                    expected((o*outHeight + oy)*outWidth + ox, j) = sum;
+                }
+            }
+        }
+    }
+    cl.Input(X);
+    cl.Forward();
+    cl.BackwardInput(G);
+    cl.Backward();
+    cl.UpdateDeltas();
+    TrainableParameter weights = cl.Parameter(0, 0);
+    TrainableParameter bias = cl.Parameter(1, 0);
+    double inner = (G.transpose().array()*expected.array()).sum();
+    double backwardInner = (cl.BackwardOutput().transpose().array()*X.array()).sum();
+    double deltaInner = (Eigen::Map<Eigen::MatrixXd>(weights.delta, outChannels, conv->PatchSize()).array()*conv->Weights().array()).sum();
+    double deltaBias = Eigen::Map<Eigen::VectorXd>(bias.delta, outChannels).sum();
+    double error = std::max({(cl.Output() - expected).cwiseAbs().maxCoeff(), std::abs(backwardInner - inner),
+                             std::abs(deltaInner - inner), std::abs(deltaBias - G.sum())});
+    std::cout << "Convolution " << cl.Cols() << " -> " << cl.Rows() << ", max. deviation: " << error << std::endl;
+    if (error > 1e-10) {
+        throw std::runtime_error("Convolution does not coincide with the direct computation.");
+    }
+}
+
+void test_MaxPoolLayer() {
+    // 2x2 windows of a 1x4x5 image (the last column is dropped); the gradient goes to the maxima
+    Eigen::MatrixXd X(20, 1);
+    X << 1, 2, 0, 0, 9,
+         3, 4, 0, 5, 9,
+         0, 0, 7, 1, 9,
+         6, 0, 1, 1, 9;
+    Eigen::MatrixXd G(1, 4);
+    G << 10, 20, 30, 40;
+    MaxPoolLayer ml(1, 4, 5, 2);
+    ml.Input(X);
+    ml.Forward();
+    ml.BackwardInput(G);
+    ml.Backward();
+    Eigen::MatrixXd expectedOutput(4, 1);
+    expectedOutput << 4, 5, 6, 7;
+    Eigen::MatrixXd expectedBackward = Eigen::MatrixXd::Zero(1, 20);
+    expectedBackward(0, 6) = 10;
+    expectedBackward(0, 8) = 20;
+    expectedBackward(0, 15) = 30;
+    expectedBackward(0, 12) = 40;
+    std::cout << "Max-pool output: " << ml.Output().transpose() << std::endl;
+    if ((ml.Output() != expectedOutput) || (ml.BackwardOutput() != expectedBackward)) {
+        throw std::runtime_error("Max-pool does not coincide with the expected result.");
+    }
+}
+
+void test_NestedConvPasses() {
+    // passes of replicas inside an outer ParallelFor (like the optimizer's loop over replicas) coincide with the
+    // passes outside of it (the nested loops over the samples are run serially, see ThreadPool)
+    ThreadPool::SetGlobalThreads(3);
+    ConvLayer cl(2, 8, 8, 4, 3);
+    std::static_pointer_cast<ConvTransformation>(cl.GetTransformation())->Weights().setRandom();
+    MaxPoolLayer ml(4, 6, 6, 2);
+    const int kReplicas = 3;
+    std::vector<std::shared_ptr<Layer> > convs, pools;
+    std::vector<Eigen::MatrixXd> inputs, gradients, expected;
+    for (int r=0; r<kReplicas; r++) {
+        convs.push_back(cl.Replicate());
+        pools.push_back(ml.Replicate());
+        inputs.push_back(Eigen::MatrixXd::Random(cl.Cols(), 16));
+        gradients.push_back(Eigen::MatrixXd::Random(16, ml.Rows()));
+    }
+    auto passes = [&](int r) {
+        convs[r]->Input(inputs[r]);
+        convs[r]->Forward();
+        pools[r]->Input(convs[r]->Output());
+        pools[r]->Forward();
+        pools[r]->BackwardInput(gradients[r]);
+        pools[r]->Backward();
+        convs[r]->BackwardInput(pools[r]->BackwardOutput());
+        convs[r]->Backward();
+        Eigen::MatrixXd result(pools[r]->Output().size() + convs[r]->BackwardOutput().size(), 1);
+        result << pools[r]->Output().reshaped(), convs[r]->BackwardOutput().reshaped();
+        return result;
+    };
+    for (int r=0; r<kReplicas; r++) {
+        expected.push_back(passes(r));
+    }
+    std::vector<Eigen::MatrixXd> results(kReplicas);
+    ThreadPool::Global().ParallelFor(0, kReplicas, 1, [&](long begin, long end) {
+        for (long r=begin; r<end; r++) {
+            results[r] = passes(r);
+        }
+    });
+    double error = 0;
+    for (int r=0; r<kReplicas; r++) {
+        error = std::max(error, (results[r] - expected[r]).cwiseAbs().maxCoeff());
+    }
+    std::cout << "Nested convolution passes, max. deviation: " << error << std::endl;
+    if (error != 0) {
+        throw std::runtime_error("Nested convolution passes do not coincide with the passes outside of a loop.");
+    }
+}
+
 int main() {
     test_LinearLayer();
+    test_ReluMask();
+    test_BatchBackward();
+    test_ConvLayer();
+    test_MaxPoolLayer();
+    test_NestedConvPasses();
     //test_ActivationLayer();
     //test_LayerVector();
 }
\ No newline at end of file
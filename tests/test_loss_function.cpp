@@ -1,5 +1,9 @@
 #include <Eigen/Dense>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include "../src/loss_function.h"
 
 /**
@@ -62,8 +66,69 @@ void test_cross_entropy() {
 }
 
 
+void test_Evaluate() {
+    // single pass has to coincide with operator() and GradsAtPoints
+    std::vector<std::string> names{"mse", "cross_entropy"};
+    for (std::string& name: names) {
+        auto loss_fct = LossFunction(name);
+        Eigen::MatrixXd y = (Eigen::MatrixXd::Random(6, 9).array() + 1.0)/2.0;
+        Eigen::MatrixXd yLabel = Eigen::MatrixXd::Zero(6, 9);
+        for (int j=0; j<9; j++) {
+            yLabel(j % 6, j) = 1.0;
+        }
+        Eigen::MatrixXd grads;
+        double loss = loss_fct.Evaluate(y, yLabel, grads);
+        loss_fct.GradsAtPoints(y, yLabel);
+
+        std::cout << name << " loss: " << loss << " (operator(): " << loss_fct(y, yLabel) << ")" << std::endl;
+        std::cout << name << " gradients coincide: " << grads.isApprox(loss_fct.GetGrads()) << std::endl;
+        if ((std::abs(loss - loss_fct(y, yLabel)) > 1e-12) || !grads.isApprox(loss_fct.GetGrads())) {
+            throw std::runtime_error("Evaluate does not coincide with operator() and GradsAtPoints.");
+        }
+    }
+}
+
+void test_ClassIndices() {
+    // class indices have to give the same loss and gradients as the one-hot-encoded labels
+    std::vector<std::string> names{"mse", "cross_entropy"};
+    for (std::string& name: names) {
+        auto loss_fct = LossFunction(name);
+        Eigen::MatrixXd y = (Eigen::MatrixXd::Random(6, 9).array() + 1.0)/2.0;
+        Eigen::RowVectorXi classes(9);
+        Eigen::MatrixXd yLabel = Eigen::MatrixXd::Zero(6, 9);
+        for (int j=0; j<9; j++) {
+            classes(j) = (5*j) % 6;
+            yLabel(classes(j), j) = 1.0;
+        }
+        Eigen::MatrixXd grads, gradsOneHot;
+        double loss = loss_fct.Evaluate(y, classes, grads);
+        double lossOneHot = loss_fct.Evaluate(y, yLabel, gradsOneHot);
+
+        std::cout << name << " loss with class indices: " << loss << " (one-hot: " << lossOneHot << ", operator(): " 
+                  << loss_fct(y, classes) << "), gradients coincide: " << grads.isApprox(gradsOneHot) << std::endl;
+        if ((std::abs(loss - lossOneHot) > 1e-12) || (std::abs(loss_fct(y, classes) - lossOneHot) > 1e-12) || !grads.isApprox(gradsOneHot)) {
+            throw std::runtime_error("Loss with class indices does not coincide with the one-hot-encoded labels.");
+        }
+    }
+    // class indices out of range
+    auto ce = LossFunction("cross_entropy");
+    Eigen::RowVectorXi invalid(2);
+    invalid << 0, 3;
+    bool thrown = false;
+    try {
+        ce(Eigen::MatrixXd::Constant(3, 2, 0.5), invalid);
+    } catch (const std::out_of_range&) {
+        thrown = true;
+    }
+    if (!thrown) {
+        throw std::runtime_error("Class index out of range was not detected.");
+    }
+}
+
 int main() {
     //test_MSE();
     //test_MSE2();
     test_cross_entropy();
+    test_Evaluate();
+    test_ClassIndices();
 }
\ No newline at end of file
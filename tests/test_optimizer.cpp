@@ -2,8 +2,12 @@
 #include "../src/loss_function.h"
 #include "../src/sequential_nn.h"
 #include "../src/optimizer.h"
+#include "../src/thread_pool.h"
+#include <algorithm>
 #include <Eigen/Dense>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 /**
@@ -121,8 +125,10 @@ void test_OptimizeLinearRegression1D() {
     std::cout << yLabel << std::endl;
 
     // train with SDG optimizer
+    // 600 epochs with 50 batches each (30000 steps)
     auto sdg = SDG("mse", 1, 0.0001);
-    sdg.Train(linear, X, yLabel, 30000);
+    sdg.Train(linear, X, yLabel, 600);
+    std::cout << "Waited for data: " << sdg.DataWaitSeconds() << " s" << std::endl;
     std::cout << linear.Summary() << std::endl;
 }
 
@@ -155,8 +161,9 @@ void test_OptimizeLinearRegression2D() {
     std::cout << X << std::endl;
 
     // train with SDG optimizer
+    // 5 epochs with 1000 batches each
     auto sdg = SDG("mse", 5, 1e-9);
-    sdg.Train(linear, X, yLabel, 5000);
+    sdg.Train(linear, X, yLabel, 5);
     std::cout << linear.Summary() << std::endl;
 }
 
@@ -201,12 +208,244 @@ void test_Softmax() {
     //std::cout << "X: " << X << std::endl;
     //std::cout << "yLabel: " << yLabel << std::endl;
     // train
+    // 3 epochs with 800 batches each
     auto sdg = SDG("cross_entropy", 5, 0.1);
-    sdg.Train(snn, X, yLabel, 2000);
+    sdg.Train(snn, X, yLabel, 3);
     std::cout << snn.Summary() << std::endl;
 }
 
+void test_Optimizers() {
+    // 1-dimensional linear regression (y = 15*x + 3) with all optimizers
+    int data_points = 50;
+    Eigen::MatrixXd X(1, data_points);
+    Eigen::MatrixXd yLabel(1, data_points);
+    for (int i=0; i<data_points; i++) {
+        X(0, i) = i/10.0;
+        yLabel(0, i) = 15.0*X(0, i) + 3.0;
+    }
+
+    std::vector<std::unique_ptr<Optimizer> > optimizers;
+    optimizers.emplace_back(std::make_unique<SDG>("mse", 5, 0.001));
+    optimizers.emplace_back(std::make_unique<Momentum>("mse", 5, 0.0001));
+    optimizers.emplace_back(std::make_unique<RMSProp>("mse", 5, 0.02));
+    optimizers.emplace_back(std::make_unique<Adam>("mse", 5, 0.05));
+    optimizers.emplace_back(std::make_unique<AdamW>("mse", 5, 0.05, 0.0001));
+
+    for (auto& optimizer: optimizers) {
+        auto ll_ptr = std::make_shared<LinearLayer>(1, 1);
+        SequentialNN linear({ll_ptr});
+        for (int j=0; j<3000; j++) {
+            optimizer->Step(linear, X.middleCols((5*j) % data_points, 5), yLabel.middleCols((5*j) % data_points, 5));
+        }
+        auto& transformation = static_cast<LinearTransformation&>(*ll_ptr->GetTransformation());
+        std::cout << optimizer->Name() << " (should be close to 15 and 3): weight " << transformation.Weights()(0, 0)
+                  << ", bias " << transformation.Bias()(0) << std::endl;
+    }
+    // number of state arrays (also on the concrete types)
+    Momentum momentum("mse", 5, 0.0001);
+    RMSProp rmsProp("mse", 5, 0.02);
+    Adam adam("mse", 5, 0.05);
+    std::cout << "State buffers: " << momentum.StateBuffers() << " " << rmsProp.StateBuffers() << " " << adam.StateBuffers()
+              << std::endl;
+    if ((momentum.StateBuffers() != 1) || (rmsProp.StateBuffers() != 1) || (adam.StateBuffers() != 2)) {
+        throw std::runtime_error("Wrong number of state buffers.");
+    }
+}
+
+// network for test_GradientAccumulation with the given weights of the LinearLayers
+SequentialNN accumulation_network(const std::vector<Eigen::MatrixXd>& weights) {
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<LinearLayer>(16, 6),
+                                                std::make_shared<ActivationLayer>(16, "relu"),
+                                                std::make_shared<LinearLayer>(8, 16),
+                                                std::make_shared<ActivationLayer>(8, "tanh"),
+                                                std::make_shared<LinearLayer>(4, 8),
+                                                std::make_shared<ActivationLayer>(4, "softmax")};
+    SequentialNN snn(layers);
+    for (int i=0; i<3; i++) {
+        std::static_pointer_cast<LinearTransformation>(snn.GetLayer(2*i).GetTransformation())->SetWeights(weights[i]);
+    }
+    return snn;
+}
+
+void test_GradientAccumulation() {
+    // a step with micro-batches (serial and on replicas) has to coincide with a step with the whole batch
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(6, 23);
+    Eigen::MatrixXd Y = Eigen::MatrixXd::Zero(4, 23);
+    for (int j=0; j<23; j++) {
+        Y(j % 4, j) = 1.0;
+    }
+    std::vector<Eigen::MatrixXd> weights{Eigen::MatrixXd::Random(16, 6), Eigen::MatrixXd::Random(8, 16),
+                                         Eigen::MatrixXd::Random(4, 8)};
+
+    std::vector<Eigen::MatrixXd> result[3];
+    double loss[3];
+    for (int k=0; k<3; k++) {
+        // whole batch, micro-batches of 5 samples on a single thread and on three threads
+        ThreadPool::SetGlobalThreads(k == 2 ? 3 : 1);
+        SDG sdg("cross_entropy", k == 0 ? 23 : 5, 0.1);
+        SequentialNN snn = accumulation_network(weights);
+        for (int step=0; step<3; step++) {
+            loss[k] = sdg.Step(snn, X, Y);
+        }
+        for (int i=0; i<3; i++) {
+            result[k].push_back(std::static_pointer_cast<LinearTransformation>(snn.GetLayer(2*i).GetTransformation())->Weights());
+        }
+    }
+    ThreadPool::SetGlobalThreads(std::max(1u, std::thread::hardware_concurrency()));
+
+    for (int k=1; k<3; k++) {
+        double error = std::abs(loss[k] - loss[0]);
+        for (int i=0; i<3; i++) {
+            error = std::max(error, (result[k][i] - result[0][i]).cwiseAbs().maxCoeff());
+        }
+        std::cout << "Gradient accumulation (" << (k == 1 ? "serial" : "replicas") << "), max. deviation: " << error << std::endl;
+        if (error > 1e-10) {
+            throw std::runtime_error("Step with micro-batches does not coincide with a step with the whole batch.");
+        }
+    }
+}
+
+void test_ClassIndices() {
+    // training with class indices has to coincide with training with one-hot-encoded labels
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(6, 40);
+    Eigen::RowVectorXi classes(40);
+    Eigen::MatrixXd Y = Eigen::MatrixXd::Zero(4, 40);
+    for (int j=0; j<40; j++) {
+        // label: index of the largest of the first four features
+        X.col(j).head(4).maxCoeff(&classes(j));
+        Y(classes(j), j) = 1.0;
+    }
+    std::vector<Eigen::MatrixXd> weights{Eigen::MatrixXd::Random(16, 6), Eigen::MatrixXd::Random(8, 16),
+                                         Eigen::MatrixXd::Random(4, 8)};
+
+    SequentialNN snn = accumulation_network(weights);
+    SequentialNN snnOneHot = accumulation_network(weights);
+    SDG sdg("cross_entropy", 8, 0.05);
+    SDG sdgOneHot("cross_entropy", 8, 0.05);
+    sdg.SetSeed(3);
+    sdgOneHot.SetSeed(3);
+    sdg.Train(snn, X, classes, 20);
+    sdgOneHot.Train(snnOneHot, X, Y, 20);
+
+    double error = 0;
+    for (int i=0; i<3; i++) {
+        auto weights = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(2*i).GetTransformation())->Weights();
+        auto weightsOneHot = std::static_pointer_cast<LinearTransformation>(snnOneHot.GetLayer(2*i).GetTransformation())->Weights();
+        error = std::max(error, (weights - weightsOneHot).cwiseAbs().maxCoeff());
+    }
+    double accuracy = snn.Accuracy(X, classes, 16);
+    // invalid labels of a step with several micro-batches are rejected before the micro-batches are distributed
+    Eigen::RowVectorXi invalidClasses = classes;
+    invalidClasses(37) = 4;
+    bool rejected = false;
+    try {
+        sdg.Step(snn, X, invalidClasses);
+    } catch (const std::out_of_range&) {
+        try {
+            sdg.Step(snn, X, Eigen::MatrixXd(Y.topRows(3)));
+        } catch (const std::invalid_argument&) {
+            rejected = true;
+        }
+    }
+    std::cout << "Class indices vs. one-hot, max. deviation: " << error << ", training accuracy: " << accuracy
+              << ", invalid labels rejected: " << rejected << std::endl;
+    if ((error > 1e-10) || (accuracy != snnOneHot.Accuracy(X, classes)) || !rejected) {
+        throw std::runtime_error("Training with class indices does not coincide with one-hot-encoded labels.");
+    }
+}
+
+void test_CompiledTraining() {
+    // training a compiled network (also on compiled replicas) has to coincide with the layer by layer passes
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(6, 48);
+    Eigen::RowVectorXi classes(48);
+    for (int j=0; j<48; j++) {
+        X.col(j).head(4).maxCoeff(&classes(j));
+    }
+    std::vector<Eigen::MatrixXd> weights{Eigen::MatrixXd::Random(16, 6), Eigen::MatrixXd::Random(8, 16),
+                                         Eigen::MatrixXd::Random(4, 8)};
+
+    ThreadPool::SetGlobalThreads(2);
+    SequentialNN snn = accumulation_network(weights);
+    SequentialNN compiled = accumulation_network(weights);
+    compiled.Compile(8);
+    Adam adam("cross_entropy", 8, 0.01);
+    Adam adamCompiled("cross_entropy", 8, 0.01);
+    for (Adam* optimizer: {&adam, &adamCompiled}) {
+        optimizer->SetSeed(5);
+        optimizer->SetAccumulationSteps(2);
+    }
+    adam.Train(snn, X, classes, 10);
+    adamCompiled.Train(compiled, X, classes, 10);
+    ThreadPool::SetGlobalThreads(std::max(1u, std::thread::hardware_concurrency()));
+
+    double error = 0;
+    for (int i=0; i<3; i++) {
+        auto weights = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(2*i).GetTransformation())->Weights();
+        auto weightsCompiled = std::static_pointer_cast<LinearTransformation>(compiled.GetLayer(2*i).GetTransformation())->Weights();
+        error = std::max(error, (weights - weightsCompiled).cwiseAbs().maxCoeff());
+    }
+    std::cout << "Compiled vs. layer by layer training, max. deviation: " << error << std::endl;
+    if ((error > 1e-10) || (compiled.Accuracy(X, classes) != snn.Accuracy(X, classes))) {
+        throw std::runtime_error("Training a compiled network does not coincide with the layer by layer passes.");
+    }
+}
+
+// 8x8 images with a horizontal (class 0) or vertical (class 1) bar at a random position plus noise
+void bar_images(int samples, Eigen::MatrixXd& X, Eigen::RowVectorXi& classes) {
+    X = 0.1*Eigen::MatrixXd::Random(64, samples);
+    classes.resize(samples);
+    for (int j=0; j<samples; j++) {
+        classes(j) = j % 2;
+        int position = (j/2) % 8;
+        for (int k=0; k<8; k++) {
+            X(classes(j) == 0 ? position*8 + k : k*8 + position, j) += 1.0;
+        }
+    }
+}
+
+void test_ConvTraining() {
+    // a small convolutional network learns to tell horizontal from vertical bars; micro-batches on replicas
+    // (parallel, with shared convolution weights) coincide with the whole batch
+    Eigen::MatrixXd X;
+    Eigen::RowVectorXi classes;
+    bar_images(64, X, classes);
+    SequentialNN snn({ConvLayer(1, 8, 8, 8, 3), ActivationLayer(288, "relu"), MaxPoolLayer(8, 6, 6, 2),
+                      LinearLayer(2, 72), ActivationLayer(2, "softmax")});
+    auto last = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(3).GetTransformation());
+    last->Weights().setRandom();
+    Adam adam("cross_entropy", 16, 0.01);
+    adam.SetSeed(1);
+    adam.Train(snn, X, classes, 30);
+    double accuracy = snn.Accuracy(X, classes);
+
+    Eigen::MatrixXd convWeights = Eigen::MatrixXd::Random(8, 9);
+    Eigen::MatrixXd linearWeights = Eigen::MatrixXd::Random(2, 72);
+    Eigen::MatrixXd weights[2];
+    for (int k=0; k<2; k++) {
+        ThreadPool::SetGlobalThreads(k == 0 ? 1 : 3);
+        SequentialNN copy({ConvLayer(1, 8, 8, 8, 3), ActivationLayer(288, "relu"), MaxPoolLayer(8, 6, 6, 2),
+                           LinearLayer(2, 72), ActivationLayer(2, "softmax")});
+        std::static_pointer_cast<ConvTransformation>(copy.GetLayer(0).GetTransformation())->Weights() = convWeights;
+        std::static_pointer_cast<LinearTransformation>(copy.GetLayer(3).GetTransformation())->SetWeights(linearWeights);
+        SDG step("cross_entropy", k == 0 ? 64 : 16, 0.05);
+        step.Step(copy, X, classes);
+        weights[k] = std::static_pointer_cast<ConvTransformation>(copy.GetLayer(0).GetTransformation())->Weights();
+    }
+    ThreadPool::SetGlobalThreads(std::max(1u, std::thread::hardware_concurrency()));
+    double error = (weights[1] - weights[0]).cwiseAbs().maxCoeff();
+    std::cout << "Convolutional network, training accuracy: " << accuracy << ", micro-batches vs. whole batch, max. deviation: "
+              << error << std::endl;
+    if ((accuracy < 0.95) || (error > 1e-10)) {
+        throw std::runtime_error("Training of the convolutional network failed.");
+    }
+}
+
 int main() {
+    test_ConvTraining();
+    test_GradientAccumulation();
+    test_ClassIndices();
+    test_CompiledTraining();
+    test_Optimizers();
     //test_OptimizeLinearRegression2D();
     test_OptimizeLinearRegression1D();
     //test_Step();
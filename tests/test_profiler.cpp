@@ -0,0 +1,143 @@
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/profiler.h"
+#include "../src/sequential_nn.h"
+#include <Eigen/Dense>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Tests for Profiler class.
+ */
+
+void test_Hooks() {
+    // the hooks are called around each layer in the order of the passes
+    SequentialNN snn({LinearLayer(64, 32), ActivationLayer(64, "relu"), LinearLayer(4, 64),
+                      ActivationLayer(4, "softmax")});
+    auto profiler = std::make_shared<Profiler>(false);
+    std::string order;
+    int open = 0;
+    bool nested = false;
+    profiler->SetHooks([&](Profiler::Phase phase, int layer) {
+                           nested = nested || (open != 0);
+                           open++;
+                           order += Profiler::PhaseName(phase).substr(0, 1) + std::to_string(layer);
+                       },
+                       [&](Profiler::Phase, int) { open--; });
+    snn.SetProfiler(profiler);
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(32, 8);
+    Eigen::RowVectorXi classes = Eigen::RowVectorXi::Zero(8);
+    SDG sdg("cross_entropy", 8, 0.01);
+    sdg.Step(snn, X, classes);
+
+    // names are escaped in the JSON report
+    profiler->SetLayerName(0, "0 \"linear\" C:\\");
+    bool escaped = (profiler->JSON().find("\"name\": \"0 \\\"linear\\\" C:\\\\\"") != std::string::npos);
+
+    std::cout << "Hooks: " << order << ", samples without timing: " << profiler->Report()[0].phases[0].calls
+              << ", names escaped: " << escaped << std::endl;
+    if ((order != "f0f1f2f3b3b2b1b0u0u2") || nested || (open != 0) || (profiler->Report()[0].phases[0].calls != 0)
+        || !escaped) {
+        throw std::runtime_error("Hooks are not called around each layer.");
+    }
+}
+
+void test_Train() {
+    // report of Train: one sample per step, layer and phase; profiling does not change the training
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(32, 200);
+    Eigen::RowVectorXi classes(200);
+    for (int j=0; j<200; j++) {
+        X.col(j).head(4).maxCoeff(&classes(j));
+    }
+    SequentialNN snn({LinearLayer(64, 32), ActivationLayer(64, "relu"), LinearLayer(4, 64),
+                      ActivationLayer(4, "softmax")});
+    // same weights
+    SequentialNN reference({LinearLayer(64, 32), ActivationLayer(64, "relu"), LinearLayer(4, 64),
+                            ActivationLayer(4, "softmax")});
+    for (int i=0; i<snn.Length(); i+=2) {
+        auto linear = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation());
+        auto other = std::static_pointer_cast<LinearTransformation>(reference.GetLayer(i).GetTransformation());
+        other->SetWeights(linear->Weights());
+        other->SetBias(linear->Bias());
+    }
+
+    Adam adam("cross_entropy", 20, 0.01);
+    adam.SetSeed(3);
+    adam.SetProfiling(true);
+    adam.Train(snn, X, classes, 3);
+    Adam unprofiled("cross_entropy", 20, 0.01);
+    unprofiled.SetSeed(3);
+    unprofiled.Train(reference, X, classes, 3);
+
+    std::shared_ptr<Profiler> profile = adam.Profile();
+    std::vector<Profiler::LayerStats> report = profile->Report();
+    std::cout << profile->Text();
+    std::string json = profile->JSON();
+    std::cout << json.substr(0, 120) << "..." << std::endl;
+
+    bool correct = (report.size() == 4) && (snn.GetProfiler() == nullptr) && (json.find("\"backward\": {\"calls\": 30") != std::string::npos);
+    for (int i=0; i<4; i++) {
+        for (int p=0; p<Profiler::kPhases; p++) {
+            const Profiler::PhaseStats& stats = report[i].phases[p];
+            long calls = ((p == 2) && (i % 2 == 1)) ? 0 : 30;
+            correct = correct && (stats.calls == calls) && (stats.p50Seconds <= stats.p90Seconds)
+                      && (stats.p90Seconds <= stats.p99Seconds) && ((calls == 0) || (stats.gflops > 0));
+        }
+    }
+    double deviation = 0;
+    for (int i=0; i<snn.Length(); i+=2) {
+        auto linear = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation());
+        auto other = std::static_pointer_cast<LinearTransformation>(reference.GetLayer(i).GetTransformation());
+        deviation = std::max(deviation, (linear->Weights() - other->Weights()).cwiseAbs().maxCoeff());
+    }
+    std::cout << "Layer names: " << report[0].name << ", " << report[1].name << "; deviation from unprofiled training: "
+              << deviation << std::endl;
+    if (!correct || (deviation != 0) || (report[0].name != "0 linear 64x32")) {
+        throw std::runtime_error("Profile of Train is not correct.");
+    }
+}
+
+void test_Counters() {
+    // hardware counters per layer and phase if perf_event_open is available, otherwise a reason in the report
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(32, 100);
+    Eigen::RowVectorXi classes = Eigen::RowVectorXi::Zero(100);
+    SequentialNN snn({LinearLayer(64, 32), ActivationLayer(64, "relu"), LinearLayer(4, 64),
+                      ActivationLayer(4, "softmax")});
+    SDG sdg("cross_entropy", 20, 0.01);
+    sdg.SetProfiling(true, true);
+    sdg.Train(snn, X, classes, 2);
+
+    std::shared_ptr<Profiler> profile = sdg.Profile();
+    std::vector<Profiler::LayerStats> report = profile->Report();
+    std::string text = profile->Text();
+    std::string json = profile->JSON();
+    std::cout << text;
+    const Profiler::PhaseStats& forward = report[0].phases[(int)Profiler::Phase::kForward];
+    double instructions = forward.counters[(int)PerfCounters::Event::kInstructions];
+    bool correct = profile->Counters() && (json.find("\"counters\": {\"ipc\": ") != std::string::npos);
+    if (profile->CountersAvailable()) {
+        correct = correct && (instructions > 0) && (json.find("\"counters_available\": true") != std::string::npos);
+        correct = correct && ((forward.ipc > 0) || (forward.counters[(int)PerfCounters::Event::kCycles] < 0));
+    } else {
+        correct = correct && !profile->CountersError().empty() && (instructions == -1) && (forward.ipc == -1)
+                  && (text.find("hardware counters not available") != std::string::npos)
+                  && (json.find("\"counters_available\": false") != std::string::npos);
+    }
+    // switched off again
+    sdg.SetProfiling(true);
+    correct = correct && !profile->Counters() && (profile->JSON().find("counters") == std::string::npos);
+    if (!correct) {
+        throw std::runtime_error("Hardware counters are not reported correctly.");
+    }
+}
+
+int main() {
+    test_Hooks();
+    test_Train();
+    test_Counters();
+
+    return 0;
+}
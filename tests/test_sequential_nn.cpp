@@ -1,8 +1,13 @@
 #include "../src/layer.h"
 #include "../src/loss_function.h"
 #include "../src/sequential_nn.h"
+#include <algorithm>
 #include <Eigen/Dense>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 void test_GetInitializationType() {
@@ -45,6 +50,32 @@ void test_VectorInitialization() {
     std::cout << snn.Summary() << std::endl;
 }
 
+void test_NoSlicing() {
+    // a vector of base class layers keeps the concrete layers (parameters, weight updates, replicas)
+    std::vector<Layer> vlayers{{LinearLayer(4, 8),
+                                ActivationLayer(4, "relu"),
+                                LinearLayer(2, 4),
+                                ActivationLayer(2, "softmax")
+                                }};
+    SequentialNN snn(vlayers);
+    SequentialNN replica = snn.Replicate();
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(8, 5);
+    Eigen::MatrixXd weights = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(0).GetTransformation())->Weights();
+    snn.SetTraining(true);
+    snn(X);
+    snn.BackwardInput(Eigen::MatrixXd::Random(5, 2));
+    snn.Backward(true);
+    snn.GetLayer(0).UpdateWeightsBias(0.1);
+    Eigen::MatrixXd updated = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(0).GetTransformation())->Weights();
+    bool correct = (snn.GetLayer(0).NumParameters() == 2) && (snn.GetLayer(2).NumParameters() == 2)
+                   && (replica.GetLayer(0).NumParameters() == 2) && !updated.isApprox(weights)
+                   && (dynamic_cast<LinearLayer*>(&snn.GetLayer(2)) != nullptr);
+    std::cout << "Layers of a std::vector<Layer> keep their type: " << correct << std::endl;
+    if (!correct) {
+        throw std::runtime_error("Layers of a std::vector<Layer> were sliced.");
+    }
+}
+
 void test_SequentialNNForward() {
     auto ll_ptr = std::make_shared<LinearLayer>(2, 5);
     auto al_ptr = std::make_shared<ActivationLayer>(2, "relu"); 
@@ -159,7 +190,185 @@ void test_CrossEntropySoftmax() {
     std::cout << "Loss: " << ce(snn.Output(), Mlabel) << std::endl;
 }
 
+void test_SetTraining() {
+    auto ll_ptr = std::make_shared<LinearLayer>(6, 5);
+    auto al_ptr = std::make_shared<ActivationLayer>(6, "relu");
+    auto ll2_ptr = std::make_shared<LinearLayer>(3, 6);
+    SequentialNN snn({ll_ptr, al_ptr, ll2_ptr});
+
+    Eigen::MatrixXd M = Eigen::MatrixXd::Random(5, 4);
+    Eigen::MatrixXd output = snn(M);
+
+    // in training mode the relu layer transforms in place (its separate forward output is released)
+    snn.SetTraining(true);
+    std::cout << "Relu forward output is forward input: " 
+              << (al_ptr->GetLayerCache().GetForwardOutput() == al_ptr->GetLayerCache().GetForwardInput()) << std::endl;
+    std::cout << "Same output in training mode: " << snn(M).isApprox(output) << std::endl;
+
+    snn.SetTraining(false);
+    std::cout << "Relu forward output is forward input (after training): " 
+              << (al_ptr->GetLayerCache().GetForwardOutput() == al_ptr->GetLayerCache().GetForwardInput()) << std::endl;
+    std::cout << "Same output after training mode: " << snn(M).isApprox(output) << std::endl;
+}
+
+void test_Compile() {
+    // compiled passes (fused pairs, a separate activation, a linear layer without activation) coincide with the
+    // layer by layer passes of a replica (same weights)
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<LinearLayer>(8, 5),
+                                                std::make_shared<ActivationLayer>(8, "relu"),
+                                                std::make_shared<LinearLayer>(6, 8),
+                                                std::make_shared<ActivationLayer>(6, "tanh"),
+                                                std::make_shared<ActivationLayer>(6, "sigmoid"),
+                                                std::make_shared<LinearLayer>(4, 6),
+                                                std::make_shared<ActivationLayer>(4, "softmax"),
+                                                std::make_shared<LinearLayer>(3, 4)};
+    SequentialNN snn(layers);
+    // the last layer is not initialized
+    auto last = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(7).GetTransformation());
+    last->SetWeights(Eigen::MatrixXd::Random(3, 4));
+    last->SetBias(Eigen::VectorXd::Random(3));
+    SequentialNN compiled = snn.Replicate();
+    compiled.Compile(16);
+    snn.SetTraining(true);
+    compiled.SetTraining(true);
+    std::cout << compiled.GetPlan()->Summary();
+
+    bool correct = (compiled.GetPlan()->ForwardCalls().size() == 5) && (compiled.GetPlan()->BackwardCalls().size() == 5);
+    double deviation = 0;
+    for (int batchSize: {16, 7}) {
+        Eigen::MatrixXd X = Eigen::MatrixXd::Random(5, batchSize);
+        Eigen::MatrixXd grads = Eigen::MatrixXd::Random(batchSize, 3);
+        Eigen::MatrixXd output = snn(X);
+        deviation = std::max(deviation, (compiled(X) - output).cwiseAbs().maxCoeff());
+        snn.BackwardInput(grads);
+        snn.Backward(true);
+        compiled.BackwardInput(grads);
+        compiled.Backward(true);
+        deviation = std::max(deviation, (compiled.BackwardOutput() - snn.BackwardOutput()).cwiseAbs().maxCoeff());
+    }
+    for (int i: {0, 2, 5, 7}) {
+        for (int j=0; j<2; j++) {
+            TrainableParameter expected = snn.GetLayer(i).Parameter(j, 0);
+            TrainableParameter delta = compiled.GetLayer(i).Parameter(j, 0);
+            deviation = std::max(deviation, (Eigen::Map<Eigen::VectorXd>(delta.delta, delta.size)
+                                             - Eigen::Map<Eigen::VectorXd>(expected.delta, expected.size)).cwiseAbs().maxCoeff());
+        }
+    }
+    std::cout << "Deviation of the compiled passes: " << deviation << std::endl;
+
+    // inference plans: two buffers, no backward pass, matrix-vector products for single samples
+    SequentialNN inference = snn.Replicate();
+    inference.Compile(16, ExecutionPlan::Mode::kInference);
+    SequentialNN single = snn.Replicate();
+    single.Compile(1, ExecutionPlan::Mode::kInference);
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(5, 16);
+    deviation = std::max(deviation, (inference(X) - snn(X)).cwiseAbs().maxCoeff());
+    deviation = std::max(deviation, (single(X.col(3)) - snn(X).col(3)).cwiseAbs().maxCoeff());
+    correct = correct && (inference.GetPlan()->ArenaSize() < compiled.GetPlan()->ArenaSize())
+              && (inference.PredictClasses(X) == snn.PredictClasses(X)) && (single.PredictClasses(X) == snn.PredictClasses(X))
+              && (single.GetPlan()->Summary().find("gemv+relu") != std::string::npos);
+    std::cout << single.GetPlan()->Summary();
+    int errors = 0;
+    try {
+        inference.BackwardInput(Eigen::MatrixXd::Zero(16, 3));
+    } catch (const std::invalid_argument&) {
+        errors++;
+    }
+    try {
+        compiled.Input(Eigen::MatrixXd::Zero(5, 17));
+    } catch (const std::invalid_argument&) {
+        errors++;
+    }
+    // the plan points into the buffers of its network, so compiled networks are moved but never copied
+    static_assert(!std::is_copy_constructible_v<SequentialNN> && std::is_move_constructible_v<SequentialNN>);
+    compiled.Decompile();
+    correct = correct && !compiled.Compiled() && (compiled(X) - snn(X)).isZero(1e-12);
+    if (!correct || (errors != 2) || (deviation > 1e-12)) {
+        throw std::runtime_error("Compiled network does not coincide with the layers.");
+    }
+}
 
+void test_PredictTopK() {
+    // top-k classes and outputs coincide with the sorted outputs of the full forward pass (softmax and sigmoid
+    // output layers are skipped, compiled networks run the full plan)
+    bool correct = true;
+    double deviation = 0;
+    for (std::string activation: {"softmax", "sigmoid", "relu"}) {
+        SequentialNN snn({LinearLayer(12, 6), ActivationLayer(12, "tanh"), LinearLayer(10, 12), ActivationLayer(10, activation)});
+        std::static_pointer_cast<LinearTransformation>(snn.GetLayer(2).GetTransformation())->Weights().setRandom();
+        SequentialNN compiled = snn.Replicate();
+        compiled.Compile(8, ExecutionPlan::Mode::kInference);
+        Eigen::MatrixXd X = Eigen::MatrixXd::Random(6, 37);
+        Eigen::MatrixXd output = snn(X);
+        for (SequentialNN* network: {&snn, &compiled}) {
+            SequentialNN::TopK topK = network->PredictTopK(X, 3, true, 16);
+            correct = correct && (topK.classes.rows() == 3) && (topK.classes.cols() == X.cols())
+                      && (network->PredictClasses(X) == topK.classes.row(0));
+            for (long j=0; j<X.cols(); j++) {
+                Eigen::VectorXd sorted = output.col(j);
+                std::sort(sorted.data(), sorted.data() + sorted.size(), std::greater<double>());
+                for (int i=0; i<3; i++) {
+                    deviation = std::max(deviation, std::abs(output(topK.classes(i, j), j) - sorted(i)));
+                    deviation = std::max(deviation, std::abs(topK.probabilities(i, j) - sorted(i)));
+                }
+            }
+        }
+        correct = correct && (snn.PredictTopK(X, 2).probabilities.size() == 0);
+    }
+    std::cout << "Deviation of the top-k outputs: " << deviation << std::endl;
+    int errors = 0;
+    SequentialNN snn({LinearLayer(4, 3), ActivationLayer(4, "softmax")});
+    for (int k: {0, 5}) {
+        try {
+            snn.PredictTopK(Eigen::MatrixXd::Zero(3, 2), k);
+        } catch (const std::invalid_argument&) {
+            errors++;
+        }
+    }
+    if (!correct || (errors != 2) || (deviation > 1e-12)) {
+        throw std::runtime_error("Top-k prediction does not coincide with the outputs.");
+    }
+}
+
+void test_Clone() {
+    // clones share the parameter blocks until they write them (only the written layer gets its own copy)
+    SequentialNN base({LinearLayer(8, 5), ActivationLayer(8, "relu"), LinearLayer(3, 8), ActivationLayer(3, "softmax")});
+    auto parameters = [](SequentialNN& snn, int i) {
+        return std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation())->Parameters().get();
+    };
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(5, 6);
+    Eigen::MatrixXd output = base(X);
+    SequentialNN clone = base.Clone();
+    bool correct = (parameters(clone, 0) == parameters(base, 0)) && (parameters(clone, 2) == parameters(base, 2))
+                   && (clone(X) - output).isZero(0);
+
+    // training the last layer of the clone
+    clone.SetTraining(true);
+    clone(X);
+    clone.BackwardInput(Eigen::MatrixXd::Random(6, 3));
+    clone.Backward();
+    clone.GetLayer(2).UpdateWeightsBias(0.5);
+    correct = correct && (parameters(clone, 0) == parameters(base, 0)) && (parameters(clone, 2) != parameters(base, 2))
+              && (base(X) - output).isZero(0) && !(clone(X) - output).isZero(1e-6);
+
+    // optimizers write through the raw parameters
+    TrainableParameter weights = clone.GetLayer(0).Parameter(0, 0);
+    weights.values[0] += 1.0;
+    correct = correct && (parameters(clone, 0) != parameters(base, 0)) && (base(X) - output).isZero(0);
+
+    // compiled clones follow the copies of their parameters
+    SequentialNN compiled = base.Clone();
+    compiled.Compile(8, ExecutionPlan::Mode::kInference);
+    auto first = std::static_pointer_cast<LinearTransformation>(compiled.GetLayer(0).GetTransformation());
+    first->SetWeights(Eigen::MatrixXd::Random(8, 5));
+    Eigen::MatrixXd compiledOutput = compiled(X);
+    compiled.Decompile();
+    correct = correct && !first->Shared() && (compiledOutput - compiled(X)).isZero(1e-12) && (base(X) - output).isZero(0);
+    std::cout << "Clones share the parameters until they are written: " << correct << std::endl;
+    if (!correct) {
+        throw std::runtime_error("Parameters of a clone are not copied on write.");
+    }
+}
 
 int main() {
     //test_ConnectLayers();
@@ -170,7 +379,12 @@ int main() {
     //test_SequentialTest();
     
     //test_VectorInitialization();
+    test_NoSlicing();
     test_CrossEntropySoftmax();
+    test_SetTraining();
+    test_Compile();
+    test_PredictTopK();
+    test_Clone();
 
     return 0;
 }
\ No newline at end of file
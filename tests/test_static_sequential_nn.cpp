@@ -0,0 +1,135 @@
+#include "../src/allocation_tracker.h"
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include "../src/static_sequential_nn.h"
+#include <Eigen/Dense>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Tests for StaticSequentialNN class.
+ */
+
+using TinyNN = StaticSequentialNN<StaticLinear<32, 16>, StaticRelu<32>, StaticLinear<12, 32>, StaticSigmoid<12>,
+                                  StaticLinear<8, 12>, StaticSoftmax<8> >;
+
+// random biases (zero after the initialization)
+void randomize_biases(SequentialNN& snn) {
+    for (int i=0; i<snn.Length(); i+=2) {
+        auto linear = std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation());
+        linear->SetBias(Eigen::VectorXd::Random(linear->Rows()));
+    }
+}
+
+// maximal deviation of the weights of the LinearLayers
+double weight_deviation(SequentialNN& snn, TinyNN& tiny) {
+    auto weights = [&](int i) -> Eigen::Map<Eigen::MatrixXd>& {
+        return std::static_pointer_cast<LinearTransformation>(snn.GetLayer(i).GetTransformation())->Weights();
+    };
+    return std::max({(weights(0) - tiny.GetLayer<0>().Weights()).cwiseAbs().maxCoeff(),
+                     (weights(2) - tiny.GetLayer<2>().Weights()).cwiseAbs().maxCoeff(),
+                     (weights(4) - tiny.GetLayer<4>().Weights()).cwiseAbs().maxCoeff()});
+}
+
+void test_Forward() {
+    // the static network with the weights of a dynamic one computes the same outputs
+    SequentialNN snn({LinearLayer(32, 16), ActivationLayer(32, "relu"), LinearLayer(12, 32),
+                      ActivationLayer(12, "sigmoid"), LinearLayer(8, 12), ActivationLayer(8, "softmax")});
+    randomize_biases(snn);
+    TinyNN tiny;
+    tiny.Load(snn);
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(16, 20);
+    Eigen::MatrixXd Y = snn(X);
+    Eigen::RowVectorXi classes = snn.PredictClasses(X);
+    double deviation = 0;
+    bool correct = true;
+    for (int j=0; j<X.cols(); j++) {
+        TinyNN::InputVector x = X.col(j);
+        deviation = std::max(deviation, (tiny(x) - Y.col(j)).cwiseAbs().maxCoeff());
+        correct = correct && (tiny.PredictClass(x) == classes(j));
+    }
+    std::cout << "Static vs. dynamic forward pass, max. deviation: " << deviation << std::endl;
+
+    // layers which do not match
+    int errors = 0;
+    SequentialNN other({LinearLayer(32, 16), ActivationLayer(32, "tanh"), LinearLayer(12, 32),
+                        ActivationLayer(12, "sigmoid"), LinearLayer(8, 12), ActivationLayer(8, "softmax")});
+    SequentialNN shorter({LinearLayer(32, 16), ActivationLayer(32, "relu")});
+    for (SequentialNN* network: {&other, &shorter}) {
+        try {
+            tiny.Load(*network);
+        } catch (const std::invalid_argument& error) {
+            std::cout << "Expected error: " << error.what() << std::endl;
+            errors++;
+        }
+    }
+    if (!correct || (deviation > 1e-14) || (errors != 2)) {
+        throw std::runtime_error("Static network does not coincide with the dynamic one.");
+    }
+}
+
+void test_Training() {
+    // Accumulate over the samples of a batch and Update is a step of SDG (with both losses)
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(16, 4);
+    Eigen::MatrixXd Y = Eigen::MatrixXd::Zero(8, 4);
+    for (int j=0; j<4; j++) {
+        Y(j % 8, j) = 1.0;
+    }
+    double deviation = 0;
+    for (std::string loss: {"cross_entropy", "mse"}) {
+        SequentialNN snn({LinearLayer(32, 16), ActivationLayer(32, "relu"), LinearLayer(12, 32),
+                          ActivationLayer(12, "sigmoid"), LinearLayer(8, 12), ActivationLayer(8, "softmax")});
+        randomize_biases(snn);
+        TinyNN tiny;
+        tiny.Load(snn);
+        SDG sdg(loss, 4, 0.1);
+        double lossDeviation = 0;
+        for (int step=0; step<3; step++) {
+            double expected = sdg.Step(snn, X, Y);
+            double value = 0;
+            for (int j=0; j<4; j++) {
+                value += tiny.Accumulate(X.col(j), Y.col(j), loss == "mse" ? StaticLoss::kMSE : StaticLoss::kCrossEntropy);
+            }
+            tiny.Update(0.1);
+            lossDeviation = std::max(lossDeviation, std::abs(value - expected));
+        }
+        deviation = std::max({deviation, lossDeviation, weight_deviation(snn, tiny)});
+    }
+    std::cout << "Static vs. dynamic training, max. deviation: " << deviation << std::endl;
+    if (deviation > 1e-12) {
+        throw std::runtime_error("Training of the static network does not coincide with SDG.");
+    }
+}
+
+void test_NoAllocations() {
+    // neither the construction nor the passes allocate
+    TinyNN::InputVector x = TinyNN::InputVector::Random();
+    TinyNN::OutputVector yLabel = TinyNN::OutputVector::Unit(3);
+    AllocationTracker::Reset();
+    double sum = 0;
+    {
+        TinyNN tiny;
+        tiny.GetLayer<0>().Weights().setConstant(0.01);
+        for (int r=0; r<10; r++) {
+            sum += tiny(x).sum();
+            sum += tiny.Accumulate(x, yLabel, StaticLoss::kCrossEntropy);
+            tiny.Update(0.01);
+        }
+    }
+    long allocations = AllocationTracker::Total().allocations;
+    std::cout << "Allocations of the static network: " << allocations << " (checksum " << sum << ")" << std::endl;
+    if (!AllocationTracker::Available() || (allocations != 0)) {
+        throw std::runtime_error("Static network allocates memory.");
+    }
+}
+
+int main() {
+    test_Forward();
+    test_Training();
+    test_NoAllocations();
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "../src/thread_pool.h"
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Tests for ThreadPool class.
+ */
+
+void test_ParallelFor() {
+    ThreadPool pool(4);
+    std::cout << "Number of threads: " << pool.NumThreads() << std::endl;
+
+    // each index is visited exactly once
+    std::vector<int> visited(100000, 0);
+    for (int repetition=0; repetition<10; repetition++) {
+        pool.ParallelFor(0, visited.size(), 100, [&](long begin, long end) {
+            for (long i=begin; i<end; i++) {
+                visited[i]++;
+            }
+        });
+    }
+    for (int v: visited) {
+        if (v != 10) {
+            throw std::runtime_error("ParallelFor did not visit each index exactly once.");
+        }
+    }
+    std::cout << "Each index visited exactly once per loop: 1" << std::endl;
+
+    // nested loops (also those started on the calling thread) are run serially on the thread of the outer chunk and
+    // visit each index exactly once
+    const int kOuter = 8, kInner = 1000;
+    std::vector<int> nested(kOuter*kInner, 0);
+    std::vector<int> foreign(kOuter, 0);
+    pool.ParallelFor(0, kOuter, 1, [&](long begin, long end) {
+        for (long i=begin; i<end; i++) {
+            std::thread::id outer = std::this_thread::get_id();
+            pool.ParallelFor(0, kInner, 1, [&](long b, long e) {
+                foreign[i] += (std::this_thread::get_id() != outer);
+                for (long j=b; j<e; j++) {
+                    nested[i*kInner + j]++;
+                }
+            });
+        }
+    });
+    for (int v: nested) {
+        if (v != 1) {
+            throw std::runtime_error("Nested ParallelFor did not visit each index exactly once.");
+        }
+    }
+    for (int f: foreign) {
+        if (f != 0) {
+            throw std::runtime_error("Nested ParallelFor did not run serially.");
+        }
+    }
+    std::cout << "Nested loops visit each index exactly once (serially): 1" << std::endl;
+    long total = 0;
+    pool.ParallelFor(0, 1000, 10000, [&](long begin, long end) { total += end - begin; });
+    std::cout << "Serial loop (small range): " << total << std::endl;
+}
+
+void test_Exceptions() {
+    // an exception of the loop body (on a worker or on the calling thread) is rethrown on the calling thread after
+    // all running chunks finished, and the pool can be used afterwards
+    ThreadPool pool(4);
+    std::atomic<int> running(0);
+    bool rethrown = true;
+    for (long thrower: {0L, 500L, 99999L}) {
+        std::string message;
+        try {
+            pool.ParallelFor(0, 100000, 100, [&](long begin, long end) {
+                running++;
+                for (long i=begin; i<end; i++) {
+                    if (i == thrower) {
+                        running--;
+                        throw std::out_of_range("index " + std::to_string(i));
+                    }
+                }
+                running--;
+            });
+        } catch (const std::out_of_range& e) {
+            message = e.what();
+        }
+        rethrown = rethrown && (message == "index " + std::to_string(thrower)) && (running == 0);
+    }
+    std::atomic<long> total(0);
+    pool.ParallelFor(0, 100000, 100, [&](long begin, long end) { total += end - begin; });
+    std::cout << "Exceptions rethrown on the calling thread: " << rethrown << ", next loop: " << total << std::endl;
+    if (!rethrown || (total != 100000)) {
+        throw std::runtime_error("Exceptions of the loop body are not rethrown correctly.");
+    }
+}
+
+int main() {
+    test_ParallelFor();
+    test_Exceptions();
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include "../src/checkpoint.h"
+#include "../src/layer.h"
+#include "../src/optimizer.h"
+#include "../src/sequential_nn.h"
+#include "../src/trace.h"
+#include <cstdio>
+#include <Eigen/Dense>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Tests for Trace class.
+ */
+
+void test_Disabled() {
+    // nothing is recorded while the trace is disabled
+    Trace::Clear();
+    Trace::Enable(false);
+    for (int i=0; i<100; i++) {
+        TraceScope scope("disabled", "test", i);
+    }
+    std::cout << "Events while disabled: " << Trace::Events().size() << std::endl;
+    if (!Trace::Events().empty()) {
+        throw std::runtime_error("Events recorded while the trace is disabled.");
+    }
+}
+
+void test_RingBuffer() {
+    // only the last events of a thread are kept
+    Trace::Clear();
+    Trace::SetCapacity(8);
+    Trace::Enable(true);
+    std::thread thread([]() {
+        Trace::SetThreadName("ring buffer");
+        for (int i=0; i<20; i++) {
+            TraceScope scope("event", "test", i);
+        }
+    });
+    thread.join();
+    Trace::Enable(false);
+    Trace::SetCapacity(1 << 16);
+
+    std::vector<Trace::Event> events = Trace::Events();
+    bool last = (events.size() == 8);
+    for (size_t i=0; last && (i<events.size()); i++) {
+        last = (events[i].arg == 12 + (long)i) && (events[i].duration >= 0);
+    }
+    std::cout << "Ring buffer: " << events.size() << " events kept, last ones: " << last << std::endl;
+    if (!last) {
+        throw std::runtime_error("Ring buffer does not keep the last events.");
+    }
+}
+
+void test_ShortLivedThreads() {
+    // finished threads pass their buffer on to new threads with the same name (their events are kept)
+    Trace::Clear();
+    Trace::Enable(true);
+    for (int t=0; t<50; t++) {
+        std::thread thread([t]() {
+            Trace::SetThreadName("short-lived");
+            for (int i=0; i<10; i++) {
+                TraceScope scope("event", "test", t);
+            }
+        });
+        thread.join();
+    }
+    Trace::Enable(false);
+
+    std::vector<Trace::Event> events = Trace::Events();
+    std::set<int> threads;
+    for (const Trace::Event& event: events) {
+        threads.insert(event.thread);
+    }
+    std::cout << "Short-lived threads: " << events.size() << " events in " << threads.size() << " buffers" << std::endl;
+    if ((events.size() != 500) || (threads.size() != 1)) {
+        throw std::runtime_error("Buffers of finished threads are not reused.");
+    }
+}
+
+void test_Train() {
+    // timeline of Train with checkpoints: layers, steps, batches and checkpoints on their threads
+    std::string path = "./tests/generated_trace.ckpt";
+    std::string tracePath = "./tests/generated_trace.json";
+    std::vector<std::shared_ptr<Layer> > layers{std::make_shared<LinearLayer>(16, 8),
+                                                std::make_shared<ActivationLayer>(16, "relu"),
+                                                std::make_shared<LinearLayer>(3, 16),
+                                                std::make_shared<ActivationLayer>(3, "softmax")};
+    SequentialNN snn(layers);
+    Eigen::MatrixXd X = Eigen::MatrixXd::Random(8, 100);
+    Eigen::RowVectorXi classes(100);
+    for (int j=0; j<100; j++) {
+        X.col(j).head(3).maxCoeff(&classes(j));
+    }
+    Adam adam("cross_entropy", 10, 0.01);
+    CheckpointScheduler scheduler(path, 5);
+    scheduler.Attach(adam);
+
+    Trace::Clear();
+    Trace::Enable(true);
+    adam.Train(snn, X, classes, 2);
+    scheduler.Wait();
+    Trace::Enable(false);
+    Trace::Export(tracePath);
+    // an unnamed calling thread is named by Train, a name given by the caller is kept
+    std::string trainingName = Trace::ThreadName();
+    std::string callerName;
+    std::thread caller([&]() {
+        Trace::SetThreadName("caller");
+        adam.Train(snn, X, classes, 1);
+        callerName = Trace::ThreadName();
+    });
+    caller.join();
+    scheduler.Wait();
+
+    std::map<std::string, int> counts;
+    std::map<std::string, std::set<int> > threads;
+    for (const Trace::Event& event: Trace::Events()) {
+        counts[event.name]++;
+        threads[event.name].insert(event.thread);
+    }
+    std::ifstream file(tracePath);
+    std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::cout << "Events: ";
+    for (auto& count: counts) {
+        std::cout << count.first << " " << count.second << ", ";
+    }
+    std::cout << "trace size: " << json.size() << " bytes, thread names: " << trainingName << ", " << callerName << std::endl;
+    std::remove(path.c_str());
+    std::remove(tracePath.c_str());
+
+    // 20 steps with 4 layers each, the batches are gathered (possibly ahead) and the checkpoints written on other threads
+    int trainingThread = *threads["step"].begin();
+    bool correct = (counts["step"] == 20) && (counts["forward"] == 80) && (counts["backward"] == 80)
+                   && (counts["update"] == 20) && (counts["gather batch"] >= 20) && (counts["checkpoint snapshot"] == 4)
+                   && (counts["checkpoint write"] == 4) && (threads["gather batch"].count(trainingThread) == 0)
+                   && (threads["checkpoint write"].count(trainingThread) == 0)
+                   && (json.rfind("{\"traceEvents\": [", 0) == 0) && (json.find("\"batch loader\"") != std::string::npos)
+                   && (json.find("\"ph\": \"X\"") != std::string::npos) && (trainingName == "training")
+                   && (callerName == "caller");
+    if (!correct) {
+        throw std::runtime_error("Trace of Train is not correct.");
+    }
+}
+
+int main() {
+    test_Disabled();
+    test_RingBuffer();
+    test_ShortLivedThreads();
+    test_Train();
+
+    return 0;
+}